@@ -0,0 +1,106 @@
+/**
+   @file arena.cpp
+   @brief Implementation of the bump allocator and string interning used by the AST
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   Contains the Arena implementation and the table of interned identifier names
+*/
+
+#include "arena.h"
+#include <cstdio>
+#include <cstdlib>
+
+#define ARENA_ALIGN 16
+
+/**
+ * The Arena used for the AST of the compilation running on each thread, created by Arena::get()
+ * on first use so that it is valid during static initialization too */
+thread_local Arena * Arena::current = NULL;
+
+/**
+ * Set once the declarations shared by every compilation have been built, and never
+ * modified after that, so it can be read from any thread */
+const Arena * Arena::shared = NULL;
+
+Arena::Arena(size_t chunkSize) : ptr(NULL), avail(0), chunkSize(chunkSize), total(0)
+{
+}
+
+Arena::~Arena()
+{
+    // Objects are destroyed in the reverse order of their registration
+    for (auto it = dtors.rbegin(); it != dtors.rend(); it++)
+	it->first(it->second);
+    for (auto it : chunks)
+	free(it.first);
+}
+
+/**
+   Allocates memory from the current chunk, starting a new chunk when it is full.
+   Requests larger than a chunk get a chunk of their own.
+
+   @param sz Number of bytes to allocate
+   @return Pointer to the allocated memory, aligned to ARENA_ALIGN bytes
+*/
+void * Arena::allocate(size_t sz)
+{
+    void * p;
+    sz = (sz + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+    if (sz > avail)
+    {
+	size_t csz = (sz > chunkSize) ? sz : chunkSize;
+	char * c = (char *) malloc(csz);
+	if (!c)
+	{
+	    fprintf(stderr, "ERROR: Out of memory!\n");
+	    exit(-1);
+	}
+	chunks.push_back(std::make_pair(c, csz));
+	if (csz > chunkSize)
+	{
+	    // Oversized chunk, keep bumping from the current one
+	    total += sz;
+	    return c;
+	}
+	ptr = c;
+	avail = csz;
+    }
+    p = ptr;
+    ptr += sz;
+    avail -= sz;
+    total += sz;
+    return p;
+}
+
+/**
+   Finds a string interned in the Arena
+
+   @param str String to look for
+   @return Pointer to the interned copy of str, or NULL if it was not interned
+*/
+const std::string * Arena::find(const std::string & str) const
+{
+    auto it = strings.find(str);
+    return it == strings.end() ? NULL : &*it;
+}
+
+/**
+   Interns a string in the current Arena, unless the shared Arena already has it.
+   Equal strings are always interned to the same object within a compilation, so
+   interned strings can be compared by address.
+
+   @param str String to intern
+   @return Reference to the interned copy of str, valid for the rest of the compilation
+*/
+const std::string & internString(const std::string & str)
+{
+    Arena & arena = Arena::get();
+    if (Arena::shared && Arena::shared != &arena)
+    {
+	const std::string * s = Arena::shared->find(str);
+	if (s)
+	    return *s;
+    }
+    return arena.intern(str);
+}
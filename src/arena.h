@@ -0,0 +1,57 @@
+/**
+   @file arena.h
+   @brief Header file for the bump allocator and string interning used by the AST
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   AST nodes and Types live for the whole compilation, so rather than being
+   allocated individually they are bumped out of large chunks owned by an Arena.
+   Identifier names are interned so that they can be compared by pointer, in a table
+   owned by the Arena too. Each compilation has an Arena of its own, made current on
+   the thread compiling it.
+*/
+
+#ifndef CREMA_ARENA_H_
+#define CREMA_ARENA_H_
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#define ARENA_CHUNK_SIZE (256 * 1024)
+
+/**
+ *  A bump allocator. Memory is only released, all at once, when the Arena is destroyed,
+ *  after running the destructors of the objects registered with own(). */
+class Arena {
+public:
+    Arena(size_t chunkSize = ARENA_CHUNK_SIZE);
+    ~Arena();
+    void * allocate(size_t sz);
+    template <typename T> T * own(T * obj) { dtors.push_back(std::make_pair(&destroy<T>, (void *) obj)); return obj; } /**< Registers an object allocated from the Arena to be destroyed with it */
+    template <typename T> T * create() { return own(new (allocate(sizeof(T))) T()); } /**< Allocates and default-constructs an object destroyed with the Arena */
+    size_t bytesAllocated() const { return total; }
+    const std::string & intern(const std::string & str) { return *(strings.insert(str).first); } /**< Interns a string in the table of the Arena */
+    const std::string * find(const std::string & str) const;
+    static thread_local Arena * current; /**< Arena that Node and Type allocations of the compilation running on this thread are served from */
+    static Arena & get() { if (!current) current = new Arena(); return *current; } /**< Returns the current Arena, creating it on first use */
+    static const Arena * shared; /**< Arena of the declarations shared by every compilation, whose interned strings the others reuse */
+private:
+    std::vector<std::pair<char *, size_t> > chunks; /**< Chunks owned by the Arena, with their sizes */
+    std::vector<std::pair<void (*)(void *), void *> > dtors; /**< Objects to destroy with the Arena, with their destructors */
+    std::unordered_set<std::string> strings; /**< Strings interned in the Arena; its elements never move */
+    char * ptr; /**< Next free byte of the current chunk */
+    size_t avail; /**< Number of free bytes left in the current chunk */
+    size_t chunkSize; /**< Size of a standard chunk */
+    size_t total; /**< Number of bytes handed out so far */
+    Arena(const Arena &);
+    Arena & operator=(const Arena &);
+    template <typename T> static void destroy(void * obj) { static_cast<T *>(obj)->~T(); }
+};
+
+const std::string & internString(const std::string & str);
+
+#endif // CREMA_ARENA_H_
@@ -11,11 +11,40 @@
 #include "parser.h"
 #include "types.h"
 #include "semantics.h"
+#include <iterator>
+#include <mutex>
+
+thread_local size_t Node::count = 0;
+thread_local int Node::currentLine = 0;
+thread_local std::vector<std::pair<char *, size_t> > Node::pending;
+
+/**
+   Checks whether a Node being constructed was allocated by Node::operator new, rather than
+   being a temporary. Node is a virtual base, so it may lie anywhere in the allocation. An
+   allocation is pending until its Node constructor runs; the arguments of a constructor
+   may allocate nodes of their own in between, so there can be a few, newest last.
+
+   @param node Node being constructed
+   @return true if the Node was allocated from the Arena
+*/
+bool Node::allocated(Node * node)
+{
+    char * p = (char *) node;
+    for (auto it = pending.rbegin(); it != pending.rend(); it++)
+      {
+	if (p >= it->first && p < it->first + it->second)
+	  {
+	    pending.erase(std::next(it).base());
+	    return true;
+	  }
+      }
+    return false;
+}
 
 /**
    Overload for the == operator to allow for simple comparison of two NIdentifiers.
-   The NIdentifier values being compared are of type string, which represent the names of 
-   variables, lists, structs, struct members, etc. 
+   The NIdentifier values being compared are interned strings, which represent the names of 
+   variables, lists, structs, struct members, etc., so equal names share the same address.
 
    @param i1 First NIdentifier to compare
    @param i2 Second NIdentifier to compare
@@ -23,7 +52,8 @@
 */
 bool operator==(const NIdentifier & i1, const NIdentifier & i2)
 {
-  return i1.value == i2.value;
+  // Identifier values are interned
+  return &i1.value == &i2.value;
 }
 
 /**
@@ -46,9 +76,11 @@ static inline NFunctionDeclaration * generateFuncDecl(Type & type, std::string n
 }
 
 /**
-   Function to define certain standard library declarations
+   Creates the declarations of the standard library functions
+
+   @param decls Vector to add the declarations to
  */
-void NBlock::createStdlib()
+static void buildStdlib(std::vector<NFunctionDeclaration *> & decls)
 {
     std::vector<NVariableDeclaration *> args;
     NFunctionDeclaration *func;
@@ -57,59 +89,49 @@ void NBlock::createStdlib()
     ct->isList = false;
     // int_list_create()
     func = generateFuncDecl(*(new Type(TTINT, true)), "int_list_create", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_list_create()
     func = generateFuncDecl(*(new Type(TTDOUBLE, true)), "double_list_create", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // str_create()
     func = generateFuncDecl(*(new Type(*ct, true)), "str_create", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // list_length(list)
     args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l"))));
     func = generateFuncDecl(*(new Type(TTINT)), "list_length", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func); 
+    decls.push_back(func);
     
     // int_list_retrieve(list, idx)
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("idx"))));
     func = generateFuncDecl(*(new Type(TTINT)), "int_list_retrieve", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // str_retrieve(list, idx)
     func = generateFuncDecl(*(new Type(TTCHAR)), "str_retrieve", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_list_retrieve(list, idx)
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_list_retrieve", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // int_list_append(list, val)
     func = generateFuncDecl(*(new Type(TTVOID)), "int_list_append", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
     
     // int_list_insert(list, idx, val)
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTVOID)), "int_list_insert", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_list_append(l, val)
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l"))));
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTVOID)), "double_list_append", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_list_insert(l, idx, val)
     args.clear();
@@ -117,48 +139,40 @@ void NBlock::createStdlib()
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("idx"))));
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTVOID)), "double_list_insert", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_print
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTVOID)), "double_print", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_println
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTVOID)), "double_println", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // str_print(list) & str_println(list)
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTCHAR, true)), *(new NIdentifier("l"))));
     func = generateFuncDecl(*(new Type(TTVOID)), "str_print", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
     func = generateFuncDecl(*(new Type(TTVOID)), "str_println", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // str_append(list, val)
     args.push_back(new NVariableDeclaration(*ct, *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTVOID)), "str_append", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // int_print(val) & int_println(val)
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTVOID)), "int_print", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
     func = generateFuncDecl(*(new Type(TTVOID)), "int_println", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
     
     // str_insert(list, idx, val)
     args.clear();
@@ -166,8 +180,7 @@ void NBlock::createStdlib()
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("idx"))));
     args.push_back(new NVariableDeclaration(*ct, *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTVOID)), "str_insert", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);  
+    decls.push_back(func);
 
     // str_substr(list, idx, len)
     args.clear();
@@ -175,29 +188,234 @@ void NBlock::createStdlib()
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("idx"))));
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("len"))));
     func = generateFuncDecl(*(new Type(TTCHAR, true)), "str_substr", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);  
+    decls.push_back(func);
     
     // list_t * prog_argument(int)
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("idx"))));
     func = generateFuncDecl(*(new Type(TTCHAR, true)), "prog_argument", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);  
+    decls.push_back(func);
 
     // uint64_t prog_arg_count()
     args.clear();
     func = generateFuncDecl(*(new Type(TTINT)), "prog_arg_count", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
+
+    // int_list_print(l)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l"))));
+    func = generateFuncDecl(*(new Type(TTVOID)), "int_list_print", args);
+    decls.push_back(func);
+
+    // double_list_print(l)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l"))));
+    func = generateFuncDecl(*(new Type(TTVOID)), "double_list_print", args);
+    decls.push_back(func);
+
+    // read_line(), read_all() & read_eof()
+    args.clear();
+    func = generateFuncDecl(*(new Type(TTCHAR, true)), "read_line", args);
+    decls.push_back(func);
+    func = generateFuncDecl(*(new Type(TTCHAR, true)), "read_all", args);
+    decls.push_back(func);
+    func = generateFuncDecl(*(new Type(TTINT)), "read_eof", args);
+    decls.push_back(func);
+
+    // read_file(path)
+    args.push_back(new NVariableDeclaration(*(new Type(TTCHAR, true)), *(new NIdentifier("path"))));
+    func = generateFuncDecl(*(new Type(TTCHAR, true)), "read_file", args);
+    decls.push_back(func);
     
     // crema_seq(start, end)
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("start"))));
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("end"))));
     func = generateFuncDecl(*(new Type(TTINT, true)), "crema_seq", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
+
+    // list_reserve(list, n), for lists of ints
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("n"))));
+    func = generateFuncDecl(*(new Type(TTVOID)), "list_reserve", args);
+    decls.push_back(func);
+
+    // double_list_reserve(list, n)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("n"))));
+    func = generateFuncDecl(*(new Type(TTVOID)), "double_list_reserve", args);
+    decls.push_back(func);
+
+    // str_reserve(list, n)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTCHAR, true)), *(new NIdentifier("l"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("n"))));
+    func = generateFuncDecl(*(new Type(TTVOID)), "str_reserve", args);
+    decls.push_back(func);
+
+    // int_list_concat(l1, l2)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l1"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l2"))));
+    func = generateFuncDecl(*(new Type(TTVOID)), "int_list_concat", args);
+    decls.push_back(func);
+
+    // int_list_copy(l)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l"))));
+    func = generateFuncDecl(*(new Type(TTINT, true)), "int_list_copy", args);
+    decls.push_back(func);
+
+    // int_list_slice(l, start, len)
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("start"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("len"))));
+    func = generateFuncDecl(*(new Type(TTINT, true)), "int_list_slice", args);
+    decls.push_back(func);
+
+    // int_list_insert_range(l, idx, src)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("idx"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("src"))));
+    func = generateFuncDecl(*(new Type(TTVOID)), "int_list_insert_range", args);
+    decls.push_back(func);
+
+    // double_list_concat(l1, l2)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l1"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l2"))));
+    func = generateFuncDecl(*(new Type(TTVOID)), "double_list_concat", args);
+    decls.push_back(func);
+
+    // double_list_copy(l)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l"))));
+    func = generateFuncDecl(*(new Type(TTDOUBLE, true)), "double_list_copy", args);
+    decls.push_back(func);
+
+    // double_list_slice(l, start, len)
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("start"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("len"))));
+    func = generateFuncDecl(*(new Type(TTDOUBLE, true)), "double_list_slice", args);
+    decls.push_back(func);
+
+    // double_list_insert_range(l, idx, src)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("idx"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("src"))));
+    func = generateFuncDecl(*(new Type(TTVOID)), "double_list_insert_range", args);
+    decls.push_back(func);
+
+    // str_concat(l1, l2)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTCHAR, true)), *(new NIdentifier("l1"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTCHAR, true)), *(new NIdentifier("l2"))));
+    func = generateFuncDecl(*(new Type(TTVOID)), "str_concat", args);
+    decls.push_back(func);
+
+    // str_copy(l)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTCHAR, true)), *(new NIdentifier("l"))));
+    func = generateFuncDecl(*(new Type(TTCHAR, true)), "str_copy", args);
+    decls.push_back(func);
+
+    // str_insert_range(l, idx, src)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTCHAR, true)), *(new NIdentifier("l"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("idx"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTCHAR, true)), *(new NIdentifier("src"))));
+    func = generateFuncDecl(*(new Type(TTVOID)), "str_insert_range", args);
+    decls.push_back(func);
+
+    // str_find(l, sub)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTCHAR, true)), *(new NIdentifier("l"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTCHAR, true)), *(new NIdentifier("sub"))));
+    func = generateFuncDecl(*(new Type(TTINT)), "str_find", args);
+    decls.push_back(func);
+
+    // ************************ List Reductions **************************** //
+
+    // int_list_sum(l)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l"))));
+    func = generateFuncDecl(*(new Type(TTINT)), "int_list_sum", args);
+    decls.push_back(func);
+
+    // int_list_min(l)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l"))));
+    func = generateFuncDecl(*(new Type(TTINT)), "int_list_min", args);
+    decls.push_back(func);
+
+    // int_list_max(l)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l"))));
+    func = generateFuncDecl(*(new Type(TTINT)), "int_list_max", args);
+    decls.push_back(func);
+
+    // int_list_dot(l1, l2)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l1"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l2"))));
+    func = generateFuncDecl(*(new Type(TTINT)), "int_list_dot", args);
+    decls.push_back(func);
+
+    // int_list_add(l1, l2)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l1"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l2"))));
+    func = generateFuncDecl(*(new Type(TTINT, true)), "int_list_add", args);
+    decls.push_back(func);
+
+    // int_list_scale(l, k)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT, true)), *(new NIdentifier("l"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("k"))));
+    func = generateFuncDecl(*(new Type(TTINT, true)), "int_list_scale", args);
+    decls.push_back(func);
+
+    // double_list_sum(l)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l"))));
+    func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_list_sum", args);
+    decls.push_back(func);
+
+    // double_list_min(l)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l"))));
+    func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_list_min", args);
+    decls.push_back(func);
+
+    // double_list_max(l)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l"))));
+    func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_list_max", args);
+    decls.push_back(func);
+
+    // double_list_dot(l1, l2)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l1"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l2"))));
+    func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_list_dot", args);
+    decls.push_back(func);
+
+    // double_list_add(l1, l2)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l1"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l2"))));
+    func = generateFuncDecl(*(new Type(TTDOUBLE, true)), "double_list_add", args);
+    decls.push_back(func);
+
+    // double_list_scale(l, k)
+    args.clear();
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE, true)), *(new NIdentifier("l"))));
+    args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("k"))));
+    func = generateFuncDecl(*(new Type(TTDOUBLE, true)), "double_list_scale", args);
+    decls.push_back(func);
 
     // ************************ Type Conversion ***************************** //
 
@@ -205,36 +423,31 @@ void NBlock::createStdlib()
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTINT)), "double_to_int", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // int_to_double
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "int_to_double", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // int_to_string
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTCHAR, true)), "int_to_string", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // string_to_int
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(*ct, true)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTINT)), "string_to_int", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // string_to_double
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(*ct, true)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "string_to_double", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // *************************** Math Functions *************************** //
 
@@ -242,101 +455,123 @@ void NBlock::createStdlib()
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_floor", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_ceiling
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_ceiling", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_round
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_round", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_truncate
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_truncate", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_square
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_square", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // int_square
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTINT)), "int_square", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_sin
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_sin", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_cos
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_cos", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_tan
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_tan", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_sqrt
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_sqrt", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_pow
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("base"))));
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("power"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_pow", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // int_pow
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("base"))));
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("power"))));
     func = generateFuncDecl(*(new Type(TTINT)), "int_pow", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // double_abs
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTDOUBLE)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTDOUBLE)), "double_abs", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
 
     // int_abs
     args.clear();
     args.push_back(new NVariableDeclaration(*(new Type(TTINT)), *(new NIdentifier("val"))));
     func = generateFuncDecl(*(new Type(TTINT)), "int_abs", args);
-    statements.insert(statements.begin(), func);
-    rootCtx.registerFunc(func);
+    decls.push_back(func);
+}
+
+/**
+   Returns the standard library declarations. They are created once, in the shared Arena,
+   and shared by every compilation in the process; they are never modified after being
+   created. Compilations call this before parsing, so that the names in the program are
+   interned to the same strings as those of the declarations.
+
+   @return The declarations
+ */
+const std::vector<NFunctionDeclaration *> & NBlock::stdlibDecls()
+{
+    static std::vector<NFunctionDeclaration *> decls;
+    static std::once_flag built;
+    std::call_once(built, []() {
+	    Arena * current = Arena::current;
+	    Arena::current = new Arena();
+	    buildStdlib(decls);
+	    Arena::shared = Arena::current;
+	    Arena::current = current;
+	});
+    return decls;
+}
+
+/**
+   Function to define certain standard library declarations
+
+   @param ctx Pointer to the SemanticContext to register the declarations in
+ */
+void NBlock::createStdlib(SemanticContext * ctx)
+{
+    for (auto func : stdlibDecls())
+      {
+	statements.insert(statements.begin(), func);
+	ctx->registerFunc(func);
+      }
 }
 
 /**
@@ -634,6 +869,11 @@ std::ostream & NVariableAccess::print(std::ostream & os) const
 */
 std::ostream & NStructureAccess::print(std::ostream & os) const
 {
+  if (index)
+    {
+      os << "(Struct access: " << ident << "[" << *index << "]." << member << ")";
+      return os;
+    }
   os << "(Struct access: " << ident << "." << member << ")";
   return os;
 }
@@ -773,6 +1013,19 @@ std::ostream & NLoopStatement::print(std::ostream & os) const
   return os;
 }
 
+/**
+   Prints NRangeLoopStatement objects, which are inherited from the NStatement class.
+
+   @param os Output stream to print to
+   @return Output stream passed in
+*/
+std::ostream & NRangeLoopStatement::print(std::ostream & os) const
+{
+  os << (parallel ? "Parallel range loop: " : "Range loop: ") << start << " to " << end << " as " << asVar << std::endl;
+  os << "{" << loopBlock << "}" << std::endl;
+  return os;
+}
+
 /**
    Prints NIfStatement objects, which are inherited from the NStatement class. There are four
    possible members that may be printed: 
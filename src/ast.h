@@ -18,21 +18,29 @@
 #include "decls.h"
 #include "types.h"
 #include "codegen.h"
-
-extern int yylineno;
+#include "arena.h"
 
 /** 
  *  The base class containing all the language constructs. */
 class Node {
  public:
   int lineno;
-  Node() { lineno = yylineno; }
+  static thread_local int currentLine; /**< Line the lexer of the compilation running on this thread is at */
+  Node() { lineno = currentLine; if (allocated(this)) Arena::get().own(this); } /**< Nodes allocated from the Arena are destroyed with it, releasing the containers they own */
   virtual ~Node() { }
+  static thread_local size_t count; /**< Number of Nodes created so far on this thread */
+  static void * operator new(size_t sz) { count++; void * p = Arena::get().allocate(sz); pending.push_back(std::make_pair((char *) p, sz)); return p; } /**< Nodes are allocated from the compilation's Arena */
+  static void operator delete(void * p) { } /**< Arena memory is released with the Arena */
   virtual llvm::Value * codeGen(CodeGenContext & context) { }
   virtual std::ostream & print(std::ostream & os) const { };
-  virtual bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration *func) { };
+  virtual bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration *func) { return false; }
   virtual bool semanticAnalysis(SemanticContext *ctx) { };
+  virtual bool modifiesList(SemanticContext *ctx, NIdentifier & list) { return false; }
+  virtual bool parallelSafe(SemanticContext *ctx, ParallelScope & scope) { return false; }
   friend std::ostream & operator<<(std::ostream & os, const Node & node);  
+ private:
+  static thread_local std::vector<std::pair<char *, size_t> > pending; /**< Allocations of operator new whose Node constructor has not run yet, with their sizes */
+  static bool allocated(Node * node);
 };
 
 /**
@@ -41,7 +49,8 @@ class Node {
 class NExpression : virtual public Node {
 public:
     Type & type; /**< Expression type used for type-checking during semantic analysis */
-NExpression() : type(*(new Type())) { }
+    NValue * folded; /**< Compile-time value of the expression, set by the ConstEvaluator, or NULL */
+NExpression() : type(*(new Type())), folded(NULL) { }
     virtual Type & getType(SemanticContext * ctx) const { }
     bool semanticAnalysis(SemanticContext * ctx) { std::cout << "Generic expression SA!" << std::endl; return false; }
 };
@@ -60,9 +69,12 @@ public:
     StatementList statements; /**< Vector of statements in the NBlock */
     llvm::Value * codeGen(CodeGenContext & context);
     std::ostream & print(std::ostream & os) const;
-    void createStdlib();
+    void createStdlib(SemanticContext * ctx);
+    static const std::vector<NFunctionDeclaration *> & stdlibDecls();
     bool semanticAnalysis(SemanticContext *ctx);
     bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration *func);
+    bool modifiesList(SemanticContext *ctx, NIdentifier & list);
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
 };
 
 /**
@@ -76,6 +88,8 @@ NAssignmentStatement(NIdentifier & ident, NExpression & expr) : ident(ident), ex
     bool semanticAnalysis(SemanticContext * ctx);
     std::ostream & print(std::ostream & os) const;
     bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return expr.checkRecursion(ctx, func); }
+    bool modifiesList(SemanticContext *ctx, NIdentifier & l);
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
 };
 
 /**
@@ -87,7 +101,9 @@ NListAssignmentStatement(NIdentifier & ident, NListAccess & list, NExpression &
     bool semanticAnalysis(SemanticContext * ctx);
     std::ostream & print(std::ostream & os) const;
     llvm::Value * codeGen(CodeGenContext & context);
-    bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return expr.checkRecursion(ctx, func); }
+    bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func);
+    bool modifiesList(SemanticContext *ctx, NIdentifier & l);
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
 };
 
 /**
@@ -99,7 +115,9 @@ NStructureAssignmentStatement(NIdentifier & ident, NStructureAccess & structure,
     llvm::Value * codeGen(CodeGenContext & context);
     std::ostream & print(std::ostream & os) const;
     bool semanticAnalysis(SemanticContext * ctx);
-    bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return expr.checkRecursion(ctx, func); }
+    bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func);
+    bool modifiesList(SemanticContext *ctx, NIdentifier & l);
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
 };
 
 /**
@@ -114,6 +132,29 @@ NLoopStatement(NIdentifier & list, NIdentifier & asVar, NBlock & loopBlock) : li
     llvm::Value * codeGen(CodeGenContext & context);
     bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return loopBlock.checkRecursion(ctx, func); }
     bool semanticAnalysis(SemanticContext * ctx);
+    bool modifiesList(SemanticContext *ctx, NIdentifier & l) { return loopBlock.modifiesList(ctx, l); }
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
+};
+
+/**
+ *  Looping construct over an integer range (foreach over crema_seq(start, end)). The range
+ *  is iterated with a counted loop instead of materializing the list. A parallel range loop
+ *  (parallel foreach) has its iterations split across the runtime's thread pool */
+class NRangeLoopStatement : public NStatement {
+public:
+    NExpression & start; /**< Expression for the first value of the range */
+    NExpression & end; /**< Expression for the last value of the range (inclusive) */
+    NIdentifier & asVar; /**< Temporary variable name inside of loop block to reference the current value */
+    NBlock & loopBlock; /**< NBlock to execute in the loop */
+    bool parallel; /**< Whether the iterations may run concurrently */
+    std::vector<NVariableDeclaration *> written; /**< Declarations of the shared lists a parallel body stores to at the loop index, NULL where unknown */
+NRangeLoopStatement(NExpression & start, NExpression & end, NIdentifier & asVar, NBlock & loopBlock, bool parallel = false) : start(start), end(end), asVar(asVar), loopBlock(loopBlock), parallel(parallel) { }
+    std::ostream & print(std::ostream & os) const;
+    llvm::Value * codeGen(CodeGenContext & context);
+    bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return start.checkRecursion(ctx, func) || end.checkRecursion(ctx, func) || loopBlock.checkRecursion(ctx, func); }
+    bool semanticAnalysis(SemanticContext * ctx);
+    bool modifiesList(SemanticContext *ctx, NIdentifier & l) { return start.modifiesList(ctx, l) || end.modifiesList(ctx, l) || loopBlock.modifiesList(ctx, l); }
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
 };
 
 /**
@@ -130,7 +171,9 @@ NIfStatement(NExpression & condition, NBlock & thenblock) : condition(condition)
     llvm::Value * codeGen(CodeGenContext & context);
     std::ostream & print(std::ostream & os) const;
     bool semanticAnalysis(SemanticContext * ctx);
-    bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return thenblock.checkRecursion(ctx, func) || (elseblock ? elseblock->checkRecursion(ctx, func) : false) || (elseif ? elseif->checkRecursion(ctx, func) : false); }
+    bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return condition.checkRecursion(ctx, func) || thenblock.checkRecursion(ctx, func) || (elseblock ? elseblock->checkRecursion(ctx, func) : false) || (elseif ? elseif->checkRecursion(ctx, func) : false); }
+    bool modifiesList(SemanticContext *ctx, NIdentifier & l) { return condition.modifiesList(ctx, l) || thenblock.modifiesList(ctx, l) || (elseblock ? elseblock->modifiesList(ctx, l) : false) || (elseif ? elseif->modifiesList(ctx, l) : false); }
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope) { return condition.parallelSafe(ctx, scope) && thenblock.parallelSafe(ctx, scope) && (elseblock ? elseblock->parallelSafe(ctx, scope) : true) && (elseif ? elseif->parallelSafe(ctx, scope) : true); }
 };
 
 /**
@@ -146,6 +189,8 @@ NBinaryOperator(NExpression & lhs, int op, NExpression & rhs) : lhs(lhs), op(op)
     Type & getType(SemanticContext * ctx) const;
     std::ostream & print(std::ostream & os) const;
     bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return lhs.checkRecursion(ctx, func) || rhs.checkRecursion(ctx, func); }
+    bool modifiesList(SemanticContext *ctx, NIdentifier & l) { return lhs.modifiesList(ctx, l) || rhs.modifiesList(ctx, l); }
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope) { return lhs.parallelSafe(ctx, scope) && rhs.parallelSafe(ctx, scope); }
 };
 
 /**
@@ -155,12 +200,17 @@ public:
     Type & type; /**< Type of variable */
     NIdentifier & ident; /**< Name of variable */
     NExpression *initializationExpression; /**< Pointer to optional initialization expression */
-NVariableDeclaration(Type & type, NIdentifier & name) : type(type), ident(name), initializationExpression(NULL) { }
-NVariableDeclaration(Type & type, NIdentifier & name, NExpression *initExpr) : type(type), ident(name), initializationExpression(initExpr) { }
+    bool ownsList; /**< Set by the EscapeAnalysis if the variable holds the only reference to its list, which is freed when its block is left */
+    bool mayAlias; /**< Set by semantic analysis if the variable is a list that another variable may also refer to: a parameter, or a variable initialized or assigned with anything but a new list */
+NVariableDeclaration(Type & type, NIdentifier & name) : type(type), ident(name), initializationExpression(NULL), ownsList(false), mayAlias(false) { }
+NVariableDeclaration(Type & type, NIdentifier & name, NExpression *initExpr) : type(type), ident(name), initializationExpression(initExpr), ownsList(false), mayAlias(false) { }
     llvm::Value * codeGen(CodeGenContext & context);
     std::ostream & print(std::ostream & os) const;
     bool semanticAnalysis(SemanticContext *ctx);
     bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return initializationExpression ? initializationExpression->checkRecursion(ctx, func) : false; }
+    bool modifiesList(SemanticContext *ctx, NIdentifier & l) { return initializationExpression ? initializationExpression->modifiesList(ctx, l) : false; }
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
+    bool mayShareList(NVariableDeclaration * other);
 };
 
 /**
@@ -203,20 +253,26 @@ NFunctionCall(NIdentifier & ident, ExpressionList & args) : ident(ident), args(a
     std::ostream & print(std::ostream & os) const;
     bool semanticAnalysis(SemanticContext * ctx);
     bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func);
+    bool modifiesList(SemanticContext *ctx, NIdentifier & list);
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
 };
 
 /**
- *  Expression resolving to a structure access */
+ *  Expression resolving to a structure access, or to a member of an element of a list of structures */
 class NStructureAccess : public NExpression {
 public:
     NIdentifier & member; /**< Structure member name to access */
     NIdentifier & ident; /**< Name of structure variable */
-NStructureAccess(NIdentifier & ident, NIdentifier & member) : ident(ident), member(member) { }
+    NExpression * index; /**< NExpression that resolves to the list index, NULL for structure variables */
+NStructureAccess(NIdentifier & ident, NIdentifier & member) : ident(ident), member(member), index(NULL) { }
+NStructureAccess(NIdentifier & ident, NIdentifier & member, NExpression * index) : ident(ident), member(member), index(index) { }
     std::ostream & print(std::ostream & os) const;
     Type & getType(SemanticContext * ctx) const;
     llvm::Value * codeGen(CodeGenContext & context);
     bool semanticAnalysis(SemanticContext * ctx);
-    bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return false; }
+    bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return index ? index->checkRecursion(ctx, func) : false; }
+    bool modifiesList(SemanticContext *ctx, NIdentifier & l) { return index ? index->modifiesList(ctx, l) : false; }
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
 };
 
 /**
@@ -230,7 +286,9 @@ NListAccess(NIdentifier & ident, NExpression * index) : ident(ident), index(inde
     llvm::Value * codeGen(CodeGenContext & context);
     Type & getType(SemanticContext * ctx) const;
     bool semanticAnalysis(SemanticContext * ctx);
-    bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return false; }
+    bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return index ? index->checkRecursion(ctx, func) : false; }
+    bool modifiesList(SemanticContext *ctx, NIdentifier & l) { return index ? index->modifiesList(ctx, l) : false; }
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
 };
 
 /**
@@ -244,6 +302,7 @@ NVariableAccess(NIdentifier & ident) : ident(ident) { }
     Type & getType(SemanticContext * ctx) const;
     bool semanticAnalysis(SemanticContext * ctx);
     bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return false; }
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
 };
 
 /**
@@ -256,6 +315,8 @@ NReturn(NExpression & re) : retExpr(re) { }
     bool semanticAnalysis(SemanticContext * ctx);
     std::ostream & print(std::ostream & os) const;
     bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return retExpr.checkRecursion(ctx, func); }
+    bool modifiesList(SemanticContext *ctx, NIdentifier & l) { return retExpr.modifiesList(ctx, l); }
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
 };
 
 /**
@@ -267,6 +328,7 @@ NBreak() { }
     bool semanticAnalysis(SemanticContext * ctx);
     std::ostream & print(std::ostream & os) const;
     bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return false; }
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
 };
 
 /**
@@ -278,6 +340,7 @@ public:
     Type & getType(SemanticContext * ctx) const { return type; }
     bool semanticAnalysis(SemanticContext * ctx) { return true; }
     bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func) { return false; }
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope) { return true; }
 };
 
 /**
@@ -352,14 +415,17 @@ NList(ExpressionList & list) : value(list) { }
     llvm::Value* codeGen(CodeGenContext & context);
     std::ostream & print(std::ostream & os) const;
     bool semanticAnalysis(SemanticContext * ctx);
+    bool checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func);
+    bool modifiesList(SemanticContext *ctx, NIdentifier & list);
+    bool parallelSafe(SemanticContext *ctx, ParallelScope & scope);
 };
 
 /**
  * Identifier */
 class NIdentifier : public NExpression {
 public:
-    std::string value; /**< Identifier value */
-NIdentifier(const std::string & value) : value(value) { }
+    const std::string & value; /**< Identifier value, interned so identifiers compare by address */
+NIdentifier(const std::string & value) : value(internString(value)) { }
     virtual llvm::Value* codeGen(CodeGenContext & context) { }
     std::ostream & print(std::ostream & os) const;
     friend bool operator==(const NIdentifier & i1, const NIdentifier & i2);
@@ -0,0 +1,383 @@
+/**
+   @file cache.cpp
+   @brief Implementation of the content-addressed cache of compiler outputs
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   Contains the CompileCache implementation and the SHA-256 digest used for its keys
+*/
+
+#include "cache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+/**
+ * Identifies the compiler build. The Makefile rebuilds cache.o whenever any other part
+ * of cremacc is rebuilt, so outputs of an older compiler are never reused. */
+static const char * buildId = "cremacc " __DATE__ " " __TIME__;
+
+/**
+ * Round constants of SHA-256 (FIPS 180-4) */
+static const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/**
+ *  An incremental SHA-256 digest */
+class Sha256 {
+public:
+    Sha256();
+    void update(const void * data, size_t len);
+    std::string hex();
+private:
+    uint32_t h[8]; /**< Intermediate hash value */
+    unsigned char block[64]; /**< Bytes of the block being filled */
+    size_t used; /**< Number of bytes in block */
+    uint64_t total; /**< Number of bytes hashed so far */
+    void compress();
+};
+
+/**
+   Starts a digest with the initial hash value of SHA-256
+*/
+Sha256::Sha256() : used(0), total(0)
+{
+    static const uint32_t init[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    memcpy(h, init, sizeof(h));
+}
+
+/**
+   Rotates a 32-bit word right
+
+   @param x Word to rotate
+   @param n Number of bits to rotate by, 1 to 31
+   @return The rotated word
+*/
+static inline uint32_t rotr(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+/**
+   Folds the full block into the hash value
+*/
+void Sha256::compress()
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+    {
+	w[i] = ((uint32_t) block[4 * i] << 24) | ((uint32_t) block[4 * i + 1] << 16) | ((uint32_t) block[4 * i + 2] << 8) | block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++)
+    {
+	uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+	uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+	w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; i++)
+    {
+	uint32_t t1 = k + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256K[i] + w[i];
+	uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+	k = g;
+	g = f;
+	f = e;
+	e = d + t1;
+	d = c;
+	c = b;
+	b = a;
+	a = t1 + t2;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    h[5] += f;
+    h[6] += g;
+    h[7] += k;
+}
+
+/**
+   Adds bytes to the digest
+
+   @param data Pointer to the bytes to hash
+   @param len Number of bytes to hash
+*/
+void Sha256::update(const void * data, size_t len)
+{
+    const unsigned char * p = (const unsigned char *) data;
+    total += len;
+    while (len > 0)
+    {
+	size_t n = (len < 64 - used) ? len : 64 - used;
+	memcpy(block + used, p, n);
+	used += n;
+	p += n;
+	len -= n;
+	if (used == 64)
+	{
+	    compress();
+	    used = 0;
+	}
+    }
+}
+
+/**
+   Pads the message and returns the digest. The Sha256 may not be updated afterwards.
+
+   @return The digest, as 64 hex digits
+*/
+std::string Sha256::hex()
+{
+    uint64_t bits = total * 8;
+    unsigned char pad = 0x80;
+    update(&pad, 1);
+    pad = 0;
+    while (used != 56)
+    {
+	update(&pad, 1);
+    }
+    unsigned char len[8];
+    for (int i = 0; i < 8; i++)
+    {
+	len[i] = (unsigned char) (bits >> (56 - 8 * i));
+    }
+    update(len, 8);
+    char buf[65];
+    for (int i = 0; i < 8; i++)
+    {
+	snprintf(buf + 8 * i, 9, "%08x", h[i]);
+    }
+    return buf;
+}
+
+/**
+   Opens a cache directory, creating it if it does not exist. Caching is disabled
+   if the directory cannot be created.
+
+   @param dir Path to the cache directory, or an empty string to disable caching
+*/
+CompileCache::CompileCache(const std::string & dir) : dir(dir)
+{
+    if (!this->dir.empty() && mkdir(this->dir.c_str(), 0755) && access(this->dir.c_str(), W_OK))
+    {
+	std::cout << "WARNING: Unable to use cache directory " << this->dir << ", caching disabled" << std::endl;
+	this->dir.clear();
+    }
+}
+
+/**
+   Computes the cache key for a compilation. Each input is hashed along with its
+   length, so that moving bytes from one input to the next changes the key.
+
+   @param inputs Everything the output depends on (source, options, runtime)
+   @return The key, the SHA-256 digest of the inputs as 64 hex digits
+*/
+std::string CompileCache::key(const std::vector<std::string> & inputs) const
+{
+    Sha256 digest;
+    digest.update(buildId, strlen(buildId));
+    for (auto & in : inputs)
+    {
+	uint64_t len = in.size();
+	digest.update(&len, sizeof(len));
+	digest.update(in.data(), in.size());
+    }
+    return digest.hex();
+}
+
+/**
+   Reads a whole file into a string
+
+   @param path Path to the file
+   @param contents String to fill with the file's bytes
+   @return true if the file could be read, false otherwise
+*/
+bool CompileCache::readFile(const std::string & path, std::string & contents)
+{
+    std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+    if (!in)
+    {
+	return false;
+    }
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    contents = ss.str();
+    return !in.bad();
+}
+
+/**
+   Copies a file
+
+   @param src Path to the file to copy
+   @param dest Path to write the copy to
+   @return true if the whole file was copied, false otherwise
+*/
+static bool copyFile(const std::string & src, const std::string & dest)
+{
+    std::ifstream in(src.c_str(), std::ios::in | std::ios::binary);
+    if (!in)
+    {
+	return false;
+    }
+    std::ofstream out(dest.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+	return false;
+    }
+    out << in.rdbuf();
+    out.close();
+    return !in.bad() && !out.fail();
+}
+
+std::string CompileCache::entryPath(const std::string & key) const
+{
+    return dir + "/" + key + ".out";
+}
+
+/**
+   Copies the cached output for key to dest and records a hit or a miss
+
+   @param key Cache key from CompileCache::key()
+   @param dest Path to write the output to
+   @param executable Whether the output is a program that should be executable
+   @return true on a hit, false on a miss (or if caching is disabled)
+*/
+bool CompileCache::fetch(const std::string & key, const std::string & dest, bool executable)
+{
+    if (!enabled())
+    {
+	return false;
+    }
+    std::string path = entryPath(key);
+    bool hit = access(path.c_str(), R_OK) == 0 && copyFile(path, dest);
+    if (hit && executable)
+    {
+	chmod(dest.c_str(), 0755);
+    }
+    record(hit);
+    return hit;
+}
+
+/**
+   Adds an output to the cache. The entry is written under a temporary name and then
+   renamed, so that concurrent compilations (in this or another process) never see a
+   partial entry.
+
+   @param key Cache key from CompileCache::key()
+   @param src Path to the output to store
+   @return true if the output was stored, false otherwise
+*/
+bool CompileCache::store(const std::string & key, const std::string & src)
+{
+    if (!enabled())
+    {
+	return false;
+    }
+    std::ostringstream tmp;
+    tmp << entryPath(key) << "." << getpid() << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+    if (!copyFile(src, tmp.str()) || rename(tmp.str().c_str(), entryPath(key).c_str()))
+    {
+	unlink(tmp.str().c_str());
+	return false;
+    }
+    return true;
+}
+
+/**
+   Reads the hit and miss counts from an open statistics file
+
+   @param fd Descriptor of the statistics file
+   @param hits Set to the number of hits, 0 if the file is empty
+   @param misses Set to the number of misses, 0 if the file is empty
+*/
+static void readStats(int fd, uint64_t & hits, uint64_t & misses)
+{
+    char buf[64];
+    unsigned long long h, m;
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    hits = misses = 0;
+    if (n > 0)
+    {
+	buf[n] = '\0';
+	if (sscanf(buf, "%llu %llu", &h, &m) == 2)
+	{
+	    hits = h;
+	    misses = m;
+	}
+    }
+}
+
+/**
+   Reads the hit and miss counts accumulated in the cache directory
+
+   @param hits Set to the number of hits
+   @param misses Set to the number of misses
+*/
+void CompileCache::stats(uint64_t & hits, uint64_t & misses) const
+{
+    hits = misses = 0;
+    if (!enabled())
+    {
+	return;
+    }
+    int fd = open((dir + "/" + CACHE_STATS_FILE).c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+	return;
+    }
+    // Wait for an update in progress to finish
+    flock(fd, LOCK_SH);
+    readStats(fd, hits, misses);
+    close(fd);
+}
+
+/**
+   Adds a hit or a miss to the counts in the cache directory. Every compilation sharing
+   the directory, in this process or another, holds a lock on the statistics file while
+   it updates the file, so that no update is lost.
+
+   @param hit true to count a hit, false to count a miss
+*/
+void CompileCache::record(bool hit)
+{
+    int fd = open((dir + "/" + CACHE_STATS_FILE).c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+	return;
+    }
+    if (flock(fd, LOCK_EX) == 0)
+    {
+	uint64_t hits, misses;
+	readStats(fd, hits, misses);
+	if (hit)
+	    hits++;
+	else
+	    misses++;
+	char buf[64];
+	int n = snprintf(buf, sizeof(buf), "%llu %llu\n", (unsigned long long) hits, (unsigned long long) misses);
+	if (ftruncate(fd, 0) || pwrite(fd, buf, n, 0) != n)
+	{
+	    std::cout << "WARNING: Unable to update the cache statistics in " << dir << std::endl;
+	}
+    }
+    close(fd);
+}
@@ -0,0 +1,43 @@
+/**
+   @file cache.h
+   @brief Header file for the content-addressed cache of compiler outputs
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   The outputs of cremacc (bitcode, object files and linked programs) are stored
+   in a cache directory under a SHA-256 digest of everything that determines them:
+   the source, the options, the runtime and the compiler build. The digest is
+   collision-resistant, so a shared cache directory cannot be made to serve one
+   program's output for another. Compiling the same
+   input again copies the cached output instead of running the whole pipeline.
+*/
+
+#ifndef CREMA_CACHE_H_
+#define CREMA_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define CACHE_ENV_VAR "CREMA_CACHE_DIR"
+#define CACHE_STATS_FILE "stats"
+
+/**
+ *  A directory of compiler outputs keyed by content digest. A CompileCache created
+ *  with an empty directory name is disabled and never hits. */
+class CompileCache {
+public:
+    CompileCache(const std::string & dir);
+    bool enabled() const { return !dir.empty(); }
+    std::string key(const std::vector<std::string> & inputs) const;
+    bool fetch(const std::string & key, const std::string & dest, bool executable);
+    bool store(const std::string & key, const std::string & src);
+    void stats(uint64_t & hits, uint64_t & misses) const;
+    static bool readFile(const std::string & path, std::string & contents);
+private:
+    std::string dir; /**< Cache directory, or empty if caching is disabled */
+    std::string entryPath(const std::string & key) const;
+    void record(bool hit);
+};
+
+#endif // CREMA_CACHE_H_
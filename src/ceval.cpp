@@ -0,0 +1,998 @@
+/**
+   @file ceval.cpp
+   @brief Implementation of the compile-time evaluator of constant expressions
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   Contains the ConstEvaluator, an interpreter for the side-effect free subset of Crema.
+   Every operation mirrors the code generated for it (or the runtime function it calls)
+   exactly; anything that would behave differently at run time is not evaluated.
+*/
+
+#include "ceval.h"
+#include "ast.h"
+#include "parser.h"
+#include "semantics.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+   Creates a scalar value
+
+   @param tc Type of the value
+   @param i Value of an INT, BOOL or CHAR
+   @param d Value of a DOUBLE
+   @return The value
+*/
+static ConstValue scalar(TypeCodes tc, int64_t i, double d = 0)
+{
+    ConstValue v;
+    v.typecode = tc;
+    v.i = i;
+    v.d = d;
+    return v;
+}
+
+/**
+   Creates an empty list value
+
+   @param tc Type of the elements
+   @return The list
+*/
+static ConstValue emptyList(TypeCodes tc)
+{
+    ConstValue v;
+    v.typecode = tc;
+    v.isList = true;
+    v.elems = std::make_shared<std::vector<ConstValue> >();
+    return v;
+}
+
+/**
+   Checks whether a value can be stored in a variable (or passed as an argument) of a type
+   without a conversion, which is all the generated code does for them
+
+   @param v Value to store
+   @param type Type of the variable
+   @return true if the value has exactly that type
+*/
+static bool hasType(const ConstValue & v, Type & type)
+{
+    return !type.isStruct && v.typecode == type.typecode && v.isList == type.isList;
+}
+
+/**
+   Wraps a 64-bit multiplication the way the generated code does
+
+   @param a First factor
+   @param b Second factor
+   @return a * b modulo 2^64
+*/
+static int64_t wrapMul(int64_t a, int64_t b)
+{
+    return (int64_t) ((uint64_t) a * (uint64_t) b);
+}
+
+/**
+   Folds the constant expressions in a program
+
+   @param root Root of the AST, after semantic analysis
+*/
+void ConstEvaluator::fold(NBlock * root)
+{
+    if (root && budget)
+    {
+	foldBlock(*root);
+    }
+}
+
+void ConstEvaluator::foldBlock(NBlock & block)
+{
+    for (auto s : block.statements)
+    {
+	foldStatement(s);
+    }
+}
+
+/**
+   Folds the constant expressions found in a statement and its sub-blocks
+
+   @param stmt Statement to search
+*/
+void ConstEvaluator::foldStatement(NStatement * stmt)
+{
+    if (NFunctionDeclaration * fd = dynamic_cast<NFunctionDeclaration *>(stmt))
+    {
+	if (fd->body)
+	    foldBlock(*fd->body);
+    }
+    else if (NVariableDeclaration * vd = dynamic_cast<NVariableDeclaration *>(stmt))
+    {
+	foldExpression(vd->initializationExpression);
+    }
+    else if (NListAssignmentStatement * la = dynamic_cast<NListAssignmentStatement *>(stmt))
+    {
+	foldExpression(la->list.index);
+	foldExpression(&la->expr);
+    }
+    else if (NStructureAssignmentStatement * sa = dynamic_cast<NStructureAssignmentStatement *>(stmt))
+    {
+	foldExpression(sa->structure.index);
+	foldExpression(&sa->expr);
+    }
+    else if (NAssignmentStatement * as = dynamic_cast<NAssignmentStatement *>(stmt))
+    {
+	foldExpression(&as->expr);
+    }
+    else if (NReturn * ret = dynamic_cast<NReturn *>(stmt))
+    {
+	foldExpression(&ret->retExpr);
+    }
+    else if (NIfStatement * is = dynamic_cast<NIfStatement *>(stmt))
+    {
+	foldExpression(&is->condition);
+	foldBlock(is->thenblock);
+	if (is->elseblock)
+	    foldBlock(*is->elseblock);
+	if (is->elseif)
+	    foldStatement(is->elseif);
+    }
+    else if (NLoopStatement * ls = dynamic_cast<NLoopStatement *>(stmt))
+    {
+	foldBlock(ls->loopBlock);
+    }
+    else if (NRangeLoopStatement * rl = dynamic_cast<NRangeLoopStatement *>(stmt))
+    {
+	foldExpression(&rl->start);
+	foldExpression(&rl->end);
+	foldBlock(rl->loopBlock);
+    }
+    else if (NFunctionCall * fc = dynamic_cast<NFunctionCall *>(stmt))
+    {
+	// A call statement is run for its side effects, only its arguments can be folded
+	for (auto a : fc->args)
+	    foldExpression(a);
+    }
+}
+
+/**
+   Folds an expression, or the largest constant parts of it
+
+   @param expr Expression to fold, may be NULL
+   @return true if the expression is a constant (a literal or a folded expression)
+*/
+bool ConstEvaluator::foldExpression(NExpression * expr)
+{
+    if (!expr)
+    {
+	return false;
+    }
+    if (expr->folded)
+    {
+	return true;
+    }
+    if (dynamic_cast<NInt *>(expr) || dynamic_cast<NDouble *>(expr) || dynamic_cast<NBool *>(expr) ||
+	dynamic_cast<NChar *>(expr) || dynamic_cast<NString *>(expr))
+    {
+	return true;
+    }
+    if (NList * l = dynamic_cast<NList *>(expr))
+    {
+	bool c = true;
+	for (auto e : l->value)
+	    c = foldExpression(e) && c;
+	return c;
+    }
+    if (NBinaryOperator * op = dynamic_cast<NBinaryOperator *>(expr))
+    {
+	bool l = foldExpression(&op->lhs);
+	bool r = foldExpression(&op->rhs);
+	return l && r && tryFold(expr);
+    }
+    if (NFunctionCall * fc = dynamic_cast<NFunctionCall *>(expr))
+    {
+	bool c = true;
+	for (auto a : fc->args)
+	    c = foldExpression(a) && c;
+	return c && tryFold(expr);
+    }
+    if (NListAccess * la = dynamic_cast<NListAccess *>(expr))
+    {
+	foldExpression(la->index);
+    }
+    if (NStructureAccess * sa = dynamic_cast<NStructureAccess *>(expr))
+    {
+	foldExpression(sa->index);
+    }
+    return false;
+}
+
+/**
+   Evaluates an expression whose operands are all constants and, if that succeeds within
+   the budget, records its value as the expression's folded node
+
+   @param expr Expression to evaluate
+   @return true if the expression was folded
+*/
+bool ConstEvaluator::tryFold(NExpression * expr)
+{
+    ConstValue v;
+    steps = 0;
+    frames.clear();
+    if (!eval(expr, v))
+    {
+	return false;
+    }
+    NValue * n = toNode(v);
+    if (!n)
+    {
+	return false;
+    }
+    expr->folded = n;
+    folds++;
+    return true;
+}
+
+/**
+   Creates the literal node for a value
+
+   @param value Value to convert
+   @return The node, or NULL if the value has no literal form
+*/
+NValue * ConstEvaluator::toNode(const ConstValue & value)
+{
+    NValue * n;
+    if (!value.isList)
+    {
+	switch (value.typecode)
+	{
+	case INT:
+	    n = new NInt(value.i);
+	    n->type = Type(TTINT);
+	    return n;
+	case DOUBLE:
+	    n = new NDouble(value.d);
+	    n->type = Type(TTDOUBLE);
+	    return n;
+	case BOOL:
+	    n = new NBool(value.i != 0);
+	    n->type = Type(TTBOOL);
+	    return n;
+	case CHAR:
+	    n = new NChar((char) value.i);
+	    n->type = Type(TTCHAR);
+	    return n;
+	default:
+	    return NULL;
+	}
+    }
+    // Very long lists would only bloat the program
+    if (value.elems->size() > CEVAL_MAX_LIST_LEN)
+    {
+	return NULL;
+    }
+    if (value.typecode == CHAR)
+    {
+	std::string s = "\"";
+	for (auto & e : *value.elems)
+	    s += (char) e.i;
+	s += "\"";
+	n = new NString(s);
+	n->type = Type(TTCHAR, true);
+	return n;
+    }
+    if (value.typecode != INT && value.typecode != DOUBLE)
+    {
+	return NULL;
+    }
+    NList * l = new NList();
+    for (auto & e : *value.elems)
+	l->value.push_back(toNode(e));
+    l->type = Type(value.typecode == INT ? TTINT : TTDOUBLE, true);
+    return l;
+}
+
+/**
+   Counts evaluation steps against the budget
+
+   @param n Number of steps taken
+   @return false once the budget is exhausted
+*/
+bool ConstEvaluator::tick(uint64_t n)
+{
+    steps += n;
+    return steps <= budget;
+}
+
+/**
+   Finds a variable of the function being evaluated
+
+   @param ident Name of the variable
+   @return Pointer to the variable, or NULL if it is not a local of that function
+*/
+ConstVariable * ConstEvaluator::lookup(NIdentifier & ident)
+{
+    if (frames.empty())
+    {
+	return NULL;
+    }
+    ConstFrame & f = frames.back();
+    for (auto it = f.rbegin(); it != f.rend(); it++)
+    {
+	auto v = it->find(&ident.value);
+	if (v != it->end())
+	    return &v->second;
+    }
+    return NULL;
+}
+
+/**
+   Declares a variable in the innermost scope of the function being evaluated.
+   Shadowing is not supported.
+
+   @param ident Name of the variable
+   @param type Declared type of the variable
+   @param value Initial value, INVALID if undefined
+   @return true if the variable was declared
+*/
+bool ConstEvaluator::declare(NIdentifier & ident, Type & type, const ConstValue & value)
+{
+    if (frames.empty() || type.isStruct || lookup(ident))
+    {
+	return false;
+    }
+    ConstVariable & v = frames.back().back()[&ident.value];
+    v.typecode = type.typecode;
+    v.isList = type.isList;
+    v.value = value;
+    return true;
+}
+
+/**
+   Evaluates an expression
+
+   @param expr Expression to evaluate
+   @param value Set to the value of the expression
+   @return true if the expression was evaluated
+*/
+bool ConstEvaluator::eval(NExpression * expr, ConstValue & value)
+{
+    if (!expr || !tick())
+    {
+	return false;
+    }
+    if (expr->folded)
+    {
+	return eval(expr->folded, value);
+    }
+    if (NInt * n = dynamic_cast<NInt *>(expr))
+    {
+	value = scalar(INT, n->value);
+	return true;
+    }
+    if (NDouble * n = dynamic_cast<NDouble *>(expr))
+    {
+	value = scalar(DOUBLE, 0, n->value);
+	return true;
+    }
+    if (NBool * n = dynamic_cast<NBool *>(expr))
+    {
+	value = scalar(BOOL, n->value);
+	return true;
+    }
+    if (NChar * n = dynamic_cast<NChar *>(expr))
+    {
+	value = scalar(CHAR, n->value);
+	return true;
+    }
+    if (NString * n = dynamic_cast<NString *>(expr))
+    {
+	if (n->value.size() > CEVAL_MAX_LIST_LEN || !tick(n->value.size()))
+	    return false;
+	value = emptyList(CHAR);
+	for (char c : n->value)
+	    value.elems->push_back(scalar(CHAR, c));
+	return true;
+    }
+    if (NList * l = dynamic_cast<NList *>(expr))
+    {
+	TypeCodes tc = l->type.typecode;
+	if (tc != INT && tc != DOUBLE && tc != CHAR)
+	    return false;
+	value = emptyList(tc);
+	for (auto e : l->value)
+	{
+	    ConstValue v;
+	    // Elements are passed to the runtime unconverted
+	    if (!eval(e, v) || v.isList || v.typecode != tc)
+		return false;
+	    value.elems->push_back(v);
+	}
+	return true;
+    }
+    if (NVariableAccess * va = dynamic_cast<NVariableAccess *>(expr))
+    {
+	ConstVariable * v = lookup(va->ident);
+	if (!v || v->value.typecode == INVALID)
+	    return false;
+	value = v->value;
+	return true;
+    }
+    if (NListAccess * la = dynamic_cast<NListAccess *>(expr))
+    {
+	ConstVariable * v = lookup(la->ident);
+	ConstValue idx;
+	if (!v || !v->value.isList || !eval(la->index, idx) || idx.isList || idx.typecode != INT)
+	    return false;
+	// Out of bounds accesses abort the program
+	if (idx.i < 0 || idx.i >= (int64_t) v->value.elems->size())
+	    return false;
+	value = (*v->value.elems)[idx.i];
+	return true;
+    }
+    if (NBinaryOperator * op = dynamic_cast<NBinaryOperator *>(expr))
+    {
+	return evalBinary(op, value);
+    }
+    if (NFunctionCall * fc = dynamic_cast<NFunctionCall *>(expr))
+    {
+	return evalCall(fc, value);
+    }
+    return false;
+}
+
+/**
+   Evaluates a binary operator the way NBinaryOperator::codeGen() compiles it
+
+   @param op Operator to evaluate
+   @param value Set to the result
+   @return true if the operator was evaluated
+*/
+bool ConstEvaluator::evalBinary(NBinaryOperator * op, ConstValue & value)
+{
+    ConstValue l, r;
+    if (!eval(&op->lhs, l) || !eval(&op->rhs, r) || l.isList || r.isList)
+    {
+	return false;
+    }
+    // The only conversion the generated code makes is from int to double
+    TypeCodes tc = l.typecode;
+    if (l.typecode != r.typecode)
+    {
+	if (!((l.typecode == INT && r.typecode == DOUBLE) || (l.typecode == DOUBLE && r.typecode == INT)))
+	    return false;
+	tc = DOUBLE;
+	if (l.typecode == INT)
+	    l = scalar(DOUBLE, 0, (double) l.i);
+	if (r.typecode == INT)
+	    r = scalar(DOUBLE, 0, (double) r.i);
+    }
+    if (tc != INT && tc != DOUBLE && tc != BOOL && tc != CHAR)
+    {
+	return false;
+    }
+
+    int64_t a = l.i, b = r.i;
+    double x = l.d, y = r.d;
+    switch (op->op)
+    {
+    case TADD:
+	if (tc == DOUBLE)
+	    value = scalar(DOUBLE, 0, x + y);
+	else if (tc == INT)
+	    value = scalar(INT, (int64_t) ((uint64_t) a + (uint64_t) b));
+	else
+	    return false;
+	return true;
+    case TSUB:
+	if (tc == DOUBLE)
+	    value = scalar(DOUBLE, 0, x - y);
+	else if (tc == INT)
+	    value = scalar(INT, (int64_t) ((uint64_t) a - (uint64_t) b));
+	else
+	    return false;
+	return true;
+    case TMUL:
+	if (tc == DOUBLE)
+	    value = scalar(DOUBLE, 0, x * y);
+	else if (tc == INT)
+	    value = scalar(INT, wrapMul(a, b));
+	else
+	    return false;
+	return true;
+    case TLAND:
+	// Compiled as a multiplication, which is a logical and on bools
+	if (tc != BOOL)
+	    return false;
+	value = scalar(BOOL, a & b);
+	return true;
+    case TDIV:
+    case TMOD:
+	if (tc == DOUBLE)
+	{
+	    value = scalar(DOUBLE, 0, op->op == TDIV ? x / y : fmod(x, y));
+	    return true;
+	}
+	// Division by zero and overflow are undefined
+	if (tc != INT || b == 0 || (a == INT64_MIN && b == -1))
+	    return false;
+	value = scalar(INT, op->op == TDIV ? a / b : a % b);
+	return true;
+    case TBAND:
+    case TBOR:
+    case TBXOR:
+	if (tc != INT && tc != BOOL)
+	    return false;
+	value = scalar(tc, op->op == TBAND ? (a & b) : op->op == TBOR ? (a | b) : (a ^ b));
+	return true;
+    case TCEQ:
+    case TCNEQ:
+    case TCLT:
+    case TCGT:
+    case TCLE:
+    case TCGE:
+	break;
+    default:
+	// TLOR is compiled as an addition, which overflows on bools
+	return false;
+    }
+
+    bool res;
+    if (tc == DOUBLE)
+    {
+	// Ordered comparisons: false whenever an operand is NaN
+	bool ordered = !std::isnan(x) && !std::isnan(y);
+	switch (op->op)
+	{
+	case TCEQ: res = ordered && x == y; break;
+	case TCNEQ: res = ordered && x != y; break;
+	case TCLT: res = ordered && x < y; break;
+	case TCGT: res = ordered && x > y; break;
+	case TCLE: res = ordered && x <= y; break;
+	default: res = ordered && x >= y; break;
+	}
+    }
+    else
+    {
+	if (tc == BOOL && op->op != TCEQ && op->op != TCNEQ)
+	    return false;
+	switch (op->op)
+	{
+	case TCEQ: res = a == b; break;
+	case TCNEQ: res = a != b; break;
+	case TCLT: res = a < b; break;
+	case TCGT: res = a > b; break;
+	case TCLE: res = a <= b; break;
+	default: res = a >= b; break;
+	}
+    }
+    value = scalar(BOOL, res);
+    return true;
+}
+
+/**
+   Evaluates a function call. Crema functions are interpreted; runtime functions are
+   evaluated only if they are known to be free of side effects.
+
+   @param call Call to evaluate
+   @param value Set to the return value
+   @return true if the call was evaluated
+*/
+bool ConstEvaluator::evalCall(NFunctionCall * call, ConstValue & value)
+{
+    NFunctionDeclaration * fd = ctx->searchFuncs(call->ident);
+    if (!fd || fd->variables.size() != call->args.size())
+    {
+	return false;
+    }
+    std::vector<ConstValue> args(call->args.size());
+    for (size_t i = 0; i < args.size(); i++)
+    {
+	if (!eval(call->args[i], args[i]) || args[i].typecode == VOID)
+	    return false;
+    }
+    if (!fd->body)
+    {
+	return evalStdlib(call->ident.value, args, value);
+    }
+
+    frames.push_back(ConstFrame(1));
+    for (size_t i = 0; i < args.size(); i++)
+    {
+	if (!hasType(args[i], fd->variables[i]->type) || !declare(fd->variables[i]->ident, fd->variables[i]->type, args[i]))
+	{
+	    frames.pop_back();
+	    return false;
+	}
+    }
+    Flow f = execBlock(*fd->body);
+    frames.pop_back();
+
+    if (f == NEXT && fd->type.typecode == VOID)
+    {
+	value = scalar(VOID, 0);
+	return true;
+    }
+    if (f != RETURN)
+    {
+	return false;
+    }
+    value = result;
+    // Returning an int from a double function converts it
+    if (fd->type.typecode == DOUBLE && !fd->type.isList && value.typecode == INT && !value.isList)
+    {
+	value = scalar(DOUBLE, 0, (double) value.i);
+    }
+    return hasType(value, fd->type);
+}
+
+/**
+   Evaluates a call to a runtime function that has no side effects, mirroring its
+   implementation in stdlib.c
+
+   @param name Name of the runtime function
+   @param args Evaluated arguments
+   @param value Set to the return value
+   @return true if the function is known and was evaluated
+*/
+bool ConstEvaluator::evalStdlib(const std::string & name, std::vector<ConstValue> & args, ConstValue & value)
+{
+    size_t n = args.size();
+    ConstValue * l = (n > 0 && args[0].isList) ? &args[0] : NULL;
+    std::vector<ConstValue> * e = l ? l->elems.get() : NULL;
+    TypeCodes et = name.compare(0, 4, "int_") == 0 ? INT : name.compare(0, 7, "double_") == 0 ? DOUBLE : name.compare(0, 4, "str_") == 0 ? CHAR : INVALID;
+    bool isInt = n > 0 && !args[0].isList && args[0].typecode == INT;
+    bool isDouble = n > 0 && !args[0].isList && args[0].typecode == DOUBLE;
+
+    if (n == 0 && (name == "int_list_create" || name == "double_list_create" || name == "str_create"))
+    {
+	value = emptyList(et);
+	return true;
+    }
+    if (n == 1 && l && name == "list_length")
+    {
+	value = scalar(INT, e->size());
+	return true;
+    }
+    if (n == 2 && l && (name == "list_reserve" || name == "double_list_reserve" || name == "str_reserve"))
+    {
+	value = scalar(VOID, 0);
+	return true;
+    }
+    if (l && l->typecode == et)
+    {
+	if (n == 2 && !args[1].isList && args[1].typecode == INT &&
+	    (name == "int_list_retrieve" || name == "double_list_retrieve" || name == "str_retrieve"))
+	{
+	    // Out of bounds accesses abort the program
+	    if (args[1].i < 0 || args[1].i >= (int64_t) e->size())
+		return false;
+	    value = (*e)[args[1].i];
+	    return true;
+	}
+	if (n == 2 && !args[1].isList && args[1].typecode == et &&
+	    (name == "int_list_append" || name == "double_list_append" || name == "str_append"))
+	{
+	    if (e->size() >= CEVAL_MAX_LIST_LEN)
+		return false;
+	    e->push_back(args[1]);
+	    value = scalar(VOID, 0);
+	    return true;
+	}
+	if (n == 3 && !args[1].isList && args[1].typecode == INT && !args[2].isList && args[2].typecode == et &&
+	    (name == "int_list_insert" || name == "double_list_insert" || name == "str_insert"))
+	{
+	    // Inserting out of bounds is ignored
+	    if (args[1].i >= 0 && args[1].i < (int64_t) e->size())
+		(*e)[args[1].i] = args[2];
+	    value = scalar(VOID, 0);
+	    return true;
+	}
+	if (n == 1 && (name == "int_list_copy" || name == "double_list_copy" || name == "str_copy"))
+	{
+	    if (!tick(e->size()))
+		return false;
+	    value = emptyList(et);
+	    *value.elems = *e;
+	    return true;
+	}
+	if (n == 2 && args[1].isList && args[1].typecode == et &&
+	    (name == "int_list_concat" || name == "double_list_concat" || name == "str_concat"))
+	{
+	    // The lists may be the same list
+	    std::vector<ConstValue> src = *args[1].elems;
+	    if (e->size() + src.size() > CEVAL_MAX_LIST_LEN || !tick(src.size()))
+		return false;
+	    e->insert(e->end(), src.begin(), src.end());
+	    value = scalar(VOID, 0);
+	    return true;
+	}
+	if (n == 3 && !args[1].isList && args[1].typecode == INT && args[2].isList && args[2].typecode == et &&
+	    (name == "int_list_insert_range" || name == "double_list_insert_range" || name == "str_insert_range"))
+	{
+	    int64_t idx = args[1].i;
+	    std::vector<ConstValue> src = *args[2].elems;
+	    if (idx < 0 || idx > (int64_t) e->size() || e->size() + src.size() > CEVAL_MAX_LIST_LEN || !tick(src.size()))
+		return false;
+	    e->insert(e->begin() + idx, src.begin(), src.end());
+	    value = scalar(VOID, 0);
+	    return true;
+	}
+	if (n == 3 && !args[1].isList && args[1].typecode == INT && !args[2].isList && args[2].typecode == INT &&
+	    (name == "int_list_slice" || name == "double_list_slice" || name == "str_substr"))
+	{
+	    int64_t start = args[1].i, len = args[2].i, size = e->size();
+	    if (name == "str_substr")
+	    {
+		// Out of range substrings are NULL
+		if (start < 0 || start >= size)
+		    return false;
+		if (len <= 0 || len > size - start)
+		    len = size - start;
+	    }
+	    else
+	    {
+		// Out of range slices abort the program
+		if (start < 0 || start > size || len < 0)
+		    return false;
+		if (len > size - start)
+		    len = size - start;
+	    }
+	    if (!tick(len))
+		return false;
+	    value = emptyList(et);
+	    value.elems->assign(e->begin() + start, e->begin() + start + len);
+	    return true;
+	}
+    }
+    if (n == 1 && l && l->typecode == CHAR && (name == "string_to_int" || name == "string_to_double"))
+    {
+	// Only the first characters are parsed, as in crema_str_number()
+	char buf[512];
+	size_t len = e->size() < sizeof(buf) - 1 ? e->size() : sizeof(buf) - 1;
+	for (size_t i = 0; i < len; i++)
+	    buf[i] = (char) (*e)[i].i;
+	buf[len] = '\0';
+	if (!tick(len))
+	    return false;
+	if (name == "string_to_int")
+	    value = scalar(INT, atoi(buf));
+	else
+	    value = scalar(DOUBLE, 0, atof(buf));
+	return true;
+    }
+    if (n == 2 && isInt && !args[1].isList && args[1].typecode == INT && name == "crema_seq")
+    {
+	int64_t start = args[0].i, end = args[1].i;
+	value = emptyList(INT);
+	if (end <= start)
+	    return true;
+	if ((uint64_t) end - (uint64_t) start >= CEVAL_MAX_LIST_LEN || !tick(end - start + 1))
+	    return false;
+	for (int64_t i = start; i <= end; i++)
+	    value.elems->push_back(scalar(INT, i));
+	return true;
+    }
+    if (n == 1 && isInt)
+    {
+	int64_t a = args[0].i;
+	if (name == "int_square")
+	    value = scalar(INT, wrapMul(a, a));
+	else if (name == "int_to_double")
+	    value = scalar(DOUBLE, 0, (double) a);
+	else if (name == "int_to_string")
+	{
+	    char buf[20];
+	    snprintf(buf, sizeof(buf), "%ld", (long) a);
+	    value = emptyList(CHAR);
+	    for (char * c = buf; *c; c++)
+		value.elems->push_back(scalar(CHAR, *c));
+	}
+	else
+	    return false;
+	return true;
+    }
+    if (n == 1 && isDouble)
+    {
+	double x = args[0].d;
+	if (name == "double_to_int")
+	{
+	    // Converting NaN or an out of range double is undefined
+	    if (!(x >= -9223372036854775808.0 && x < 9223372036854775808.0))
+		return false;
+	    value = scalar(INT, (int64_t) x);
+	    return true;
+	}
+	if (name == "double_square")
+	    value = scalar(DOUBLE, 0, x * x);
+	else if (name == "double_sqrt")
+	    value = scalar(DOUBLE, 0, sqrt(x));
+	else if (name == "double_floor")
+	    value = scalar(DOUBLE, 0, floor(x));
+	else if (name == "double_truncate")
+	    value = scalar(DOUBLE, 0, trunc(x));
+	else if (name == "double_sin")
+	    value = scalar(DOUBLE, 0, sin(x));
+	else if (name == "double_cos")
+	    value = scalar(DOUBLE, 0, cos(x));
+	else if (name == "double_tan")
+	    value = scalar(DOUBLE, 0, tan(x));
+	else
+	    return false;
+	return true;
+    }
+    if (n == 2 && isDouble && !args[1].isList && args[1].typecode == DOUBLE && name == "double_pow")
+    {
+	value = scalar(DOUBLE, 0, pow(args[0].d, args[1].d));
+	return true;
+    }
+    return false;
+}
+
+/**
+   Executes the statements of a block, in the innermost scope
+
+   @param block Block to execute
+   @return How the block ended
+*/
+ConstEvaluator::Flow ConstEvaluator::execBlock(NBlock & block)
+{
+    for (auto s : block.statements)
+    {
+	Flow f = exec(s);
+	if (f != NEXT)
+	    return f;
+    }
+    return NEXT;
+}
+
+/**
+   Executes a statement of a function being evaluated
+
+   @param stmt Statement to execute
+   @return How the statement ended
+*/
+ConstEvaluator::Flow ConstEvaluator::exec(NStatement * stmt)
+{
+    if (!tick())
+    {
+	return FAIL;
+    }
+    if (NVariableDeclaration * vd = dynamic_cast<NVariableDeclaration *>(stmt))
+    {
+	ConstValue v;
+	Type & t = vd->type;
+	if (t.isStruct || (t.typecode != INT && t.typecode != DOUBLE && t.typecode != BOOL && t.typecode != CHAR))
+	    return FAIL;
+	if (vd->initializationExpression)
+	{
+	    if (!eval(vd->initializationExpression, v) || !hasType(v, t))
+		return FAIL;
+	}
+	else if (t.isList)
+	{
+	    // Only int lists and strings are created when declared without a value
+	    if (t.typecode != INT && t.typecode != CHAR)
+		return FAIL;
+	    v = emptyList(t.typecode);
+	}
+	return declare(vd->ident, t, v) ? NEXT : FAIL;
+    }
+    if (dynamic_cast<NStructureAssignmentStatement *>(stmt))
+    {
+	return FAIL;
+    }
+    if (NListAssignmentStatement * la = dynamic_cast<NListAssignmentStatement *>(stmt))
+    {
+	ConstVariable * var = lookup(la->list.ident);
+	ConstValue idx, v;
+	if (!var || !var->value.isList || !eval(&la->expr, v) || v.isList || v.typecode != var->value.typecode)
+	    return FAIL;
+	std::vector<ConstValue> & e = *var->value.elems;
+	if (!la->list.index)
+	{
+	    if (e.size() >= CEVAL_MAX_LIST_LEN)
+		return FAIL;
+	    e.push_back(v);
+	    return NEXT;
+	}
+	if (!eval(la->list.index, idx) || idx.isList || idx.typecode != INT)
+	    return FAIL;
+	// Assigning out of bounds is ignored
+	if (idx.i >= 0 && idx.i < (int64_t) e.size())
+	    e[idx.i] = v;
+	return NEXT;
+    }
+    if (NAssignmentStatement * as = dynamic_cast<NAssignmentStatement *>(stmt))
+    {
+	ConstVariable * var = lookup(as->ident);
+	ConstValue v;
+	if (!var || !eval(&as->expr, v) || v.typecode != var->typecode || v.isList != var->isList)
+	    return FAIL;
+	var->value = v;
+	return NEXT;
+    }
+    if (NReturn * ret = dynamic_cast<NReturn *>(stmt))
+    {
+	// Calls in the expression set result themselves
+	ConstValue v;
+	if (!eval(&ret->retExpr, v))
+	    return FAIL;
+	result = v;
+	return RETURN;
+    }
+    if (dynamic_cast<NBreak *>(stmt))
+    {
+	return BREAK;
+    }
+    if (NIfStatement * is = dynamic_cast<NIfStatement *>(stmt))
+    {
+	ConstValue c;
+	if (!eval(&is->condition, c) || c.isList || c.typecode != BOOL)
+	    return FAIL;
+	Flow f = NEXT;
+	frames.back().push_back(ConstScope());
+	if (c.i)
+	    f = execBlock(is->thenblock);
+	else if (is->elseblock)
+	    f = execBlock(*is->elseblock);
+	else if (is->elseif)
+	    f = exec(is->elseif);
+	frames.back().pop_back();
+	return f;
+    }
+    if (NLoopStatement * ls = dynamic_cast<NLoopStatement *>(stmt))
+    {
+	ConstVariable * var = lookup(ls->list);
+	// A loop that changes its list is not worth reproducing
+	if (!var || !var->value.isList || ls->loopBlock.modifiesList(ctx, ls->list))
+	    return FAIL;
+	std::shared_ptr<std::vector<ConstValue> > elems = var->value.elems;
+	Type t(TTINT);
+	t.typecode = var->value.typecode;
+	// Like the generated loop, read the length once: the body may still change the list through an alias
+	size_t n = elems->size();
+	for (size_t i = 0; i < n; i++)
+	{
+	    if (i >= elems->size())
+		return FAIL;
+	    frames.back().push_back(ConstScope());
+	    Flow f = declare(ls->asVar, t, (*elems)[i]) ? execBlock(ls->loopBlock) : FAIL;
+	    frames.back().pop_back();
+	    if (f == BREAK)
+		break;
+	    if (f != NEXT)
+		return f;
+	}
+	return NEXT;
+    }
+    if (NRangeLoopStatement * rl = dynamic_cast<NRangeLoopStatement *>(stmt))
+    {
+	ConstValue first, last;
+	if (!eval(&rl->start, first) || !eval(&rl->end, last) || first.isList || last.isList ||
+	    first.typecode != INT || last.typecode != INT)
+	    return FAIL;
+	Type t(TTINT);
+	for (int64_t i = first.i; last.i > first.i; i++)
+	{
+	    frames.back().push_back(ConstScope());
+	    Flow f = declare(rl->asVar, t, scalar(INT, i)) ? execBlock(rl->loopBlock) : FAIL;
+	    frames.back().pop_back();
+	    if (f == BREAK)
+		break;
+	    if (f != NEXT)
+		return f;
+	    if (i == last.i)
+		break;
+	}
+	return NEXT;
+    }
+    if (NFunctionCall * fc = dynamic_cast<NFunctionCall *>(stmt))
+    {
+	ConstValue v;
+	return evalCall(fc, v) ? NEXT : FAIL;
+    }
+    return FAIL;
+}
@@ -0,0 +1,88 @@
+/**
+   @file ceval.h
+   @brief Header file for the compile-time evaluator of constant expressions
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   Crema programs always terminate: there is no recursion and every loop is bounded.
+   A call to a function without side effects whose arguments are constants can thus
+   be run while compiling. After semantic analysis the ConstEvaluator evaluates the
+   binary operators over literals and the calls with constant arguments, and records
+   their values in NExpression::folded, which code generation emits instead of the
+   expression. Evaluation gives up on anything it cannot reproduce exactly (I/O,
+   global variables, structures, out of bounds accesses, undefined behavior) and
+   once it has taken more steps than its budget; the expression is then compiled
+   as before.
+*/
+
+#ifndef CREMA_CEVAL_H_
+#define CREMA_CEVAL_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "decls.h"
+#include "types.h"
+
+#define CEVAL_DEFAULT_BUDGET 100000
+#define CEVAL_MAX_LIST_LEN 65536
+
+/**
+ *  A value computed at compile time: a scalar or a list of scalars. Lists are shared
+ *  by reference, as they are in Crema programs. */
+struct ConstValue {
+    TypeCodes typecode; /**< INT, DOUBLE, BOOL or CHAR, the element type of a list, or INVALID if undefined */
+    bool isList; /**< Whether the value is a list */
+    int64_t i; /**< Value of an INT, BOOL or CHAR */
+    double d; /**< Value of a DOUBLE */
+    std::shared_ptr<std::vector<ConstValue> > elems; /**< Elements of a list */
+    ConstValue() : typecode(INVALID), isList(false), i(0), d(0) { }
+};
+
+/**
+ *  A variable of a function being evaluated */
+struct ConstVariable {
+    TypeCodes typecode; /**< Declared type, or element type of a list */
+    bool isList; /**< Whether the variable is a list */
+    ConstValue value; /**< Current value, INVALID until the variable is assigned */
+};
+
+typedef std::unordered_map<const std::string *, ConstVariable> ConstScope; /**< Variables of one block, keyed by interned name */
+typedef std::vector<ConstScope> ConstFrame; /**< Scopes of one function call, innermost last */
+
+/**
+ *  Replaces constant expressions in the AST by their values */
+class ConstEvaluator {
+public:
+    ConstEvaluator(SemanticContext * ctx, uint64_t budget) : folds(0), ctx(ctx), budget(budget), steps(0) { }
+    void fold(NBlock * root);
+    size_t folds; /**< Number of expressions replaced by their value */
+private:
+    /** How executing a statement ends */
+    enum Flow { NEXT, BREAK, RETURN, FAIL };
+    SemanticContext * ctx; /**< Semantic information of the program, for looking up functions */
+    uint64_t budget; /**< Steps allowed for evaluating each expression */
+    uint64_t steps; /**< Steps taken evaluating the current expression */
+    std::vector<ConstFrame> frames; /**< Calls being evaluated, innermost last */
+    ConstValue result; /**< Value of the latest return statement */
+
+    void foldBlock(NBlock & block);
+    void foldStatement(NStatement * stmt);
+    bool foldExpression(NExpression * expr);
+    bool tryFold(NExpression * expr);
+    NValue * toNode(const ConstValue & value);
+
+    bool tick(uint64_t n = 1);
+    ConstVariable * lookup(NIdentifier & ident);
+    bool declare(NIdentifier & ident, Type & type, const ConstValue & value);
+    bool eval(NExpression * expr, ConstValue & value);
+    bool evalBinary(NBinaryOperator * op, ConstValue & value);
+    bool evalCall(NFunctionCall * call, ConstValue & value);
+    bool evalStdlib(const std::string & name, std::vector<ConstValue> & args, ConstValue & value);
+    Flow exec(NStatement * stmt);
+    Flow execBlock(NBlock & block);
+};
+
+#endif // CREMA_CEVAL_H_
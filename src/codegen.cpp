@@ -12,9 +12,25 @@
 #include "ast.h"
 #include "parser.h"
 #include "types.h"
-
-CodeGenContext rootCodeGenCtx; 
-std::map<std::string, std::pair<NStructureDeclaration *, llvm::StructType *> > structs;
+#include "semantics.h"
+#include <llvm/Analysis/Verifier.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Linker.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FormattedStream.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Dwarf.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetOptions.h>
+#include <mutex>
 
 /**
    This constructor creates an llvm::Module object called 'rootModule' and a llvm::IRBuilder
@@ -24,13 +40,36 @@ std::map<std::string, std::pair<NStructureDeclaration *, llvm::StructType *> > s
    a symbol table, and data about the target's characteristics. The IRBuilder provides a uniform
    API for creating instructions and inserting them into a basic block. Use mutators 
    (e.g. setVolatile) on instructions after they have been created for access to extra instruction
-   properties.
+   properties. All of the module's types and constants belong to llvmContext, so separate
+   compilations can generate code concurrently.
+
+   @param llvmContext LLVMContext owning the generated module
+   @param semantics SemanticContext the program was analyzed with
 */
-CodeGenContext::CodeGenContext()
+CodeGenContext::CodeGenContext(llvm::LLVMContext & llvmContext, SemanticContext * semantics) : llvmContext(llvmContext), semantics(semantics)
 {
-    rootModule = new llvm::Module("Crema JIT", llvm::getGlobalContext());
+    rootModule = new llvm::Module("Crema JIT", llvmContext);
     rootModule->setTargetTriple(llvm::sys::getDefaultTargetTriple());
-    Builder = new llvm::IRBuilder<>(llvm::getGlobalContext());
+    Builder = new llvm::IRBuilder<>(llvmContext);
+    optLevel = 0;
+    targetMachine = NULL;
+    useRegions = false;
+    regionEscape = false;
+    verbose = false;
+    useCounters = false;
+    debugInfo = false;
+    dbuilder = NULL;
+    debugScope = NULL;
+
+    std::vector<llvm::Type *> fields;
+    fields.push_back(llvm::Type::getInt64Ty(llvmContext));   // cap
+    fields.push_back(llvm::Type::getInt64Ty(llvmContext));   // len
+    fields.push_back(llvm::Type::getInt64Ty(llvmContext));   // elem_sz
+    fields.push_back(llvm::Type::getInt8PtrTy(llvmContext)); // arr
+    fields.push_back(llvm::Type::getInt8PtrTy(llvmContext)); // region
+    fields.push_back(llvm::Type::getInt64Ty(llvmContext));   // flags
+    fields.push_back(llvm::Type::getInt8PtrTy(llvmContext)); // shared
+    listType = llvm::StructType::create(llvmContext, fields, "list_t", false);
 }
 
 /**
@@ -60,16 +99,28 @@ void CodeGenContext::codeGen(NBlock * rootBlock)
 
     // Define arguments to root function, i.e. main(int, char**)
     std::vector<llvm::Type *> params;
-    params.push_back(llvm::Type::getInt64Ty(llvm::getGlobalContext()));
-    params.push_back(llvm::PointerType::get(llvm::Type::getInt8PtrTy(llvm::getGlobalContext()), 0));
+    params.push_back(llvm::Type::getInt64Ty(llvmContext));
+    params.push_back(llvm::PointerType::get(llvm::Type::getInt8PtrTy(llvmContext), 0));
     llvm::ArrayRef<llvm::Type *> argTypes(params);
     
     // Create the root "function" for top level functionality
-    llvm::FunctionType *ftype = llvm::FunctionType::get(llvm::Type::getInt64Ty(llvm::getGlobalContext()), argTypes, false);
+    llvm::FunctionType *ftype = llvm::FunctionType::get(llvm::Type::getInt64Ty(llvmContext), argTypes, false);
     mainFunction = llvm::Function::Create(ftype, llvm::GlobalValue::ExternalLinkage, "main", rootModule);
-    llvm::BasicBlock *bb = llvm::BasicBlock::Create(llvm::getGlobalContext(), "entry", mainFunction, 0);
+    llvm::BasicBlock *bb = llvm::BasicBlock::Create(llvmContext, "entry", mainFunction, 0);
+
+    if (debugInfo)
+      {
+	// The top-level statements are the body of main, which starts at the first line
+	llvm::SmallString<128> cwd;
+	llvm::sys::fs::current_path(cwd);
+	std::string file = sourceFile.empty() ? "<stdin>" : sourceFile;
+	dbuilder = new llvm::DIBuilder(*rootModule);
+	dbuilder->createCompileUnit(llvm::dwarf::DW_LANG_C, file, cwd.str(), "cremacc", optLevel > 0, "", 0);
+	debugFile = dbuilder->createFile(file, cwd.str());
+	debugScope = createDebugFunction(mainFunction, 1);
+      }
 
-    variables.push_back(*(new std::map<std::string, std::pair<NVariableDeclaration *, llvm::Value *> >()));
+    variables.push_back(VariableScope());
     blocks.push(bb);
     if (rootBlock)
       {		
@@ -86,16 +137,439 @@ void CodeGenContext::codeGen(NBlock * rootBlock)
 	// stdlib functions defined in ast.cpp are not yet available
 
 	std::string funcname = "save_args";
-	llvm::FunctionType *ft = llvm::FunctionType::get(llvm::Type::getVoidTy(llvm::getGlobalContext()), argTypes, false);
+	llvm::FunctionType *ft = llvm::FunctionType::get(llvm::Type::getVoidTy(llvmContext), argTypes, false);
 	llvm::Function * func = llvm::Function::Create(ft, llvm::GlobalValue::ExternalLinkage, funcname.c_str(), this->rootModule);
 	llvm::CallInst::Create(func, argvParseR, "", this->blocks.top());
 
+	if (useCounters)
+	  {
+	    // Registers the exit hook that reports the runtime's list operation counters
+	    llvm::FunctionType *cft = llvm::FunctionType::get(llvm::Type::getVoidTy(llvmContext), false);
+	    llvm::Function * cfunc = llvm::Function::Create(cft, llvm::GlobalValue::ExternalLinkage, "crema_counters_init", this->rootModule);
+	    llvm::CallInst::Create(cfunc, "", this->blocks.top());
+	  }
+
+	if (debugScope)
+	    setDebugLocations(mainFunction, 1);
+
 	// Call codeGen on our rootBlock
 	rootBlock->codeGen(*this);
       }
     if (!blocks.top()->getTerminator())
-      llvm::ReturnInst::Create(llvm::getGlobalContext(), llvm::ConstantInt::get(llvm::getGlobalContext(), llvm::APInt(64, 0, true)), blocks.top());
+      llvm::ReturnInst::Create(llvmContext, llvm::ConstantInt::get(llvmContext, llvm::APInt(64, 0, true)), blocks.top());
     blocks.pop();
+
+    if (dbuilder)
+      {
+	setDebugLocations(mainFunction, 1, true);
+	debugScope = NULL;
+	dbuilder->finalize();
+	rootModule->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+      }
+}
+
+/**
+   Describes a generated function in the debug info. Only line tables are emitted, so the
+   subprogram has no parameter or variable descriptions.
+
+   @param func Function being generated
+   @param line Source line the function is declared on
+   @return The subprogram, the scope of the function's debug locations
+*/
+llvm::MDNode * CodeGenContext::createDebugFunction(llvm::Function * func, int line)
+{
+    llvm::DICompositeType ftype = dbuilder->createSubroutineType(debugFile, dbuilder->getOrCreateArray(llvm::ArrayRef<llvm::Value *>()));
+    return dbuilder->createFunction(debugFile, func->getName(), func->getName(), debugFile, line, ftype, func->hasInternalLinkage(), true, line, 0, optLevel > 0, func);
+}
+
+/**
+   Gives the instructions without a location at the end of a block a source line
+
+   @param bb Block to walk back from the end of
+   @param loc Location to give the instructions
+   @param all Give every instruction of the block without a location the line
+*/
+static void setBlockDebugLocations(llvm::BasicBlock * bb, llvm::DebugLoc & loc, bool all)
+{
+    for (llvm::BasicBlock::reverse_iterator it = bb->rbegin(); it != bb->rend(); it++)
+      {
+	if (llvm::isa<llvm::AllocaInst>(&*it))
+	    continue;
+	if (!it->getDebugLoc().isUnknown())
+	  {
+	    if (all)
+		continue;
+	    break;
+	  }
+	it->setDebugLoc(loc);
+      }
+}
+
+/**
+   Attributes the instructions generated for a statement to its source line. Statements are
+   generated inside out, so the instructions without a location at the end of each block
+   of func are the ones just generated; inner statements have already given theirs a line.
+   Only the blocks created since the previous call and those that were not terminated then
+   can have new instructions, so the others are not visited again (see DebugCursor). Allocas
+   are left without a location, as clang does.
+
+   @param func Function the statement was generated in
+   @param line Source line of the statement
+   @param all Give every instruction of func without a location the line, not only the ones
+   at the end of each block; done once the function is complete
+*/
+void CodeGenContext::setDebugLocations(llvm::Function * func, int line, bool all)
+{
+    llvm::DebugLoc loc = llvm::DebugLoc::get(line, 0, debugScope);
+    if (all)
+      {
+	for (llvm::Function::iterator bb = func->begin(); bb != func->end(); bb++)
+	    setBlockDebugLocations(&*bb, loc, true);
+	debugCursors.erase(func);
+	return;
+      }
+    DebugCursor & cursor = debugCursors[func];
+    std::vector<llvm::BasicBlock *> open;
+    for (auto bb : cursor.open)
+      {
+	setBlockDebugLocations(bb, loc, false);
+	if (!bb->getTerminator())
+	    open.push_back(bb);
+      }
+    llvm::Function::iterator bb = cursor.last ? ++llvm::Function::iterator(cursor.last) : func->begin();
+    for (; bb != func->end(); bb++)
+      {
+	setBlockDebugLocations(&*bb, loc, false);
+	if (!bb->getTerminator())
+	    open.push_back(&*bb);
+	cursor.last = &*bb;
+      }
+    cursor.open.swap(open);
+}
+
+/**
+   Links the prebuilt stdlib bitcode into rootModule. Once the runtime lives in the same module,
+   the optimizer can inline list accessors such as int_list_retrieve and see through the list_t
+   layout. The runtime definitions are internalized so unused ones are dropped and single-use ones
+   are inlined; only main() is left externally visible.
+
+   @param filename Path to the stdlib bitcode file (stdlib/stdlib.bc)
+   @return true if the runtime was linked in, false otherwise
+*/
+bool CodeGenContext::linkStdlib(const char * filename)
+{
+    // The runtime is read once per process and parsed from memory into each compilation's context
+    static std::map<std::string, llvm::MemoryBuffer *> runtimes;
+    static std::mutex runtimesLock;
+    llvm::MemoryBuffer * runtime;
+    llvm::SMDiagnostic diag;
+    {
+	std::lock_guard<std::mutex> guard(runtimesLock);
+	runtime = runtimes[filename];
+	if (!runtime)
+	{
+	    llvm::OwningPtr<llvm::MemoryBuffer> buf;
+	    if (!llvm::MemoryBuffer::getFile(filename, buf))
+	    {
+		runtime = runtimes[filename] = buf.take();
+	    }
+	}
+    }
+    if (!runtime)
+    {
+	std::cout << "Warning: Unable to read stdlib bitcode " << filename << std::endl;
+	return false;
+    }
+    llvm::Module * stdlib = llvm::ParseIR(llvm::MemoryBuffer::getMemBuffer(runtime->getBuffer(), filename, false), diag, llvmContext);
+    if (!stdlib)
+    {
+	std::cout << "Warning: Unable to load stdlib bitcode " << filename << ": " << diag.getMessage().str() << std::endl;
+	return false;
+    }
+
+    std::string err;
+    if (llvm::Linker::LinkModules(rootModule, stdlib, llvm::Linker::DestroySource, &err))
+    {
+	std::cout << "Warning: Unable to link stdlib bitcode " << filename << ": " << err << std::endl;
+	delete stdlib;
+	return false;
+    }
+    delete stdlib;
+
+    for (llvm::Module::iterator f = rootModule->begin(); f != rootModule->end(); ++f)
+    {
+	if (!f->isDeclaration() && &(*f) != mainFunction)
+	{
+	    f->setLinkage(llvm::GlobalValue::InternalLinkage);
+	}
+    }
+    for (llvm::Module::global_iterator g = rootModule->global_begin(); g != rootModule->global_end(); ++g)
+    {
+	if (!g->isDeclaration())
+	{
+	    g->setLinkage(llvm::GlobalValue::InternalLinkage);
+	}
+    }
+    return true;
+}
+
+/**
+   Runs the LLVM optimization pipeline over rootModule for the level stored in optLevel.
+   The pipeline is populated by llvm::PassManagerBuilder, the same way clang does it:
+   -O1 runs SROA/mem2reg, early CSE, instcombine, simplifycfg and the always-inliner,
+   -O2 adds the function inliner, GVN, LICM, loop unrolling and the loop/SLP vectorizers,
+   and -O3 raises the inlining threshold and enables argument promotion.
+
+   @return false if the generated module failed verification, true otherwise
+*/
+bool CodeGenContext::optimize()
+{
+    if (optLevel <= 0)
+    {
+	return true;
+    }
+
+    std::string err;
+    if (llvm::verifyModule(*rootModule, llvm::ReturnStatusAction, &err))
+    {
+	std::cout << "ERROR: Generated module is invalid, refusing to optimize: " << err << std::endl;
+	return false;
+    }
+
+    // Without a TargetMachine the vectorizers fall back to a target-independent cost model
+    createTargetMachine();
+
+    llvm::PassManagerBuilder pmb;
+    pmb.OptLevel = (optLevel > 3) ? 3 : optLevel;
+    pmb.SizeLevel = 0;
+    if (pmb.OptLevel > 1)
+    {
+	pmb.Inliner = llvm::createFunctionInliningPass(pmb.OptLevel > 2 ? 275 : 225);
+    }
+    else
+    {
+	pmb.Inliner = llvm::createAlwaysInlinerPass();
+    }
+    pmb.DisableUnrollLoops = (pmb.OptLevel < 2);
+    pmb.LoopVectorize = (pmb.OptLevel > 1);
+    pmb.SLPVectorize = (pmb.OptLevel > 1);
+
+    // Per-function cleanup (SROA, early CSE) before the module-level pipeline
+    llvm::FunctionPassManager fpm(rootModule);
+    fpm.add(new llvm::DataLayout(rootModule));
+    if (targetMachine)
+    {
+	targetMachine->addAnalysisPasses(fpm);
+    }
+    pmb.populateFunctionPassManager(fpm);
+    fpm.doInitialization();
+    for (llvm::Module::iterator f = rootModule->begin(); f != rootModule->end(); ++f)
+    {
+	fpm.run(*f);
+    }
+    fpm.doFinalization();
+
+    llvm::PassManager mpm;
+    mpm.add(new llvm::DataLayout(rootModule));
+    if (targetMachine)
+    {
+	targetMachine->addAnalysisPasses(mpm);
+    }
+    pmb.populateModulePassManager(mpm);
+    mpm.run(*rootModule);
+    return true;
+}
+
+/**
+   Maps an optimization level onto the LLVM code generator's optimization level
+
+   @param optLevel Optimization level (0-3)
+   @return The matching llvm::CodeGenOpt::Level
+*/
+static llvm::CodeGenOpt::Level codeGenOptLevel(int optLevel)
+{
+    if (optLevel <= 0)
+    {
+	return llvm::CodeGenOpt::None;
+    }
+    else if (optLevel >= 3)
+    {
+	return llvm::CodeGenOpt::Aggressive;
+    }
+    return llvm::CodeGenOpt::Default;
+}
+
+/**
+   Creates the llvm::TargetMachine for the module's target triple (the host's default triple)
+   and sets the module's data layout to match it. Only the first call does any work, and
+   TargetMachines are reused by later compilations on the same thread.
+
+   @return true if a TargetMachine is available, false otherwise
+*/
+bool CodeGenContext::createTargetMachine()
+{
+    // A TargetMachine does not depend on the LLVMContext, so compilations on the same
+    // thread share one per optimization level
+    static thread_local std::map<int, llvm::TargetMachine *> machines;
+    if (targetMachine)
+    {
+	return true;
+    }
+
+    std::map<int, llvm::TargetMachine *>::iterator it = machines.find(optLevel);
+    if (it != machines.end())
+    {
+	targetMachine = it->second;
+	rootModule->setDataLayout(targetMachine->getDataLayout()->getStringRepresentation());
+	return true;
+    }
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    std::string err;
+    std::string triple = rootModule->getTargetTriple();
+    const llvm::Target * target = llvm::TargetRegistry::lookupTarget(triple, err);
+    if (!target)
+    {
+	std::cout << "ERROR: Unable to find target " << triple << ": " << err << std::endl;
+	return false;
+    }
+
+    llvm::TargetOptions options;
+    targetMachine = target->createTargetMachine(triple, llvm::sys::getHostCPUName(), "", options, llvm::Reloc::PIC_, llvm::CodeModel::Default, codeGenOptLevel(optLevel));
+    if (!targetMachine)
+    {
+	std::cout << "ERROR: Unable to create target machine for " << triple << std::endl;
+	return false;
+    }
+    machines[optLevel] = targetMachine;
+    rootModule->setDataLayout(targetMachine->getDataLayout()->getStringRepresentation());
+    return true;
+}
+
+/**
+   Writes rootModule as a native object file for the host, without going through
+   textual IR or an external compiler.
+
+   @param filename Name of the object file to write
+   @return true if the object file was written, false otherwise
+*/
+bool CodeGenContext::emitObject(const char * filename)
+{
+    if (!createTargetMachine())
+    {
+	return false;
+    }
+
+    std::string err;
+    llvm::raw_fd_ostream out(filename, err, llvm::sys::fs::F_Binary);
+    if (!err.empty())
+    {
+	std::cout << "ERROR: Unable to open " << filename << ": " << err << std::endl;
+	return false;
+    }
+    llvm::formatted_raw_ostream fout(out);
+
+    llvm::PassManager pm;
+    pm.add(new llvm::DataLayout(*(targetMachine->getDataLayout())));
+    targetMachine->addAnalysisPasses(pm);
+    if (targetMachine->addPassesToEmitFile(pm, fout, llvm::TargetMachine::CGFT_ObjectFile))
+    {
+	std::cout << "ERROR: Target is unable to emit an object file!" << std::endl;
+	return false;
+    }
+    pm.run(*rootModule);
+    return true;
+}
+
+/**
+   Writes rootModule as an LLVM bitcode file
+
+   @param filename Name of the bitcode file to write
+   @return true if the bitcode file was written, false otherwise
+*/
+bool CodeGenContext::emitBitcode(const char * filename)
+{
+    std::string err;
+    llvm::raw_fd_ostream out(filename, err, llvm::sys::fs::F_Binary);
+    if (!err.empty())
+    {
+	std::cout << "ERROR: Unable to open " << filename << ": " << err << std::endl;
+	return false;
+    }
+    llvm::WriteBitcodeToFile(rootModule, out);
+    return true;
+}
+
+/**
+   Counts the instructions in rootModule
+
+   @return Number of instructions in all function bodies of the module
+*/
+size_t CodeGenContext::instructionCount()
+{
+    size_t count = 0;
+    for (llvm::Module::iterator f = rootModule->begin(); f != rootModule->end(); ++f)
+    {
+	for (llvm::Function::iterator bb = f->begin(); bb != f->end(); ++bb)
+	{
+	    count += bb->size();
+	}
+    }
+    return count;
+}
+
+/**
+   Measures rootModule by serializing it as bitcode in memory
+
+   @return Size of the module's bitcode in bytes
+*/
+size_t CodeGenContext::bitcodeSize()
+{
+    std::string buf;
+    llvm::raw_string_ostream out(buf);
+    llvm::WriteBitcodeToFile(rootModule, out);
+    return out.str().size();
+}
+
+/**
+   Writes rootModule as textual LLVM assembly
+
+   @param filename Name of the .ll file to write
+   @return true if the assembly file was written, false otherwise
+*/
+bool CodeGenContext::emitAssembly(const char * filename)
+{
+    std::string err;
+    llvm::raw_fd_ostream out(filename, err);
+    if (!err.empty())
+    {
+	std::cout << "ERROR: Unable to open " << filename << ": " << err << std::endl;
+	return false;
+    }
+    rootModule->print(out, NULL);
+    return true;
+}
+
+/**
+   Creates an alloca in the entry block of the function currently being generated. mem2reg and
+   SROA only promote allocas found in the entry block, so all locals are placed there instead of
+   in whichever block (e.g. a loop body) declares them.
+
+   @param type LLVM type to allocate
+   @param name Name of the allocated variable
+   @param context CodeGenContext
+   @return The generated llvm::AllocaInst
+*/
+static llvm::AllocaInst * createEntryBlockAlloca(llvm::Type * type, const std::string & name, CodeGenContext & context)
+{
+    llvm::BasicBlock & entry = context.blocks.top()->getParent()->getEntryBlock();
+    if (entry.empty())
+    {
+	return new llvm::AllocaInst(type, name, &entry);
+    }
+    return new llvm::AllocaInst(type, name, &(entry.front()));
 }
 
 /** 
@@ -103,7 +577,7 @@ void CodeGenContext::codeGen(NBlock * rootBlock)
 */
 static inline llvm::CastInst* convertIToFP(llvm::Value * toConvert, CodeGenContext & context)
 {
-    return new llvm::SIToFPInst(toConvert, llvm::Type::getDoubleTy(llvm::getGlobalContext()), "", context.blocks.top());
+    return new llvm::SIToFPInst(toConvert, llvm::Type::getDoubleTy(context.llvmContext), "", context.blocks.top());
 }
 
 /**
@@ -178,47 +652,86 @@ static inline llvm::Value * cmpOpInstCreate(llvm::Instruction::OtherOps i, unsig
 
 
 /**
-   Function to execute a program after it's been generated using the LLVM JIT
-   LLVMInitializeNativeTarget() -- initializes the native target corresponding to the host, useful to ensure target is linked correctly
-   llvm::ExecutionEngine -- abstract interface for implementation execution of LLVM modules
-
-   @return llvm::GenericValue object -- struct data structure
+   Executes the program in-process by compiling rootModule to native code with MCJIT, at the
+   code generation level matching optLevel. The runtime is not linked into the module, since
+   the JIT cannot relocate its thread-local variables; it is loaded as a shared library
+   instead, and the runtime functions are resolved from it, like libc and libm, through the
+   symbols of the cremacc process. The ExecutionEngine takes ownership of rootModule, so
+   nothing else may be done with the module afterwards.
+
+   @param runtime Path to the shared library of the runtime
+   @param argc Number of program arguments
+   @param argv Program arguments, handed to the program's save_args() call
+   @return The program's return value, or -1 if it could not be compiled
 */
-llvm::GenericValue CodeGenContext::runProgram()
+int CodeGenContext::runProgram(const char * runtime, int argc, char ** argv)
 {
     std::string err;
-    LLVMInitializeNativeTarget();
-    llvm::ExecutionEngine *ee = llvm::EngineBuilder(rootModule).setEngineKind(llvm::EngineKind::Interpreter).setErrorStr(&err).create();
+    if (llvm::sys::DynamicLibrary::LoadLibraryPermanently(runtime, &err))
+    {
+	std::cout << "ERROR: Unable to load the runtime " << runtime << ": " << err << std::endl;
+	return -1;
+    }
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::ExecutionEngine *ee = llvm::EngineBuilder(rootModule).setEngineKind(llvm::EngineKind::JIT).setUseMCJIT(true).setOptLevel(codeGenOptLevel(optLevel)).setErrorStr(&err).create();
     if (!ee)
     {
-	std::cout << "Error: " << err << std::endl;
-	exit(-1);
+	std::cout << "ERROR: Unable to create JIT: " << err << std::endl;
+	return -1;
     }
-    
-    llvm::ArrayRef<llvm::GenericValue> noargs;
-    llvm::GenericValue retVal = ee->runFunction(mainFunction, noargs);
-    
-    return retVal;
+    ee->finalizeObject();
+
+    int64_t (*entry)(int64_t, char **) = (int64_t (*)(int64_t, char **)) ee->getPointerToFunction(mainFunction);
+    if (!entry)
+    {
+	std::cout << "ERROR: Unable to JIT compile main()" << std::endl;
+	return -1;
+    }
+    int ret = (int) entry(argc, argv);
+    // The runtime buffers the program's output, and cremacc keeps running after main()
+    void (*flushOutput)() = (void (*)()) llvm::sys::DynamicLibrary::SearchForAddressOfSymbol("crema_flush");
+    if (flushOutput)
+    {
+	flushOutput();
+    }
+    return ret;
 }
 
 /**
-   Looks up a reference to a variable by iterating over the variables vector and searching for the string
-   name of the variable (ident). 
+   Looks up a variable by searching the stack of scopes from the innermost outwards, with a
+   single hash lookup per scope.
 
    @param ident String name of variable
-   @return Pointer to llvm::Value of that variable, NULL if variable not found.
+   @return Pointer to the NVariableDeclaration/llvm::Value pair of that variable, NULL if variable not found.
 */
-llvm::Value * CodeGenContext::findVariable(std::string ident)
+std::pair<NVariableDeclaration *, llvm::Value *> * CodeGenContext::find(const std::string & ident)
 {
-    std::vector<std::map<std::string, std::pair<NVariableDeclaration *, llvm::Value *> > >::reverse_iterator scopes;
+    std::vector<VariableScope>::reverse_iterator scopes;
     for ( scopes = variables.rbegin(); scopes != variables.rend(); scopes++)
-       if ((*scopes).find(ident) != (*scopes).end())
-	      return (*scopes).find(ident)->second.second;
+      {
+	VariableScope::iterator it = (*scopes).find(ident);
+	if (it != (*scopes).end())
+	  return &(it->second);
+      }
     
     std::cout << "Unable to find variable " << ident << "!" << std::endl;
     return NULL;
 }
 
+/**
+   Looks up a reference to a variable by iterating over the variables vector and searching for the string
+   name of the variable (ident). 
+
+   @param ident String name of variable
+   @return Pointer to llvm::Value of that variable, NULL if variable not found.
+*/
+llvm::Value * CodeGenContext::findVariable(const std::string & ident)
+{
+    std::pair<NVariableDeclaration *, llvm::Value *> * var = find(ident);
+    return var ? var->second : NULL;
+}
+
 /**
    Looks up a reference to a variable by iterating over the variables vector and searching for the string
    name of the variable (ident). 
@@ -226,134 +739,912 @@ llvm::Value * CodeGenContext::findVariable(std::string ident)
    @param ident String name of variable
    @return Pointer to NVariableDeclaration of that variable, NULL if variable not found.
 */
-NVariableDeclaration * CodeGenContext::findVariableDeclaration(std::string ident)
+NVariableDeclaration * CodeGenContext::findVariableDeclaration(const std::string & ident)
 {
-    std::vector<std::map<std::string, std::pair<NVariableDeclaration *, llvm::Value *> > >::reverse_iterator scopes;
-    for ( scopes = variables.rbegin(); scopes != variables.rend(); scopes++)
-       if ((*scopes).find(ident) != (*scopes).end())
-	      return (*scopes).find(ident)->second.first;
-    
-    std::cout << "Unable to find variable " << ident << "!" << std::endl;
+    std::pair<NVariableDeclaration *, llvm::Value *> * var = find(ident);
+    return var ? var->first : NULL;
+}
+
+/**
+   Adds a variable name/Value * pair to the stack of scopes
+
+   @param ident String name of variable
+   @param value Pointer to llvm::Value to store
+*/
+void CodeGenContext::addVariable(NVariableDeclaration * var, llvm::Value * value)
+{
+    variables.back()[var->ident.value] = std::make_pair(var, value);
+}
+
+/**
+   An error function for code generation routines
+
+   @param str A string to print as an error message
+   @return NULL llvm:Value pointer
+*/
+llvm::Value * CodeGenError(const char * str)
+{
+    std::cout << "ERROR: " << str << std::endl;
     return NULL;
 }
 
 /**
-   Adds a variable name/Value * pair to the stack of scopes
+   Iterates over the StatementList statements vector (typedef std::vector<NStatement*> StatementList) and
+   returns a pointer to the last statement in the context.
+
+   @param CodeGenContext & context -- reference to the context of the operator statement
+   @return llvm::Value * -- Pointer to the last statement in the codeGen(context)
+*/
+llvm::Value * NBlock::codeGen(CodeGenContext & context)
+{
+    llvm::Value * last;
+    context.ownedLists.push_back(std::vector<llvm::Value *>());
+    for (auto it : statements)
+      {
+        last = (it)->codeGen(context);
+	if (context.debugScope)
+	    context.setDebugLocations(context.blocks.top()->getParent(), it->lineno);
+      }
+    // Blocks ending in a return or break have freed their lists already
+    if (!context.blocks.top()->getTerminator())
+	context.freeLists(context.ownedLists.size() - 1);
+    context.ownedLists.pop_back();
+
+    return last;
+}
+
+/**
+   Generates code to declare a structure. This will take the format of the structure and create a new
+   LLVM StructType which is later used in the codeGen method for NVariableDeclaration.
+
+   @param context CodeGenContext parameter
+   @return Returns nothing concretely, but adds the structure type to the struct map
+*/
+llvm::Value * NStructureDeclaration::codeGen(CodeGenContext & context)
+{
+  std::vector<llvm::Type *> vec;
+  for (int i = 0; i < members.size(); i++)
+    {
+      vec.push_back(members[i]->type.toLlvmType(context.llvmContext));
+    }
+  llvm::ArrayRef<llvm::Type *> mems(vec);
+  context.structs[ident.value] = std::make_pair(this, llvm::StructType::create(context.llvmContext, mems, ident.value, false));
+}
+
+/**
+   Loads a field of a runtime list_t through CodeGenContext::listType
+
+   @param list Pointer to the list, as returned by the list_create family of stdlib functions
+   @param field Index of the field to load, see ListFields
+   @param bb BasicBlock to insert the instructions into
+   @param context CodeGenContext
+   @return The loaded field
+*/
+static llvm::Value * loadListField(llvm::Value * list, int field, llvm::BasicBlock * bb, CodeGenContext & context)
+{
+    llvm::Value * lp = new llvm::BitCastInst(list, llvm::PointerType::get(context.listType, 0), "", bb);
+    std::vector<llvm::Value *> vec;
+    vec.push_back(llvm::ConstantInt::get(context.llvmContext, llvm::APInt(32, 0, true)));
+    vec.push_back(llvm::ConstantInt::get(context.llvmContext, llvm::APInt(32, field, true)));
+    llvm::ArrayRef<llvm::Value *> arr(vec);
+    llvm::Value * gep = llvm::GetElementPtrInst::Create(lp, arr, "", bb);
+    return new llvm::LoadInst(gep, "", false, bb);
+}
+
+/**
+   Generates the address of a list element directly from the list's backing array, without any
+   bounds checking
+
+   @param arr The arr field of the list
+   @param idx Index of the element
+   @param elemType LLVM type of the list elements
+   @param bb BasicBlock to insert the instructions into
+   @return Pointer to the element
+*/
+static llvm::Value * listElementPtr(llvm::Value * arr, llvm::Value * idx, llvm::Type * elemType, llvm::BasicBlock * bb)
+{
+    llvm::Value * typed = new llvm::BitCastInst(arr, llvm::PointerType::get(elemType, 0), "", bb);
+    llvm::GetElementPtrInst * gep = llvm::GetElementPtrInst::Create(typed, idx, "", bb);
+    gep->setIsInBounds(true);
+    return gep;
+}
+
+/**
+   Branches to the out-of-bounds path of an inline list access if the list is NULL, as
+   returned by str_substr() for a start past the end of the string
+
+   @param list Pointer to the list
+   @param oobBlock BasicBlock calling the runtime, which reports the error and exits
+   @param context CodeGenContext
+   @return BasicBlock to continue the access in, where the list is not NULL
+*/
+static llvm::BasicBlock * generateNullCheck(llvm::Value * list, llvm::BasicBlock * oobBlock, CodeGenContext & context)
+{
+    llvm::BasicBlock * checkBlock = llvm::BasicBlock::Create(context.llvmContext, "listcheck", context.blocks.top()->getParent());
+    llvm::Value * null = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(list->getType()));
+    llvm::Value * isNull = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ, list, null, "", context.blocks.top());
+    llvm::BranchInst * br = llvm::BranchInst::Create(oobBlock, checkBlock, isNull, context.blocks.top());
+    br->setMetadata(llvm::LLVMContext::MD_prof, llvm::MDBuilder(context.llvmContext).createBranchWeights(1, 2000));
+    return checkBlock;
+}
+
+/**
+   Generates an inline retrieval of a list element. The NULL and length checks and the element
+   load are emitted directly; the stdlib retrieve function is only called on the (unlikely)
+   out-of-bounds path, where it reports the error and exits.
+
+   @param list Pointer to the list
+   @param idx Index of the element
+   @param tc Typecode of the list elements
+   @param context CodeGenContext
+   @return The element, or NULL if lists of the given type cannot be accessed
+*/
+static llvm::Value * generateListRetrieve(llvm::Value * list, llvm::Value * idx, TypeCodes tc, CodeGenContext & context)
+{
+    std::string name;
+    switch (tc)
+      {
+      case INT:
+	name = "int_list_retrieve";
+	break;
+      case DOUBLE:
+	name = "double_list_retrieve";
+	break;
+      case CHAR:
+      case STRING:
+	name = "str_retrieve";
+	break;
+      default:
+	return NULL;
+      }
+    llvm::Function *func = context.rootModule->getFunction(name.c_str());
+    std::vector<llvm::Value *> v;
+    v.push_back(list);
+    v.push_back(idx);
+    llvm::ArrayRef<llvm::Value *> llvmargs(v);
+    if (context.useCounters)
+      {
+	// Every retrieval goes through the runtime so that it is counted
+	return llvm::CallInst::Create(func, llvmargs, "", context.blocks.top());
+      }
+
+    llvm::Type * elemType = func->getReturnType();
+    llvm::Function * parent = context.blocks.top()->getParent();
+    llvm::BasicBlock * fastBlock = llvm::BasicBlock::Create(context.llvmContext, "listaccess", parent);
+    llvm::BasicBlock * oobBlock = llvm::BasicBlock::Create(context.llvmContext, "listoob", parent);
+    llvm::BasicBlock * contBlock = llvm::BasicBlock::Create(context.llvmContext, "listcont", parent);
+
+    llvm::BasicBlock * checkBlock = generateNullCheck(list, oobBlock, context);
+    // Unsigned compare so negative indices are also out of bounds
+    llvm::Value * len = loadListField(list, LIST_LEN, checkBlock, context);
+    llvm::Value * inBounds = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_ULT, idx, len, "", checkBlock);
+    llvm::BranchInst * br = llvm::BranchInst::Create(fastBlock, oobBlock, inBounds, checkBlock);
+    br->setMetadata(llvm::LLVMContext::MD_prof, llvm::MDBuilder(context.llvmContext).createBranchWeights(2000, 1));
+
+    llvm::Value * arr = loadListField(list, LIST_ARR, fastBlock, context);
+    llvm::Value * elem = new llvm::LoadInst(listElementPtr(arr, idx, elemType, fastBlock), "", false, fastBlock);
+    llvm::BranchInst::Create(contBlock, fastBlock);
+
+    llvm::Value * checked = llvm::CallInst::Create(func, llvmargs, "", oobBlock);
+    llvm::BranchInst::Create(contBlock, oobBlock);
+
+    context.blocks.push(contBlock);
+    context.Builder->SetInsertPoint(contBlock);
+    llvm::PHINode * pn = llvm::PHINode::Create(elemType, 2, "", contBlock);
+    pn->addIncoming(elem, fastBlock);
+    pn->addIncoming(checked, oobBlock);
+    return pn;
+}
+
+/**
+   Looks up a runtime function that is not part of the Crema stdlib, declaring it on first use
+
+   @param name Name of the runtime function
+   @param ft Type of the runtime function
+   @param context CodeGenContext
+   @return The function
+*/
+static llvm::Function * runtimeFunction(const char * name, llvm::FunctionType * ft, CodeGenContext & context)
+{
+    llvm::Function * func = context.rootModule->getFunction(name);
+    if (!func)
+	func = llvm::Function::Create(ft, llvm::GlobalValue::ExternalLinkage, name, context.rootModule);
+    return func;
+}
+
+/**
+   Frees the lists owned by the variables of the innermost blocks being left, see
+   EscapeAnalysis. list_free() leaves alone the lists of regions and the elements
+   borrowed from or by other lists.
+
+   @param depth Number of the outer blocks of the function that are not left
+*/
+void CodeGenContext::freeLists(size_t depth)
+{
+    llvm::Type * i8p = llvm::Type::getInt8PtrTy(llvmContext);
+    llvm::FunctionType * ft = llvm::FunctionType::get(llvm::Type::getVoidTy(llvmContext), i8p, false);
+    for (size_t i = depth; i < ownedLists.size(); i++)
+      {
+	for (auto var : ownedLists[i])
+	  {
+	    llvm::Value * list = new llvm::LoadInst(var, "", false, blocks.top());
+	    llvm::CallInst::Create(runtimeFunction("list_free", ft, *this), list, "", blocks.top());
+	  }
+      }
+}
+
+/**
+   Declares the runtime list_element function, which returns a pointer to a list element
+
+   @param context CodeGenContext
+   @return The function
+*/
+static llvm::Function * listElementFunction(CodeGenContext & context)
+{
+    llvm::Type * i8p = llvm::Type::getInt8PtrTy(context.llvmContext);
+    std::vector<llvm::Type *> params(1, i8p);
+    params.push_back(llvm::Type::getInt64Ty(context.llvmContext));
+    return runtimeFunction("list_element", llvm::FunctionType::get(i8p, params, false), context);
+}
+
+/**
+   Generates the address of a member of a structure. For struct-of-arrays lists this is the
+   address of the list holding the member of every element.
+
+   @param var Pointer to the structure
+   @param member Index of the member
+   @param bb BasicBlock to insert the instructions into
+   @param context CodeGenContext
+   @return Pointer to the member
+*/
+static llvm::Value * memberPtr(llvm::Value * var, int member, llvm::BasicBlock * bb, CodeGenContext & context)
+{
+    std::vector<llvm::Value *> vec;
+    vec.push_back(llvm::ConstantInt::get(context.llvmContext, llvm::APInt(32, 0, true)));
+    vec.push_back(llvm::ConstantInt::get(context.llvmContext, llvm::APInt(32, member, true)));
+    llvm::ArrayRef<llvm::Value *> arr(vec);
+    return llvm::GetElementPtrInst::Create(var, arr, "", bb);
+}
+
+/**
+   Finds the index of a structure member
+
+   @param member Name of the member
+   @param sd Declaration of the structure
+   @return Index of the member in the structure
+*/
+static int memberIndex(NIdentifier & member, NStructureDeclaration * sd)
+{
+    int i;
+    for (i = 0; i < sd->members.size(); i++)
+      {
+	if (member == sd->members[i]->ident)
+	  break;
+      }
+    return i;
+}
+
+/**
+   Generates an inline, bounds-checked address computation of a list element, for the lists whose
+   elements are accessed in place. As in generateListRetrieve, the runtime list_element function
+   is only called on the out-of-bounds path, where it reports the error and exits.
+
+   @param list Pointer to the list
+   @param idx Index of the element
+   @param elemType LLVM type of the list elements
+   @param context CodeGenContext
+   @return Pointer to the element
+*/
+static llvm::Value * generateElementPtr(llvm::Value * list, llvm::Value * idx, llvm::Type * elemType, CodeGenContext & context)
+{
+    llvm::Function * func = listElementFunction(context);
+    llvm::Type * ptrType = llvm::PointerType::get(elemType, 0);
+    std::vector<llvm::Value *> v;
+    v.push_back(list);
+    v.push_back(idx);
+    if (context.useCounters)
+      {
+	llvm::Value * p = llvm::CallInst::Create(func, v, "", context.blocks.top());
+	return new llvm::BitCastInst(p, ptrType, "", context.blocks.top());
+      }
+
+    llvm::Function * parent = context.blocks.top()->getParent();
+    llvm::BasicBlock * fastBlock = llvm::BasicBlock::Create(context.llvmContext, "listaccess", parent);
+    llvm::BasicBlock * oobBlock = llvm::BasicBlock::Create(context.llvmContext, "listoob", parent);
+    llvm::BasicBlock * contBlock = llvm::BasicBlock::Create(context.llvmContext, "listcont", parent);
+
+    llvm::BasicBlock * checkBlock = generateNullCheck(list, oobBlock, context);
+    llvm::Value * len = loadListField(list, LIST_LEN, checkBlock, context);
+    llvm::Value * inBounds = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_ULT, idx, len, "", checkBlock);
+    llvm::BranchInst * br = llvm::BranchInst::Create(fastBlock, oobBlock, inBounds, checkBlock);
+    br->setMetadata(llvm::LLVMContext::MD_prof, llvm::MDBuilder(context.llvmContext).createBranchWeights(2000, 1));
+
+    llvm::Value * arr = loadListField(list, LIST_ARR, fastBlock, context);
+    llvm::Value * ep = listElementPtr(arr, idx, elemType, fastBlock);
+    llvm::BranchInst::Create(contBlock, fastBlock);
+
+    llvm::Value * checked = new llvm::BitCastInst(llvm::CallInst::Create(func, v, "", oobBlock), ptrType, "", oobBlock);
+    llvm::BranchInst::Create(contBlock, oobBlock);
+
+    context.blocks.push(contBlock);
+    context.Builder->SetInsertPoint(contBlock);
+    llvm::PHINode * pn = llvm::PHINode::Create(ptrType, 2, "", contBlock);
+    pn->addIncoming(ep, fastBlock);
+    pn->addIncoming(checked, oobBlock);
+    return pn;
+}
+
+/**
+   Gets the LLVM type of a variable holding a list of structures. A list stored contiguously is a
+   runtime list whose elements are the structures; a struct-of-arrays list is a structure of one
+   runtime list per member.
+
+   @param st Type of the list
+   @param context CodeGenContext
+   @return LLVM type of the variable
+*/
+static llvm::Type * structListType(StructType & st, CodeGenContext & context)
+{
+    llvm::Type * i8p = llvm::Type::getInt8PtrTy(context.llvmContext);
+    if (!st.soa)
+      return i8p;
+    NStructureDeclaration * sd = context.structs[st.ident.value].first;
+    std::vector<llvm::Type *> cols(sd->members.size(), i8p);
+    return llvm::StructType::get(context.llvmContext, cols);
+}
+
+/**
+   Generates the creation of an empty list of structures. The element size of a contiguous list
+   is the size of the structure, each list of a struct-of-arrays list holds one member.
+
+   @param st Type of the list
+   @param var Pointer to the list variable
+   @param context CodeGenContext
+*/
+static void createStructList(StructType & st, llvm::Value * var, CodeGenContext & context)
+{
+    llvm::Type * i8p = llvm::Type::getInt8PtrTy(context.llvmContext);
+    std::vector<llvm::Type *> params(1, llvm::Type::getInt64Ty(context.llvmContext));
+    llvm::Function * func = runtimeFunction("list_create", llvm::FunctionType::get(i8p, params, false), context);
+    NStructureDeclaration * sd = context.structs[st.ident.value].first;
+    if (!st.soa)
+      {
+	llvm::Value * es = llvm::ConstantExpr::getSizeOf(context.structs[st.ident.value].second);
+	new llvm::StoreInst(llvm::CallInst::Create(func, es, "", context.blocks.top()), var, false, context.blocks.top());
+	return;
+      }
+    for (int i = 0; i < sd->members.size(); i++)
+      {
+	llvm::Value * es = llvm::ConstantExpr::getSizeOf(sd->members[i]->type.toLlvmType(context.llvmContext));
+	llvm::Value * col = llvm::CallInst::Create(func, es, "", context.blocks.top());
+	new llvm::StoreInst(col, memberPtr(var, i, context.blocks.top(), context), false, context.blocks.top());
+      }
+}
+
+/**
+   Generates the address of a member of an element of a list of structures. Reads are bounds
+   checked inline, writes go through list_element, which gives the list an array of its own first.
+
+   @param vd Declaration of the list variable
+   @param var Pointer to the list variable
+   @param member Name of the member
+   @param idx Index of the element
+   @param write Whether the member is stored to
+   @param context CodeGenContext
+   @return Pointer to the member
+*/
+static llvm::Value * structListMemberPtr(NVariableDeclaration * vd, llvm::Value * var, NIdentifier & member, llvm::Value * idx, bool write, CodeGenContext & context)
+{
+    StructType * st = (StructType *) &(vd->type);
+    NStructureDeclaration * sd = context.structs[st->ident.value].first;
+    int i = memberIndex(member, sd);
+    llvm::Type * elemType = st->soa ? sd->members[i]->type.toLlvmType(context.llvmContext) : context.structs[st->ident.value].second;
+    llvm::Value * list = new llvm::LoadInst(st->soa ? memberPtr(var, i, context.blocks.top(), context) : var, "", false, context.blocks.top());
+    llvm::Value * ep;
+    if (write)
+      {
+	std::vector<llvm::Value *> v;
+	v.push_back(list);
+	v.push_back(idx);
+	ep = new llvm::BitCastInst(llvm::CallInst::Create(listElementFunction(context), v, "", context.blocks.top()), llvm::PointerType::get(elemType, 0), "", context.blocks.top());
+      }
+    else
+      {
+	ep = generateElementPtr(list, idx, elemType, context);
+      }
+    return st->soa ? ep : memberPtr(ep, i, context.blocks.top(), context);
+}
+
+/**
+   Collects the members of a structure variable used by a piece of code. Using the variable as a
+   whole, e.g. appending it to a list, uses all of its members.
+
+   @param node Node to search, may be NULL
+   @param var Name of the structure variable
+   @param sd Declaration of the structure
+   @param used Whether each member of the structure is used
+*/
+static void structMembersUsed(Node * node, NIdentifier & var, NStructureDeclaration * sd, std::vector<bool> & used)
+{
+    if (!node)
+      return;
+    if (NBlock * b = dynamic_cast<NBlock *>(node))
+      {
+	for (auto it : b->statements)
+	  structMembersUsed(it, var, sd, used);
+      }
+    else if (NStructureAssignmentStatement * sa = dynamic_cast<NStructureAssignmentStatement *>(node))
+      {
+	structMembersUsed(&sa->structure, var, sd, used);
+	structMembersUsed(&sa->expr, var, sd, used);
+      }
+    else if (NListAssignmentStatement * la = dynamic_cast<NListAssignmentStatement *>(node))
+      {
+	structMembersUsed(la->list.index, var, sd, used);
+	structMembersUsed(&la->expr, var, sd, used);
+      }
+    else if (NAssignmentStatement * as = dynamic_cast<NAssignmentStatement *>(node))
+      {
+	structMembersUsed(&as->expr, var, sd, used);
+      }
+    else if (NVariableDeclaration * vd = dynamic_cast<NVariableDeclaration *>(node))
+      {
+	structMembersUsed(vd->initializationExpression, var, sd, used);
+      }
+    else if (NIfStatement * is = dynamic_cast<NIfStatement *>(node))
+      {
+	structMembersUsed(&is->condition, var, sd, used);
+	structMembersUsed(&is->thenblock, var, sd, used);
+	structMembersUsed(is->elseblock, var, sd, used);
+	structMembersUsed(is->elseif, var, sd, used);
+      }
+    else if (NLoopStatement * ls = dynamic_cast<NLoopStatement *>(node))
+      {
+	structMembersUsed(&ls->loopBlock, var, sd, used);
+      }
+    else if (NRangeLoopStatement * rl = dynamic_cast<NRangeLoopStatement *>(node))
+      {
+	structMembersUsed(&rl->start, var, sd, used);
+	structMembersUsed(&rl->end, var, sd, used);
+	structMembersUsed(&rl->loopBlock, var, sd, used);
+      }
+    else if (NReturn * ret = dynamic_cast<NReturn *>(node))
+      {
+	structMembersUsed(&ret->retExpr, var, sd, used);
+      }
+    else if (NBinaryOperator * op = dynamic_cast<NBinaryOperator *>(node))
+      {
+	structMembersUsed(&op->lhs, var, sd, used);
+	structMembersUsed(&op->rhs, var, sd, used);
+      }
+    else if (NFunctionCall * fc = dynamic_cast<NFunctionCall *>(node))
+      {
+	for (auto it : fc->args)
+	  structMembersUsed(it, var, sd, used);
+      }
+    else if (NList * l = dynamic_cast<NList *>(node))
+      {
+	for (auto it : l->value)
+	  structMembersUsed(it, var, sd, used);
+      }
+    else if (NListAccess * la = dynamic_cast<NListAccess *>(node))
+      {
+	structMembersUsed(la->index, var, sd, used);
+      }
+    else if (NStructureAccess * sa = dynamic_cast<NStructureAccess *>(node))
+      {
+	if (!sa->index && sa->ident == var)
+	  used[memberIndex(sa->member, sd)] = true;
+	structMembersUsed(sa->index, var, sd, used);
+      }
+    else if (NVariableAccess * va = dynamic_cast<NVariableAccess *>(node))
+      {
+	if (va->ident == var)
+	  used.assign(used.size(), true);
+      }
+    else if (NIdentifier * id = dynamic_cast<NIdentifier *>(node))
+      {
+	// Structure variables are initialized from an identifier
+	if (*id == var)
+	  used.assign(used.size(), true);
+      }
+}
+
+/**
+   State of a search of a loop body by modifiesAlias()
+*/
+struct AliasSearch {
+    std::unordered_map<const std::string *, NVariableDeclaration *> decls; /**< Variables declared so far in the function body being searched */
+    bool inCallee; /**< Searching a called function, whose undeclared names refer to globals rather than to the loop's variables */
+    std::unordered_map<NFunctionDeclaration *, bool> * callees; /**< Functions searched so far for the loop, with the result */
+};
+
+/**
+   Checks whether a loop body may change a list through a variable other than the loop's own,
+   as in int m[] = l followed by foreach (l as x) { int_list_append(m, x) }. A change of any
+   list that may be the same list (see NVariableDeclaration::mayShareList) counts, as does
+   passing it to a Crema function, whose body is searched as well, or to a runtime function.
+   Each function is searched once per loop, however many calls reach it.
+
+   @param node Node to search, may be NULL
+   @param list Declaration of the list the loop iterates over
+   @param search Declarations and searched functions of the function body being searched
+   @param context CodeGenContext, used to look up the variables in scope
+   @return true if the node may change the loop's list through another variable
+*/
+static bool modifiesAlias(Node * node, NVariableDeclaration * list, AliasSearch & search, CodeGenContext & context)
+{
+    auto shares = [&](NIdentifier & ident) {
+	auto it = search.decls.find(&ident.value);
+	NVariableDeclaration * vd = NULL;
+	if (it != search.decls.end())
+	  {
+	    vd = it->second;
+	  }
+	else if (!search.inCallee)
+	  {
+	    vd = context.findVariableDeclaration(ident.value);
+	  }
+	else
+	  {
+	    VariableScope & globals = context.variables.front();
+	    VariableScope::iterator g = globals.find(ident.value);
+	    vd = (g != globals.end()) ? g->second.first : NULL;
+	  }
+	return vd != list && list->mayShareList(vd);
+    };
+    if (!node)
+      {
+	return false;
+      }
+    if (NBlock * b = dynamic_cast<NBlock *>(node))
+      {
+	for (auto it : b->statements)
+	  if (modifiesAlias(it, list, search, context))
+	    return true;
+      }
+    else if (NVariableDeclaration * vd = dynamic_cast<NVariableDeclaration *>(node))
+      {
+	search.decls[&vd->ident.value] = vd;
+	return modifiesAlias(vd->initializationExpression, list, search, context);
+      }
+    else if (NListAssignmentStatement * la = dynamic_cast<NListAssignmentStatement *>(node))
+      {
+	return shares(la->ident) || modifiesAlias(la->list.index, list, search, context) || modifiesAlias(&la->expr, list, search, context);
+      }
+    else if (NStructureAssignmentStatement * sa = dynamic_cast<NStructureAssignmentStatement *>(node))
+      {
+	return (sa->structure.index && shares(sa->ident)) || modifiesAlias(sa->structure.index, list, search, context) || modifiesAlias(&sa->expr, list, search, context);
+      }
+    else if (NAssignmentStatement * as = dynamic_cast<NAssignmentStatement *>(node))
+      {
+	// Reassigning a variable leaves the list it referred to alone
+	return modifiesAlias(&as->expr, list, search, context);
+      }
+    else if (NIfStatement * is = dynamic_cast<NIfStatement *>(node))
+      {
+	return modifiesAlias(&is->condition, list, search, context) || modifiesAlias(&is->thenblock, list, search, context) ||
+	  modifiesAlias(is->elseblock, list, search, context) || modifiesAlias(is->elseif, list, search, context);
+      }
+    else if (NLoopStatement * ls = dynamic_cast<NLoopStatement *>(node))
+      {
+	return modifiesAlias(&ls->loopBlock, list, search, context);
+      }
+    else if (NRangeLoopStatement * rl = dynamic_cast<NRangeLoopStatement *>(node))
+      {
+	return modifiesAlias(&rl->start, list, search, context) || modifiesAlias(&rl->end, list, search, context) || modifiesAlias(&rl->loopBlock, list, search, context);
+      }
+    else if (NReturn * ret = dynamic_cast<NReturn *>(node))
+      {
+	return modifiesAlias(&ret->retExpr, list, search, context);
+      }
+    else if (NBinaryOperator * op = dynamic_cast<NBinaryOperator *>(node))
+      {
+	return modifiesAlias(&op->lhs, list, search, context) || modifiesAlias(&op->rhs, list, search, context);
+      }
+    else if (NList * l = dynamic_cast<NList *>(node))
+      {
+	for (auto it : l->value)
+	  if (modifiesAlias(it, list, search, context))
+	    return true;
+      }
+    else if (NListAccess * la = dynamic_cast<NListAccess *>(node))
+      {
+	return modifiesAlias(la->index, list, search, context);
+      }
+    else if (NStructureAccess * sa = dynamic_cast<NStructureAccess *>(node))
+      {
+	return modifiesAlias(sa->index, list, search, context);
+      }
+    else if (NFunctionCall * fc = dynamic_cast<NFunctionCall *>(node))
+      {
+	for (auto it : fc->args)
+	  {
+	    NVariableAccess * va = dynamic_cast<NVariableAccess *>(it);
+	    if ((va && shares(va->ident)) || modifiesAlias(it, list, search, context))
+	      return true;
+	  }
+	NFunctionDeclaration * func = context.semantics->searchFuncs(fc->ident);
+	if (func && func->body)
+	  {
+	    auto known = search.callees->find(func);
+	    if (known != search.callees->end())
+	      return known->second;
+	    AliasSearch callee;
+	    callee.inCallee = true;
+	    callee.callees = search.callees;
+	    for (auto it : func->variables)
+	      callee.decls[&it->ident.value] = it;
+	    bool modifies = modifiesAlias(func->body, list, callee, context);
+	    (*search.callees)[func] = modifies;
+	    return modifies;
+	  }
+      }
+    return false;
+}
+
+/**
+   Attaches llvm.loop metadata hinting the loop vectorizer to the latch branch of a loop
 
-   @param ident String name of variable
-   @param value Pointer to llvm::Value to store
+   @param latch The branch instruction that jumps back to the loop header
 */
-void CodeGenContext::addVariable(NVariableDeclaration * var, llvm::Value * value)
+static void addVectorizeHint(llvm::BranchInst * latch)
 {
-    variables.back()[var->ident.value] = *(new std::pair<NVariableDeclaration *, llvm::Value *>(var, value));
+    llvm::LLVMContext & ctx = latch->getContext();
+    llvm::Value * hint[] = { llvm::MDString::get(ctx, "llvm.vectorizer.enable"), llvm::ConstantInt::get(llvm::Type::getInt1Ty(ctx), 1) };
+    // The loop ID is a distinct, self-referential node
+    llvm::MDNode * tmp = llvm::MDNode::getTemporary(ctx, llvm::ArrayRef<llvm::Value *>());
+    llvm::Value * ops[] = { tmp, llvm::MDNode::get(ctx, hint) };
+    llvm::MDNode * loopID = llvm::MDNode::get(ctx, ops);
+    loopID->replaceOperandWith(0, loopID);
+    llvm::MDNode::deleteTemporary(tmp);
+    latch->setMetadata("llvm.loop", loopID);
 }
 
 /**
-   An error function for code generation routines
+   Checks whether an expression reads a variable
 
-   @param str A string to print as an error message
-   @return NULL llvm:Value pointer
+   @param expr Expression to check
+   @param ident Name of the variable
+   @return true if the expression is an access of the variable
 */
-llvm::Value * CodeGenError(const char * str)
+static bool accessesVariable(NExpression & expr, NIdentifier & ident)
 {
-    std::cout << "ERROR: " << str << std::endl;
-    return NULL;
+    NVariableAccess * va = dynamic_cast<NVariableAccess *>(&expr);
+    return va && !expr.folded && va->ident == ident;
 }
 
 /**
-   Iterates over the StatementList statements vector (typedef std::vector<NStatement*> StatementList) and
-   returns a pointer to the last statement in the context.
-
-   @param CodeGenContext & context -- reference to the context of the operator statement
-   @return llvm::Value * -- Pointer to the last statement in the codeGen(context)
+   Generates a call to a runtime reduction for a foreach loop over a list of int whose body
+   only accumulates the elements into an int variable. The body acc = acc + x (or x + acc)
+   becomes int_list_sum(), and if (x < acc) { acc = x } with any strict or non-strict
+   comparison in either order becomes int_list_min() or int_list_max(). Integer addition
+   wraps and the comparisons are exact, so the accumulator ends up with the same value as
+   after running the loop. Loops over lists of double are not rewritten, since the runtime
+   adds doubles in a different order than the loop would, and neither are loops compiled
+   with -counters, whose retrievals are counted.
+
+   @param loop The NLoopStatement to generate
+   @param context Reference of the CodeGenContext
+   @return The store to the accumulator, or NULL if the loop is not a reduction
 */
-llvm::Value * NBlock::codeGen(CodeGenContext & context)
+static llvm::Value * generateListReduction(NLoopStatement & loop, CodeGenContext & context)
 {
-    llvm::Value * last;
-    for (auto it : statements)
-        last = (it)->codeGen(context);
+    NVariableDeclaration * ld = context.findVariableDeclaration(loop.list.value);
+    if (context.useCounters || !ld || ld->type.isStruct || ld->type.typecode != INT || loop.loopBlock.statements.size() != 1)
+	return NULL;
+    NStatement * s = loop.loopBlock.statements[0];
+    NAssignmentStatement * as = NULL;
+    const char * name = NULL;
+    // Comparison of the reduced value with the accumulator deciding which is kept, none for sums
+    llvm::CmpInst::Predicate pred = llvm::CmpInst::BAD_ICMP_PREDICATE;
+    if (typeid(*s) == typeid(NAssignmentStatement))
+      {
+	as = (NAssignmentStatement *) s;
+	NBinaryOperator * bo = dynamic_cast<NBinaryOperator *>(&as->expr);
+	if (bo && !bo->folded && bo->op == TADD &&
+	    ((accessesVariable(bo->lhs, as->ident) && accessesVariable(bo->rhs, loop.asVar)) ||
+	     (accessesVariable(bo->lhs, loop.asVar) && accessesVariable(bo->rhs, as->ident))))
+	  name = "int_list_sum";
+      }
+    else if (NIfStatement * is = dynamic_cast<NIfStatement *>(s))
+      {
+	NBinaryOperator * cmp = dynamic_cast<NBinaryOperator *>(&is->condition);
+	NStatement * t = is->thenblock.statements.size() == 1 ? is->thenblock.statements[0] : NULL;
+	if (cmp && !cmp->folded && !is->elseblock && !is->elseif && t && typeid(*t) == typeid(NAssignmentStatement))
+	  {
+	    as = (NAssignmentStatement *) t;
+	    bool less = cmp->op == TCLT || cmp->op == TCLE;
+	    bool elemFirst = accessesVariable(cmp->lhs, loop.asVar) && accessesVariable(cmp->rhs, as->ident);
+	    bool accFirst = accessesVariable(cmp->lhs, as->ident) && accessesVariable(cmp->rhs, loop.asVar);
+	    if (accessesVariable(as->expr, loop.asVar) && (less || cmp->op == TCGT || cmp->op == TCGE) && (elemFirst || accFirst))
+	      {
+		// x < acc keeps the smallest element, acc < x the largest
+		bool min = less == elemFirst;
+		name = min ? "int_list_min" : "int_list_max";
+		pred = min ? llvm::CmpInst::ICMP_SLT : llvm::CmpInst::ICMP_SGT;
+	      }
+	  }
+      }
+    NVariableDeclaration * acc = (name && !(as->ident == loop.asVar)) ? context.findVariableDeclaration(as->ident.value) : NULL;
+    if (!acc || acc->type.isList || acc->type.isStruct || acc->type.typecode != INT)
+	return NULL;
 
-    return last;
-}
+    if (context.verbose)
+      std::cout << "Generating " << name << " for loop over " << loop.list.value << std::endl;
+    llvm::Function * func = context.rootModule->getFunction(name);
+    llvm::Value * var = context.findVariable(as->ident.value);
+    llvm::Value * li = new llvm::LoadInst(context.findVariable(loop.list.value), "", false, context.blocks.top());
+    llvm::Value * reduced;
+    if (pred == llvm::CmpInst::BAD_ICMP_PREDICATE)
+      {
+	llvm::Value * sum = llvm::CallInst::Create(func, li, "", context.blocks.top());
+	llvm::Value * cur = new llvm::LoadInst(var, "", false, context.blocks.top());
+	reduced = llvm::BinaryOperator::Create(llvm::Instruction::Add, cur, sum, "", context.blocks.top());
+	return new llvm::StoreInst(reduced, var, false, context.blocks.top());
+      }
 
-/**
-   Generates code to declare a structure. This will take the format of the structure and create a new
-   LLVM StructType which is later used in the codeGen method for NVariableDeclaration.
+    // The runtime aborts on an empty list, for which the loop leaves the accumulator alone
+    llvm::Function * parent = context.blocks.top()->getParent();
+    llvm::BasicBlock * reduceBlock = llvm::BasicBlock::Create(context.llvmContext, "reduceblock", parent);
+    llvm::BasicBlock * doneBlock = llvm::BasicBlock::Create(context.llvmContext, "reducedoneblock", parent);
+    llvm::Value * len = loadListField(li, LIST_LEN, context.blocks.top(), context);
+    llvm::Value * empty = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ, len, llvm::ConstantInt::get(llvm::Type::getInt64Ty(context.llvmContext), 0), "", context.blocks.top());
+    llvm::BranchInst::Create(doneBlock, reduceBlock, empty, context.blocks.top());
+
+    context.blocks.push(reduceBlock);
+    llvm::Value * ext = llvm::CallInst::Create(func, li, "", reduceBlock);
+    llvm::Value * cur = new llvm::LoadInst(var, "", false, reduceBlock);
+    llvm::Value * better = llvm::CmpInst::Create(llvm::Instruction::ICmp, pred, ext, cur, "", reduceBlock);
+    reduced = llvm::SelectInst::Create(better, ext, cur, "", reduceBlock);
+    llvm::Value * store = new llvm::StoreInst(reduced, var, false, reduceBlock);
+    llvm::BranchInst::Create(doneBlock, reduceBlock);
+    context.blocks.pop();
 
-   @param context CodeGenContext parameter
-   @return Returns nothing concretely, but adds the structure type to the struct map
-*/
-llvm::Value * NStructureDeclaration::codeGen(CodeGenContext & context)
-{
-  std::vector<llvm::Type *> vec;
-  for (int i = 0; i < members.size(); i++)
-    {
-      vec.push_back(members[i]->type.toLlvmType());
-    }
-  llvm::ArrayRef<llvm::Type *> mems(vec);
-  structs[ident.value] = *(new std::pair<NStructureDeclaration *, llvm::StructType *>(this, llvm::StructType::create(llvm::getGlobalContext(), mems, ident.value, false)));
+    context.blocks.push(doneBlock);
+    context.Builder->SetInsertPoint(context.blocks.top());
+    return store;
 }
 
 /**
-   Generates code for looping constructs
+   Generates code for looping constructs. The list header is loaded once in the pre-block and
+   the loop counter is a phi node, so the counter is known to be within [0, list_length) and
+   elements are loaded straight from the backing array. If the loop body may modify the list
+   (see Node::modifiesList), directly or through another variable referring to it (see
+   modifiesAlias()), the backing array may move, so the element is instead fetched through
+   the bounds-checked access path on each iteration, as it is with -counters so that the
+   runtime counts every retrieval. For lists of structures only
+   the members the loop body uses are copied into the loop variable, so a loop over a
+   struct-of-arrays list only streams through the lists of those members. Loops that only
+   reduce a list of int into a variable are replaced with a runtime call, see
+   generateListReduction().
 
    @param context Reference of the CodeGenContext
    @return llvm::Value * pointing to the generated instructions
 */
 llvm::Value * NLoopStatement::codeGen(CodeGenContext & context)
 {
-    NIdentifier * itIdent = new NIdentifier("loopItCnter");
-    NIdentifier * maxIdent = new NIdentifier("loopItMax");
+    llvm::Value * reduction = generateListReduction(*this, context);
+    if (reduction)
+	return reduction;
     NVariableDeclaration * loop = context.findVariableDeclaration(list.value);
-    NVariableDeclaration * loopVar = new NVariableDeclaration(*(new Type(loop->type, false)), asVar, NULL);
-    NVariableDeclaration * itNum = new NVariableDeclaration(*(new Type(TTINT)), *itIdent, new NInt(0));
-
-    std::vector<NExpression *> args;
-    args.push_back(new NVariableAccess(list));
-    NVariableAccess * access = new NVariableAccess(*itIdent);
-    access->type = itNum->type;
-    NFunctionCall * funcCall = new NFunctionCall(*(new NIdentifier("list_length")), args);
-    funcCall->type = itNum->type;
-    NVariableDeclaration * loopMax = new NVariableDeclaration(*(new Type(TTINT)), *maxIdent, ((NExpression *) funcCall));
-    NVariableAccess * maxaccess = new NVariableAccess(*maxIdent);
-    maxaccess->type = itNum->type;
-    NBinaryOperator * c = new NBinaryOperator(*((NExpression *) access), (int) TCEQ, *((NExpression *) maxaccess));
+    StructType * st = loop->type.isStruct ? (StructType *) &(loop->type) : NULL;
+    NVariableDeclaration * loopVar = new NVariableDeclaration(st ? *(new StructType(st->ident)) : *(new Type(loop->type, false)), asVar, NULL);
+    NStructureDeclaration * sd = st ? context.structs[st->ident.value].first : NULL;
+    std::vector<int> members;
+    if (st)
+      {
+	std::vector<bool> used(sd->members.size(), false);
+	structMembersUsed(&loopBlock, asVar, sd, used);
+	for (int i = 0; i < used.size(); i++)
+	  if (used[i])
+	    members.push_back(i);
+      }
+    std::unordered_map<NFunctionDeclaration *, bool> callees;
+    AliasSearch search;
+    search.inCallee = false;
+    search.callees = &callees;
+    bool readOnly = !context.useCounters && !loopBlock.modifiesList(context.semantics, list) && !modifiesAlias(&loopBlock, loop, search, context);
+    llvm::Type * i64 = llvm::Type::getInt64Ty(context.llvmContext);
     llvm::Value * cond;
     llvm::Function * parent = context.blocks.top()->getParent();
-    llvm::BasicBlock * preBlock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "preblock", parent);
-    llvm::BasicBlock * bodyBlock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "bodyblock", parent);
-    llvm::BasicBlock * loopCondBlock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "loopcondblock", parent);
-    llvm::BasicBlock * terminateBlock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "termblock");
+    llvm::BasicBlock * preBlock = llvm::BasicBlock::Create(context.llvmContext, "preblock", parent);
+    llvm::BasicBlock * bodyBlock = llvm::BasicBlock::Create(context.llvmContext, "bodyblock", parent);
+    llvm::BasicBlock * loopCondBlock = llvm::BasicBlock::Create(context.llvmContext, "loopcondblock", parent);
+    llvm::BasicBlock * terminateBlock = llvm::BasicBlock::Create(context.llvmContext, "termblock");
 
-    // Create pre-block
+    // Create pre-block, hoisting the list length and backing array out of the loop
     context.blocks.push(preBlock);
     context.listblocks.push(terminateBlock);
     context.Builder->SetInsertPoint(context.blocks.top());
-    llvm::Value * itNumBC = itNum->codeGen(context);
     llvm::Value * lvBC = loopVar->codeGen(context);
-    llvm::Value * maxNumBC = loopMax->codeGen(context);
-    llvm::BranchInst::Create(bodyBlock, context.blocks.top()->end());
+    llvm::Value * listVar = context.findVariable(list.value);
+    // All the member lists of a struct-of-arrays list have the same length
+    bool soa = st && st->soa;
+    llvm::Value * li = new llvm::LoadInst(soa ? memberPtr(listVar, 0, context.blocks.top(), context) : listVar, "", false, context.blocks.top());
+    llvm::Value * len = loadListField(li, LIST_LEN, context.blocks.top(), context);
+    llvm::Value * arr = (readOnly && !soa) ? loadListField(li, LIST_ARR, context.blocks.top(), context) : NULL;
+    std::vector<llvm::Value *> cols(soa ? sd->members.size() : 0, (llvm::Value *) NULL);
+    if (readOnly && soa)
+      {
+	for (auto i : members)
+	  {
+	    llvm::Value * col = new llvm::LoadInst(memberPtr(listVar, i, context.blocks.top(), context), "", false, context.blocks.top());
+	    cols[i] = loadListField(col, LIST_ARR, context.blocks.top(), context);
+	  }
+      }
+    llvm::Value * empty = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ, len, llvm::ConstantInt::get(i64, 0), "", context.blocks.top());
+    llvm::BranchInst::Create(terminateBlock, bodyBlock, empty, context.blocks.top());
     context.blocks.pop();
     
     context.Builder->SetInsertPoint(context.blocks.top());
-    std::cout << "Creating branch to preBlock" << std::endl;
-    std::cout << "pb: " << preBlock->getName().str() << " " << context.blocks.top()->getName().str() << std::endl;
+    if (context.verbose)
+      {
+	std::cout << "Creating branch to preBlock" << std::endl;
+	std::cout << "pb: " << preBlock->getName().str() << " " << context.blocks.top()->getName().str() << std::endl;
+      }
     llvm::BranchInst::Create(preBlock, context.blocks.top());
 
-    std::cout << "Creating body block" << std::endl;
+    if (context.verbose)
+      std::cout << "Creating body block" << std::endl;
     context.blocks.push(bodyBlock);
     context.Builder->SetInsertPoint(context.blocks.top());
-    context.variables.push_back(*(new std::map<std::string, std::pair<NVariableDeclaration *, llvm::Value *> >()));
+    llvm::PHINode * iv = llvm::PHINode::Create(i64, 2, "loopit", bodyBlock);
+    iv->addIncoming(llvm::ConstantInt::get(i64, 0), preBlock);
+    context.variables.push_back(VariableScope());
     // Add asVar to context
     context.addVariable(loopVar, lvBC);
 
-    std::cout << "Creating list access instruction" << std::endl;
-    NListAccess * nla = new NListAccess(list, access);
-    nla->type = loop->type;
-    new llvm::StoreInst(nla->codeGen(context), lvBC, false, context.blocks.top());
+    if (context.verbose)
+      std::cout << "Creating list access instruction" << std::endl;
+    if (st)
+      {
+	llvm::Value * ep = NULL;
+	llvm::StructType * elemType = context.structs[st->ident.value].second;
+	if (!soa && readOnly)
+	  ep = listElementPtr(arr, iv, elemType, context.blocks.top());
+	else if (!soa)
+	  ep = generateElementPtr(new llvm::LoadInst(listVar, "", false, context.blocks.top()), iv, elemType, context);
+	for (auto i : members)
+	  {
+	    llvm::Value * mp;
+	    if (!soa)
+	      {
+		mp = memberPtr(ep, i, context.blocks.top(), context);
+	      }
+	    else
+	      {
+		llvm::Type * mt = sd->members[i]->type.toLlvmType(context.llvmContext);
+		if (readOnly)
+		  mp = listElementPtr(cols[i], iv, mt, context.blocks.top());
+		else
+		  mp = generateElementPtr(new llvm::LoadInst(memberPtr(listVar, i, context.blocks.top(), context), "", false, context.blocks.top()), iv, mt, context);
+	      }
+	    llvm::Value * mv = new llvm::LoadInst(mp, "", false, context.blocks.top());
+	    new llvm::StoreInst(mv, memberPtr(lvBC, i, context.blocks.top(), context), false, context.blocks.top());
+	  }
+      }
+    else
+      {
+	llvm::Value * elem;
+	if (readOnly)
+	  {
+	    llvm::Value * ep = listElementPtr(arr, iv, loopVar->type.toLlvmType(context.llvmContext), context.blocks.top());
+	    elem = new llvm::LoadInst(ep, "", false, context.blocks.top());
+	  }
+	else
+	  {
+	    li = new llvm::LoadInst(listVar, "", false, context.blocks.top());
+	    elem = generateListRetrieve(li, iv, loop->type.typecode, context);
+	  }
+	new llvm::StoreInst(elem, lvBC, false, context.blocks.top());
+      }
     
-    std::cout << "Generating body" << std::endl;
+    if (context.verbose)
+      std::cout << "Generating body" << std::endl;
+    context.loopScopes.push_back(context.ownedLists.size());
     llvm::Value * bodyval = loopBlock.codeGen(context);
+    context.loopScopes.pop_back();
 
     if (!context.blocks.top()->getTerminator()) {
       llvm::BranchInst::Create(loopCondBlock, context.blocks.top());
@@ -368,16 +1659,233 @@ llvm::Value * NLoopStatement::codeGen(CodeGenContext & context)
     context.blocks.push(loopCondBlock);
     context.Builder->SetInsertPoint(context.blocks.top());
 
-    // Increment loop counter
-    NInt one(1);
-    
-    llvm::Value * newValue = llvm::BinaryOperator::Create(llvm::Instruction::Add, one.codeGen(context), new llvm::LoadInst(itNumBC, "", false, context.blocks.top()), "", context.blocks.top());
-    new llvm::StoreInst(newValue, itNumBC, false, context.blocks.top());
-    
-    // Create termination check
-    cond = c->codeGen(context);
-    llvm::BranchInst::Create(terminateBlock, bodyBlock, cond, context.blocks.top());
+    // Increment loop counter and check for termination
+    llvm::Value * next = llvm::BinaryOperator::Create(llvm::Instruction::Add, iv, llvm::ConstantInt::get(i64, 1), "", context.blocks.top());
+    iv->addIncoming(next, loopCondBlock);
+    cond = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ, next, len, "", context.blocks.top());
+    llvm::BranchInst * latch = llvm::BranchInst::Create(terminateBlock, bodyBlock, cond, context.blocks.top());
+    if (readOnly)
+      addVectorizeHint(latch);
+
+    context.blocks.pop();
+
+    // Link in the terminate block to the function
+    context.blocks.push(terminateBlock);
+    parent->getBasicBlockList().push_back(terminateBlock);
+    context.Builder->SetInsertPoint(context.blocks.top());
+    return cond;
+}
+
+/**
+   Generates code for a parallel foreach over crema_seq(start, end). The loop body is outlined
+   into an internal function running the iterations lo to hi, inclusive, which the runtime's
+   crema_parallel_for splits across its worker threads. Locals of the enclosing function are
+   passed to the body as an array of pointers to them; the variables of main are globals and
+   are used directly. Semantic analysis has checked that the iterations do not conflict.
+
+   @param loop The NRangeLoopStatement to generate
+   @param context Reference of the CodeGenContext
+   @return llvm::Value * pointing to the call to crema_parallel_for
+*/
+static llvm::Value * generateParallelRangeLoop(NRangeLoopStatement & loop, CodeGenContext & context)
+{
+    llvm::Type * i64 = llvm::Type::getInt64Ty(context.llvmContext);
+    llvm::Type * i8p = llvm::Type::getInt8PtrTy(context.llvmContext);
+    llvm::Value * first = loop.start.codeGen(context);
+    llvm::Value * last = loop.end.codeGen(context);
+    // Evaluating the bounds may have started a new block
+    llvm::BasicBlock * parentBlock = context.blocks.top();
+
+    // Capture the innermost definition of every local in scope
+    std::vector<std::pair<std::string, std::pair<NVariableDeclaration *, llvm::Value *> > > captured;
+    std::set<std::string> seen;
+    for (auto scope = context.variables.rbegin(); scope != context.variables.rend(); scope++)
+      {
+	for (auto & var : *scope)
+	  {
+	    if (seen.insert(var.first).second && !llvm::isa<llvm::GlobalVariable>(var.second.second))
+	      captured.push_back(var);
+	  }
+      }
+    llvm::ArrayType * envType = llvm::ArrayType::get(i8p, captured.size());
+    llvm::Value * env = createEntryBlockAlloca(envType, "parenv", context);
+    for (size_t i = 0; i < captured.size(); i++)
+      {
+	llvm::Value * idx[] = { llvm::ConstantInt::get(i64, 0), llvm::ConstantInt::get(i64, i) };
+	llvm::Value * slot = llvm::GetElementPtrInst::Create(env, idx, "", parentBlock);
+	llvm::Value * p = new llvm::BitCastInst(captured[i].second.second, i8p, "", parentBlock);
+	new llvm::StoreInst(p, slot, false, parentBlock);
+      }
+
+    // void parallel_body(int64_t lo, int64_t hi, void * env)
+    llvm::Type * argTypes[] = { i64, i64, i8p };
+    llvm::FunctionType * bodyType = llvm::FunctionType::get(llvm::Type::getVoidTy(context.llvmContext), argTypes, false);
+    llvm::Function * body = llvm::Function::Create(bodyType, llvm::GlobalValue::InternalLinkage, "parallel_body", context.rootModule);
+    llvm::Function::arg_iterator args = body->arg_begin();
+    llvm::Value * lo = &*args++;
+    llvm::Value * hi = &*args++;
+    llvm::Value * envArg = &*args;
+    llvm::BasicBlock * entryBlock = llvm::BasicBlock::Create(context.llvmContext, "entry", body);
+    llvm::BasicBlock * bodyBlock = llvm::BasicBlock::Create(context.llvmContext, "parbody", body);
+    llvm::BasicBlock * loopCondBlock = llvm::BasicBlock::Create(context.llvmContext, "parcond", body);
+    llvm::BasicBlock * terminateBlock = llvm::BasicBlock::Create(context.llvmContext, "parterm", body);
+    llvm::MDNode * parentScope = context.debugScope;
+    if (parentScope)
+	context.debugScope = context.createDebugFunction(body, loop.lineno);
+
+    context.blocks.push(entryBlock);
+    context.Builder->SetInsertPoint(context.blocks.top());
+    context.variables.push_back(VariableScope());
+    llvm::Value * envArr = new llvm::BitCastInst(envArg, envType->getPointerTo(), "", entryBlock);
+    for (size_t i = 0; i < captured.size(); i++)
+      {
+	llvm::Value * idx[] = { llvm::ConstantInt::get(i64, 0), llvm::ConstantInt::get(i64, i) };
+	llvm::Value * slot = llvm::GetElementPtrInst::Create(envArr, idx, "", entryBlock);
+	llvm::Value * p = new llvm::LoadInst(slot, "", false, entryBlock);
+	p = new llvm::BitCastInst(p, captured[i].second.second->getType(), captured[i].first, entryBlock);
+	context.variables.back()[captured[i].first] = std::make_pair(captured[i].second.first, p);
+      }
+    NVariableDeclaration * loopVar = new NVariableDeclaration(*(new Type(TTINT)), loop.asVar, NULL);
+    llvm::Value * lvBC = loopVar->codeGen(context);
+    context.addVariable(loopVar, lvBC);
+    llvm::Value * empty = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SGT, lo, hi, "", entryBlock);
+    llvm::BranchInst::Create(terminateBlock, bodyBlock, empty, entryBlock);
+    context.blocks.pop();
+
+    context.blocks.push(bodyBlock);
+    context.listblocks.push(terminateBlock);
+    context.Builder->SetInsertPoint(context.blocks.top());
+    llvm::PHINode * iv = llvm::PHINode::Create(i64, 2, "parit", bodyBlock);
+    iv->addIncoming(lo, entryBlock);
+    new llvm::StoreInst(iv, lvBC, false, context.blocks.top());
+
+    // The body is a function of its own, so it only frees the lists of its own blocks
+    std::vector<std::vector<llvm::Value *> > outerLists;
+    outerLists.swap(context.ownedLists);
+    context.loopScopes.push_back(0);
+    loop.loopBlock.codeGen(context);
+    context.loopScopes.pop_back();
+    context.ownedLists.swap(outerLists);
+
+    if (!context.blocks.top()->getTerminator()) {
+      llvm::BranchInst::Create(loopCondBlock, context.blocks.top());
+    }
+
+    while (bodyBlock != context.blocks.top())
+	context.blocks.pop();
+    context.listblocks.pop();
+    context.blocks.pop();
+    context.variables.pop_back();
+
+    // As in the serial loop, the counter is compared with hi before it is incremented, so it can't overflow
+    llvm::Value * cond = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ, iv, hi, "", loopCondBlock);
+    llvm::Value * next = llvm::BinaryOperator::Create(llvm::Instruction::Add, iv, llvm::ConstantInt::get(i64, 1), "", loopCondBlock);
+    iv->addIncoming(next, loopCondBlock);
+    llvm::BranchInst::Create(terminateBlock, bodyBlock, cond, loopCondBlock);
+    llvm::ReturnInst::Create(context.llvmContext, terminateBlock);
+    if (parentScope)
+      {
+	context.setDebugLocations(body, loop.lineno, true);
+	context.debugScope = parentScope;
+      }
+
+    // Like crema_seq, crema_parallel_for runs the range up to and including last unless it is empty
+    context.Builder->SetInsertPoint(parentBlock);
 
+    // Workers would each copy a borrowed array on their first store, so the lists stored to are copied up front
+    llvm::FunctionType * ownType = llvm::FunctionType::get(llvm::Type::getVoidTy(context.llvmContext), i8p, false);
+    seen.clear();
+    for (auto scope = context.variables.rbegin(); scope != context.variables.rend(); scope++)
+      {
+	for (auto & var : *scope)
+	  {
+	    NVariableDeclaration * decl = var.second.first;
+	    if (!seen.insert(var.first).second || !decl)
+	      continue;
+	    for (auto w : loop.written)
+	      {
+		if (decl->mayShareList(w))
+		  {
+		    llvm::Value * list = new llvm::LoadInst(var.second.second, "", false, parentBlock);
+		    list = new llvm::BitCastInst(list, i8p, "", parentBlock);
+		    llvm::CallInst::Create(runtimeFunction("list_own_array", ownType, context), list, "", parentBlock);
+		    break;
+		  }
+	      }
+	  }
+      }
+
+    llvm::Function * pfor = context.rootModule->getFunction("crema_parallel_for");
+    if (!pfor)
+      {
+	llvm::Type * pforArgs[] = { i64, i64, bodyType->getPointerTo(), i8p };
+	llvm::FunctionType * ft = llvm::FunctionType::get(llvm::Type::getVoidTy(context.llvmContext), pforArgs, false);
+	pfor = llvm::Function::Create(ft, llvm::GlobalValue::ExternalLinkage, "crema_parallel_for", context.rootModule);
+      }
+    llvm::Value * callArgs[] = { first, last, body, new llvm::BitCastInst(env, i8p, "", parentBlock) };
+    return llvm::CallInst::Create(pfor, callArgs, "", parentBlock);
+}
+
+/**
+   Generates code for a foreach loop over crema_seq(start, end) as a counted loop. Like
+   crema_seq, the range is empty if end <= start and otherwise includes end. Both bounds are
+   evaluated once before the loop, and the counter is compared for equality with end before
+   being incremented so it can never overflow. Parallel loops are generated by
+   generateParallelRangeLoop.
+
+   @param context Reference of the CodeGenContext
+   @return llvm::Value * pointing to the generated instructions
+*/
+llvm::Value * NRangeLoopStatement::codeGen(CodeGenContext & context)
+{
+    if (parallel)
+	return generateParallelRangeLoop(*this, context);
+    NVariableDeclaration * loopVar = new NVariableDeclaration(*(new Type(TTINT)), asVar, NULL);
+    llvm::Type * i64 = llvm::Type::getInt64Ty(context.llvmContext);
+    llvm::Value * cond;
+    llvm::Function * parent = context.blocks.top()->getParent();
+
+    llvm::Value * lvBC = loopVar->codeGen(context);
+    llvm::Value * first = start.codeGen(context);
+    llvm::Value * last = end.codeGen(context);
+    // Evaluating the bounds may have started a new block
+    llvm::BasicBlock * preBlock = context.blocks.top();
+    llvm::BasicBlock * bodyBlock = llvm::BasicBlock::Create(context.llvmContext, "rangebody", parent);
+    llvm::BasicBlock * loopCondBlock = llvm::BasicBlock::Create(context.llvmContext, "rangecond", parent);
+    llvm::BasicBlock * terminateBlock = llvm::BasicBlock::Create(context.llvmContext, "rangeterm");
+
+    llvm::Value * empty = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SLE, last, first, "", preBlock);
+    llvm::BranchInst::Create(terminateBlock, bodyBlock, empty, preBlock);
+
+    context.blocks.push(bodyBlock);
+    context.listblocks.push(terminateBlock);
+    context.Builder->SetInsertPoint(context.blocks.top());
+    llvm::PHINode * iv = llvm::PHINode::Create(i64, 2, "rangeit", bodyBlock);
+    iv->addIncoming(first, preBlock);
+    context.variables.push_back(VariableScope());
+    context.addVariable(loopVar, lvBC);
+    new llvm::StoreInst(iv, lvBC, false, context.blocks.top());
+
+    context.loopScopes.push_back(context.ownedLists.size());
+    loopBlock.codeGen(context);
+    context.loopScopes.pop_back();
+
+    if (!context.blocks.top()->getTerminator()) {
+      llvm::BranchInst::Create(loopCondBlock, context.blocks.top());
+    }
+
+    while (bodyBlock != context.blocks.top())
+	context.blocks.pop();
+    context.listblocks.pop();
+    context.blocks.pop();
+    context.variables.pop_back();
+
+    context.blocks.push(loopCondBlock);
+    context.Builder->SetInsertPoint(context.blocks.top());
+    cond = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_EQ, iv, last, "", context.blocks.top());
+    llvm::Value * next = llvm::BinaryOperator::Create(llvm::Instruction::Add, iv, llvm::ConstantInt::get(i64, 1), "", context.blocks.top());
+    iv->addIncoming(next, loopCondBlock);
+    llvm::BranchInst::Create(terminateBlock, bodyBlock, cond, context.blocks.top());
     context.blocks.pop();
 
     // Link in the terminate block to the function
@@ -396,8 +1904,9 @@ llvm::Value * NLoopStatement::codeGen(CodeGenContext & context)
 llvm::Value * NBreak::codeGen(CodeGenContext & context)
 {
 //    llvm::Function * parent = context.blocks.top()->getParent();
-    //   llvm::BasicBlock * brkBlock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "breakblock");
+    //   llvm::BasicBlock * brkBlock = llvm::BasicBlock::Create(context.llvmContext, "breakblock");
     //parent->getBasicBlockList().push_back(brkBlock);
+    context.freeLists(context.loopScopes.back());
     llvm::Value * bi = llvm::BranchInst::Create(context.listblocks.top(), context.blocks.top());
 
     //context.blocks.push(brkBlock);
@@ -418,11 +1927,11 @@ llvm::Value * NIfStatement::codeGen(CodeGenContext & context)
     switch (condition.type.typecode)
     {
     case DOUBLE:
-    	cond = llvm::CmpInst::Create(llvm::Instruction::FCmp, llvm::CmpInst::FCMP_ONE, llvm::ConstantFP::get(llvm::getGlobalContext(), llvm::APFloat(0.0)), cond, "", context.blocks.top());
+    	cond = llvm::CmpInst::Create(llvm::Instruction::FCmp, llvm::CmpInst::FCMP_ONE, llvm::ConstantFP::get(context.llvmContext, llvm::APFloat(0.0)), cond, "", context.blocks.top());
 	    break;
     case UINT:
     case INT:
-	cond = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SLT, llvm::ConstantInt::get(llvm::getGlobalContext(), llvm::APInt(64, 0, false)), cond, "", context.blocks.top());
+	cond = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_SLT, llvm::ConstantInt::get(context.llvmContext, llvm::APInt(64, 0, false)), cond, "", context.blocks.top());
 	break;
     case BOOL:
         if (cond == NULL) {
@@ -430,7 +1939,7 @@ llvm::Value * NIfStatement::codeGen(CodeGenContext & context)
 	    exit(-1);
 	}
 	if (typeid(condition) != typeid(NBinaryOperator)) {
-	  cond = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_NE, llvm::ConstantInt::get(llvm::getGlobalContext(), llvm::APInt(1, 0, false)), cond, "", context.blocks.top());
+	  cond = llvm::CmpInst::Create(llvm::Instruction::ICmp, llvm::CmpInst::ICMP_NE, llvm::ConstantInt::get(context.llvmContext, llvm::APInt(1, 0, false)), cond, "", context.blocks.top());
 	}
 	break;
     default:
@@ -441,16 +1950,16 @@ llvm::Value * NIfStatement::codeGen(CodeGenContext & context)
     }
 
     llvm::Function * parent = context.blocks.top()->getParent();
-    llvm::BasicBlock * thenBlock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "", parent, 0);
+    llvm::BasicBlock * thenBlock = llvm::BasicBlock::Create(context.llvmContext, "", parent, 0);
     llvm::BasicBlock * elseBlock = NULL;
     llvm::BasicBlock * ifcontBlock = NULL;
 
     if (elseblock || elseif) {
-      elseBlock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "");
+      elseBlock = llvm::BasicBlock::Create(context.llvmContext, "");
       llvm::BranchInst::Create(thenBlock, elseBlock, cond, context.blocks.top());
     }
 
-    ifcontBlock = llvm::BasicBlock::Create(llvm::getGlobalContext(), "");
+    ifcontBlock = llvm::BasicBlock::Create(context.llvmContext, "");
     if (elseBlock == NULL) {
       llvm::BranchInst::Create(thenBlock, ifcontBlock, cond, context.blocks.top());
     }
@@ -459,7 +1968,7 @@ llvm::Value * NIfStatement::codeGen(CodeGenContext & context)
     context.blocks.push(thenBlock);
     context.Builder->SetInsertPoint(thenBlock);
 
-    context.variables.push_back(*(new std::map<std::string, std::pair<NVariableDeclaration *, llvm::Value *> >()));
+    context.variables.push_back(VariableScope());
     llvm::Value * thenValue = thenblock.codeGen(context);
 
     if (!context.blocks.top()->getTerminator())
@@ -479,7 +1988,7 @@ llvm::Value * NIfStatement::codeGen(CodeGenContext & context)
       context.blocks.push(elseBlock);
       context.Builder->SetInsertPoint(elseBlock);
 
-      context.variables.push_back(*(new std::map<std::string, std::pair<NVariableDeclaration *, llvm::Value *> >()));
+      context.variables.push_back(VariableScope());
       llvm::Value * elseValue = NULL;    
       if (elseblock)
 	elseValue = elseblock->codeGen(context);
@@ -499,7 +2008,7 @@ llvm::Value * NIfStatement::codeGen(CodeGenContext & context)
     context.blocks.push(ifcontBlock);
     context.Builder->SetInsertPoint(ifcontBlock);
 /*
-    llvm::PHINode *PN = context.Builder->CreatePHI(llvm::Type::getVoidTy(llvm::getGlobalContext()), 2, "iftmp");
+    llvm::PHINode *PN = context.Builder->CreatePHI(llvm::Type::getVoidTy(context.llvmContext), 2, "iftmp");
 
     PN->addIncoming(thenValue, thenBlock);
     PN->addIncoming(ev, elseBlock);
@@ -530,7 +2039,12 @@ llvm::Value * NVariableAccess::codeGen(CodeGenContext & context)
 */
 llvm::Value * NAssignmentStatement::codeGen(CodeGenContext & context)
 {
-  return new llvm::StoreInst(expr.codeGen(context), context.findVariable(ident.value), false, context.blocks.top());
+  llvm::Value * val = expr.codeGen(context);
+  llvm::Value * var = context.findVariable(ident.value);
+  // A list stored in a global outlives the function's region
+  if (val->getType()->isPointerTy() && llvm::isa<llvm::GlobalVariable>(var))
+    context.regionEscape = true;
+  return new llvm::StoreInst(val, var, false, context.blocks.top());
 }
 
 /**
@@ -541,6 +2055,8 @@ llvm::Value * NAssignmentStatement::codeGen(CodeGenContext & context)
 */
 llvm::Value * NBinaryOperator::codeGen(CodeGenContext & context)
 {
+    if (folded)
+	return folded->codeGen(context);
     TypeCodes tc = Type::getLargerType(rhs.type, lhs.type).typecode;
 
     switch (op)
@@ -649,7 +2165,7 @@ llvm::Value * NBinaryOperator::codeGen(CodeGenContext & context)
 }
 
 /**
-   Generates the stdlib function call bytecode to retrieve an element from a list
+   Generates the bytecode to retrieve an element from a list
 
    @param CodeGenContext & context -- reference to the context of the operator statement
    @return llvm::Value * -- Pointer to the code generated that will access a list elemnt.
@@ -657,34 +2173,61 @@ llvm::Value * NBinaryOperator::codeGen(CodeGenContext & context)
 llvm::Value * NListAccess::codeGen(CodeGenContext & context)
 {
     llvm::Value * var = context.findVariable(ident.value);
-    std::string name;
     if (!index)
       {
 	std::cout << "NULL index for NListAccess!" << std::endl;
 	return NULL;
       }
-    switch (type.typecode)
-      {
-      case INT:
-	name = "int_list_retrieve";
-	break;
-      case CHAR:
-      case STRING:
-	  name = "str_retrieve";
-	  break;
-      default:
-	return NULL;
-      }
-    llvm::Function *func = context.rootModule->getFunction(name.c_str());
     llvm::Value * li = new llvm::LoadInst(var, "", false, context.blocks.top());
-    std::vector<llvm::Value *> v;
-    v.push_back(li);
     // Generate LLVM IR for the list index
     llvm::Value *igc = index->codeGen(context);
-    v.push_back(igc);
-    
-    llvm::ArrayRef<llvm::Value *> llvmargs(v);
-    return llvm::CallInst::Create(func, llvmargs, "", context.blocks.top());
+    return generateListRetrieve(li, igc, type.typecode, context);
+}
+
+/**
+   Generates the runtime calls storing a structure variable into a list of structures, as a new
+   element or over an existing one. The structure is copied into a contiguous list whole, and
+   member by member into the lists of a struct-of-arrays list.
+
+   @param la The list assignment
+   @param vd Declaration of the list variable
+   @param var Pointer to the list variable
+   @param context CodeGenContext
+   @return The last runtime call
+*/
+static llvm::Value * generateStructListStore(NListAssignmentStatement & la, NVariableDeclaration * vd, llvm::Value * var, CodeGenContext & context)
+{
+    StructType * st = (StructType *) &(vd->type);
+    NStructureDeclaration * sd = context.structs[st->ident.value].first;
+    llvm::Type * i8p = llvm::Type::getInt8PtrTy(context.llvmContext);
+    llvm::Type * i64 = llvm::Type::getInt64Ty(context.llvmContext);
+    std::vector<llvm::Type *> params(1, i8p);
+    if (la.list.index)
+	params.push_back(i64);
+    params.push_back(i8p);
+    llvm::FunctionType * ft = llvm::FunctionType::get(llvm::Type::getVoidTy(context.llvmContext), params, false);
+    llvm::Function * func = runtimeFunction(la.list.index ? "list_insert" : "list_append", ft, context);
+    llvm::Value * idx = la.list.index ? la.list.index->codeGen(context) : NULL;
+    llvm::Value * src = context.findVariable(((NVariableAccess &) la.expr).ident.value);
+    // Lists stored in structures are not tracked, so they may outlive the function's region
+    for (auto it : sd->members)
+	if (it->type.isList)
+	    context.regionEscape = true;
+
+    llvm::Value * call = NULL;
+    int n = st->soa ? sd->members.size() : 1;
+    for (int i = 0; i < n; i++)
+    {
+	llvm::Value * list = new llvm::LoadInst(st->soa ? memberPtr(var, i, context.blocks.top(), context) : var, "", false, context.blocks.top());
+	llvm::Value * elem = st->soa ? memberPtr(src, i, context.blocks.top(), context) : src;
+	std::vector<llvm::Value *> v;
+	v.push_back(list);
+	if (idx)
+	    v.push_back(idx);
+	v.push_back(new llvm::BitCastInst(elem, i8p, "", context.blocks.top()));
+	call = llvm::CallInst::Create(func, v, "", context.blocks.top());
+    }
+    return call;
 }
 
 /**
@@ -696,6 +2239,9 @@ llvm::Value * NListAccess::codeGen(CodeGenContext & context)
 llvm::Value * NListAssignmentStatement::codeGen(CodeGenContext & context)
 {
     llvm::Value * var = context.findVariable(list.ident.value);
+    NVariableDeclaration * vd = context.findVariableDeclaration(list.ident.value);
+    if (vd && vd->type.isStruct)
+	return generateStructListStore(*this, vd, var, context);
     std::string name;
     switch (list.type.typecode)
       {
@@ -761,8 +2307,8 @@ static llvm::GetElementPtrInst * getGEPForStruct(llvm::Value * var, NIdentifier
     
     std::vector<llvm::Value *> vec;
     // The argument IdxList *MUST* contain i32 values otherwise the call to GEP::Create() will segfault
-    vec.push_back(llvm::ConstantInt::get(llvm::getGlobalContext(), llvm::APInt(32, 0, true)));
-    vec.push_back(llvm::ConstantInt::get(llvm::getGlobalContext(), llvm::APInt(32, i, true)));
+    vec.push_back(llvm::ConstantInt::get(context.llvmContext, llvm::APInt(32, 0, true)));
+    vec.push_back(llvm::ConstantInt::get(context.llvmContext, llvm::APInt(32, i, true)));
     
     llvm::ArrayRef<llvm::Value *> arr(vec);
     llvm::GetElementPtrInst * gep = llvm::GetElementPtrInst::Create(var, arr, "", context.blocks.top());
@@ -789,8 +2335,14 @@ llvm::Value * NStructureAccess::codeGen(CodeGenContext & context)
 	std::cout << "Error: Unable to find variable for " << ident << std::endl;
 	exit(-1);
     }
+    if (index)
+    {
+	llvm::Value * idx = index->codeGen(context);
+	llvm::Value * mp = structListMemberPtr(vd, var, member, idx, false, context);
+	return new llvm::LoadInst(mp, "", false, context.blocks.top());
+    }
     StructType *st = (StructType *) &(vd->type);
-    NStructureDeclaration * sd = structs[st->ident.value].first;
+    NStructureDeclaration * sd = context.structs[st->ident.value].first;
     llvm::GetElementPtrInst * gep = getGEPForStruct(var, member, sd, context);
     return new llvm::LoadInst(gep, "", false, context.blocks.top());
 }
@@ -810,10 +2362,66 @@ llvm::Value * NStructureAssignmentStatement::codeGen(CodeGenContext & context)
 	std::cout << "Error: Unable to find variable for " << structure.ident << std::endl;
 	exit(-1);
     }
+    if (structure.index)
+    {
+	llvm::Value * idx = structure.index->codeGen(context);
+	llvm::Value * val = expr.codeGen(context);
+	if (val->getType()->isPointerTy())
+	    context.regionEscape = true;
+	llvm::Value * mp = structListMemberPtr(vd, var, structure.member, idx, true, context);
+	return new llvm::StoreInst(val, mp, false, context.blocks.top());
+    }
     StructType *st = (StructType *) &(vd->type);
-    NStructureDeclaration * sd = structs[st->ident.value].first;
+    NStructureDeclaration * sd = context.structs[st->ident.value].first;
     llvm::GetElementPtrInst * gep = getGEPForStruct(var, structure.member, sd, context);
-    return new llvm::StoreInst(expr.codeGen(context), gep, false, context.blocks.top());
+    llvm::Value * val = expr.codeGen(context);
+    // Lists stored in structures are not tracked, so they may outlive the function's region
+    if (val->getType()->isPointerTy())
+	context.regionEscape = true;
+    return new llvm::StoreInst(val, gep, false, context.blocks.top());
+}
+
+/**
+   Wraps a function body in a runtime region: crema_region_enter() is called on entry and
+   crema_region_leave() before every return, so that all the lists the function allocates
+   are released together. A returned list is passed to crema_region_leave(), which moves it
+   out of the region, and the moved list is returned instead.
+
+   @param func The function to wrap
+   @param context CodeGenContext
+*/
+static void addFunctionRegion(llvm::Function * func, CodeGenContext & context)
+{
+    llvm::Type * i8p = llvm::Type::getInt8PtrTy(context.llvmContext);
+    llvm::Function * enter = context.rootModule->getFunction("crema_region_enter");
+    llvm::Function * leave = context.rootModule->getFunction("crema_region_leave");
+    if (!enter)
+	enter = llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(context.llvmContext), false), llvm::GlobalValue::ExternalLinkage, "crema_region_enter", context.rootModule);
+    if (!leave)
+	leave = llvm::Function::Create(llvm::FunctionType::get(i8p, i8p, false), llvm::GlobalValue::ExternalLinkage, "crema_region_leave", context.rootModule);
+
+    // Enter the region after the entry block's allocas
+    llvm::BasicBlock::iterator ip = func->getEntryBlock().begin();
+    while (llvm::isa<llvm::AllocaInst>(&*ip))
+	ip++;
+    llvm::CallInst::Create(enter, "", ip);
+
+    std::vector<llvm::ReturnInst *> rets;
+    for (llvm::Function::iterator bb = func->begin(); bb != func->end(); bb++)
+	if (llvm::ReturnInst * ret = llvm::dyn_cast_or_null<llvm::ReturnInst>(bb->getTerminator()))
+	    rets.push_back(ret);
+    for (auto ret : rets)
+      {
+	llvm::Value * rv = ret->getReturnValue();
+	if (rv && rv->getType() == i8p)
+	  {
+	    ret->setOperand(0, llvm::CallInst::Create(leave, rv, "", ret));
+	  }
+	else
+	  {
+	    llvm::CallInst::Create(leave, llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(i8p)), "", ret);
+	  }
+      }
 }
 
 /**
@@ -827,22 +2435,27 @@ llvm::Value * NFunctionDeclaration::codeGen(CodeGenContext & context)
     std::vector<llvm::Type *> v;
     // Loop through argument types
     for (auto it : variables)
-        v.push_back(it->type.toLlvmType());
+        v.push_back(it->type.toLlvmType(context.llvmContext));
 
     // Convert from std::vector to llvm::ArrayRef
     llvm::ArrayRef<llvm::Type *> argtypes(v);
-    llvm::FunctionType *ft = llvm::FunctionType::get(type.toLlvmType(), argtypes, false);
+    llvm::FunctionType *ft = llvm::FunctionType::get(type.toLlvmType(context.llvmContext), argtypes, false);
     llvm::Function * func;
 
     if (body)
       {
-	std::cout << "Generating function body: " << ident.value.c_str() << std::endl;
+	if (context.verbose)
+	  std::cout << "Generating function body: " << ident.value.c_str() << std::endl;
 	func = llvm::Function::Create(ft, llvm::GlobalValue::InternalLinkage, ident.value.c_str(), context.rootModule);
-	llvm::BasicBlock *bb = llvm::BasicBlock::Create(llvm::getGlobalContext(), "entry", func);
+	llvm::BasicBlock *bb = llvm::BasicBlock::Create(context.llvmContext, "entry", func);
+	llvm::MDNode * parentScope = context.debugScope;
+	if (parentScope)
+	    context.debugScope = context.createDebugFunction(func, lineno);
 	
 	context.blocks.push(bb);
-	context.variables.push_back(*(new std::map<std::string, std::pair<NVariableDeclaration *, llvm::Value *> >()));
+	context.variables.push_back(VariableScope());
 	context.Builder->SetInsertPoint(bb);
+	context.regionEscape = (type.typecode == STRUCT);
 
 	int i = 0;
 	for (llvm::Function::arg_iterator args = func->arg_begin(); args != func->arg_end(); ++args)
@@ -851,12 +2464,16 @@ llvm::Value * NFunctionDeclaration::codeGen(CodeGenContext & context)
 	    i++;
 	  }
 
+	// The blocks of the function are freed by its own returns
+	std::vector<std::vector<llvm::Value *> > outerLists;
+	outerLists.swap(context.ownedLists);
 	body->codeGen(context);
+	context.ownedLists.swap(outerLists);
 
 	if (type.typecode == VOID)
 	{
 	    // Add in a void return instruction for void functions
-	    llvm::ReturnInst::Create(llvm::getGlobalContext(), context.blocks.top());
+	    llvm::ReturnInst::Create(context.llvmContext, context.blocks.top());
 	} else if (!context.blocks.top()->getTerminator()) {
         std::cout << "Warning: Control may reach end of non-void function: " << ident << std::endl;
     }
@@ -867,6 +2484,19 @@ llvm::Value * NFunctionDeclaration::codeGen(CodeGenContext & context)
 	if (context.blocks.empty() == false && context.blocks.top() == bb) 
 	  context.blocks.pop();
 	context.variables.pop_back();
+
+	if (context.regionEscape)
+	    context.regionUnsafe.insert(func);
+	else if (context.useRegions)
+	    addFunctionRegion(func, context);
+	context.regionEscape = false;
+
+	if (parentScope)
+	  {
+	    // The parameter stores and the region calls belong to the declaration
+	    context.setDebugLocations(func, lineno, true);
+	    context.debugScope = parentScope;
+	  }
       }
     else 
       {
@@ -883,10 +2513,26 @@ llvm::Value * NFunctionDeclaration::codeGen(CodeGenContext & context)
 */
 llvm::Value * NFunctionCall::codeGen(CodeGenContext & context)
 {
+    if (folded)
+	return folded->codeGen(context);
     llvm::Function *func = context.rootModule->getFunction(ident.value.c_str());
     std::vector<llvm::Value *> v;
     for (auto it : args) 
+      {
+	NVariableAccess * va = dynamic_cast<NVariableAccess *>(it);
+	NVariableDeclaration * vd = va ? context.findVariableDeclaration(va->ident.value) : NULL;
+	if (vd && StructType::isSoaList(vd->type))
+	  {
+	    // The length of a struct-of-arrays list is the length of its first member list
+	    llvm::Value * col = memberPtr(context.findVariable(va->ident.value), 0, context.blocks.top(), context);
+	    v.push_back(new llvm::LoadInst(col, "", false, context.blocks.top()));
+	    continue;
+	  }
         v.push_back(it->codeGen(context));
+      }
+    // Lists created by a region-unsafe callee are allocated from the caller's region
+    if (context.regionUnsafe.count(func))
+	context.regionEscape = true;
    
     llvm::ArrayRef<llvm::Value *> llvmargs(v);
     return llvm::CallInst::Create(func, llvmargs, "", context.blocks.top());
@@ -901,13 +2547,14 @@ llvm::Value * NFunctionCall::codeGen(CodeGenContext & context)
 llvm::Value * NReturn::codeGen(CodeGenContext & context)
 {    
     llvm::Value *re = retExpr.codeGen(context);
+    context.freeLists(0);
 
     // upcasts the return value to floating point if function return is 
     // declared as double, but integer is returned in body of function
-    if ( retExpr.type.toLlvmType() != context.blocks.top()->getParent()->getReturnType() )
-        return llvm::ReturnInst::Create(llvm::getGlobalContext(), convertIToFP(re,context), context.blocks.top());
+    if ( retExpr.type.toLlvmType(context.llvmContext) != context.blocks.top()->getParent()->getReturnType() )
+        return llvm::ReturnInst::Create(context.llvmContext, convertIToFP(re,context), context.blocks.top());
 
-    return llvm::ReturnInst::Create(llvm::getGlobalContext(), re, context.blocks.top());
+    return llvm::ReturnInst::Create(context.llvmContext, re, context.blocks.top());
 }
 
 /**
@@ -919,27 +2566,41 @@ llvm::Value * NReturn::codeGen(CodeGenContext & context)
 llvm::Value * NVariableDeclaration::codeGen(CodeGenContext & context)
 {
   llvm::Value * a;
-  if (type.isStruct) 
+  if (type.isStruct && type.isList)
+    {
+      StructType *st = (StructType *) &type;
+      llvm::Type * lt = structListType(*st, context);
+      if (context.blocks.top()->getParent()->getName().str() == "main")
+	{
+	    a = new llvm::GlobalVariable(*(context.rootModule), lt, false, llvm::GlobalValue::InternalLinkage, llvm::UndefValue::get(lt), ident.value);
+	}
+      else
+	{
+	    a = createEntryBlockAlloca(lt, ident.value, context);
+	}
+      createStructList(*st, a, context);
+    }
+  else if (type.isStruct) 
     {
       StructType *st = (StructType *) &type;
       if (context.blocks.top()->getParent()->getName().str() == "main")
 	{
-	    a = new llvm::GlobalVariable(*(context.rootModule), structs[st->ident.value].second, false, llvm::GlobalValue::InternalLinkage, llvm::UndefValue::get(structs[st->ident.value].second), ident.value);
+	    a = new llvm::GlobalVariable(*(context.rootModule), context.structs[st->ident.value].second, false, llvm::GlobalValue::InternalLinkage, llvm::UndefValue::get(context.structs[st->ident.value].second), ident.value);
 	}
       else 
 	{
-	    a = new llvm::AllocaInst(structs[st->ident.value].second, ident.value, context.blocks.top());
+	    a = createEntryBlockAlloca(context.structs[st->ident.value].second, ident.value, context);
 	}
     }
   else 
     {
       if (context.blocks.top()->getParent()->getName().str() == "main")
       {
-	  a = new llvm::GlobalVariable(*(context.rootModule), type.toLlvmType(), false, llvm::GlobalValue::InternalLinkage, llvm::UndefValue::get(type.toLlvmType()), ident.value);
+	  a = new llvm::GlobalVariable(*(context.rootModule), type.toLlvmType(context.llvmContext), false, llvm::GlobalValue::InternalLinkage, llvm::UndefValue::get(type.toLlvmType(context.llvmContext)), ident.value);
       }
       else 
               {
-	  a = new llvm::AllocaInst(type.toLlvmType(), ident.value, context.blocks.top());
+	  a = createEntryBlockAlloca(type.toLlvmType(context.llvmContext), ident.value, context);
       }
       if ((type.isList || type.typecode == STRING) && !initializationExpression)
       {
@@ -972,12 +2633,17 @@ llvm::Value * NVariableDeclaration::codeGen(CodeGenContext & context)
       NAssignmentStatement nas(ident, *initializationExpression);
       nas.codeGen(context);
   }
+  if (ownsList && !context.ownedLists.empty())
+      context.ownedLists.back().push_back(a);
   
   return a;
 }
 
 /**
-   Generates code for a pre-defined list
+   Generates code for a pre-defined list. A literal whose elements are all constants is
+   emitted as a private constant global array, wrapped in a list by a single
+   list_from_array() call; the list borrows the array and only copies it if the program
+   changes it. Other literals reserve room for all of their elements before appending them.
 
    @param context Context variable
    @return LLVM bytecode for the list
@@ -985,49 +2651,82 @@ llvm::Value * NVariableDeclaration::codeGen(CodeGenContext & context)
 llvm::Value * NList::codeGen(CodeGenContext & context)
 {
     // Create list
-    std::string name;
+    std::string name, append;
     switch (type.typecode)
     {
     case INT:
 	name = "int_list_create";
+	append = "int_list_append";
 	break;
     case CHAR:
 	name = "str_create";
+	append = "str_append";
 	break;
     case DOUBLE:
 	name = "double_list_create";
+	append = "double_list_append";
 	break;
     default:
 	std::cout << "Unsupported type for list!" << std::endl;
 	exit(-1);
 	return NULL;
     }
+    llvm::Type * i8p = llvm::Type::getInt8PtrTy(context.llvmContext);
+    llvm::Type * i64 = llvm::Type::getInt64Ty(context.llvmContext);
+    llvm::Type * elemType = Type(type, false).toLlvmType(context.llvmContext);
+
+    // The elements are evaluated in order before the list is created, which has no side effects
+    std::vector<llvm::Value *> elems;
+    std::vector<llvm::Constant *> consts;
+    for (int i = 0; i < value.size(); i++)
+    {
+	llvm::Value * v = value[i]->codeGen(context);
+	elems.push_back(v);
+	if (llvm::isa<llvm::Constant>(v) && v->getType() == elemType)
+	    consts.push_back(llvm::cast<llvm::Constant>(v));
+    }
+
+    if (!consts.empty() && consts.size() == elems.size())
+    {
+	llvm::Function * func = context.rootModule->getFunction("list_from_array");
+	if (!func)
+	{
+	    std::vector<llvm::Type *> params(1, i8p);
+	    params.push_back(i64);
+	    params.push_back(i64);
+	    func = llvm::Function::Create(llvm::FunctionType::get(i8p, params, false), llvm::GlobalValue::ExternalLinkage, "list_from_array", context.rootModule);
+	}
+	llvm::ArrayType * at = llvm::ArrayType::get(elemType, consts.size());
+	llvm::GlobalVariable * gv = new llvm::GlobalVariable(*context.rootModule, at, true, llvm::GlobalValue::PrivateLinkage, llvm::ConstantArray::get(at, consts), ".list");
+	gv->setUnnamedAddr(true);
+	std::vector<llvm::Value *> args;
+	args.push_back(llvm::ConstantExpr::getBitCast(gv, i8p));
+	args.push_back(llvm::ConstantInt::get(i64, consts.size()));
+	args.push_back(llvm::ConstantInt::get(i64, elemType->getPrimitiveSizeInBits() / 8));
+	return llvm::CallInst::Create(func, args, "", context.blocks.top());
+    }
+
     llvm::Function *func = context.rootModule->getFunction(name.c_str());
     std::vector<llvm::Value *> v;
     
     llvm::ArrayRef<llvm::Value *> llvmargs(v);
     llvm::Value * li = llvm::CallInst::Create(func, llvmargs, "", context.blocks.top());
 
-    for (int i = 0; i < value.size(); i++)
+    if (elems.size() > 1)
     {
-	switch (type.typecode)
-	{
-	case INT:
-	    name = "int_list_append";
-	    break;
-	case CHAR:
-	    name = "str_append";
-	    break;
-	case DOUBLE:
-	    name = "double_list_append";
-	    break;
-	default:
-	    return NULL;
-	}
-	llvm::Function *func = context.rootModule->getFunction(name.c_str());
+	// Grow the list once instead of on the way
+	std::vector<llvm::Value *> reserveArgs;
+	reserveArgs.push_back(li);
+	reserveArgs.push_back(llvm::ConstantInt::get(i64, elems.size()));
+	llvm::CallInst::Create(context.rootModule->getFunction("list_reserve"), reserveArgs, "", context.blocks.top());
+    }
+
+    for (int i = 0; i < elems.size(); i++)
+    {
+	llvm::Function *func = context.rootModule->getFunction(append.c_str());
 	std::vector<llvm::Value *> v;
 	v.push_back(li);
-	v.push_back(value[i]->codeGen(context));
+	v.push_back(elems[i]);
 
 	llvm::ArrayRef<llvm::Value *> llvmargs(v);
 	llvm::CallInst::Create(func, llvmargs, "", context.blocks.top());
@@ -1037,24 +2736,39 @@ llvm::Value * NList::codeGen(CodeGenContext & context)
 }
 
 /**
-   Generates code for string values.
+   Generates code for string values. The characters are emitted once, as a private constant
+   global shared by every occurrence of the same literal, and each evaluation wraps them in a
+   list with a single str_from_literal() call. The list borrows the constant characters and
+   only copies them if the program changes it.
 
    @param CodeGenContext & context -- reference to the context of the operator statement
    @return llvm::Value * -- Pointer to the code generated as a result of the string instance
 */
 llvm::Value * NString::codeGen(CodeGenContext & context)
 {
-    ExpressionList * chars = new ExpressionList();
-    for (int i = 0; i < value.length(); i++)
-    {
-	NChar *c = new NChar(value[i]);
-	c->type.typecode = CHAR;
-	chars->push_back(c);
-    }
-    NList * cl = new NList(*chars);
-    cl->type.typecode = CHAR;
-    llvm::Value * v = cl->codeGen(context);
-    return v;
+    llvm::Type * i8p = llvm::Type::getInt8PtrTy(context.llvmContext);
+    llvm::Type * i64 = llvm::Type::getInt64Ty(context.llvmContext);
+    llvm::Function * func = context.rootModule->getFunction("str_from_literal");
+    if (!func)
+      {
+	std::vector<llvm::Type *> params;
+	params.push_back(i8p);
+	params.push_back(i64);
+	func = llvm::Function::Create(llvm::FunctionType::get(i8p, params, false), llvm::GlobalValue::ExternalLinkage, "str_from_literal", context.rootModule);
+      }
+
+    llvm::GlobalVariable *& gv = context.stringLiterals[value];
+    if (!gv)
+      {
+	llvm::Constant * chars = llvm::ConstantDataArray::getString(context.llvmContext, value, true);
+	gv = new llvm::GlobalVariable(*context.rootModule, chars->getType(), true, llvm::GlobalValue::PrivateLinkage, chars, ".str");
+	gv->setUnnamedAddr(true);
+      }
+    std::vector<llvm::Constant *> idx(2, llvm::ConstantInt::get(i64, 0));
+    std::vector<llvm::Value *> args;
+    args.push_back(llvm::ConstantExpr::getInBoundsGetElementPtr(gv, idx));
+    args.push_back(llvm::ConstantInt::get(i64, value.length()));
+    return llvm::CallInst::Create(func, args, "", context.blocks.top());
 }
 
 /**
@@ -1065,7 +2779,7 @@ llvm::Value * NString::codeGen(CodeGenContext & context)
 */
 llvm::Value * NDouble::codeGen(CodeGenContext & context)
 {
-    return llvm::ConstantFP::get(llvm::getGlobalContext(), llvm::APFloat(value));
+    return llvm::ConstantFP::get(context.llvmContext, llvm::APFloat(value));
 }
 
 /**
@@ -1076,7 +2790,7 @@ llvm::Value * NDouble::codeGen(CodeGenContext & context)
 */
 llvm::Value * NUInt::codeGen(CodeGenContext & context)
 {
-    return llvm::ConstantInt::get(llvm::getGlobalContext(), llvm::APInt(64, value, false));
+    return llvm::ConstantInt::get(context.llvmContext, llvm::APInt(64, value, false));
 }
 
 /**
@@ -1087,7 +2801,7 @@ llvm::Value * NUInt::codeGen(CodeGenContext & context)
 */
 llvm::Value * NInt::codeGen(CodeGenContext & context)
 {
-    return llvm::ConstantInt::get(llvm::getGlobalContext(), llvm::APInt(64, value, true));
+    return llvm::ConstantInt::get(context.llvmContext, llvm::APInt(64, value, true));
 }
 
 /**
@@ -1098,7 +2812,7 @@ llvm::Value * NInt::codeGen(CodeGenContext & context)
 */
 llvm::Value * NChar::codeGen(CodeGenContext & context)
 {
-    return llvm::ConstantInt::get(llvm::getGlobalContext(), llvm::APInt(8, value, true));
+    return llvm::ConstantInt::get(context.llvmContext, llvm::APInt(8, value, true));
 }
 
 /**
@@ -1110,5 +2824,5 @@ llvm::Value * NChar::codeGen(CodeGenContext & context)
 llvm::Value * NBool::codeGen(CodeGenContext & context)
 {
     char v = value ? 1 : 0;
-    return llvm::ConstantInt::get(llvm::getGlobalContext(), llvm::APInt(1, v, true));
+    return llvm::ConstantInt::get(context.llvmContext, llvm::APInt(1, v, true));
 }
@@ -14,39 +14,104 @@
 #include <stack>
 #include <string>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Type.h>
+#include <llvm/DIBuilder.h>
+#include <llvm/DebugInfo.h>
 #include <llvm/ADT/APFloat.h>
 #include <llvm/ADT/APInt.h>
 #include <llvm/PassManager.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/Interpreter.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
 #include <llvm/Assembly/PrintModulePass.h>
 #include <llvm/Support/Host.h>
+#include <llvm/Target/TargetMachine.h>
 
 class NBlock;
 class NVariableDeclaration;
+class NStructureDeclaration;
+class SemanticContext;
+
+/**
+ *  Field indices of the runtime list_t structure. These must match the layout of
+ *  struct list_s in stdlib/stdlib.h */
+enum ListFields {
+    LIST_CAP,
+    LIST_LEN,
+    LIST_ELEM_SZ,
+    LIST_ARR,
+    LIST_REGION,
+    LIST_FLAGS,
+    LIST_SHARED_REFS
+};
+
+typedef std::unordered_map<std::string, std::pair<NVariableDeclaration *, llvm::Value *> > VariableScope; /**< Variables of a single scope, keyed by name */
+
+/**
+ *  Where CodeGenContext::setDebugLocations() stopped in a function. New blocks are only
+ *  appended to a function, and only blocks without a terminator get new instructions. */
+struct DebugCursor {
+    llvm::BasicBlock * last; /**< Newest block visited, NULL if none was */
+    std::vector<llvm::BasicBlock *> open; /**< Visited blocks that had no terminator yet */
+    DebugCursor() : last(NULL) { }
+};
 
 class CodeGenContext
 {
 public:
+    llvm::LLVMContext & llvmContext; /**< LLVMContext of the compilation, owning every type and constant of rootModule */
+    SemanticContext * semantics; /**< SemanticContext the program was analyzed with */
     llvm::Module * rootModule;
     llvm::IRBuilder<> * Builder;
     llvm::Function *mainFunction;
     std::stack<llvm::BasicBlock *> blocks, listblocks;
-    std::vector<std::map<std::string, std::pair<NVariableDeclaration *, llvm::Value *> > > variables;
+    std::vector<VariableScope> variables; /**< Stack of variable scopes, innermost last */
+    std::unordered_map<std::string, std::pair<NStructureDeclaration *, llvm::StructType *> > structs; /**< Generated structure types, keyed by name */
+    std::unordered_map<std::string, llvm::GlobalVariable *> stringLiterals; /**< Constant characters of the string literals, keyed by value */
+    int optLevel; /**< Optimization level (0-3) of the pass pipeline run by optimize() */
+    llvm::StructType * listType; /**< LLVM mirror of the runtime list_t structure, see ListFields */
+    llvm::TargetMachine * targetMachine; /**< Native TargetMachine, created on first use by createTargetMachine() */
+    bool useRegions; /**< Allocate the lists of eligible functions from a runtime region freed on return */
+    bool regionEscape; /**< Set while generating a function body if lists may outlive its region */
+    std::set<llvm::Function *> regionUnsafe; /**< Functions whose lists may escape, so callers may not use a region */
+    bool verbose; /**< Print progress messages while generating code */
+    bool useCounters; /**< Report the runtime's list operation counters at exit; list accesses go through the runtime */
+    bool debugInfo; /**< Emit DWARF line tables mapping the generated code to the source lines */
+    std::string sourceFile; /**< Path to the source file named in the debug info, empty for stdin */
+    llvm::DIBuilder * dbuilder; /**< Builder of the debug info, NULL unless debugInfo is set */
+    llvm::DIFile debugFile; /**< Source file of the debug info */
+    llvm::MDNode * debugScope; /**< Subprogram of the function being generated, NULL without debug info */
+    std::unordered_map<llvm::Function *, DebugCursor> debugCursors; /**< Where setDebugLocations() stopped in each function being generated */
+    std::vector<std::vector<llvm::Value *> > ownedLists; /**< Variables owning their list in each block of the function being generated, innermost last */
+    std::vector<size_t> loopScopes; /**< Number of blocks in ownedLists outside the body of each loop being generated, innermost last */
 //    std::vector<std::map<std::string, std::pair<NVariableDeclaration *, llvm::Value *> > > functions;
     
-    CodeGenContext();
-    ~CodeGenContext() { delete Builder; }
+    CodeGenContext(llvm::LLVMContext & llvmContext, SemanticContext * semantics);
+    ~CodeGenContext() { delete Builder; delete dbuilder; }
     void codeGen(NBlock * rootBlock);
-    llvm::Value * findVariable(std::string ident);
-    NVariableDeclaration * findVariableDeclaration(std::string ident);
+    llvm::MDNode * createDebugFunction(llvm::Function * func, int line);
+    void setDebugLocations(llvm::Function * func, int line, bool all = false);
+    void freeLists(size_t depth);
+    bool linkStdlib(const char * filename);
+    bool optimize();
+    bool createTargetMachine();
+    bool emitObject(const char * filename);
+    bool emitBitcode(const char * filename);
+    bool emitAssembly(const char * filename);
+    std::pair<NVariableDeclaration *, llvm::Value *> * find(const std::string & ident);
+    llvm::Value * findVariable(const std::string & ident);
+    NVariableDeclaration * findVariableDeclaration(const std::string & ident);
     void addVariable(NVariableDeclaration * var, llvm::Value * value);
-    llvm::GenericValue runProgram();
+    int runProgram(const char * runtime, int argc, char ** argv);
+    size_t instructionCount();
+    size_t bitcodeSize();
     void dump() { rootModule->dump(); }
 };
 
@@ -0,0 +1,124 @@
+/**
+   @file compilation.cpp
+   @brief Implementation of the state of compiling a single Crema program
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   Contains the Compilation implementation, which drives the reentrant lexer and parser
+*/
+
+#include "compilation.h"
+#include "ast.h"
+#include "parser.h"
+#include <cstdio>
+#include <iostream>
+
+int yylex_init_extra(Compilation * extra, yyscan_t * scanner);
+int yylex_destroy(yyscan_t scanner);
+void yyset_in(FILE * in, yyscan_t scanner);
+void yyset_debug(int debug, yyscan_t scanner);
+
+/**
+   Creates the state for compiling a file
+
+   @param filename Path to the input file, or an empty string to read stdin
+*/
+Compilation::Compilation(const std::string & filename) : filename(filename), source(NULL), codegen(llvmContext, &semantics), root(NULL), nodes(0), syntaxError(false)
+{
+}
+
+Compilation::~Compilation()
+{
+    if (Arena::current == &arena)
+    {
+	Arena::current = NULL;
+    }
+}
+
+/**
+   Makes this the compilation running on the calling thread, so that the AST
+   Nodes and Types it creates are allocated from its Arena
+*/
+void Compilation::activate()
+{
+    Arena::current = &arena;
+}
+
+/**
+   Parses the input, or source if it is set, into root with a scanner of its own
+
+   @param debug Whether the lexer should print debugging output
+   @return true if the input was parsed, false on an I/O or syntax error
+*/
+bool Compilation::parse(bool debug)
+{
+    FILE * in = stdin;
+    activate();
+    if (source)
+    {
+	if (source->empty())
+	{
+	    // Empty program; fmemopen() rejects empty buffers
+	    return true;
+	}
+	in = fmemopen((void *) source->data(), source->size(), "r");
+    }
+    else if (!filename.empty())
+    {
+	in = fopen(filename.c_str(), "r");
+    }
+    if (!in)
+    {
+	std::cout << "Cannot open file, " << filename << ".\n" << "Usage: ./cremacc -f <input file>\n";
+	return false;
+    }
+    NBlock::stdlibDecls();
+    Node::currentLine = 1;
+    size_t before = Node::count;
+    yyscan_t scanner;
+    yylex_init_extra(this, &scanner);
+    yyset_in(in, scanner);
+    yyset_debug(debug, scanner);
+    bool parsed = yyparse(scanner, this) == 0 && !syntaxError;
+    yylex_destroy(scanner);
+    if (in != stdin)
+    {
+	fclose(in);
+    }
+    nodes = Node::count - before;
+    return parsed;
+}
+
+/**
+   Reports a syntax error in the input
+
+   @param line Line of the input the error is on
+   @param msg Description of the error
+*/
+void Compilation::error(int line, const char * msg)
+{
+    std::cerr << "ERROR on line " << line;
+    if (!filename.empty())
+    {
+	std::cerr << " of " << filename;
+    }
+    std::cerr << ": " << msg << std::endl;
+    syntaxError = true;
+}
+
+thread_local std::streambuf * ThreadStreamBuf::target = NULL;
+
+int ThreadStreamBuf::overflow(int c)
+{
+    return (c == traits_type::eof()) ? traits_type::not_eof(c) : dest()->sputc(traits_type::to_char_type(c));
+}
+
+std::streamsize ThreadStreamBuf::xsputn(const char * s, std::streamsize n)
+{
+    return dest()->sputn(s, n);
+}
+
+int ThreadStreamBuf::sync()
+{
+    return dest()->pubsync();
+}
@@ -0,0 +1,76 @@
+/**
+   @file compilation.h
+   @brief Header file for the state of compiling a single Crema program
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   A Compilation owns everything needed to compile one input: the Arena holding
+   its AST, its SemanticContext, its CodeGenContext and the LLVMContext of the
+   generated module. The lexer and parser are reentrant and keep their state in
+   the Compilation, so separate inputs can be compiled concurrently, one per thread.
+*/
+
+#ifndef CREMA_COMPILATION_H_
+#define CREMA_COMPILATION_H_
+
+#include <cstddef>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <llvm/IR/LLVMContext.h>
+#include "arena.h"
+#include "codegen.h"
+#include "semantics.h"
+
+class NBlock;
+
+/**
+ *  The state of compiling one input file. A Compilation must be used on one thread
+ *  at a time, and activate() must be called on a thread before using it there. */
+class Compilation {
+public:
+    Compilation(const std::string & filename);
+    ~Compilation();
+    std::string filename; /**< Path to the input file, empty to read stdin */
+    const std::string * source; /**< Program text to parse instead of the input, or NULL */
+    Arena arena; /**< Memory of the AST and Types of the program */
+    llvm::LLVMContext llvmContext; /**< LLVMContext owning the generated module */
+    SemanticContext semantics; /**< Semantic information of the program */
+    CodeGenContext codegen; /**< Code generation state and generated module */
+    NBlock * root; /**< Root block of the program, NULL if the program is empty */
+    size_t nodes; /**< Number of AST nodes created while parsing */
+    std::ostringstream diagnostics; /**< Messages printed while compiling alongside other inputs, see ThreadStreamBuf */
+    bool syntaxError; /**< Set when the lexer or parser reports an error */
+    void activate();
+    bool parse(bool debug);
+    void error(int line, const char * msg);
+private:
+    Compilation(const Compilation &);
+    Compilation & operator=(const Compilation &);
+};
+
+/**
+ *  A stream buffer standing in for the buffer of a stream, which sends what each thread
+ *  writes to the buffer set for that thread with redirect(), or else to the buffer it
+ *  replaced. Installed on std::cout and std::cerr while inputs are compiled concurrently,
+ *  so that the messages of each input can be printed together. */
+class ThreadStreamBuf : public std::streambuf {
+public:
+    ThreadStreamBuf(std::ostream & os) : os(os), orig(os.rdbuf(this)) { }
+    ~ThreadStreamBuf() { os.rdbuf(orig); }
+    static void redirect(std::streambuf * buf) { target = buf; } /**< Sends the calling thread's output to buf, or back to the stream's own buffer if NULL */
+protected:
+    int overflow(int c);
+    std::streamsize xsputn(const char * s, std::streamsize n);
+    int sync();
+private:
+    std::ostream & os; /**< Stream the buffer is installed on */
+    std::streambuf * orig; /**< Buffer of the stream before */
+    static thread_local std::streambuf * target; /**< Buffer the calling thread's output goes to, NULL for orig */
+    std::streambuf * dest() { return target ? target : orig; }
+    ThreadStreamBuf(const ThreadStreamBuf &);
+    ThreadStreamBuf & operator=(const ThreadStreamBuf &);
+};
+
+#endif // CREMA_COMPILATION_H_
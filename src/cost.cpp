@@ -0,0 +1,841 @@
+/**
+   @file cost.cpp
+   @brief Implementation of the static worst-case cost analysis
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   Contains the CostPoly arithmetic and the CostAnalysis. Functions are analyzed callees
+   first, so every call is costed by substituting the bounds of its arguments into the
+   summary of its callee.
+*/
+
+#include "cost.h"
+#include "ast.h"
+#include "parser.h"
+#include "semantics.h"
+#include <algorithm>
+
+/**
+   Adds two coefficients, saturating instead of overflowing
+
+   @param a First coefficient
+   @param b Second coefficient
+   @return a + b, or UINT64_MAX
+*/
+static uint64_t satAdd(uint64_t a, uint64_t b)
+{
+    return a + b < a ? UINT64_MAX : a + b;
+}
+
+/**
+   Multiplies two coefficients, saturating instead of overflowing
+
+   @param a First coefficient
+   @param b Second coefficient
+   @return a * b, or UINT64_MAX
+*/
+static uint64_t satMul(uint64_t a, uint64_t b)
+{
+    return (a && b > UINT64_MAX / a) ? UINT64_MAX : a * b;
+}
+
+/**
+   Creates the polynomial of a single symbol
+
+   @param name Name of the symbol
+   @return The polynomial 1*name
+*/
+CostPoly CostPoly::symbol(const std::string & name)
+{
+    CostPoly p;
+    p.terms[Monomial(1, name)] = 1;
+    return p;
+}
+
+/**
+   Adds a term, folding every term with the COST_UNBOUNDED symbol into COST_UNBOUNDED
+
+   @param m Monomial of the term
+   @param c Coefficient of the term
+*/
+void CostPoly::add(Monomial m, uint64_t c)
+{
+    if (std::find(m.begin(), m.end(), COST_UNBOUNDED) != m.end())
+    {
+	// Nothing bounds the term, whatever it is multiplied by
+	terms[Monomial(1, COST_UNBOUNDED)] = 1;
+	return;
+    }
+    uint64_t & t = terms[m];
+    t = satAdd(t, c);
+}
+
+CostPoly & CostPoly::operator+=(const CostPoly & p)
+{
+    for (auto & t : p.terms)
+    {
+	add(t.first, t.second);
+    }
+    return *this;
+}
+
+CostPoly CostPoly::operator+(const CostPoly & p) const
+{
+    CostPoly r = *this;
+    r += p;
+    return r;
+}
+
+CostPoly CostPoly::operator*(const CostPoly & p) const
+{
+    CostPoly r;
+    for (auto & a : terms)
+    {
+	for (auto & b : p.terms)
+	{
+	    Monomial m = a.first;
+	    m.insert(m.end(), b.first.begin(), b.first.end());
+	    std::sort(m.begin(), m.end());
+	    r.add(m, satMul(a.second, b.second));
+	}
+    }
+    return r;
+}
+
+/**
+   Subtracts a polynomial term by term, dropping the terms that would become negative.
+   Used to find how much a polynomial grew.
+
+   @param p Polynomial to subtract
+   @return The difference
+*/
+CostPoly CostPoly::minus(const CostPoly & p) const
+{
+    CostPoly r;
+    for (auto & t : terms)
+    {
+	auto it = p.terms.find(t.first);
+	uint64_t sub = it == p.terms.end() ? 0 : it->second;
+	if (t.second > sub)
+	    r.terms[t.first] = t.second - sub;
+    }
+    return r;
+}
+
+/**
+   Replaces symbols by polynomials
+
+   @param values Polynomial to replace each symbol with, symbols not in it are kept
+   @return The polynomial after the replacement
+*/
+CostPoly CostPoly::substitute(const std::map<std::string, CostPoly> & values) const
+{
+    CostPoly r;
+    for (auto & t : terms)
+    {
+	CostPoly m(t.second);
+	for (auto & s : t.first)
+	{
+	    auto it = values.find(s);
+	    m = m * (it == values.end() ? symbol(s) : it->second);
+	}
+	r += m;
+    }
+    return r;
+}
+
+/**
+   Evaluates the polynomial with every symbol set to the same value
+
+   @param n Value of the symbols
+   @return The value of the polynomial, or UINT64_MAX if it overflows or is unbounded
+*/
+uint64_t CostPoly::evaluate(uint64_t n) const
+{
+    uint64_t r = 0;
+    for (auto & t : terms)
+    {
+	if (t.first == Monomial(1, COST_UNBOUNDED))
+	    return UINT64_MAX;
+	uint64_t v = t.second;
+	for (size_t i = 0; i < t.first.size(); i++)
+	    v = satMul(v, n);
+	r = satAdd(r, v);
+    }
+    return r;
+}
+
+/**
+   Formats the polynomial, lowest degree first (e.g. "3 + 2*len(l) + len(l)*n")
+
+   @return The formatted polynomial
+*/
+std::string CostPoly::str() const
+{
+    std::vector<std::pair<Monomial, uint64_t> > sorted(terms.begin(), terms.end());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const std::pair<Monomial, uint64_t> & a, const std::pair<Monomial, uint64_t> & b) {
+	    return a.first.size() < b.first.size();
+	});
+    std::string s;
+    for (auto & t : sorted)
+    {
+	std::string m = t.second == UINT64_MAX ? "inf" : std::to_string(t.second);
+	if (t.second == 1 && !t.first.empty())
+	    m.clear();
+	for (auto & sym : t.first)
+	    m += (m.empty() ? "" : "*") + sym;
+	s += (s.empty() ? "" : " + ") + m;
+    }
+    return s.empty() ? "0" : s;
+}
+
+/**
+   Computes the cost bounds of every function with a body, then of the top-level block
+
+   @param root Root of the AST, after semantic analysis
+*/
+void CostAnalysis::analyze(NBlock * root)
+{
+    if (root)
+    {
+	for (auto s : root->statements)
+	{
+	    if (NVariableDeclaration * vd = dynamic_cast<NVariableDeclaration *>(s))
+		globalDecls[&vd->ident.value] = vd;
+	}
+    }
+    for (auto func : ctx->callOrder)
+    {
+	analyzeFunction(func);
+    }
+    current = NULL;
+    globals.clear();
+    if (root)
+    {
+	CostState state;
+	programCost = blockCost(*root, state);
+    }
+}
+
+/**
+   Computes the summary of a function, with its list parameters of length len(name),
+   its int parameters of magnitude name and the globals it uses bounded by ::name
+
+   @param func Function to analyze
+*/
+void CostAnalysis::analyzeFunction(NFunctionDeclaration * func)
+{
+    CostState state;
+    current = &funcs[func];
+    globals.clear();
+    order.push_back(func);
+    for (auto p : func->variables)
+    {
+	state.decls[&p->ident.value] = p;
+	if (p->type.isList)
+	    state.lens[&p->ident.value] = CostPoly::symbol("len(" + p->ident.value + ")");
+	else
+	    state.ints[&p->ident.value] = CostPoly::symbol(p->ident.value);
+    }
+    current->cost = blockCost(*func->body, state);
+    for (auto p : func->variables)
+    {
+	if (p->type.isList)
+	{
+	    CostPoly g = state.lens[&p->ident.value].minus(CostPoly::symbol("len(" + p->ident.value + ")"));
+	    current->growth[&p->ident.value] = g;
+	}
+    }
+    for (auto g : globals)
+    {
+	if (state.lens.count(g))
+	    current->globals.lens[g] = state.lens[g];
+	if (state.ints.count(g))
+	    current->globals.ints[g] = state.ints[g];
+    }
+}
+
+CostPoly CostAnalysis::blockCost(NBlock & block, CostState & state)
+{
+    CostPoly c;
+    for (auto s : block.statements)
+    {
+	c += stmtCost(s, state);
+    }
+    return c;
+}
+
+/**
+   Names the symbol a function bounds a global it uses by
+
+   @param name Name of the global
+   @param list Whether the global is a list
+   @return The symbol, ::name or len(::name)
+*/
+static std::string globalSymbol(const std::string & name, bool list)
+{
+    return list ? "len(::" + name + ")" : "::" + name;
+}
+
+/**
+   Finds the length bound of a list variable. A function bounds the globals it uses
+   by the symbol len(::name), which calls replace by the bound at the call site.
+
+   @param name Interned name of the list
+   @param state Bounds on the variables in scope
+   @return Reference to the length bound
+*/
+CostPoly & CostAnalysis::lenVar(const std::string & name, CostState & state)
+{
+    auto it = state.lens.find(&name);
+    if (it == state.lens.end())
+    {
+	globals.insert(&name);
+	it = state.lens.insert(std::make_pair(&name, CostPoly::symbol(current ? globalSymbol(name, true) : COST_UNBOUNDED))).first;
+    }
+    return it->second;
+}
+
+/**
+   Finds the magnitude bound of an int variable. A function bounds the globals it uses
+   by the symbol ::name, which calls replace by the bound at the call site.
+
+   @param name Interned name of the int
+   @param state Bounds on the variables in scope
+   @return Reference to the magnitude bound
+*/
+CostPoly & CostAnalysis::intVar(const std::string & name, CostState & state)
+{
+    auto it = state.ints.find(&name);
+    if (it == state.ints.end())
+    {
+	globals.insert(&name);
+	it = state.ints.insert(std::make_pair(&name, CostPoly::symbol(current ? globalSymbol(name, false) : COST_UNBOUNDED))).first;
+    }
+    return it->second;
+}
+
+/**
+   Adds elements to a list variable, leaving every list that may be the same list
+   unbounded, since the analysis does not know which of them grew
+
+   @param name Interned name of the list
+   @param n Number of elements added
+   @param state Bounds on the variables in scope
+*/
+void CostAnalysis::grow(const std::string & name, const CostPoly & n, CostState & state)
+{
+    lenVar(name, state) += n;
+    if (!(n == CostPoly()))
+    {
+	unboundAliases(name, state);
+    }
+}
+
+/**
+   Leaves the length of every list that may be the same list as a list variable
+   (see NVariableDeclaration::mayShareList) unbounded, after the length of that list
+   changed. Inside a function, the globals it uses count too.
+
+   @param name Interned name of the list that changed
+   @param state Bounds on the variables in scope
+*/
+void CostAnalysis::unboundAliases(const std::string & name, CostState & state)
+{
+    auto decl = [&](const std::string * n) -> NVariableDeclaration * {
+	auto it = state.decls.find(n);
+	if (it != state.decls.end())
+	    return it->second;
+	auto g = globalDecls.find(n);
+	return g != globalDecls.end() ? g->second : NULL;
+    };
+    NVariableDeclaration * changed = decl(&name);
+    std::vector<const std::string *> others;
+    for (auto & d : state.decls)
+	others.push_back(d.first);
+    if (current)
+	others.insert(others.end(), globals.begin(), globals.end());
+    for (auto other : others)
+    {
+	NVariableDeclaration * vd = decl(other);
+	if (other != &name && vd && vd->mayShareList(changed))
+	    lenVar(*other, state) = CostPoly::symbol(COST_UNBOUNDED);
+    }
+}
+
+/**
+   Merges the bounds after two branches, of which only one runs. The sum of two
+   bounds bounds either of them.
+
+   @param state Bounds after the first branch, updated to bound both
+   @param other Bounds after the second branch
+*/
+static void joinBounds(std::unordered_map<const std::string *, CostPoly> & state, const std::unordered_map<const std::string *, CostPoly> & other)
+{
+    for (auto & v : other)
+    {
+	auto it = state.find(v.first);
+	if (it == state.end())
+	    state.insert(v);
+	else if (!(it->second == v.second))
+	    it->second += v.second;
+    }
+}
+
+/**
+   Computes the cost of a statement and updates the bounds of the variables it changes
+
+   @param stmt Statement to analyze
+   @param state Bounds on the variables in scope
+   @return The cost of executing the statement
+*/
+CostPoly CostAnalysis::stmtCost(NStatement * stmt, CostState & state)
+{
+    CostPoly c(1);
+    if (dynamic_cast<NFunctionDeclaration *>(stmt) || dynamic_cast<NStructureDeclaration *>(stmt))
+    {
+	return CostPoly();
+    }
+    if (NVariableDeclaration * vd = dynamic_cast<NVariableDeclaration *>(stmt))
+    {
+	NExpression * init = vd->initializationExpression;
+	c += exprCost(init, state);
+	state.decls[&vd->ident.value] = vd;
+	if (vd->type.isList)
+	    state.lens[&vd->ident.value] = init ? lenOf(init, state) : CostPoly();
+	else
+	    state.ints[&vd->ident.value] = init ? intBound(init, state) : CostPoly();
+    }
+    else if (NListAssignmentStatement * la = dynamic_cast<NListAssignmentStatement *>(stmt))
+    {
+	c += exprCost(la->list.index, state) + exprCost(&la->expr, state);
+	if (!la->list.index)
+	    grow(la->list.ident.value, CostPoly(1), state);
+    }
+    else if (NStructureAssignmentStatement * sa = dynamic_cast<NStructureAssignmentStatement *>(stmt))
+    {
+	c += exprCost(sa->structure.index, state) + exprCost(&sa->expr, state);
+    }
+    else if (NAssignmentStatement * as = dynamic_cast<NAssignmentStatement *>(stmt))
+    {
+	c += exprCost(&as->expr, state);
+	if (state.lens.count(&as->ident.value) || as->expr.type.isList)
+	{
+	    CostPoly len = lenOf(&as->expr, state);
+	    lenVar(as->ident.value, state) = len;
+	}
+	else
+	    // The value may grow on every iteration of an enclosing loop
+	    intVar(as->ident.value, state) = CostPoly::symbol(COST_UNBOUNDED);
+    }
+    else if (NReturn * ret = dynamic_cast<NReturn *>(stmt))
+    {
+	c += exprCost(&ret->retExpr, state);
+	if (current)
+	    current->retLen += lenOf(&ret->retExpr, state);
+    }
+    else if (NIfStatement * is = dynamic_cast<NIfStatement *>(stmt))
+    {
+	// Both branches are counted, which bounds whichever one runs
+	c += exprCost(&is->condition, state);
+	CostState other = state;
+	c += blockCost(is->thenblock, state);
+	if (is->elseblock)
+	    c += blockCost(*is->elseblock, other);
+	if (is->elseif)
+	    c += stmtCost(is->elseif, other);
+	joinBounds(state.lens, other.lens);
+	joinBounds(state.ints, other.ints);
+    }
+    else if (NLoopStatement * ls = dynamic_cast<NLoopStatement *>(stmt))
+    {
+	// The length is read once, before the first iteration
+	CostPoly trips = lenVar(ls->list.value, state);
+	// The elements are only known at run time
+	state.ints[&ls->asVar.value] = CostPoly::symbol(COST_UNBOUNDED);
+	c += loopCost(ls->loopBlock, trips, state);
+    }
+    else if (NRangeLoopStatement * rl = dynamic_cast<NRangeLoopStatement *>(stmt))
+    {
+	c += exprCost(&rl->start, state) + exprCost(&rl->end, state);
+	CostPoly trips = rangeTrips(&rl->start, &rl->end, state);
+	state.ints[&rl->asVar.value] = intBound(&rl->start, state) + intBound(&rl->end, state);
+	c += loopCost(rl->loopBlock, trips, state);
+    }
+    else if (NFunctionCall * fc = dynamic_cast<NFunctionCall *>(stmt))
+    {
+	c += callCost(fc, state);
+    }
+    return c;
+}
+
+/**
+   Computes the cost of a loop. Two passes over the body find how much each list grows
+   in the first two iterations. A list that grows by the same amount in both grows by
+   that amount per iteration, one set to the same length by both keeps that length, and
+   any other (e.g. one concatenated with itself) may grow geometrically, so is unbounded.
+   The body is then costed with every list at its length after the last iteration,
+   which bounds its length in every iteration.
+
+   @param body Body of the loop
+   @param trips Bound on the number of iterations
+   @param state Bounds on the variables in scope, updated to after the loop
+   @return The cost of all the iterations
+*/
+CostPoly CostAnalysis::loopCost(NBlock & body, const CostPoly & trips, CostState & state)
+{
+    CostState before = state;
+    blockCost(body, state);
+    CostState first = state;
+    blockCost(body, state);
+    for (auto & l : state.lens)
+    {
+	auto it = before.lens.find(l.first);
+	CostPoly entry = it != before.lens.end() ? it->second : CostPoly();
+	if (it == before.lens.end() && current && globals.count(l.first))
+	    // A global first used in the loop
+	    entry = CostPoly::symbol(globalSymbol(*l.first, true));
+	CostPoly once = first.lens.count(l.first) ? first.lens[l.first] : CostPoly();
+	CostPoly growth = once.minus(entry);
+	if (l.second == once)
+	    // The loop may also not run at all
+	    l.second = once == entry ? entry : entry + once;
+	else if (l.second.minus(once) == growth && once == entry + growth)
+	    l.second = entry + trips * growth;
+	else
+	    l.second = CostPoly::symbol(COST_UNBOUNDED);
+    }
+    std::unordered_map<const std::string *, CostPoly> after = state.lens;
+    // Each iteration also costs one unit for stepping the loop
+    CostPoly c = trips * (blockCost(body, state) + CostPoly(1));
+    state.lens = after;
+    return c;
+}
+
+/**
+   Computes the cost of evaluating an expression, including the calls it makes
+
+   @param expr Expression to analyze, may be NULL
+   @param state Bounds on the variables in scope
+   @return The cost of the expression
+*/
+CostPoly CostAnalysis::exprCost(NExpression * expr, CostState & state)
+{
+    if (!expr || expr->folded)
+    {
+	return CostPoly();
+    }
+    if (NBinaryOperator * op = dynamic_cast<NBinaryOperator *>(expr))
+    {
+	return exprCost(&op->lhs, state) + exprCost(&op->rhs, state);
+    }
+    if (NListAccess * la = dynamic_cast<NListAccess *>(expr))
+    {
+	return exprCost(la->index, state);
+    }
+    if (NStructureAccess * sa = dynamic_cast<NStructureAccess *>(expr))
+    {
+	return exprCost(sa->index, state);
+    }
+    if (NList * l = dynamic_cast<NList *>(expr))
+    {
+	CostPoly c(l->value.size());
+	for (auto e : l->value)
+	    c += exprCost(e, state);
+	return c;
+    }
+    if (NFunctionCall * fc = dynamic_cast<NFunctionCall *>(expr))
+    {
+	return callCost(fc, state);
+    }
+    return CostPoly();
+}
+
+/**
+   Binds the parameters of a function to the bounds of the arguments of a call
+
+   @param func Function called
+   @param call Call of the function
+   @param state Bounds on the variables in scope
+   @return The polynomial to substitute for each parameter and global symbol
+*/
+std::map<std::string, CostPoly> CostAnalysis::bindings(NFunctionDeclaration * func, NFunctionCall * call, CostState & state)
+{
+    std::map<std::string, CostPoly> values;
+    for (size_t i = 0; i < func->variables.size() && i < call->args.size(); i++)
+    {
+	NVariableDeclaration * p = func->variables[i];
+	if (p->type.isList)
+	    values["len(" + p->ident.value + ")"] = lenOf(call->args[i], state);
+	else
+	    values[p->ident.value] = intBound(call->args[i], state);
+    }
+    auto it = funcs.find(func);
+    if (it != funcs.end())
+    {
+	for (auto & g : it->second.globals.lens)
+	    values[globalSymbol(*g.first, true)] = lenVar(*g.first, state);
+	for (auto & g : it->second.globals.ints)
+	    values[globalSymbol(*g.first, false)] = intVar(*g.first, state);
+    }
+    return values;
+}
+
+/**
+   Computes the cost of a call and applies its effects on the lengths of the lists
+   passed to it. Runtime functions cost one unit, plus one per element for those that
+   process whole lists.
+
+   @param call Call to analyze
+   @param state Bounds on the variables in scope
+   @return The cost of the call, including its arguments
+*/
+CostPoly CostAnalysis::callCost(NFunctionCall * call, CostState & state)
+{
+    CostPoly c(1);
+    ExpressionList & args = call->args;
+    for (auto a : args)
+    {
+	c += exprCost(a, state);
+    }
+    NFunctionDeclaration * func = ctx->searchFuncs(call->ident);
+    if (!func)
+    {
+	return c;
+    }
+    if (func->body)
+    {
+	auto it = funcs.find(func);
+	if (it == funcs.end())
+	    return c;
+	std::map<std::string, CostPoly> values = bindings(func, call, state);
+	c += it->second.cost.substitute(values);
+	for (size_t i = 0; i < func->variables.size() && i < args.size(); i++)
+	{
+	    NVariableAccess * va = dynamic_cast<NVariableAccess *>(args[i]);
+	    auto g = it->second.growth.find(&func->variables[i]->ident.value);
+	    if (va && g != it->second.growth.end())
+		grow(va->ident.value, g->second.substitute(values), state);
+	}
+	for (auto & g : it->second.globals.lens)
+	{
+	    CostPoly after = g.second.substitute(values);
+	    CostPoly & len = lenVar(*g.first, state);
+	    if (!(len == after))
+	    {
+		len = after;
+		unboundAliases(*g.first, state);
+	    }
+	}
+	for (auto & g : it->second.globals.ints)
+	    intVar(*g.first, state) = g.second.substitute(values);
+	return c;
+    }
+
+    const std::string & name = call->ident.value;
+    NVariableAccess * first = args.empty() ? NULL : dynamic_cast<NVariableAccess *>(args[0]);
+    if (name == "str_print" || name == "str_println" || name == "int_list_print" || name == "double_list_print" ||
+	name == "int_list_copy" || name == "double_list_copy" || name == "str_copy" ||
+	name == "int_list_slice" || name == "double_list_slice" || name == "string_to_int" || name == "string_to_double" ||
+	name == "int_list_sum" || name == "int_list_min" || name == "int_list_max" || name == "int_list_dot" ||
+	name == "int_list_add" || name == "int_list_scale" || name == "double_list_sum" || name == "double_list_min" ||
+	name == "double_list_max" || name == "double_list_dot" || name == "double_list_add" || name == "double_list_scale")
+    {
+	c += lenOf(args[0], state);
+    }
+    else if (name == "str_find")
+    {
+	c += lenOf(args[0], state) * lenOf(args[1], state);
+    }
+    else if (name == "read_line" || name == "read_all" || name == "read_file")
+    {
+	c += CostPoly::symbol(COST_INPUT);
+    }
+    else if (name == "crema_seq")
+    {
+	c += rangeTrips(args[0], args[1], state);
+    }
+    else if (name == "int_list_append" || name == "double_list_append" || name == "str_append")
+    {
+	if (first)
+	    grow(first->ident.value, CostPoly(1), state);
+    }
+    else if (name == "int_list_concat" || name == "double_list_concat" || name == "str_concat")
+    {
+	CostPoly n = lenOf(args[1], state);
+	c += n;
+	if (first)
+	    grow(first->ident.value, n, state);
+    }
+    else if (name == "int_list_insert_range" || name == "double_list_insert_range" || name == "str_insert_range")
+    {
+	// The elements after the index are moved
+	CostPoly n = lenOf(args[2], state);
+	c += lenOf(args[0], state) + n;
+	if (first)
+	    grow(first->ident.value, n, state);
+    }
+    return c;
+}
+
+/**
+   Bounds the length of a list expression
+
+   @param expr List expression
+   @param state Bounds on the variables in scope
+   @return The bound, COST_INPUT for lists whose length is only known at run time
+*/
+CostPoly CostAnalysis::lenOf(NExpression * expr, CostState & state)
+{
+    if (expr && expr->folded)
+    {
+	return lenOf(expr->folded, state);
+    }
+    if (NString * s = dynamic_cast<NString *>(expr))
+    {
+	return CostPoly(s->value.size());
+    }
+    if (NList * l = dynamic_cast<NList *>(expr))
+    {
+	return CostPoly(l->value.size());
+    }
+    if (NVariableAccess * va = dynamic_cast<NVariableAccess *>(expr))
+    {
+	return lenVar(va->ident.value, state);
+    }
+    NFunctionCall * call = dynamic_cast<NFunctionCall *>(expr);
+    NFunctionDeclaration * func = call ? ctx->searchFuncs(call->ident) : NULL;
+    if (!func)
+    {
+	return CostPoly::symbol(COST_INPUT);
+    }
+    if (func->body)
+    {
+	auto it = funcs.find(func);
+	if (it == funcs.end())
+	    return CostPoly::symbol(COST_INPUT);
+	return it->second.retLen.substitute(bindings(func, call, state));
+    }
+    const std::string & name = call->ident.value;
+    if (name == "int_list_create" || name == "double_list_create" || name == "str_create")
+    {
+	return CostPoly();
+    }
+    if (name == "int_list_copy" || name == "double_list_copy" || name == "str_copy" ||
+	name == "int_list_slice" || name == "double_list_slice" || name == "str_substr" ||
+	name == "int_list_add" || name == "int_list_scale" || name == "double_list_add" || name == "double_list_scale")
+    {
+	return lenOf(call->args[0], state);
+    }
+    if (name == "crema_seq")
+    {
+	return rangeTrips(call->args[0], call->args[1], state);
+    }
+    if (name == "int_to_string")
+    {
+	return CostPoly(20);
+    }
+    return CostPoly::symbol(COST_INPUT);
+}
+
+/**
+   Finds the value of an int literal
+
+   @param expr Expression to check
+   @param value Set to the value of the literal
+   @return true if the expression is an int literal (or was folded to one)
+*/
+static bool constInt(NExpression * expr, int64_t & value)
+{
+    if (expr && expr->folded)
+    {
+	expr = expr->folded;
+    }
+    NInt * n = dynamic_cast<NInt *>(expr);
+    if (n)
+    {
+	value = n->value;
+    }
+    return n != NULL;
+}
+
+/**
+   Bounds the magnitude of an int expression, so that the bounds of differences
+   and quotients hold for negative values too
+
+   @param expr Int expression
+   @param state Bounds on the variables in scope
+   @return The bound, COST_UNBOUNDED for values only known at run time
+*/
+CostPoly CostAnalysis::intBound(NExpression * expr, CostState & state)
+{
+    int64_t v;
+    if (constInt(expr, v))
+    {
+	return CostPoly(v < 0 ? (uint64_t) 0 - (uint64_t) v : v);
+    }
+    if (NVariableAccess * va = dynamic_cast<NVariableAccess *>(expr))
+    {
+	return intVar(va->ident.value, state);
+    }
+    if (NBinaryOperator * op = dynamic_cast<NBinaryOperator *>(expr))
+    {
+	switch (op->op)
+	{
+	case TADD:
+	case TSUB:
+	    return intBound(&op->lhs, state) + intBound(&op->rhs, state);
+	case TMUL:
+	    return intBound(&op->lhs, state) * intBound(&op->rhs, state);
+	case TDIV:
+	    return intBound(&op->lhs, state);
+	case TMOD:
+	    return intBound(&op->rhs, state);
+	}
+    }
+    NFunctionCall * call = dynamic_cast<NFunctionCall *>(expr);
+    if (call && call->ident.value == "list_length" && call->args.size() == 1)
+    {
+	return lenOf(call->args[0], state);
+    }
+    return CostPoly::symbol(COST_UNBOUNDED);
+}
+
+/**
+   Bounds the number of iterations of a range, end - start + 1
+
+   @param start First value of the range
+   @param end Last value of the range
+   @param state Bounds on the variables in scope
+   @return The bound
+*/
+CostPoly CostAnalysis::rangeTrips(NExpression * start, NExpression * end, CostState & state)
+{
+    int64_t s, e;
+    bool cs = constInt(start, s);
+    if (cs && constInt(end, e))
+    {
+	return CostPoly(e >= s ? (uint64_t) e - (uint64_t) s + 1 : 0);
+    }
+    // A positive constant start cannot be subtracted from the magnitude of the end
+    return intBound(end, state) + CostPoly(1) + (cs && s >= 0 ? CostPoly() : intBound(start, state));
+}
+
+/**
+   Prints the cost bounds as a JSON object of the form
+   {"input_size": N, "functions": [{"name": ..., "cost": ..., "bound": ...}], "program": {"cost": ..., "bound": ...}}
+   where each cost is a polynomial and each bound its value with every symbol set to N
+
+   @param os Output stream to print to
+   @param inputSize Value of the symbols for the bounds
+*/
+void CostAnalysis::reportJSON(std::ostream & os, uint64_t inputSize) const
+{
+    os << "{\"input_size\": " << inputSize << ", \"functions\": [";
+    for (size_t i = 0; i < order.size(); i++)
+    {
+	const CostPoly & c = funcs.at(order[i]).cost;
+	os << (i ? ", " : "") << "{\"name\": \"" << order[i]->ident.value << "\", \"cost\": \"" << c.str() << "\", \"bound\": " << c.evaluate(inputSize) << "}";
+    }
+    os << "], \"program\": {\"cost\": \"" << programCost.str() << "\", \"bound\": " << programCost.evaluate(inputSize) << "}}" << std::endl;
+}
@@ -0,0 +1,100 @@
+/**
+   @file cost.h
+   @brief Header file for the static worst-case cost analysis
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   Every Crema loop is bounded by the length of a list or by a range, so the work a
+   program does is bounded by a polynomial in the lengths of its inputs. The
+   CostAnalysis computes such a bound for each function, in terms of its parameters,
+   and for the top-level block, in terms of the data read at run time. One unit of
+   cost is one statement executed, or one list element processed by a runtime function.
+*/
+
+#ifndef CREMA_COST_H_
+#define CREMA_COST_H_
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "decls.h"
+
+#define COST_DEFAULT_INPUT_SIZE 1024
+#define COST_INPUT "input" /**< Symbol for the length of lists read at run time (stdin, files, arguments) */
+#define COST_UNBOUNDED "unbounded" /**< Symbol for values no polynomial bounds, such as ints read or reassigned at run time */
+
+/**
+ *  A polynomial with non-negative coefficients over symbols: the lengths of lists
+ *  (len(l)) and the magnitudes of ints (n) a cost depends on. Coefficients saturate,
+ *  and a term with the COST_UNBOUNDED symbol evaluates to UINT64_MAX. */
+class CostPoly {
+public:
+    CostPoly() { }
+    CostPoly(uint64_t c) { if (c) terms[Monomial()] = c; }
+    static CostPoly symbol(const std::string & name);
+    CostPoly & operator+=(const CostPoly & p);
+    CostPoly operator+(const CostPoly & p) const;
+    CostPoly operator*(const CostPoly & p) const;
+    CostPoly minus(const CostPoly & p) const;
+    bool operator==(const CostPoly & p) const { return terms == p.terms; }
+    CostPoly substitute(const std::map<std::string, CostPoly> & values) const;
+    uint64_t evaluate(uint64_t n) const;
+    std::string str() const;
+private:
+    typedef std::vector<std::string> Monomial; /**< Product of symbols, sorted */
+    std::map<Monomial, uint64_t> terms; /**< Coefficient of each monomial */
+    void add(Monomial m, uint64_t c);
+};
+
+/**
+ *  Computes worst-case cost bounds for the functions of a program and its top-level
+ *  block, assuming functions do not shadow the globals they use. A change to the length
+ *  of a list leaves the length of every list that may be the same list unbounded. */
+class CostAnalysis {
+public:
+    CostAnalysis(SemanticContext * ctx) : ctx(ctx), current(NULL) { }
+    void analyze(NBlock * root);
+    void reportJSON(std::ostream & os, uint64_t inputSize) const;
+    CostPoly programCost; /**< Cost of running the program */
+private:
+    /** Bounds on the variables in scope */
+    struct CostState {
+	std::unordered_map<const std::string *, CostPoly> lens; /**< Length of each list variable */
+	std::unordered_map<const std::string *, CostPoly> ints; /**< Value of each int variable */
+	std::unordered_map<const std::string *, NVariableDeclaration *> decls; /**< Declaration of each variable declared in the block analyzed, and of the parameters */
+    };
+    /** What a call to a function costs and does to the lengths of lists */
+    struct FunctionCost {
+	CostPoly cost; /**< Cost of a call, in terms of the parameters */
+	CostPoly retLen; /**< Length of the returned list, if the function returns one */
+	std::map<const std::string *, CostPoly> growth; /**< Elements added to each list parameter */
+	CostState globals; /**< Bounds on the globals it uses when it returns, in terms of their bounds (::name) before the call */
+    };
+    SemanticContext * ctx; /**< Semantic information of the program, for looking up functions */
+    std::unordered_map<NFunctionDeclaration *, FunctionCost> funcs; /**< Functions analyzed so far */
+    FunctionList order; /**< Functions in the order they were analyzed, callees first */
+    FunctionCost * current; /**< Function being analyzed, NULL at the top level */
+    std::set<const std::string *> globals; /**< Globals used by the function being analyzed */
+    std::unordered_map<const std::string *, NVariableDeclaration *> globalDecls; /**< Declarations of the variables of the top-level block */
+
+    void analyzeFunction(NFunctionDeclaration * func);
+    CostPoly blockCost(NBlock & block, CostState & state);
+    CostPoly stmtCost(NStatement * stmt, CostState & state);
+    CostPoly loopCost(NBlock & body, const CostPoly & trips, CostState & state);
+    CostPoly exprCost(NExpression * expr, CostState & state);
+    CostPoly callCost(NFunctionCall * call, CostState & state);
+    CostPoly lenOf(NExpression * expr, CostState & state);
+    CostPoly intBound(NExpression * expr, CostState & state);
+    CostPoly rangeTrips(NExpression * start, NExpression * end, CostState & state);
+    CostPoly & lenVar(const std::string & name, CostState & state);
+    CostPoly & intVar(const std::string & name, CostState & state);
+    void grow(const std::string & name, const CostPoly & n, CostState & state);
+    void unboundAliases(const std::string & name, CostState & state);
+    std::map<std::string, CostPoly> bindings(NFunctionDeclaration * func, NFunctionCall * call, CostState & state);
+};
+
+#endif // CREMA_COST_H_
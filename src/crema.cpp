@@ -6,88 +6,188 @@
 
    A main function to read in an input. It will parse and perform semantic
    analysis on the input and either exit(0) if it passes both, -1 otherwise.
+   Several inputs given with repeated -f options are compiled concurrently.
  */
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include "ast.h"
+#include "ceval.h"
+#include "cost.h"
+#include "escape.h"
 #include "codegen.h"
+#include "compilation.h"
+#include "cache.h"
+#include "timing.h"
+#include "server.h"
 #include "ezOptionParser.hpp"
 #include "llvm/CodeGen/AsmPrinter.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Threading.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 
-extern NBlock *rootBlock;
-extern int yyparse();
-extern "C" FILE *yyin;
+static PhaseTimer phaseTimer; /**< Phase timings of the compilation, recorded with -time-phases or -time-json */
+static bool printPhases = false; /**< Whether to print the phase timings on exit */
+static std::string phaseJSON; /**< File to write the phase timings to as JSON on exit, "-" for stdout */
 
-void yyset_debug(int);
+/**
+   Reports the phase timings on exit, however cremacc exits
+*/
+static void reportPhases()
+{
+    phaseTimer.stop();
+    if (printPhases)
+    {
+	phaseTimer.report(std::cout);
+    }
+    if (phaseJSON == "-")
+    {
+	phaseTimer.reportJSON(std::cout);
+    }
+    else if (!phaseJSON.empty())
+    {
+	std::ofstream out(phaseJSON.c_str());
+	phaseTimer.reportJSON(out);
+    }
+}
 
-int main(int argc, const char *argv[])
+/**
+   Prints the hit and miss counts accumulated in the cache directory
+
+   @param cache CompileCache to report on
+*/
+static void printCacheStats(const CompileCache & cache)
 {
-    // Handling command-line options
-    ez::ezOptionParser opt;
-    opt.overview = "Crema Compiler for Sub-Turing Complete Programs";
-    opt.syntax = "cremacc [OPTIONS]";
-    opt.footer = "\n(C) 2014 Assured Information Security, Inc.\n";
+    uint64_t hits, misses;
+    cache.stats(hits, misses);
+    std::cout << "Cache: " << hits << " hits, " << misses << " misses" << std::endl;
+}
 
-    opt.add("", 0, 0, 0, "Prints this help", "-h");
-    opt.add("", 0, 0, 0, "Parse only: Will halt after parsing and pretty-printing the AST for the input program", "-p");
-    opt.add("", 0, 0, 0, "Semantic check only: Will halt after parsing, pretty-printing and performing semantic checks on the AST for the input program", "-s");
-    opt.add("", 0, 1, 0, "Print LLVM Assembly to file", "-S");
-    opt.add("", 0, 1, 0, "Set the output program name to ARG instead of 'a.out'", "-o");
-    opt.add("", 0, 1, 0, "Read input from file instead of stdin", "-f");
-    opt.add("", 0, 0, 0, "Print parser output and root block", "-v");
 
-    opt.parse(argc, argv);
+/**
+ *  What to do with an input file, from the command line options */
+struct CompileSettings {
+    bool parseOnly; /**< Halt after parsing (-p) */
+    bool semanticOnly; /**< Halt after semantic analysis (-s) */
+    bool verbose; /**< Print parser output and the root block (-v) */
+    bool useRegions; /**< Allocate lists from per-function regions (-arena) */
+    bool useCounters; /**< Link the counting runtime (-counters) */
+    bool debugInfo; /**< Emit DWARF line tables for the source (-g) */
+    bool run; /**< JIT compile and run the program instead of writing it (-r) */
+    bool printCacheStats; /**< Print the cache statistics after storing the output (-cache-stats) */
+    int optLevel; /**< Optimization level (-O) */
+    int cevalBudget; /**< Steps allowed for evaluating each constant expression at compile time, 0 to disable (-ceval-budget) */
+    std::string costFile; /**< File to write the worst-case cost bounds to as JSON, "-" for stdout, empty for none (-cost) */
+    unsigned long long costLimit; /**< Largest worst-case cost of the program accepted, 0 for no limit (-cost-limit) */
+    unsigned long long costInputSize; /**< Length assumed for inputs when bounding costs (-cost-input-size) */
+    std::string asmFile; /**< File to write LLVM assembly to, empty for none (-S) */
+    std::string bitcodeFile; /**< File to write LLVM bitcode to instead of linking, empty for none (-b) */
+    std::string objectFile; /**< File to write a native object to instead of linking, empty for none (-c) */
+    std::string outputFile; /**< Name of the linked program, empty for clang's default (-o) */
+    std::string tmpObject; /**< Object file the program is linked from */
+    std::string runtimeName; /**< Runtime to link against, without its extension */
+};
 
-    if (opt.isSet("-h"))
+/**
+   Adds a freshly compiled output to the cache, if the compilation is cacheable
+
+   @param cache CompileCache to store the output in
+   @param key Cache key of the compilation, empty if it is not cacheable
+   @param path Path to the output
+   @param printStats Whether to print the cache statistics afterwards
+   @return 0, the exit code for a successful compilation
+*/
+static int cacheStore(CompileCache & cache, const std::string & key, const std::string & path, bool printStats)
+{
+    if (!key.empty())
     {
-	std::string usage;
-	opt.getUsage(usage);
-	std::cout << usage;
-	return 0;
+	cache.store(key, path);
     }
-    
-    if (opt.isSet("-v")) {
-	yyset_debug(1);
-    } else {
-	yyset_debug(0);
+    if (printStats)
+    {
+	printCacheStats(cache);
     }
-    // Parse input
-    if (opt.isSet("-f")) {
-        // searches for the -f flag
-        int i=0;
-        while (argv[i] != std::string("-f"))
-            ++i;
+    return 0;
+}
 
-        // reads the file name string after the -f flag
-        FILE *inFile = fopen(argv[i+1],"r");
-        if (!inFile)
-            std::cout << "Cannot open file, " << argv[i+1] << ".\n" << "Usage: ./cremacc -f <input file>\n";
-        yyin = inFile;
+/**
+   Computes the cache key for compiling an input file and looks its output up in the cache.
+   Bitcode, objects and programs are keyed by a SHA-256 digest of the source, the options, the runtime
+   and the compiler build; other outputs, and outputs with debug info naming the source's path, are not cached.
 
-        // feeds the input file into cremacc
-        do {
-            yyparse();
-        } while (!feof(yyin));
+   @param cache CompileCache to look the output up in
+   @param inputname Path to the input file, empty for stdin
+   @param settings What the input is compiled to
+   @param key Set to the cache key, left empty if the compilation is not cacheable
+   @return true if the output was copied from the cache, false otherwise
+*/
+static bool cacheLookup(CompileCache & cache, const std::string & inputname, const CompileSettings & settings, std::string & key)
+{
+    std::string source, runtime, prebuilt;
+    if (!cache.enabled() || inputname.empty() || settings.parseOnly || settings.semanticOnly || !settings.asmFile.empty() || settings.run || settings.verbose || !settings.costFile.empty() || settings.costLimit || settings.debugInfo)
+    {
+	return false;
+    }
+    if (!CompileCache::readFile(inputname, source))
+    {
+	return false;
     }
-    else 
-        yyparse(); // no -f flag will produce the commandline cremacc
+    CompileCache::readFile(settings.runtimeName + ".bc", runtime);
+    CompileCache::readFile(settings.runtimeName + ".o", prebuilt);
+    std::ostringstream options;
+    bool program = settings.bitcodeFile.empty() && settings.objectFile.empty();
+    options << (!settings.bitcodeFile.empty() ? "bitcode" : !settings.objectFile.empty() ? "object" : "program") << " -O" << settings.optLevel << (settings.useRegions ? " -arena" : "") << (settings.useCounters ? " -counters" : "") << " -ceval-budget " << settings.cevalBudget << " " << llvm::sys::getDefaultTargetTriple()
+	    // Code is generated for the host CPU
+	    << " " << llvm::sys::getHostCPUName().str();
+    std::vector<std::string> inputs = { source, options.str(), runtime, program ? prebuilt : "" };
+    key = cache.key(inputs);
+    std::string outputPath = !settings.bitcodeFile.empty() ? settings.bitcodeFile : !settings.objectFile.empty() ? settings.objectFile : settings.outputFile.empty() ? "a.out" : settings.outputFile;
+    return cache.fetch(key, outputPath, program);
+}
+
+/**
+   Runs the compiler pipeline on an input: parsing, semantic analysis, code generation,
+   linking the runtime, optimization and writing (or running) the output
 
-    if (opt.isSet("-p"))
+   @param comp Compilation of the input
+   @param settings What to compile the input to
+   @param timer PhaseTimer to record the phases in
+   @param cache CompileCache to store the output in
+   @param cacheKey Cache key of the compilation, empty if it is not cacheable
+   @param runArgs NULL-terminated arguments of the program when settings.run is set
+   @return The exit code of cremacc, or of the program when settings.run is set
+*/
+static int compile(Compilation & comp, const CompileSettings & settings, PhaseTimer & timer, CompileCache & cache, const std::string & cacheKey, std::vector<char *> & runArgs)
+{
+    // Parse input
+    timer.start("parse");
+    if (!comp.parse(settings.verbose))
+    {
+	return -1;
+    }
+    timer.stop();
+    timer.addStat("ast_nodes", comp.nodes);
+
+    if (settings.parseOnly)
     {
 	return 0;
     }
 
     // Perform semantic checks
-    if (rootBlock)
+    if (comp.root)
     {
-        if (opt.isSet("-v")) {
-	    std::cout << *rootBlock << std::endl;
+        if (settings.verbose) {
+	    std::cout << *comp.root << std::endl;
         }
-	if (rootBlock->semanticAnalysis(&rootCtx))
+	timer.start("semantic");
+	if (comp.root->semanticAnalysis(&comp.semantics))
 	{
 	    std::cout << "Passed semantic analysis!" << std::endl;
 	}
@@ -97,55 +197,525 @@ int main(int argc, const char *argv[])
 	    return -1;
 	}
     }
-    if (opt.isSet("-s"))
+
+    // Replace constant expressions and calls of pure functions with their values
+    timer.start("ceval");
+    ConstEvaluator eval(&comp.semantics, settings.cevalBudget > 0 ? settings.cevalBudget : 0);
+    eval.fold(comp.root);
+    timer.addStat("ceval_folds", eval.folds);
+    if (settings.verbose)
+    {
+	std::cout << "Folded " << eval.folds << " constant expressions" << std::endl;
+    }
+
+    // Bound the worst-case cost of the program
+    if (!settings.costFile.empty() || settings.costLimit)
+    {
+	timer.start("cost");
+	CostAnalysis cost(&comp.semantics);
+	cost.analyze(comp.root);
+	if (settings.costFile == "-")
+	{
+	    cost.reportJSON(std::cout, settings.costInputSize);
+	}
+	else if (!settings.costFile.empty())
+	{
+	    std::ofstream out(settings.costFile.c_str());
+	    cost.reportJSON(out, settings.costInputSize);
+	}
+	uint64_t bound = cost.programCost.evaluate(settings.costInputSize);
+	if (settings.costLimit && bound > settings.costLimit)
+	{
+	    std::cout << "ERROR: Worst-case cost " << cost.programCost.str() << " = " << bound << " for inputs of length " << settings.costInputSize
+		      << " exceeds the limit of " << settings.costLimit << std::endl;
+	    return -1;
+	}
+    }
+    timer.stop();
+    if (settings.semanticOnly)
     {
 	return 0;
     }
 
+    // Find the local lists that can be freed when their block is left
+    timer.start("escape");
+    EscapeAnalysis escape(&comp.semantics);
+    escape.analyze(comp.root);
+    timer.addStat("owned_lists", escape.owned);
+    if (settings.verbose)
+    {
+	std::cout << "Freeing " << escape.owned << " local lists at the end of their blocks" << std::endl;
+    }
+    timer.stop();
+
     // Code Generation
     std::cout << "Generating LLVM IR bytecode" << std::endl;
-    rootCodeGenCtx.codeGen(rootBlock);
+    timer.start("codegen");
+    comp.codegen.verbose = settings.verbose;
+    comp.codegen.useRegions = settings.useRegions;
+    comp.codegen.useCounters = settings.useCounters;
+    comp.codegen.debugInfo = settings.debugInfo;
+    comp.codegen.sourceFile = comp.filename;
+    comp.codegen.optLevel = settings.optLevel;
+    comp.codegen.codeGen(comp.root);
+    timer.stop();
+    if (timer.enabled)
+    {
+	timer.addStat("ir_instructions", comp.codegen.instructionCount());
+    }
 
-    if (opt.isSet("-S"))
+    // Link the runtime in before optimizing so its calls can be inlined; programs run with -r
+    // load it as a shared library instead
+    bool linkedStdlib = false;
+    if (!settings.run)
     {
-        // searches for the -S flag
-        int i=0;
-        while (argv[i] != std::string("-S"))
-            ++i;
+	timer.start("link-stdlib");
+	linkedStdlib = comp.codegen.linkStdlib((settings.runtimeName + ".bc").c_str());
+    }
 
-        // writes output LLVM assembly to argument after -S flag
-        FILE *outFile;
-        outFile = freopen(argv[i+1],"w",stderr);
-        rootCodeGenCtx.dump();
-        fclose(outFile);
+    timer.start("optimize");
+    if (!comp.codegen.optimize())
+    {
+	return -1;
+    }
+    timer.stop();
+    if (timer.enabled)
+    {
+	timer.addStat("ir_instructions_opt", comp.codegen.instructionCount());
+	timer.addStat("module_bytes", comp.codegen.bitcodeSize());
     }
 
-    char tmpname[12] = "crematmp.ll";
-    FILE *outFile;
-    outFile = freopen(tmpname, "wb", stderr);
-    rootCodeGenCtx.dump();
-    fclose(outFile);
+    if (!settings.asmFile.empty())
+    {
+	// writes output LLVM assembly to argument after -S flag
+	timer.start("emit-asm");
+	if (!comp.codegen.emitAssembly(settings.asmFile.c_str()))
+	{
+	    return -1;
+	}
+    }
 
-    std::ostringstream oss;
-    std::cout << "Linking with stdlib.c using clang..." << std::endl;
-    std::string outputname = "";
-    if (opt.isSet("-o"))
+    if (!settings.bitcodeFile.empty())
+    {
+	timer.start("emit-bitcode");
+	if (!comp.codegen.emitBitcode(settings.bitcodeFile.c_str()))
+	{
+	    return -1;
+	}
+	return cacheStore(cache, cacheKey, settings.bitcodeFile, settings.printCacheStats);
+    }
+
+    if (!settings.objectFile.empty())
     {
-        // searches for the -S flag
-        int i=0;
-        while (argv[i] != std::string("-o"))
-            ++i;
-	outputname = "-o " + std::string(argv[i + 1]);	
+	timer.start("emit-object");
+	if (!comp.codegen.emitObject(settings.objectFile.c_str()))
+	{
+	    return -1;
+	}
+	return cacheStore(cache, cacheKey, settings.objectFile, settings.printCacheStats);
+    }
+
+    if (settings.run)
+    {
+	std::cout.flush();
+	timer.start("run");
+	return comp.codegen.runProgram((settings.runtimeName + ".so").c_str(), runArgs.size() - 1, &runArgs[0]);
     }
-    oss << "clang " << outputname << " " << tmpname << " stdlib/stdlib.c -lm";
+
+    const char * tmpname = settings.tmpObject.c_str();
+    std::cout << "Emitting native object file..." << std::endl;
+    timer.start("emit-object");
+    if (!comp.codegen.emitObject(tmpname))
+    {
+	return -1;
+    }
+
+    std::ostringstream oss;
+    std::cout << "Linking program using clang..." << std::endl;
+    timer.start("link");
+    std::string outputname = settings.outputFile.empty() ? "" : "-o " + settings.outputFile;
+    // the runtime is already part of the object unless its bitcode could not be linked in
+    oss << "clang " << outputname << " " << tmpname << (linkedStdlib ? "" : " " + settings.runtimeName + ".o") << " -lm -lpthread";
     std::string cmd = oss.str();
-    // runs the command: clang <.ll filename> <library files>
+    // runs the command: clang <object filename> [prebuilt runtime]
     if(std::system(cmd.c_str()))
     {
-	std::cout << "ERROR: Unable to build program with CLANG!" << std::endl;
+	std::cout << "ERROR: Unable to link program with CLANG!" << std::endl;
+	unlink(tmpname);
 	return -1;
     }
     unlink(tmpname);
-    
-    return 0;
+
+    return cacheStore(cache, cacheKey, settings.outputFile.empty() ? "a.out" : settings.outputFile, settings.printCacheStats);
+}
+
+/**
+   Names the output of one of several inputs after the input, with its extension replaced
+
+   @param inputname Path to the input file
+   @param dir Directory to write the output to
+   @param ext Extension of the output, including the '.', or empty for a program
+   @return Path to the output
+*/
+static std::string outputName(const std::string & inputname, const std::string & dir, const std::string & ext)
+{
+    size_t slash = inputname.rfind('/');
+    std::string stem = inputname.substr(slash == std::string::npos ? 0 : slash + 1);
+    size_t dot = stem.rfind('.');
+    if (dot != std::string::npos && dot > 0)
+    {
+	stem = stem.substr(0, dot);
+    }
+    std::string path = dir + "/" + stem + ext;
+    // Never overwrite an input without an extension with its program
+    return (path == inputname || "./" + inputname == path) ? path + ".out" : path;
+}
+
+/**
+   Compiles several inputs concurrently on jobs threads, each input with a Compilation of
+   its own. The output of each input is named after it by outputName() and written to the
+   directory given to -b, -c or -o, or to the current directory. The messages of each
+   input are collected in its Compilation and printed in the order of the inputs, as soon
+   as the inputs before it are done.
+
+   @param inputs Paths to the input files
+   @param base What to compile the inputs to; the output names are replaced for each input
+   @param dir Directory to write the outputs to
+   @param jobs Number of inputs to compile at once
+   @param cache CompileCache to look the outputs up in and store them in
+   @return 0 if every input was compiled, -1 otherwise
+*/
+static int compileAll(const std::vector<std::string> & inputs, const CompileSettings & base, const std::string & dir, int jobs, CompileCache & cache)
+{
+    std::vector<int> results(inputs.size(), -1);
+    std::atomic<size_t> next(0);
+    std::vector<std::string> logs(inputs.size());
+    std::vector<bool> done(inputs.size(), false);
+    size_t printed = 0;
+    std::mutex logsLock;
+    ThreadStreamBuf coutBuf(std::cout);
+    ThreadStreamBuf cerrBuf(std::cerr);
+
+    auto finish = [&](size_t i, const std::string & log) {
+	std::lock_guard<std::mutex> guard(logsLock);
+	logs[i] = log;
+	done[i] = true;
+	for (; printed < inputs.size() && done[printed]; printed++)
+	{
+	    std::cout << logs[printed];
+	    logs[printed].clear();
+	}
+	std::cout.flush();
+    };
+
+    // Register the target once, before any thread needs it
+    llvm::llvm_start_multithreaded();
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    auto worker = [&]() {
+	PhaseTimer timer;
+	std::vector<char *> noArgs;
+	for (size_t i = next++; i < inputs.size(); i = next++)
+	{
+	    CompileSettings settings = base;
+	    if (!settings.bitcodeFile.empty())
+	    {
+		settings.bitcodeFile = outputName(inputs[i], dir, ".bc");
+	    }
+	    else if (!settings.objectFile.empty())
+	    {
+		settings.objectFile = outputName(inputs[i], dir, ".o");
+	    }
+	    else
+	    {
+		settings.outputFile = outputName(inputs[i], dir, "");
+		settings.tmpObject = settings.outputFile + ".crematmp.o";
+	    }
+	    std::string key;
+	    if (cacheLookup(cache, inputs[i], settings, key))
+	    {
+		results[i] = 0;
+		finish(i, "");
+		continue;
+	    }
+	    Compilation comp(inputs[i]);
+	    ThreadStreamBuf::redirect(comp.diagnostics.rdbuf());
+	    results[i] = compile(comp, settings, timer, cache, key, noArgs);
+	    ThreadStreamBuf::redirect(NULL);
+	    finish(i, comp.diagnostics.str());
+	}
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < jobs && (size_t) t < inputs.size(); t++)
+    {
+	threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto & t : threads)
+    {
+	t.join();
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+	if (results[i])
+	{
+	    std::cout << "ERROR: Unable to compile " << inputs[i] << std::endl;
+	    failed++;
+	}
+    }
+    std::cout << "Compiled " << inputs.size() - failed << " of " << inputs.size() << " files" << std::endl;
+    return failed ? -1 : 0;
+}
+
+/**
+   Compiles a program sent to the compile server. Each request gets a Compilation of its
+   own, while the target machines, standard library declarations and runtime bitcode
+   loaded by earlier requests are reused.
+
+   @param request Program to compile and what to compile it to
+   @return The exit code cremacc would have returned for the program
+*/
+static int serveCompile(const ServerRequest & request)
+{
+    CompileSettings settings;
+    settings.parseOnly = false;
+    settings.semanticOnly = request.output == "check";
+    settings.verbose = false;
+    settings.useRegions = request.useRegions;
+    settings.useCounters = request.useCounters;
+    settings.debugInfo = false;
+    settings.run = false;
+    settings.printCacheStats = false;
+    settings.optLevel = request.optLevel;
+    settings.cevalBudget = CEVAL_DEFAULT_BUDGET;
+    settings.costLimit = 0;
+    settings.costInputSize = COST_DEFAULT_INPUT_SIZE;
+    if (request.output == "bitcode")
+    {
+	settings.bitcodeFile = request.path;
+    }
+    else if (request.output == "object")
+    {
+	settings.objectFile = request.path;
+    }
+    else if (request.output == "program")
+    {
+	settings.outputFile = request.path;
+    }
+    else if (!settings.semanticOnly)
+    {
+	std::cout << "ERROR: Unknown server output " << request.output << std::endl;
+	return -1;
+    }
+    settings.tmpObject = request.path + ".crematmp.o";
+    settings.runtimeName = request.useCounters ? "stdlib/stdlib_counters" : "stdlib/stdlib";
+
+    PhaseTimer timer;
+    CompileCache noCache("");
+    std::vector<char *> noArgs;
+    Compilation comp("");
+    comp.source = &request.source;
+    return compile(comp, settings, timer, noCache, "", noArgs);
+}
+
+int main(int argc, const char *argv[])
+{
+    // Handling command-line options
+    ez::ezOptionParser opt;
+    opt.overview = "Crema Compiler for Sub-Turing Complete Programs";
+    opt.syntax = "cremacc [OPTIONS]";
+    opt.footer = "\n(C) 2014 Assured Information Security, Inc.\n";
+
+    opt.add("", 0, 0, 0, "Prints this help", "-h");
+    opt.add("", 0, 0, 0, "Parse only: Will halt after parsing and pretty-printing the AST for the input program", "-p");
+    opt.add("", 0, 0, 0, "Semantic check only: Will halt after parsing, pretty-printing and performing semantic checks on the AST for the input program", "-s");
+    opt.add("", 0, 1, 0, "Print LLVM Assembly to file", "-S");
+    opt.add("", 0, 1, 0, "Compile only: Write a native object file to ARG instead of linking a program (with several inputs, ARG is the output directory)", "-c");
+    opt.add("", 0, 1, 0, "Compile only: Write LLVM bitcode to ARG instead of linking a program (with several inputs, ARG is the output directory)", "-b");
+    opt.add("", 0, 1, 0, "Set the output program name to ARG instead of 'a.out' (with several inputs, ARG is the output directory)", "-o");
+    opt.add("", 0, 1, 0, "Read input from file instead of stdin; repeat to compile several files concurrently", "-f");
+    opt.add("", 0, 1, 0, "Compile up to ARG of several input files at once (default: the number of CPUs)", "-j");
+    opt.add("", 0, 0, 0, "Print parser output and root block", "-v");
+    opt.add("", 0, 0, 0, "Emit DWARF debug info mapping the program to the lines of its source, for debuggers and profilers", "-g");
+    opt.add("0", 0, 1, 0, "Set the optimization level to ARG (0-3) for the generated LLVM IR", "-O");
+    opt.add("100000", 0, 1, 0, "Evaluate constant expressions and calls of pure functions with constant arguments at compile time, taking at most ARG steps for each (0 disables)", "-ceval-budget");
+    opt.add("", 0, 1, 0, "Write the worst-case cost bound of each function and of the program to ARG as JSON ('-' for stdout)", "-cost");
+    opt.add("", 0, 1, 0, "Reject the program if its worst-case cost for inputs of the -cost-input-size length exceeds ARG", "-cost-limit");
+    opt.add("1024", 0, 1, 0, "Length of the inputs (and magnitude of the int parameters) assumed by -cost and -cost-limit (default 1024)", "-cost-input-size");
+    opt.add("", 0, 0, 0, "Allocate the lists of each function from a region that is freed when the function returns", "-arena");
+    opt.add("", 0, 0, 0, "Run: JIT compile the program and run it in-process; arguments after -- are passed to the program", "-r");
+    opt.add("", 0, 1, 0, "Cache compiled outputs in directory ARG (default: $" CACHE_ENV_VAR ")", "-cache");
+    opt.add("", 0, 0, 0, "Print the hit and miss counts of the cache (and exit if there is no input file)", "-cache-stats");
+    opt.add("", 0, 0, 0, "Link the counting runtime and report its list operation counters at exit (to $CREMA_COUNTERS_FILE or stderr)", "-counters");
+    opt.add("", 0, 0, 0, "Print the time and memory used by each compiler phase, and the size of the program", "-time-phases");
+    opt.add("", 0, 1, 0, "Write the phase timings and program size statistics to ARG as JSON ('-' for stdout)", "-time-json");
+    opt.add("", 0, 1, 0, "Run as a compile server listening on the Unix socket ARG, serving one connection at a time (see server.h for the protocol)", "-server", "--server");
+
+    // Arguments after "--" belong to the program run with -r
+    int cremaArgc = argc;
+    for (int i = 1; i < argc; i++)
+    {
+	if (std::string(argv[i]) == "--")
+	{
+	    cremaArgc = i;
+	    break;
+	}
+    }
+    opt.parse(cremaArgc, argv);
+
+    if (opt.isSet("-h"))
+    {
+	std::string usage;
+	opt.getUsage(usage);
+	std::cout << usage;
+	return 0;
+    }
+
+    if (opt.isSet("-server"))
+    {
+	std::string socketPath;
+	opt.get("-server")->getString(socketPath);
+	llvm::llvm_start_multithreaded();
+	llvm::InitializeNativeTarget();
+	llvm::InitializeNativeTargetAsmPrinter();
+	return runServer(socketPath, serveCompile);
+    }
+
+    std::string cacheDir;
+    if (opt.isSet("-cache"))
+    {
+	opt.get("-cache")->getString(cacheDir);
+    }
+    else if (getenv(CACHE_ENV_VAR))
+    {
+	cacheDir = getenv(CACHE_ENV_VAR);
+    }
+    CompileCache cache(cacheDir);
+    if (opt.isSet("-cache-stats") && !opt.isSet("-f"))
+    {
+	printCacheStats(cache);
+	return 0;
+    }
+
+    CompileSettings settings;
+    settings.parseOnly = opt.isSet("-p");
+    settings.semanticOnly = opt.isSet("-s");
+    settings.verbose = opt.isSet("-v");
+    settings.useRegions = opt.isSet("-arena");
+    settings.useCounters = opt.isSet("-counters");
+    settings.debugInfo = opt.isSet("-g");
+    settings.run = opt.isSet("-r");
+    settings.printCacheStats = opt.isSet("-cache-stats");
+    settings.optLevel = 0;
+    if (opt.isSet("-O"))
+    {
+	opt.get("-O")->getInt(settings.optLevel);
+    }
+    settings.cevalBudget = CEVAL_DEFAULT_BUDGET;
+    if (opt.isSet("-ceval-budget"))
+    {
+	opt.get("-ceval-budget")->getInt(settings.cevalBudget);
+    }
+    if (opt.isSet("-cost"))
+    {
+	opt.get("-cost")->getString(settings.costFile);
+    }
+    settings.costLimit = 0;
+    if (opt.isSet("-cost-limit"))
+    {
+	opt.get("-cost-limit")->getULongLong(settings.costLimit);
+    }
+    settings.costInputSize = COST_DEFAULT_INPUT_SIZE;
+    if (opt.isSet("-cost-input-size"))
+    {
+	opt.get("-cost-input-size")->getULongLong(settings.costInputSize);
+    }
+    if (opt.isSet("-S"))
+    {
+	opt.get("-S")->getString(settings.asmFile);
+    }
+    if (opt.isSet("-b"))
+    {
+	opt.get("-b")->getString(settings.bitcodeFile);
+    }
+    if (opt.isSet("-c"))
+    {
+	opt.get("-c")->getString(settings.objectFile);
+    }
+    if (opt.isSet("-o"))
+    {
+	opt.get("-o")->getString(settings.outputFile);
+    }
+    settings.tmpObject = "crematmp.o";
+    settings.runtimeName = opt.isSet("-counters") ? "stdlib/stdlib_counters" : "stdlib/stdlib";
+
+    std::vector<std::string> inputs;
+    if (opt.isSet("-f"))
+    {
+	std::vector<std::vector<std::string> > files;
+	opt.get("-f")->getMultiStrings(files);
+	for (auto & f : files)
+	{
+	    inputs.insert(inputs.end(), f.begin(), f.end());
+	}
+    }
+
+    if (inputs.size() > 1)
+    {
+	if (settings.run || !settings.asmFile.empty() || !settings.costFile.empty() || opt.isSet("-time-phases") || opt.isSet("-time-json"))
+	{
+	    std::cout << "ERROR: -r, -S, -cost, -time-phases and -time-json take a single input file" << std::endl;
+	    return -1;
+	}
+	int jobs = std::thread::hardware_concurrency();
+	if (opt.isSet("-j"))
+	{
+	    opt.get("-j")->getInt(jobs);
+	}
+	std::string dir = !settings.bitcodeFile.empty() ? settings.bitcodeFile : !settings.objectFile.empty() ? settings.objectFile : settings.outputFile.empty() ? "." : settings.outputFile;
+	settings.printCacheStats = false;
+	int ret = compileAll(inputs, settings, dir, (jobs < 1) ? 1 : jobs, cache);
+	if (opt.isSet("-cache-stats"))
+	{
+	    printCacheStats(cache);
+	}
+	return ret;
+    }
+
+    std::string inputname = inputs.empty() ? "" : inputs[0];
+    std::string cacheKey;
+    if (cacheLookup(cache, inputname, settings, cacheKey))
+    {
+	std::cout << "Reusing cached output " << cacheKey << std::endl;
+	return cacheStore(cache, "", "", settings.printCacheStats);
+    }
+
+    printPhases = opt.isSet("-time-phases");
+    if (opt.isSet("-time-json"))
+    {
+	opt.get("-time-json")->getString(phaseJSON);
+    }
+    if (printPhases || !phaseJSON.empty())
+    {
+	phaseTimer.enabled = true;
+	atexit(reportPhases);
+    }
+
+    std::string progname = inputs.empty() ? "crema" : inputname;
+    std::vector<char *> progArgv;
+    progArgv.push_back((char *) progname.c_str());
+    for (int i = cremaArgc + 1; i < argc; i++)
+    {
+	progArgv.push_back((char *) argv[i]);
+    }
+    progArgv.push_back(NULL);
+
+    Compilation comp(inputname);
+    int ret = compile(comp, settings, phaseTimer, cache, cacheKey, progArgv);
+    // The phase ends while its Arena is still alive
+    phaseTimer.stop();
+    return ret;
 }
@@ -23,8 +23,11 @@ class NValue;
 class NBlock;
 class NListAccess;
 class NStructureAccess;
+class NBinaryOperator;
+class NFunctionCall;
 class NIdentifier;
 class SemanticContext;
+class ParallelScope;
 class Type;
 
 typedef std::vector<NStatement*> StatementList;
@@ -33,7 +36,4 @@ typedef std::vector<NVariableDeclaration*> VariableList;
 typedef std::vector<NFunctionDeclaration*> FunctionList;
 typedef std::vector<NValue*> ValueList;
 
-extern SemanticContext rootCtx;
-extern CodeGenContext rootCodeGenCtx;
-
 #endif // CREMA_DECLS_H_
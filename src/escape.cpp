@@ -0,0 +1,327 @@
+/**
+   @file escape.cpp
+   @brief Implementation of the escape analysis of local lists
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   Functions are analyzed callees first, so every call knows which of its list
+   arguments the callee may keep and whether the list it returns is new. Runtime
+   functions never keep their arguments and always return new lists.
+*/
+
+#include "escape.h"
+#include "ast.h"
+#include "semantics.h"
+
+/**
+   Checks whether variables of a type refer to a runtime list
+
+   @param type Type of the variable
+   @return true for lists and strings, false for scalars, structures and lists of structures
+*/
+bool EscapeAnalysis::isList(Type & type)
+{
+    return !type.isStruct && (type.isList || type.typecode == STRING);
+}
+
+/**
+   Marks the variables that own their list in every function and in the top-level block
+
+   @param root Root block of the program
+*/
+void EscapeAnalysis::analyze(NBlock * root)
+{
+    for (auto func : ctx->callOrder)
+    {
+	analyzeFunction(func);
+    }
+    current = NULL;
+    if (root)
+    {
+	// The variables of the top-level block are globals, which functions may use
+	vars.clear();
+	scopes.assign(1, ListScope());
+	for (auto s : root->statements)
+	{
+	    statement(s);
+	}
+	finish();
+    }
+}
+
+/**
+   Computes which parameters a function may keep and whether it returns new lists,
+   and marks the variables owning their list in its body
+
+   @param func Function to analyze
+*/
+void EscapeAnalysis::analyzeFunction(NFunctionDeclaration * func)
+{
+    current = &funcs[func];
+    current->params.assign(func->variables.size(), true);
+    current->returnsFresh = isList(func->type);
+    vars.clear();
+    scopes.assign(1, ListScope());
+    for (size_t i = 0; i < func->variables.size(); i++)
+    {
+	NVariableDeclaration * p = func->variables[i];
+	bool list = isList(p->type);
+	if (list)
+	{
+	    ListVar v = { p, (int) i, false, false, false };
+	    vars.push_back(v);
+	}
+	declare(p->ident, list ? &vars.back() : NULL);
+    }
+    block(*func->body);
+    finish();
+}
+
+/**
+   Records what the function or top-level block just analyzed does with its list
+   variables
+*/
+void EscapeAnalysis::finish()
+{
+    for (auto & v : vars)
+    {
+	if (v.param >= 0)
+	{
+	    current->params[v.param] = v.escapes || v.returned;
+	}
+	if (v.returned && current && (v.param >= 0 || !v.fresh || v.escapes))
+	{
+	    current->returnsFresh = false;
+	}
+	if (v.param < 0 && v.fresh && !v.escapes && !v.returned)
+	{
+	    v.decl->ownsList = true;
+	    owned++;
+	}
+    }
+    vars.clear();
+    scopes.clear();
+}
+
+/**
+   Finds the list variable an identifier refers to in the function being analyzed
+
+   @param ident Name of the variable
+   @return The variable, or NULL if it is a global or not a list
+*/
+EscapeAnalysis::ListVar * EscapeAnalysis::lookup(NIdentifier & ident)
+{
+    for (auto it = scopes.rbegin(); it != scopes.rend(); it++)
+    {
+	auto v = it->find(&ident.value);
+	if (v != it->end())
+	    return v->second;
+    }
+    return NULL;
+}
+
+/**
+   Declares a variable in the innermost scope, hiding any variable of the same name
+
+   @param ident Name of the variable
+   @param var The list variable, NULL if the variable is not a list
+*/
+void EscapeAnalysis::declare(NIdentifier & ident, ListVar * var)
+{
+    scopes.back()[&ident.value] = var;
+}
+
+/**
+   Checks whether an expression evaluates to a new list that nothing else refers to
+
+   @param expr Expression initializing a variable or returned by a function
+   @return true for list literals, strings and calls of functions returning new lists
+*/
+bool EscapeAnalysis::fresh(NExpression * expr)
+{
+    if (dynamic_cast<NList *>(expr) || dynamic_cast<NString *>(expr))
+    {
+	return true;
+    }
+    if (NFunctionCall * fc = dynamic_cast<NFunctionCall *>(expr))
+    {
+	NFunctionDeclaration * func = ctx->searchFuncs(fc->ident);
+	if (!func)
+	    return false;
+	if (!func->body)
+	    return isList(func->type);
+	auto it = funcs.find(func);
+	return it != funcs.end() && it->second.returnsFresh;
+    }
+    return false;
+}
+
+/**
+   Marks the lists an expression evaluates to, or passes to a function that may keep
+   them, as escaping. Accessing the elements of a list does not make it escape.
+
+   @param expr Expression to analyze, may be NULL
+*/
+void EscapeAnalysis::use(NExpression * expr)
+{
+    if (!expr)
+    {
+	return;
+    }
+    if (NVariableAccess * va = dynamic_cast<NVariableAccess *>(expr))
+    {
+	if (ListVar * v = lookup(va->ident))
+	    v->escapes = true;
+    }
+    else if (NListAccess * la = dynamic_cast<NListAccess *>(expr))
+    {
+	use(la->index);
+    }
+    else if (NStructureAccess * sa = dynamic_cast<NStructureAccess *>(expr))
+    {
+	use(sa->index);
+    }
+    else if (NBinaryOperator * bo = dynamic_cast<NBinaryOperator *>(expr))
+    {
+	use(&bo->lhs);
+	use(&bo->rhs);
+    }
+    else if (NFunctionCall * fc = dynamic_cast<NFunctionCall *>(expr))
+    {
+	call(fc);
+    }
+    else if (NList * l = dynamic_cast<NList *>(expr))
+    {
+	for (auto e : l->value)
+	    use(e);
+    }
+}
+
+/**
+   Analyzes the arguments of a call. A list passed to a runtime function, or to a
+   parameter its function neither keeps nor returns, does not escape.
+
+   @param call Call to analyze
+*/
+void EscapeAnalysis::call(NFunctionCall * call)
+{
+    NFunctionDeclaration * func = ctx->searchFuncs(call->ident);
+    FunctionEscapes * callee = NULL;
+    if (func && func->body)
+    {
+	auto it = funcs.find(func);
+	callee = it != funcs.end() ? &it->second : NULL;
+    }
+    for (size_t i = 0; i < call->args.size(); i++)
+    {
+	NVariableAccess * va = dynamic_cast<NVariableAccess *>(call->args[i]);
+	bool kept = !func || (func->body && (!callee || i >= callee->params.size() || callee->params[i]));
+	if (va && !kept)
+	    continue;
+	use(call->args[i]);
+    }
+}
+
+/**
+   Analyzes the statements of a block in a scope of their own
+
+   @param block Block to analyze
+*/
+void EscapeAnalysis::block(NBlock & block)
+{
+    scopes.push_back(ListScope());
+    for (auto s : block.statements)
+    {
+	statement(s);
+    }
+    scopes.pop_back();
+}
+
+/**
+   Analyzes a statement, declaring the variables it declares
+
+   @param stmt Statement to analyze
+*/
+void EscapeAnalysis::statement(NStatement * stmt)
+{
+    if (dynamic_cast<NFunctionDeclaration *>(stmt) || dynamic_cast<NStructureDeclaration *>(stmt))
+    {
+	return;
+    }
+    if (NVariableDeclaration * vd = dynamic_cast<NVariableDeclaration *>(stmt))
+    {
+	NExpression * init = vd->initializationExpression;
+	use(init);
+	ListVar * v = NULL;
+	// The variables of the top-level block are globals
+	if (isList(vd->type) && scopes.size() > 1)
+	{
+	    ListVar lv = { vd, -1, !init || fresh(init), false, false };
+	    vars.push_back(lv);
+	    v = &vars.back();
+	}
+	declare(vd->ident, v);
+    }
+    else if (NListAssignmentStatement * la = dynamic_cast<NListAssignmentStatement *>(stmt))
+    {
+	use(la->list.index);
+	use(&la->expr);
+    }
+    else if (NStructureAssignmentStatement * sa = dynamic_cast<NStructureAssignmentStatement *>(stmt))
+    {
+	use(sa->structure.index);
+	use(&sa->expr);
+    }
+    else if (NAssignmentStatement * as = dynamic_cast<NAssignmentStatement *>(stmt))
+    {
+	use(&as->expr);
+	// Assigning a local loses its list; assigning a parameter leaves the caller's alone
+	ListVar * v = lookup(as->ident);
+	if (v && v->param < 0)
+	    v->escapes = true;
+    }
+    else if (NReturn * ret = dynamic_cast<NReturn *>(stmt))
+    {
+	NVariableAccess * va = dynamic_cast<NVariableAccess *>(&ret->retExpr);
+	ListVar * v = va ? lookup(va->ident) : NULL;
+	if (v)
+	{
+	    v->returned = true;
+	}
+	else
+	{
+	    use(&ret->retExpr);
+	    if (current && !fresh(&ret->retExpr))
+		current->returnsFresh = false;
+	}
+    }
+    else if (NIfStatement * is = dynamic_cast<NIfStatement *>(stmt))
+    {
+	use(&is->condition);
+	block(is->thenblock);
+	if (is->elseblock)
+	    block(*is->elseblock);
+	if (is->elseif)
+	    statement(is->elseif);
+    }
+    else if (NLoopStatement * ls = dynamic_cast<NLoopStatement *>(stmt))
+    {
+	scopes.push_back(ListScope());
+	declare(ls->asVar, NULL);
+	block(ls->loopBlock);
+	scopes.pop_back();
+    }
+    else if (NRangeLoopStatement * rl = dynamic_cast<NRangeLoopStatement *>(stmt))
+    {
+	use(&rl->start);
+	use(&rl->end);
+	scopes.push_back(ListScope());
+	declare(rl->asVar, NULL);
+	block(rl->loopBlock);
+	scopes.pop_back();
+    }
+    else if (NFunctionCall * fc = dynamic_cast<NFunctionCall *>(stmt))
+    {
+	call(fc);
+    }
+}
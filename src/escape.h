@@ -0,0 +1,67 @@
+/**
+   @file escape.h
+   @brief Header file for the escape analysis of local lists
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   Lists and strings are heap-allocated by the runtime and were never released, so a
+   function called in a loop leaked the lists it created on every call. The
+   EscapeAnalysis finds the list variables that hold the only reference to a new list:
+   variables initialized with a list literal, a string or the result of a function that
+   returns a new list, and whose value is never assigned, returned, stored in a
+   structure or list, or passed to a function that may keep it. Such variables are
+   marked with NVariableDeclaration::ownsList, and code generation frees their list
+   with list_free() when their block is left.
+*/
+
+#ifndef CREMA_ESCAPE_H_
+#define CREMA_ESCAPE_H_
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "decls.h"
+#include "types.h"
+
+/**
+ *  Finds the local lists that can be freed when their block is left */
+class EscapeAnalysis {
+public:
+    EscapeAnalysis(SemanticContext * ctx) : owned(0), ctx(ctx), current(NULL) { }
+    void analyze(NBlock * root);
+    size_t owned; /**< Number of list variables marked as owning their list */
+private:
+    /** A list variable in scope */
+    struct ListVar {
+	NVariableDeclaration * decl; /**< Declaration of the variable */
+	int param; /**< Index of the variable among the parameters of its function, -1 for locals */
+	bool fresh; /**< Whether the variable is initialized with a new list */
+	bool escapes; /**< Whether another reference to the list may be created */
+	bool returned; /**< Whether the variable is returned by its function */
+    };
+    /** What a call to a function does with lists */
+    struct FunctionEscapes {
+	std::vector<bool> params; /**< Whether each parameter may be retained or returned by the function */
+	bool returnsFresh; /**< Whether the function returns a new list that nothing else refers to */
+    };
+    typedef std::unordered_map<const std::string *, ListVar *> ListScope; /**< Variables of one block keyed by interned name, NULL for variables that are not lists */
+    SemanticContext * ctx; /**< Semantic information of the program, for looking up functions */
+    std::unordered_map<NFunctionDeclaration *, FunctionEscapes> funcs; /**< Functions analyzed so far */
+    FunctionEscapes * current; /**< Function being analyzed, NULL at the top level */
+    std::deque<ListVar> vars; /**< List variables of the function being analyzed */
+    std::vector<ListScope> scopes; /**< Scopes of the function being analyzed, innermost last */
+
+    static bool isList(Type & type);
+    void analyzeFunction(NFunctionDeclaration * func);
+    void finish();
+    ListVar * lookup(NIdentifier & ident);
+    void declare(NIdentifier & ident, ListVar * var);
+    bool fresh(NExpression * expr);
+    void use(NExpression * expr);
+    void call(NFunctionCall * call);
+    void block(NBlock & block);
+    void statement(NStatement * stmt);
+};
+
+#endif // CREMA_ESCAPE_H_
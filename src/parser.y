@@ -2,16 +2,26 @@
     #include "decls.h"
     #include "ast.h"
     #include "semantics.h"
+    #include "compilation.h"
     #include <stdlib.h>
     #include <stdio.h>
+%}
 
-    NBlock *rootBlock;
+%code requires {
+    typedef void * yyscan_t;
+    class Compilation;
+}
 
-    extern int yylex();
-    extern int yylineno;
-    void yyerror(const char *s) { fprintf(stderr, "ERROR on line %d: %s\n", yylineno, s); exit(-1); }
-%}
+%code {
+    int yylex(YYSTYPE * lvalp, yyscan_t scanner);
+    int yyget_lineno(yyscan_t scanner);
+    void yyerror(yyscan_t scanner, Compilation * comp, const char *s) { comp->error(yyget_lineno(scanner), s); }
+}
 
+/* The parser and lexer keep their state in the Compilation and scanner, so files can be parsed concurrently */
+%define api.pure full
+%lex-param { yyscan_t scanner }
+%parse-param { yyscan_t scanner } { Compilation * comp }
 %define parse.error verbose
 
 %union {
@@ -30,7 +40,7 @@
 
 /* Terminal types */
 %token <string> TIDENTIFIER TINT TDOUBLE TCHAR TSTRING                               /* token strings */
-%token <token> TBREAK TRETURN TSDEF TDEF TEXTERN TIF TELSE TFOREACH TAS TTRUE TFALSE /* keywords */
+%token <token> TBREAK TRETURN TSDEF TDEF TEXTERN TIF TELSE TFOREACH TPARALLEL TSOA TAS TTRUE TFALSE /* keywords */
 %token <token> TMUL TADD TDIV TSUB TMOD                                              /* binary operators */
 %token <token> TCEQ TCNEQ TCLE TCGE TCLT TCGT                                        /* comparison operators */
 %token <token> TEQUAL                                                                /* assignment operator */
@@ -61,8 +71,8 @@
 
 %%
 
-program : { rootBlock = NULL; } /* Empty program */
-	| statements { rootBlock = $1; rootBlock->createStdlib(); }
+program : { comp->root = NULL; } /* Empty program */
+	| statements { comp->root = $1; comp->root->createStdlib(&comp->semantics); }
     	;
 
 block : TLBRACKET statements TRBRACKET { $$ = $2; }
@@ -74,8 +84,8 @@ block : TLBRACKET statements TRBRACKET { $$ = $2; }
                ;
 
         statement : var_decl { }
-                  | struct_decl { if(!rootCtx.registerStruct((NStructureDeclaration *) $1)) yyerror("Duplicate struct declaration!"); $$ = $1; }
-                  | func_decl { if(!rootCtx.registerFunc((NFunctionDeclaration *) $1)) yyerror("Duplicate function declaration!"); $$ = $1; }
+                  | struct_decl { if(!comp->semantics.registerStruct((NStructureDeclaration *) $1)) { yyerror(scanner, comp, "Duplicate struct declaration!"); YYABORT; } $$ = $1; }
+                  | func_decl { if(!comp->semantics.registerFunc((NFunctionDeclaration *) $1)) { yyerror(scanner, comp, "Duplicate function declaration!"); YYABORT; } $$ = $1; }
                   | assignment { }
 		  | identifier TLPAREN func_call_arg_list TRPAREN { $$ = new NFunctionCall(*$1, *$3); } 
 		  | conditional { }
@@ -88,6 +98,8 @@ block : TLBRACKET statements TRBRACKET { $$ = $2; }
                      | type identifier TEQUAL expression { $$ = new NVariableDeclaration(*(new Type($1)), *$2, $4); }
 		     | TTSTRUCT identifier identifier { $$ = new NVariableDeclaration(*(new StructType(*$2)), *$3); }
 		     | TTSTRUCT identifier identifier TEQUAL identifier { $$ = new NVariableDeclaration(*(new StructType(*$2)), *$3, $5); }
+		     | TTSTRUCT identifier identifier TLBRAC TRBRAC { $$ = new NVariableDeclaration(*(new StructType(*$2, true, false)), *$3); } /* List of structures */
+		     | TSOA TTSTRUCT identifier identifier TLBRAC TRBRAC { $$ = new NVariableDeclaration(*(new StructType(*$3, true, true)), *$4); } /* Struct-of-arrays list of structures */
 		     | list_decl { }
                      ;
 
@@ -103,8 +115,8 @@ block : TLBRACKET statements TRBRACKET { $$ = $2; }
             struct_decl : TTSTRUCT identifier TLBRACKET var_decls TRBRACKET { $$ = new NStructureDeclaration(*$2, *$4); }	
                         ;
 
-                var_decls : { $$ = new VariableList(); }
-                      | var_decl { $$ = new VariableList(); $$->push_back($<var_decl>1); }
+                var_decls : { $$ = Arena::get().create<VariableList>(); }
+                      | var_decl { $$ = Arena::get().create<VariableList>(); $$->push_back($<var_decl>1); }
                       | var_decls TCOMMA var_decl { $$->push_back($<var_decl>3); }
                       ;
 
@@ -118,8 +130,8 @@ block : TLBRACKET statements TRBRACKET { $$ = $2; }
                     | TSDEF
                     ;
 
-                func_decl_arg_list : /* Empty */ { $$ = new VariableList(); }
-                                   | var_decl { $$ = new VariableList(); $$->push_back($<var_decl>1); }
+                func_decl_arg_list : /* Empty */ { $$ = Arena::get().create<VariableList>(); }
+                                   | var_decl { $$ = Arena::get().create<VariableList>(); $$->push_back($<var_decl>1); }
                                    | func_decl_arg_list TCOMMA var_decl { $$->push_back($<var_decl>3); }
                                    ;
 
@@ -138,6 +150,9 @@ block : TLBRACKET statements TRBRACKET { $$ = $2; }
                     ;
 
             loop : TFOREACH TLPAREN identifier TAS identifier TRPAREN block { $$ = new NLoopStatement(*$3, *$5, *$7); }
+                 | TFOREACH TLPAREN identifier TLPAREN func_call_arg_list TRPAREN TAS identifier TRPAREN block { if ($3->value != "crema_seq" || $5->size() != 2) { yyerror(scanner, comp, "foreach can only iterate over a list or a crema_seq() range!"); YYABORT; } $$ = new NRangeLoopStatement(*(*$5)[0], *(*$5)[1], *$8, *$10); } /* Range loop */
+                 | TPARALLEL TFOREACH TLPAREN identifier TAS identifier TRPAREN block { yyerror(scanner, comp, "parallel foreach can only iterate over a crema_seq() range!"); YYABORT; }
+                 | TPARALLEL TFOREACH TLPAREN identifier TLPAREN func_call_arg_list TRPAREN TAS identifier TRPAREN block { if ($4->value != "crema_seq" || $6->size() != 2) { yyerror(scanner, comp, "parallel foreach can only iterate over a crema_seq() range!"); YYABORT; } $$ = new NRangeLoopStatement(*(*$6)[0], *(*$6)[1], *$9, *$11, true); } /* Parallel range loop */
                  ;
 
             return : TRETURN expression { $$ = new NReturn(*$2); }
@@ -179,13 +194,13 @@ block : TLBRACKET statements TRBRACKET { $$ = $2; }
                            | value { }
                            | identifier TLPAREN func_call_arg_list TRPAREN { $$ = new NFunctionCall(*$1, *$3); }
                            | TLPAREN expression TRPAREN { $$ = $2; }
-            			   | TSUB TLPAREN expression TRPAREN %prec TUMINUS { NInt *zero = new NInt(0); zero->type = *(new Type(TTINT)); $$ = new NBinaryOperator(*zero, $1, *$3); }
+            			   | TSUB TLPAREN expression TRPAREN %prec TUMINUS { NInt *zero = new NInt(0); zero->type = Type(TTINT); $$ = new NBinaryOperator(*zero, $1, *$3); }
                            ;
 
                         var_access : identifier { $$ = new NVariableAccess(*$1); }
                                    | list_access { }
                                    | struct { }
-                                   | TSUB var_access %prec TUMINUS { NInt *zero = new NInt(0); zero->type = *(new Type(TTINT)); $$ = new NBinaryOperator(*zero, $1, *$2); }
+                                   | TSUB var_access %prec TUMINUS { NInt *zero = new NInt(0); zero->type = Type(TTINT); $$ = new NBinaryOperator(*zero, $1, *$2); }
                                    ;
 
                             identifier : TIDENTIFIER { std::string str = $1->c_str(); $$ = new NIdentifier(str); delete $1; }
@@ -196,34 +211,35 @@ block : TLBRACKET statements TRBRACKET { $$ = $2; }
                                         ;
 
                             struct : identifier TPERIOD identifier { $$ = new NStructureAccess(*$1, *$3); } /* Structure access */
+                                   | identifier TLBRAC expression TRBRAC TPERIOD identifier { $$ = new NStructureAccess(*$1, *$6, $3); } /* Structure list element access */
                                    ;
 
                         list : TLBRAC func_call_arg_list TRBRAC { $$ = new NList(*$2); }
                              ;
 
-                            func_call_arg_list : /* Empty */ { $$ = new ExpressionList(); }
-                                       | expression { $$ = new ExpressionList(); $$->push_back($<expression>1); }
+                            func_call_arg_list : /* Empty */ { $$ = Arena::get().create<ExpressionList>(); }
+                                       | expression { $$ = Arena::get().create<ExpressionList>(); $$->push_back($<expression>1); }
                                        | func_call_arg_list TCOMMA expression { $$->push_back($<expression>3); }
                                        ;
 
                         value : numeric { $$ = $1; }
-			      | TCHAR { $$ = new NChar(*$1); $$->type = *(new Type(TTCHAR)); delete $1; }
-			      | TSTRING { std::string str = $1->c_str(); $$ = new NString(str); $$->type = *(new Type(TTCHAR, true)); delete $1; }
-                              | TTRUE { $$ = new NBool(true); $$->type = *(new Type(TTBOOL)); }
-                              | TFALSE { $$ = new NBool(false); $$->type = *(new Type(TTBOOL)); }
+			      | TCHAR { $$ = new NChar(*$1); $$->type = Type(TTCHAR); delete $1; }
+			      | TSTRING { std::string str = $1->c_str(); $$ = new NString(str); $$->type = Type(TTCHAR, true); delete $1; }
+                              | TTRUE { $$ = new NBool(true); $$->type = Type(TTBOOL); }
+                              | TFALSE { $$ = new NBool(false); $$->type = Type(TTBOOL); }
                               ;
 
-                            numeric : TDOUBLE { $$ = new NDouble(atof($1->c_str())); $$->type = *(new Type(TTDOUBLE)); delete $1; }
+                            numeric : TDOUBLE { $$ = new NDouble(atof($1->c_str())); $$->type = Type(TTDOUBLE); delete $1; }
                                     | TSUB TDOUBLE %prec TUMINUS { NDouble *zero = new NDouble(0); 
-                                                                   zero->type = *(new Type(TTDOUBLE)); 
+                                                                   zero->type = Type(TTDOUBLE); 
                                                                    NDouble *d = new NDouble(atof($2->c_str())); 
                                                                    d->type = Type(TTDOUBLE); 
                                                                    delete $2; $$ = new NBinaryOperator(*zero, $1, *d); } 
-                                    | TINT { $$ = new NInt(atol($1->c_str())); $$->type = *(new Type(TTINT)); delete $1; }
+                                    | TINT { $$ = new NInt(atol($1->c_str())); $$->type = Type(TTINT); delete $1; }
                                     | TSUB TINT %prec TUMINUS { NInt *zero = new NInt(0); 
                                                                 zero->type = TTINT; 
                                                                 NInt *i = new NInt(atol($2->c_str())); 
-                                                                i->type = *(new Type(TTINT)); 
+                                                                i->type = Type(TTINT); 
                                                                 delete $2; 
                                                                 $$ = new NBinaryOperator(*zero, $1, *i); } 
                                     ;
@@ -12,10 +12,8 @@
 #include "parser.h"
 #include "types.h"
 #include <typeinfo>
-
-/**
- * The root SemanticContext object to use when performing semantic analysis */
-SemanticContext rootCtx;
+#include <algorithm>
+#include <cstring>
 
 SemanticContext::SemanticContext() 
 { 
@@ -30,9 +28,9 @@ SemanticContext::SemanticContext()
 
 /** 
     Creates a new scope for variable declarations. 
-    'vars' is a std::vector<VariableList*> and VariableList is a 
-    typedef std::vector<NVariableDeclaration*>. So when newScope is called,
-    an empty vector of NVariableDeclarations is pushed to the back of the
+    'vars' is a std::vector<VariableTable> and VariableTable is a hash map
+    from variable names to NVariableDeclaration*. So when newScope is called,
+    an empty table is pushed to the back of the
     vars vector. 'currType' is a std::vector<Type>. The new type being pushed 
     to the back of currType contains a boolean 'isList' member and a
     TypeCodes 'typecode' variable, which is an enum containing all the possible
@@ -42,7 +40,7 @@ SemanticContext::SemanticContext()
  */
 void SemanticContext::newScope(Type & type)
 {
-  vars.push_back(new VariableList());
+  vars.push_back(VariableTable());
   currType.push_back(type);
   funcReturns.push_back(false);
   currScope++;
@@ -50,7 +48,7 @@ void SemanticContext::newScope(Type & type)
 
 /**
    Deletes the most recent scope.
-   Pops back the most recent VariableList (typedef std::vector<NVariableDeclaration*>)
+   Pops back the most recent VariableTable
    from the vars vector and the most recent Type object from the currType vector. 
    currScope is decremented by one.
 */
@@ -63,12 +61,9 @@ void SemanticContext::delScope()
 
 /**
    Registers the variable into the current scope and returns true or false depending
-   on whether it was successfully added. The function looks to see if there is an 
-   existing variable name (ident) in the current scope by iterating through the 
-   VariableList (typedef std::vector<NVariableDeclaration*>) and comparing the 
-   argument member, var->ident, with the other ident members within the VariableList.
-   If there is no duplicate, the function will push_back the var class object to the
-   vars vector.
+   on whether it was successfully added. The variable is inserted into the
+   VariableTable of the current scope, which fails if the scope already
+   contains a variable with the same name (var->ident).
 
    @param var Pointer to the NVariableDeclaration to add to the current scope
    @return true if the variable was added, false if it is a duplicate
@@ -78,20 +73,14 @@ bool SemanticContext::registerVar(NVariableDeclaration * var)
     if (NULL != searchFuncs(var->ident))
     	return false;
   
-  // Search through current scope for variable duplication
-  for (auto it : (*(vars[currScope])))
-    if ( var->ident == it->ident )
-        return false;
-
-  vars[currScope]->push_back(var);
-  return true;
+  // Insertion fails on variable duplication within the current scope
+  return vars[currScope].insert(std::make_pair(&var->ident.value, var)).second;
 }
 
 /**
    Registers the function into the global scope and returns true or false depending
-   on whether it was successfully added. The function searches for the function name
-   being passed as an argument (func->ident) matches with exising functions in
-   the funcs vector. 
+   on whether it was successfully added. Insertion into the funcs map fails if a
+   function with the same name (func->ident) already exists.
 
    @param func Pointer to the NFunctionDeclaration to add to the global scope
    @return true if the function was added, false if it is a duplicate
@@ -101,40 +90,26 @@ bool SemanticContext::registerFunc(NFunctionDeclaration * func)
     if (NULL != searchVars(func->ident))
     	return false;
 
-  // Search through for duplicate function duplication
-  for (auto it : funcs)
-      if ( func->ident == it->ident )
-          return false;
-
-  funcs.push_back(func);
-  return true;
+  return funcs.insert(std::make_pair(&func->ident.value, func)).second;
 }
 
 /**
    Registers the structure into the global scope and returns true or false depending 
-   on whether it was successfully added. The function searches for struct name 
-   being passed as an argument (s->ident) matches with existing struct names
-   in the structs vector.
+   on whether it was successfully added. Insertion into the structs map fails if a
+   structure with the same name (s->ident) already exists.
 
    @param s Pointer to the NStructureDeclaration to add to the global scope
    @return true if the structure was added, false if it is a duplicate
 */
 bool SemanticContext::registerStruct(NStructureDeclaration * s)
 {
-  // Search through for duplicate struct duplication
-  for (auto it : structs)
-      if ( s->ident == it->ident )
-          return false;
-
-  structs.push_back(s);
-  return true;
+  return structs.insert(std::make_pair(&s->ident.value, s)).second;
 }
 
 /**
   Searches the local, then parent scopes for a variable declaration. The search begins
-  at the back of the std::vector<Variable*> vars vector. At each vars element the inner
-  for loop looks for matches between the function argument ident and the ident member of the 
-  NVariableDeclaration class. The function then returns a pointer to the class object of the
+  at the back of the std::vector<VariableTable> vars vector, and each scope is a single
+  hash lookup of the identifier. The function then returns a pointer to the class object of the
   referenced variable.
 
   @param ident NIdentifier to search for in the stack of scopes
@@ -146,47 +121,43 @@ NVariableDeclaration * SemanticContext::searchVars(NIdentifier & ident)
   for (int i = vars.size()-1; i >= 0; i--)
     {
       // Search through current scope for variable
-      for (int j = 0; j < (vars[i])->size(); j++)
-	{
-	  if (ident == vars[i]->at(j)->ident)
-	    return vars[i]->at(j);
-	}
+      VariableTable::iterator it = vars[i].find(&ident.value);
+      if (it != vars[i].end())
+	return it->second;
     }
 
   return NULL;
 }
 
 /**
-  Searches for a function declaration. A std::vector<T>::iterator iterates over the funcs
-  vector and the if statement compares the name of the argument ident with each function name
-  funcs[index]->ident. 
+  Searches for a function declaration with a single hash lookup of the name of the
+  argument ident in the funcs map.
 
   @param ident NIdentifier to search for in the global function scope
   @return Pointer to NFunctionDeclaration of the referenced function or NULL if it cannot be found
 */
 NFunctionDeclaration * SemanticContext::searchFuncs(NIdentifier & ident) 
 {
-  for (auto it : funcs)
-      if (ident == it->ident)
-          return it;
+  std::unordered_map<const std::string *, NFunctionDeclaration *>::iterator it = funcs.find(&ident.value);
+  if (it != funcs.end())
+      return it->second;
 
   return NULL;
 }
 
 
 /**
-  Searches for a structure declaration. A std::vector<T>::iterator moves over the structs
-  vector and the if statement compares the name of the argument ident with each struct name
-  struct[index]->ident.
+  Searches for a structure declaration with a single hash lookup of the name of the
+  argument ident in the structs map.
 
   @param ident NIdentifier to search for in the global structure scope
   @return Pointer to NStructureDeclaration of the referenced structure or NULL if it cannot be found
 */
 NStructureDeclaration * SemanticContext::searchStructs(NIdentifier & ident) 
 {
-  for (auto it : structs)
-      if (ident == it->ident)
-          return it;
+  std::unordered_map<const std::string *, NStructureDeclaration *>::iterator it = structs.find(&ident.value);
+  if (it != structs.end())
+      return it->second;
 
   return NULL;
 }
@@ -207,10 +178,109 @@ bool NBlock::semanticAnalysis(SemanticContext * ctx)
       if (!((*it).semanticAnalysis(ctx)))
           return false;
 
+  // Once the root block is analyzed every function body has added its calls to the call graph
+  if (ctx->currScope == 1 && (!ctx->checkCallGraph() || !ctx->checkParallelLoops()))
+      return false;
+
   ctx->delScope();
   return true;
 }
 
+/**
+   Records a call edge in the call graph
+
+   @param caller Function containing the call
+   @param callee Function being called
+*/
+void SemanticContext::addCall(NFunctionDeclaration * caller, NFunctionDeclaration * callee)
+{
+  callGraph[caller].push_back(callee);
+}
+
+/**
+   State of a function during the strongly connected component search of checkCallGraph() */
+struct SCCNode {
+  int index; /**< Order in which the function was first visited */
+  int lowlink; /**< Smallest index reachable from the function */
+  bool onStack; /**< Whether the function is on the SCC stack */
+};
+
+/**
+   Visits a function for Tarjan's strongly connected components algorithm. Each completed
+   component is appended to ctx->callOrder, so callees come before their callers. Components
+   of more than one function, or of a function calling itself, are recursive.
+
+   @param ctx Pointer to the SemanticContext holding the call graph
+   @param func Function to visit
+   @param nodes Search state of the visited functions
+   @param stack Stack of functions in the components being searched
+   @param next Next index to assign
+   @return true if a recursive component was found, false otherwise
+*/
+static bool visitSCC(SemanticContext * ctx, NFunctionDeclaration * func, std::unordered_map<NFunctionDeclaration *, SCCNode> & nodes, FunctionList & stack, int & next)
+{
+  bool recursive = false, selfCall = false;
+  SCCNode & n = nodes[func];
+  n.index = n.lowlink = next++;
+  n.onStack = true;
+  stack.push_back(func);
+
+  for (auto callee : ctx->callGraph[func])
+    {
+      if (callee == func)
+	selfCall = true;
+      if (nodes.find(callee) == nodes.end())
+	{
+	  recursive |= visitSCC(ctx, callee, nodes, stack, next);
+	  nodes[func].lowlink = std::min(nodes[func].lowlink, nodes[callee].lowlink);
+	}
+      else if (nodes[callee].onStack)
+	{
+	  nodes[func].lowlink = std::min(nodes[func].lowlink, nodes[callee].index);
+	}
+    }
+
+  if (nodes[func].lowlink == nodes[func].index)
+    {
+      // func is the root of a component, pop it off the stack
+      FunctionList::iterator first = std::find(stack.begin(), stack.end(), func);
+      if (selfCall || stack.end() - first > 1)
+	{
+	  recursive = true;
+	  for (FunctionList::iterator it = first; it != stack.end(); it++)
+	    std::cout << "Recursive function call in " << (*it)->ident << std::endl;
+	}
+      for (FunctionList::iterator it = first; it != stack.end(); it++)
+	{
+	  nodes[*it].onStack = false;
+	  ctx->callOrder.push_back(*it);
+	}
+      stack.erase(first, stack.end());
+    }
+  return recursive;
+}
+
+/**
+   Checks the call graph built while analyzing function bodies for recursion, direct or
+   through any number of other functions, in time linear in the size of the graph. Also
+   fills callOrder with every function ordered callees first.
+
+   @return true if no function is recursive, false otherwise
+*/
+bool SemanticContext::checkCallGraph()
+{
+  std::unordered_map<NFunctionDeclaration *, SCCNode> nodes;
+  FunctionList stack;
+  int next = 0;
+  bool recursive = false;
+
+  callOrder.clear();
+  for (auto func : callers)
+    if (nodes.find(func) == nodes.end())
+      recursive |= visitSCC(this, func, nodes, stack, next);
+  return !recursive;
+}
+
 /**
    Iterates over the vector and returns 'true' if any of
    checkRecursion elements are true.
@@ -228,26 +298,569 @@ bool NBlock::checkRecursion(SemanticContext *ctx, NFunctionDeclaration * func)
 }
 
 /**
-   Checks the name of the function being called (ident) with the name of the member
-   within the NFunctionCall object (func->ident), and returns true if the names match.
-   Otherwise, other function names are searched within the body and checkRecursion is
-   called again recursively.
+   Records the call in the call graph as an edge from func to the called function, and
+   returns true if func calls itself. Indirect recursion is found once the whole graph is
+   built, by SemanticContext::checkCallGraph().
 
    @param ctx Pointer to the SemanticContext on which to perform the checks
    @param func Pointer to the NFunctionDeclaration that is being checked
-   @return true if there is a recursive call, false otherwise
+   @return true if there is a directly recursive call, false otherwise
 */
 bool NFunctionCall::checkRecursion(SemanticContext * ctx, NFunctionDeclaration * func)
 {
-  if (func->ident == ident)
+  bool recursive = (func->ident == ident);
+  NFunctionDeclaration * callee = ctx->searchFuncs(ident);
+  if (callee && callee->body)
+      ctx->addCall(func, callee);
+  for (auto it : args)
+      recursive |= it->checkRecursion(ctx, func);
+  return recursive;
+}
+
+/**
+   Records the calls made in the list index of the structure and the assigned expression
+
+   @param ctx Pointer to the SemanticContext on which to perform the checks
+   @param func Pointer to the NFunctionDeclaration that is being checked
+   @return true if there is a directly recursive call, false otherwise
+*/
+bool NStructureAssignmentStatement::checkRecursion(SemanticContext * ctx, NFunctionDeclaration * func)
+{
+  return structure.checkRecursion(ctx, func) || expr.checkRecursion(ctx, func);
+}
+
+/**
+   Records the calls made in the list index and the assigned expression
+
+   @param ctx Pointer to the SemanticContext on which to perform the checks
+   @param func Pointer to the NFunctionDeclaration that is being checked
+   @return true if there is a directly recursive call, false otherwise
+*/
+bool NListAssignmentStatement::checkRecursion(SemanticContext * ctx, NFunctionDeclaration * func)
+{
+  return list.checkRecursion(ctx, func) || expr.checkRecursion(ctx, func);
+}
+
+/**
+   Records the calls made in the elements of a list literal
+
+   @param ctx Pointer to the SemanticContext on which to perform the checks
+   @param func Pointer to the NFunctionDeclaration that is being checked
+   @return true if there is a directly recursive call, false otherwise
+*/
+bool NList::checkRecursion(SemanticContext * ctx, NFunctionDeclaration * func)
+{
+  for (auto it : value)
+    if (it->checkRecursion(ctx, func))
       return true;
-  if (ctx->searchFuncs(ident)->body)
+  return false;
+}
+
+/**
+   Iterates over the statements in the block and returns 'true' if any of them
+   may modify the passed list.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param list NIdentifier of the list variable
+   @return true if the list may be modified, false otherwise
+*/
+bool NBlock::modifiesList(SemanticContext *ctx, NIdentifier & list)
+{
+    for (auto it : statements)
+        if ((*it).modifiesList(ctx, list))
+            return true;
+    return false;
+}
+
+/**
+   An assignment modifies a list if it reassigns the list variable itself or if
+   the assigned expression does.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param l NIdentifier of the list variable
+   @return true if the list may be modified, false otherwise
+*/
+bool NAssignmentStatement::modifiesList(SemanticContext *ctx, NIdentifier & l)
+{
+    return ident == l || expr.modifiesList(ctx, l);
+}
+
+/**
+   A list element assignment modifies the list if it stores into it, or if its
+   index or assigned expressions do.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param l NIdentifier of the list variable
+   @return true if the list may be modified, false otherwise
+*/
+bool NListAssignmentStatement::modifiesList(SemanticContext *ctx, NIdentifier & l)
+{
+    return ident == l || list.modifiesList(ctx, l) || expr.modifiesList(ctx, l);
+}
+
+/**
+   A structure member assignment modifies a list of structures if it stores into an
+   element of it, or if its index or assigned expressions do.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param l NIdentifier of the list variable
+   @return true if the list may be modified, false otherwise
+*/
+bool NStructureAssignmentStatement::modifiesList(SemanticContext *ctx, NIdentifier & l)
+{
+    return (structure.index && ident == l) || structure.modifiesList(ctx, l) || expr.modifiesList(ctx, l);
+}
+
+/**
+   Conservatively checks whether a function call may modify the passed list. Passing
+   the list as an argument counts as a modification, since the callee receives the
+   list by reference. The bodies of called Crema functions are also searched, as they
+   may reference the list directly; recursion is rejected by checkRecursion so this
+   always terminates.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param list NIdentifier of the list variable
+   @return true if the list may be modified, false otherwise
+*/
+bool NFunctionCall::modifiesList(SemanticContext *ctx, NIdentifier & list)
+{
+  for (auto it : args)
     {
-      return ctx->searchFuncs(ident)->body->checkRecursion(ctx, func);
+      NVariableAccess * va = dynamic_cast<NVariableAccess *>(it);
+      if ((va && va->ident == list) || it->modifiesList(ctx, list))
+	return true;
     }
+  NFunctionDeclaration * func = ctx->searchFuncs(ident);
+  if (func && func->body)
+    return func->body->modifiesList(ctx, list);
   return false;
 }
 
+/**
+   Checks whether any of the list literal's elements may modify the passed list.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param list NIdentifier of the list variable
+   @return true if the list may be modified, false otherwise
+*/
+bool NList::modifiesList(SemanticContext *ctx, NIdentifier & list)
+{
+  for (auto it : value)
+    if (it->modifiesList(ctx, list))
+      return true;
+  return false;
+}
+
+/**
+   Reports why a loop cannot be run in parallel
+
+   @param what Description of the offending construct
+   @param name Name of the variable or function involved
+   @return false
+*/
+static bool notParallel(const char * what, const std::string & name)
+{
+    std::cout << "Unable to run loop in parallel: " << what << " " << name << std::endl;
+    return false;
+}
+
+/**
+   Checks whether a runtime function modifies the list passed as its first argument
+
+   @param name Name of the runtime function
+   @return true if the function modifies its first argument, false otherwise
+*/
+static bool modifiesFirstArg(const std::string & name)
+{
+    static const char * suffixes[] = { "_append", "_insert", "_concat", "_insert_range", "_delete", "_reserve" };
+    for (auto suffix : suffixes)
+      {
+	size_t len = strlen(suffix);
+	if (name.size() >= len && name.compare(name.size() - len, len, suffix) == 0)
+	  return true;
+      }
+    return false;
+}
+
+/**
+   Records an outer variable that the loop body stores to at the loop index or reads,
+   along with its declaration, which checkParallelLoops() needs once the body is out of scope
+
+   @param ctx Pointer to SemanticContext used to look up outer variables
+   @param scope ParallelScope of the loop being checked
+   @param set scope.written or scope.read
+   @param ident Name of the variable
+*/
+static void touchShared(SemanticContext *ctx, ParallelScope & scope, std::set<const std::string *> & set, NIdentifier & ident)
+{
+    auto it = scope.decls.find(&ident.value);
+    set.insert(&ident.value);
+    scope.lists[&ident.value] = (it != scope.decls.end()) ? it->second : ctx->searchVars(ident);
+}
+
+/**
+   Checks the statements of a block for parallel safety. Variables declared in the
+   block are only private to the iteration until the block ends.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if the block is safe to run in parallel, false otherwise
+*/
+bool NBlock::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    std::set<const std::string *> outer = scope.locals;
+    std::unordered_map<const std::string *, NVariableDeclaration *> decls = scope.decls;
+    const std::string * index = scope.index;
+    bool safe = true;
+    for (auto it : statements)
+      {
+	if (!(*it).parallelSafe(ctx, scope))
+	  {
+	    safe = false;
+	    break;
+	  }
+      }
+    scope.locals = outer;
+    scope.decls = decls;
+    scope.index = index;
+    return safe;
+}
+
+/**
+   An assignment is parallel safe if it assigns a variable private to the iteration.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if the assignment is safe to run in parallel, false otherwise
+*/
+bool NAssignmentStatement::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    if (!scope.locals.count(&ident.value))
+      return notParallel("assignment to shared variable", ident.value);
+    return expr.parallelSafe(ctx, scope);
+}
+
+/**
+   A list element assignment is parallel safe if it stores into a list private to the
+   iteration, or into a shared list at exactly the loop index, so that no two iterations
+   store to the same element.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if the assignment is safe to run in parallel, false otherwise
+*/
+bool NListAssignmentStatement::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    if (!expr.parallelSafe(ctx, scope))
+      return false;
+    if (scope.locals.count(&ident.value))
+      return list.index ? list.index->parallelSafe(ctx, scope) : true;
+    NVariableAccess * va = dynamic_cast<NVariableAccess *>(list.index);
+    if (!scope.index || !va || &va->ident.value != scope.index)
+      return notParallel("store to shared list at an index other than the loop variable:", ident.value);
+    touchShared(ctx, scope, scope.written, ident);
+    return true;
+}
+
+/**
+   A structure member assignment is parallel safe if the structure is private to the iteration.
+   A member of a shared list of structures may only be stored to at the loop index.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if the assignment is safe to run in parallel, false otherwise
+*/
+bool NStructureAssignmentStatement::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    if (!expr.parallelSafe(ctx, scope))
+      return false;
+    if (scope.locals.count(&ident.value))
+      return structure.index ? structure.index->parallelSafe(ctx, scope) : true;
+    if (!structure.index)
+      return notParallel("assignment to shared structure", ident.value);
+    NVariableAccess * va = dynamic_cast<NVariableAccess *>(structure.index);
+    if (!scope.index || !va || &va->ident.value != scope.index)
+      return notParallel("store to shared structure list at an index other than the loop variable:", ident.value);
+    touchShared(ctx, scope, scope.written, ident);
+    return true;
+}
+
+/**
+   A loop nested in a parallel loop runs serially within its iteration. It reads the
+   whole list it iterates over.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if the loop is safe to run in parallel, false otherwise
+*/
+bool NLoopStatement::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    std::set<const std::string *> outer = scope.locals;
+    const std::string * index = scope.index;
+    bool safe;
+    if (!scope.locals.count(&list.value))
+      touchShared(ctx, scope, scope.read, list);
+    if (&asVar.value == scope.index)
+      scope.index = NULL;
+    scope.locals.insert(&asVar.value);
+    scope.loopDepth++;
+    safe = loopBlock.parallelSafe(ctx, scope);
+    scope.loopDepth--;
+    scope.locals = outer;
+    scope.index = index;
+    return safe;
+}
+
+/**
+   A range loop nested in a parallel loop runs serially within its iteration.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if the loop is safe to run in parallel, false otherwise
+*/
+bool NRangeLoopStatement::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    std::set<const std::string *> outer = scope.locals;
+    const std::string * index = scope.index;
+    bool safe;
+    if (!start.parallelSafe(ctx, scope) || !end.parallelSafe(ctx, scope))
+      return false;
+    if (&asVar.value == scope.index)
+      scope.index = NULL;
+    scope.locals.insert(&asVar.value);
+    scope.loopDepth++;
+    safe = loopBlock.parallelSafe(ctx, scope);
+    scope.loopDepth--;
+    scope.locals = outer;
+    scope.index = index;
+    return safe;
+}
+
+/**
+   A variable declaration makes the variable private to the iteration, unless it is a list
+   that may refer to the same list as another variable, such as int tmp[] = out. Stores
+   through such a variable are checked as stores to a shared list.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if the initialization is safe to run in parallel, false otherwise
+*/
+bool NVariableDeclaration::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    if (initializationExpression && !initializationExpression->parallelSafe(ctx, scope))
+      return false;
+    if (&ident.value == scope.index)
+      scope.index = NULL;
+    scope.decls[&ident.value] = this;
+    if (mayAlias)
+      scope.locals.erase(&ident.value);
+    else
+      scope.locals.insert(&ident.value);
+    return true;
+}
+
+/**
+   A call is parallel safe if its arguments are and the callee neither performs I/O nor
+   writes shared data. The bodies of Crema functions are checked with their scalar
+   arguments as private variables; lists and structures are passed by reference and stay
+   shared. Runtime functions are safe unless they print, read input or modify a shared list.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if the call is safe to run in parallel, false otherwise
+*/
+bool NFunctionCall::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    for (auto it : args)
+      if (!it->parallelSafe(ctx, scope))
+	return false;
+    NFunctionDeclaration * func = ctx->searchFuncs(ident);
+    if (!func)
+      return false;
+    if (func->body)
+      {
+	// Recursion is reported by checkRecursion, which runs after the body is analyzed
+	static thread_local std::set<NFunctionDeclaration *> checking;
+	if (checking.count(func))
+	  return notParallel("recursive call to", ident.value);
+	ParallelScope callee(NULL);
+	for (auto it : func->variables)
+	  {
+	    callee.decls[&it->ident.value] = it;
+	    if (!it->type.isList && !it->type.isStruct && it->type.typecode != STRING)
+	      callee.locals.insert(&it->ident.value);
+	  }
+	checking.insert(func);
+	bool safe = func->body->parallelSafe(ctx, callee);
+	checking.erase(func);
+	if (!safe)
+	  return notParallel("unsafe call to", ident.value);
+	scope.read.insert(callee.read.begin(), callee.read.end());
+	scope.lists.insert(callee.lists.begin(), callee.lists.end());
+	return true;
+      }
+    if (ident.value.find("print") != std::string::npos || ident.value.compare(0, 5, "read_") == 0 || ident.value == "save_args" || ident.value == "make_symbolic")
+      return notParallel("call to I/O function", ident.value);
+    if (modifiesFirstArg(ident.value) && !args.empty())
+      {
+	NVariableAccess * va = dynamic_cast<NVariableAccess *>(args[0]);
+	if (va && !scope.locals.count(&va->ident.value))
+	  return notParallel("shared list modified by", ident.value);
+      }
+    return true;
+}
+
+/**
+   Reading a structure member of a shared structure is parallel safe. Reads of shared lists
+   of structures at the loop index are tracked separately, as for list elements.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if the index expression is safe to run in parallel, false otherwise
+*/
+bool NStructureAccess::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    if (index && !index->parallelSafe(ctx, scope))
+      return false;
+    if (!scope.locals.count(&ident.value))
+      {
+	NVariableAccess * va = dynamic_cast<NVariableAccess *>(index);
+	if (!scope.index || !va || &va->ident.value != scope.index)
+	  touchShared(ctx, scope, scope.read, ident);
+      }
+    return true;
+}
+
+/**
+   Reading a list element is parallel safe. Reads of shared lists at the loop index are
+   tracked separately, as they do not conflict with stores at the loop index.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if the index expression is safe to run in parallel, false otherwise
+*/
+bool NListAccess::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    if (index && !index->parallelSafe(ctx, scope))
+      return false;
+    if (!scope.locals.count(&ident.value))
+      {
+	NVariableAccess * va = dynamic_cast<NVariableAccess *>(index);
+	if (!scope.index || !va || &va->ident.value != scope.index)
+	  touchShared(ctx, scope, scope.read, ident);
+      }
+    return true;
+}
+
+/**
+   Reading a variable is parallel safe.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true
+*/
+bool NVariableAccess::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    if (!scope.locals.count(&ident.value))
+      touchShared(ctx, scope, scope.read, ident);
+    return true;
+}
+
+/**
+   Returning is only parallel safe from a function called by the loop body.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if the return is in a called function, false otherwise
+*/
+bool NReturn::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    if (!scope.inCall)
+      return notParallel("return from", "loop body");
+    return retExpr.parallelSafe(ctx, scope);
+}
+
+/**
+   Breaking out of a parallel loop is not possible, as other iterations may already have
+   run. Breaking out of loops nested in it is safe.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if the break leaves a nested loop, false otherwise
+*/
+bool NBreak::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+    if (!scope.inCall && scope.loopDepth == 0)
+      return notParallel("break out of", "parallel loop");
+    return true;
+}
+
+/**
+   Checks the elements of a list literal for parallel safety.
+
+   @param ctx Pointer to SemanticContext used to look up called functions
+   @param scope ParallelScope of the loop being checked
+   @return true if all the elements are safe to run in parallel, false otherwise
+*/
+bool NList::parallelSafe(SemanticContext *ctx, ParallelScope & scope)
+{
+  for (auto it : value)
+    if (!it->parallelSafe(ctx, scope))
+      return false;
+  return true;
+}
+
+/**
+   Checks whether two declared structure types (or lists of them) are of the same structure
+
+   @param t1 First declared type
+   @param t2 Second declared type
+   @return true if both are of the same structure, false otherwise
+*/
+static bool sameStruct(Type & t1, Type & t2)
+{
+  return t1.isStruct && t2.isStruct && ((StructType &) t1).ident == ((StructType &) t2).ident;
+}
+
+/**
+   Checks whether variables of a type refer to a runtime list, which is shared on assignment
+
+   @param type Type of the variable
+   @return true for lists and strings, false otherwise
+*/
+static bool isListType(Type & type)
+{
+  return type.isList || type.typecode == STRING;
+}
+
+/**
+   Gives the type of the elements of a list type, strings being lists of char
+
+   @param type List type
+   @return The element type code
+*/
+static TypeCodes elementCode(Type & type)
+{
+  return type.typecode == STRING ? CHAR : type.typecode;
+}
+
+/**
+   Checks whether an expression creates a list that no variable refers to yet. Runtime
+   functions always return new lists; substrings share their characters copy-on-write.
+
+   @param ctx Pointer to the SemanticContext used to look up called functions
+   @param expr Expression assigned to a list variable
+   @return true for list literals, strings and calls of runtime functions returning a list
+*/
+static bool newList(SemanticContext * ctx, NExpression * expr)
+{
+  if (dynamic_cast<NList *>(expr) || dynamic_cast<NString *>(expr))
+    return true;
+  NFunctionCall * fc = dynamic_cast<NFunctionCall *>(expr);
+  NFunctionDeclaration * func = fc ? ctx->searchFuncs(fc->ident) : NULL;
+  return func && !func->body && isListType(func->type);
+}
+
 /**
    Performs the semantic analysis of a binary operator expression. This function compares
    the two types of the left- and right-hand-side of the expression by calling the function
@@ -333,6 +946,13 @@ bool NAssignmentStatement::semanticAnalysis(SemanticContext * ctx)
       std::cout << "Assignment to undefined variable " << ident << std::endl;
       return false;
   }
+  NVariableAccess * va = dynamic_cast<NVariableAccess *>(&expr);
+  NVariableDeclaration * src = va ? ctx->searchVars(va->ident) : NULL;
+  if (StructType::isSoaList(var->type) || (src && StructType::isSoaList(src->type)))
+  {
+      std::cout << "Unable to assign soa list in assignment to " << ident << std::endl;
+      return false;
+  }
   Type & t = expr.getType(ctx);
   if (var->type < t)
   {
@@ -343,6 +963,8 @@ bool NAssignmentStatement::semanticAnalysis(SemanticContext * ctx)
   {
       std::cout << "Warning: Upcast from " << var->type << " to " << expr.getType(ctx) << std::endl;
   }
+  if (isListType(var->type) && !newList(ctx, &expr))
+      var->mayAlias = true;
   return true;
 }
 
@@ -366,7 +988,7 @@ bool NStructureAssignmentStatement::semanticAnalysis(SemanticContext * ctx)
       std::cout << "Assignment to undefined variable " << ident << std::endl;
       return false;
   }
-  if (!var->type.isStruct)
+  if (!var->type.isStruct || !structure.semanticAnalysis(ctx))
   {
       return false;
   }
@@ -402,6 +1024,17 @@ bool NListAssignmentStatement::semanticAnalysis(SemanticContext * ctx)
       std::cout << "Assignment to undefined variable " << ident << std::endl;
       return false;
     }
+  if (var->type.isStruct)
+  {
+      // Elements of lists of structures are copied from structure variables
+      NVariableAccess * va = dynamic_cast<NVariableAccess *>(&expr);
+      NVariableDeclaration * src = va ? ctx->searchVars(va->ident) : NULL;
+      if (!src || src->type.isList || !sameStruct(var->type, src->type))
+      {
+	  std::cout << "Type mismatch for assignment to " << ident << ": expected a variable of type " << var->type << std::endl;
+	  return false;
+      }
+  }
   if (list.index)
   {
       Type & it = list.index->getType(ctx);
@@ -564,10 +1197,14 @@ bool NListAccess::semanticAnalysis(SemanticContext * ctx)
 Type & NListAccess::getType(SemanticContext * ctx) const
 {
   NVariableDeclaration *var = ctx->searchVars(ident);
-  if (var)
+  if (index)
   {
-      Type *st = new Type(var->type, false);
       index->getType(ctx);
+  }
+  // Elements of lists of structures are only accessed by member
+  if (var && !var->type.isStruct)
+  {
+      Type *st = new Type(var->type, false);
       type = *st;
       return *st;
   }
@@ -617,6 +1254,18 @@ bool NFunctionCall::semanticAnalysis(SemanticContext * ctx)
       }
       for (int i = 0; i < args.size(); i++)
       {
+	  NVariableAccess * va = dynamic_cast<NVariableAccess *>(args[i]);
+	  NVariableDeclaration * av = va ? ctx->searchVars(va->ident) : NULL;
+	  if (av && StructType::isSoaList(av->type) && ident.value != "list_length")
+	  {
+	      std::cout << "Unable to pass soa list " << va->ident << " to function: " << ident << " on line " << lineno << std::endl;
+	      return false;
+	  }
+	  if (func->variables[i]->type.isStruct && !(av && sameStruct(av->type, func->variables[i]->type) && av->type.isList == func->variables[i]->type.isList))
+	  {
+	      std::cout << "Type mismatch when calling function: " << ident << " on line " << lineno << std::endl;
+	      return false;
+	  }
 	  if (args[i]->getType(ctx) > func->variables[i]->type)
 	  {
 	      std::cout << "Type mismatch when calling function: " << ident << " on line " << lineno << std::endl;
@@ -659,7 +1308,14 @@ bool NLoopStatement::semanticAnalysis(SemanticContext * ctx)
 	return false;
     }
     ctx->newScope(ctx->currType.back());
-    st = new Type(l->type, false);
+    if (l->type.isStruct)
+    {
+	st = new StructType(((StructType &) l->type).ident);
+    }
+    else
+    {
+	st = new Type(l->type, false);
+    }
     
     ctx->registerVar(new NVariableDeclaration(*st, asVar));
 
@@ -671,6 +1327,106 @@ bool NLoopStatement::semanticAnalysis(SemanticContext * ctx)
     return blockSA;
 }
 
+/**
+   Performs semantic analysis on a range loop. The bounds of the range must be
+   integers, and the loop variable is an int visible only in the loop block.
+
+   @param ctx Pointer to context object
+   @return true if the range and loop block pass semantic analysis, false otherwise
+*/
+bool NRangeLoopStatement::semanticAnalysis(SemanticContext * ctx)
+{
+    bool blockSA, oldList;
+
+    if (!start.semanticAnalysis(ctx) || !end.semanticAnalysis(ctx))
+	return false;
+    Type & st = start.getType(ctx);
+    Type & et = end.getType(ctx);
+    if (st.isList || et.isList || (st.typecode != INT && st.typecode != UINT) || (et.typecode != INT && et.typecode != UINT))
+    {
+	std::cout << "Range bounds of loop over " << asVar << " must be integers!" << std::endl;
+	return false;
+    }
+    ctx->newScope(ctx->currType.back());
+    ctx->registerVar(new NVariableDeclaration(*(new Type(TTINT)), asVar));
+
+    oldList = ctx->inList;
+    ctx->inList = true;
+    blockSA = loopBlock.semanticAnalysis(ctx);
+    ctx->inList = oldList;
+    if (blockSA && parallel)
+    {
+	// Iterations may only share data they read, or lists they store to at the loop index
+	ParallelScope scope(&asVar.value);
+	blockSA = loopBlock.parallelSafe(ctx, scope);
+	for (auto it = scope.written.begin(); blockSA && it != scope.written.end(); it++)
+	{
+	    if (scope.read.count(*it))
+		blockSA = notParallel("shared list is both stored to at the loop index and read elsewhere:", **it);
+	}
+	// Whether another variable may refer to a stored list is only known once the whole program is analyzed
+	if (blockSA)
+	{
+	    ctx->parallelLoops.push_back(scope);
+	    for (auto it : scope.written)
+		written.push_back(scope.lists[it]);
+	}
+    }
+    ctx->delScope();
+    return blockSA;
+}
+
+/**
+   Checks whether this variable and another may refer to the same list. Lists of the same
+   element type may if either of them may refer to a list another variable refers to; a
+   list that is created by its declaration and never reassigned can only be reached
+   through other variables that were set from it. Only meaningful once semantic analysis
+   of the whole program is done.
+
+   @param other Declaration of the other variable, NULL if unknown
+   @return true if the variables may refer to the same list, false otherwise
+*/
+bool NVariableDeclaration::mayShareList(NVariableDeclaration * other)
+{
+    if (!isListType(type))
+	return false;
+    if (!other)
+	return true;
+    if (other == this)
+	return true;
+    if (!isListType(other->type) || !(mayAlias || other->mayAlias))
+	return false;
+    if (type.isStruct || other->type.isStruct)
+	return sameStruct(type, other->type);
+    return elementCode(type) == elementCode(other->type);
+}
+
+/**
+   Checks that no parallel loop stores to a shared list at the loop index through one
+   variable while reading it elsewhere through another. Runs once the whole program is
+   analyzed, when NVariableDeclaration::mayAlias is known for every variable, including
+   variables that are assigned after the loop but inside a loop around it.
+
+   @return true if no parallel loop may race through aliased lists, false otherwise
+*/
+bool SemanticContext::checkParallelLoops()
+{
+    for (auto & scope : parallelLoops)
+      {
+	for (auto w : scope.written)
+	  {
+	    for (auto r : scope.read)
+	      {
+		NVariableDeclaration * wd = scope.lists[w];
+		NVariableDeclaration * rd = scope.lists[r];
+		if (w != r && (wd ? wd->mayShareList(rd) : (!rd || isListType(rd->type))))
+		  return notParallel("shared list is stored to at the loop index and may be read elsewhere through", *r);
+	      }
+	  }
+      }
+    return true;
+}
+
 /**
    Checks a break statement to ensure it is in a looping construct
 
@@ -699,16 +1455,26 @@ bool NFunctionDeclaration::semanticAnalysis(SemanticContext * ctx)
   ctx->newScope(type);
   for (auto it : variables)
   {
+      if (StructType::isSoaList(it->type))
+      {
+	  std::cout << "Unable to declare soa list parameter " << it->ident << " of function " << ident << std::endl;
+	  ctx->delScope();
+	  return false;
+      }
       if (!ctx->registerVar(it))
       {
           ctx->delScope();
           return false;
       }
+      // The caller may pass the same list for several parameters, or a global
+      if (body && isListType(it->type))
+	  it->mayAlias = true;
   }
   if (body)
     {
       ctx->inFunc = true;
       blockSA = body->semanticAnalysis(ctx);
+      ctx->callers.push_back(this);
       blockRecur = body->checkRecursion(ctx, this);
       if (blockRecur)
 	{
@@ -777,6 +1543,11 @@ bool NVariableDeclaration::semanticAnalysis(SemanticContext * ctx)
 	    std::cout << "Declaring variable of undefined struct type: " << st->ident << std::endl;
 	    return false;
 	}
+	if (StructType::isSoaList(type) && sd->members.empty())
+	{
+	    std::cout << "Declaring soa list " << ident << " of struct type without members: " << st->ident << std::endl;
+	    return false;
+	}
     }
     
     if (!ctx->registerVar(this)) 
@@ -792,6 +1563,8 @@ bool NVariableDeclaration::semanticAnalysis(SemanticContext * ctx)
 	    std::cout << "Type mismatch for " << ident << " (" << type << " vs. " << initializationExpression->getType(ctx) << ")" << std::endl;
 	    return false;
 	}
+	if (isListType(type) && !newList(ctx, initializationExpression))
+	    mayAlias = true;
 	return initializationExpression->semanticAnalysis(ctx);
     }
     return true;
@@ -837,7 +1610,12 @@ Type & NStructureAccess::getType(SemanticContext * ctx) const
   {
       return *(new Type());
   }
-  if (!(var->type.isStruct))
+  if (index)
+  {
+      index->getType(ctx);
+  }
+  // Structure variables are accessed directly, lists of structures by index
+  if (!(var->type.isStruct) || var->type.isList != (index != NULL))
   {
       return *(new Type());
   }
@@ -874,6 +1652,30 @@ bool NStructureAccess::semanticAnalysis(SemanticContext * ctx)
 	std::cout << "Structure variable " << ident << " cannot be found!" << std::endl;
 	return false;
     }
+    if (!var->type.isStruct)
+    {
+	std::cout << "Variable " << ident << " is not a structure!" << std::endl;
+	return false;
+    }
+    if (index && !var->type.isList)
+    {
+	std::cout << "Structure variable " << ident << " is not a list!" << std::endl;
+	return false;
+    }
+    if (!index && var->type.isList)
+    {
+	std::cout << "Structure list " << ident << " accessed without an index!" << std::endl;
+	return false;
+    }
+    if (index)
+    {
+	Type & it = index->getType(ctx);
+	if (it.typecode != INT && it.typecode != UINT)
+	{
+	    std::cout << "Invalid non-integer index to accessing " << ident << std::endl;
+	    return false;
+	}
+    }
     StructType *st = (StructType *) &(var->type);
     NStructureDeclaration * s = ctx->searchStructs(st->ident);
     if (NULL == s)
@@ -11,20 +11,47 @@
 #ifndef CREMA_SEMANTICS_H_
 #define CREMA_SEMANTICS_H_
 
+#include <set>
+#include <unordered_map>
 #include "decls.h"
 #include "types.h"
 
+typedef std::unordered_map<const std::string *, NVariableDeclaration *> VariableTable; /**< Variables of a single scope, keyed by interned name */
+
+/**
+ *  What the body of a parallel loop touches, collected by parallelSafe(). Each iteration
+ *  runs on an arbitrary thread, so the body may only assign variables it declares itself
+ *  and store into outer lists at the loop's index. A list variable that may refer to the
+ *  same list as another variable (NVariableDeclaration::mayAlias) is never private. Bodies
+ *  of functions called from the loop are checked with a scope of their own. */
+class ParallelScope {
+public:
+    const std::string * index; /**< Interned name of the loop variable, NULL in a called function or where it is shadowed */
+    bool inCall; /**< Whether a called function is being checked rather than the loop body */
+    int loopDepth; /**< Number of (serial) loops nested inside the parallel loop around the current node */
+    std::set<const std::string *> locals; /**< Variables declared by the body, private to each iteration */
+    std::set<const std::string *> written; /**< Outer lists stored to at the loop index */
+    std::set<const std::string *> read; /**< Outer variables read, other than lists read at the loop index */
+    std::unordered_map<const std::string *, NVariableDeclaration *> decls; /**< Variables declared by the body, which are out of scope once the body has been analyzed */
+    std::unordered_map<const std::string *, NVariableDeclaration *> lists; /**< Declarations of the variables in written and read, NULL where unknown */
+    ParallelScope(const std::string * index) : index(index), inCall(index == NULL), loopDepth(0) { if (index) locals.insert(index); }
+};
+
 /** 
  *  Stores the contextual information required to perform semantic analysis on a Crema program */
 class SemanticContext {
 public:
     int currScope; /**< Index to the current scope used for variable search */
     bool inList, inFunc;
-    std::vector<VariableList*> vars; /**< Stack of scopes containing declared variables */
+    std::vector<VariableTable> vars; /**< Stack of scopes containing declared variables */
     std::vector<Type> currType; /**< List of return types for the stack of scopes */
     std::vector<bool> funcReturns; /**< List of bools to see if the function has a matching return statement */
-    std::vector<NStructureDeclaration*> structs; /**< List of defined structures */
-    FunctionList funcs; /**< List of defined functions */
+    std::unordered_map<const std::string *, NStructureDeclaration *> structs; /**< Defined structures, keyed by interned name */
+    std::unordered_map<const std::string *, NFunctionDeclaration *> funcs; /**< Defined functions, keyed by interned name */
+    std::vector<NFunctionDeclaration *> callers; /**< Functions with bodies, in the order they were analyzed */
+    std::unordered_map<NFunctionDeclaration *, FunctionList> callGraph; /**< Crema functions called from each function body */
+    FunctionList callOrder; /**< Functions with bodies ordered callees first, filled by checkCallGraph() */
+    std::vector<ParallelScope> parallelLoops; /**< What each parallel loop touches, checked for aliased lists by checkParallelLoops() */
     
     SemanticContext(); /**< Default constructor, creates the root (empty) scope */
     void newScope(Type & type);
@@ -35,6 +62,9 @@ public:
     bool registerVar(NVariableDeclaration * var);
     bool registerFunc(NFunctionDeclaration * func);
     bool registerStruct(NStructureDeclaration * s);
+    void addCall(NFunctionDeclaration * caller, NFunctionDeclaration * callee);
+    bool checkCallGraph();
+    bool checkParallelLoops();
 };
 
 #endif // CREMA_SEMANTICS_H_
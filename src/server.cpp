@@ -0,0 +1,229 @@
+/**
+   @file server.cpp
+   @brief Implementation of the compile server mode of cremacc
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   Contains the socket handling and request protocol of the compile server
+*/
+
+#include "server.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+   Reads one request from a connection
+
+   @param in Stream reading from the connection
+   @param request Request to fill in
+   @param shutdown Set if the client asked the server to stop
+   @param error Set to the message to answer with if the request was refused
+   @return true if a whole request was read, false at the end of the connection or on a malformed request
+*/
+static bool readRequest(FILE * in, ServerRequest & request, bool & shutdown, std::string & error)
+{
+    char * line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    bool complete = false;
+    request.output = "object";
+    request.path = "a.out";
+    request.optLevel = 0;
+    request.useRegions = false;
+    request.useCounters = false;
+    request.source.clear();
+    while ((len = getline(&line, &cap, in)) > 0)
+    {
+	std::string name(line, (line[len - 1] == '\n') ? len - 1 : len);
+	std::string value;
+	size_t space = name.find(' ');
+	if (space != std::string::npos)
+	{
+	    value = name.substr(space + 1);
+	    name = name.substr(0, space);
+	}
+	if (name == "output")
+	    request.output = value;
+	else if (name == "path")
+	    request.path = value;
+	else if (name == "O")
+	    request.optLevel = atoi(value.c_str());
+	else if (name == "arena")
+	    request.useRegions = true;
+	else if (name == "counters")
+	    request.useCounters = true;
+	else if (name == "shutdown")
+	{
+	    shutdown = true;
+	    break;
+	}
+	else if (name == "source")
+	{
+	    size_t n = strtoul(value.c_str(), NULL, 10);
+	    if (n > SERVER_MAX_SOURCE)
+	    {
+		std::ostringstream msg;
+		msg << "ERROR: Source of " << n << " bytes exceeds the limit of " << SERVER_MAX_SOURCE << " bytes" << std::endl;
+		error = msg.str();
+		break;
+	    }
+	    request.source.resize(n);
+	    complete = n == 0 || fread(&request.source[0], 1, n, in) == n;
+	    break;
+	}
+	else
+	{
+	    std::cout << "WARNING: Ignoring unknown server request option " << name << std::endl;
+	}
+    }
+    free(line);
+    return complete;
+}
+
+/**
+   Writes the response to a request
+
+   @param out Stream writing to the connection
+   @param status Exit code of the compilation
+   @param path Path to the output, empty if none was written
+   @param msgs Messages of the compilation
+*/
+static void writeResponse(FILE * out, int status, const std::string & path, const std::string & msgs)
+{
+    fprintf(out, "status %d\n", status);
+    if (!path.empty())
+    {
+	fprintf(out, "path %s\n", path.c_str());
+    }
+    fprintf(out, "diagnostics %zu\n", msgs.size());
+    fwrite(msgs.data(), 1, msgs.size(), out);
+    fflush(out);
+}
+
+/**
+   Compiles a request with the messages printed to std::cout and std::cerr captured,
+   and writes the response. LLVM and the linker write some messages straight to file
+   descriptor 2, which is redirected to a temporary file while the request is compiled;
+   those messages follow the others in the response.
+
+   @param out Stream writing to the connection
+   @param request Request to compile
+   @param handler Function compiling the request
+*/
+static void serveRequest(FILE * out, const ServerRequest & request, ServerHandler handler)
+{
+    std::ostringstream diagnostics;
+    FILE * errFile = tmpfile();
+    int savedErr = errFile ? dup(2) : -1;
+    if (savedErr >= 0)
+    {
+	fflush(stderr);
+	dup2(fileno(errFile), 2);
+    }
+    std::streambuf * coutBuf = std::cout.rdbuf(diagnostics.rdbuf());
+    std::streambuf * cerrBuf = std::cerr.rdbuf(diagnostics.rdbuf());
+    int status = handler(request);
+    std::cout.rdbuf(coutBuf);
+    std::cerr.rdbuf(cerrBuf);
+    if (savedErr >= 0)
+    {
+	fflush(stderr);
+	dup2(savedErr, 2);
+	close(savedErr);
+	rewind(errFile);
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), errFile)) > 0)
+	{
+	    diagnostics.write(buf, n);
+	}
+    }
+    if (errFile)
+    {
+	fclose(errFile);
+    }
+
+    bool written = status == 0 && request.output != "check";
+    writeResponse(out, status, written ? request.path : "", diagnostics.str());
+}
+
+/**
+   Listens on a Unix domain socket and compiles the requests sent to it, one at a time,
+   until a client sends "shutdown". An existing socket at the path is replaced, but any
+   other file there is left alone and the server fails to start.
+
+   @param socketPath Path of the socket to listen on
+   @param handler Function compiling each request
+   @return 0 once the server was shut down, -1 if the socket could not be set up
+*/
+int runServer(const std::string & socketPath, ServerHandler handler)
+{
+    struct sockaddr_un addr;
+    if (socketPath.size() >= sizeof(addr.sun_path))
+    {
+	std::cout << "ERROR: Socket path " << socketPath << " is too long" << std::endl;
+	return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    struct stat st;
+    if (lstat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+	// Left behind by a previous server
+	unlink(socketPath.c_str());
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || bind(sock, (struct sockaddr *) &addr, sizeof(addr)) || listen(sock, 16))
+    {
+	std::cout << "ERROR: Unable to listen on " << socketPath << ": " << strerror(errno) << std::endl;
+	if (sock >= 0)
+	    close(sock);
+	return -1;
+    }
+    // A client hanging up must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    std::cout << "Listening on " << socketPath << std::endl;
+
+    bool shutdown = false;
+    while (!shutdown)
+    {
+	int conn = accept(sock, NULL, NULL);
+	if (conn < 0)
+	{
+	    continue;
+	}
+	FILE * in = fdopen(conn, "r");
+	FILE * out = fdopen(dup(conn), "w");
+	ServerRequest request;
+	std::string error;
+	while (in && out && readRequest(in, request, shutdown, error))
+	{
+	    serveRequest(out, request, handler);
+	}
+	if (out && !error.empty())
+	{
+	    // The rest of the request is not read, so the connection cannot be used again
+	    writeResponse(out, -1, "", error);
+	}
+	if (in)
+	    fclose(in);
+	else
+	    close(conn);
+	if (out)
+	    fclose(out);
+    }
+    close(sock);
+    unlink(socketPath.c_str());
+    return 0;
+}
@@ -0,0 +1,54 @@
+/**
+   @file server.h
+   @brief Header file for the compile server mode of cremacc
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   With -server SOCKET, cremacc listens on a Unix domain socket and compiles the
+   programs sent to it, keeping the target machines, standard library declarations
+   and runtime bitcode loaded between requests.
+
+   A request is a sequence of lines, each an option name optionally followed by a
+   space and a value, ended by a source line:
+     output object|bitcode|program|check   What to produce (default object)
+     path FILE                           Where to write the output (default a.out)
+     O N                                 Optimization level (default 0)
+     arena                               As the -arena option
+     counters                            As the -counters option
+     source LENGTH                       Followed by LENGTH bytes of Crema source, at most SERVER_MAX_SOURCE
+   The line "shutdown" instead stops the server. Several requests may be sent over
+   one connection. Each request is answered with
+     status CODE                         0 if the output was written, -1 otherwise
+     path FILE                           Path to the output, if one was written
+     diagnostics LENGTH                  Followed by LENGTH bytes of compiler messages
+   A request whose source is too long is answered with status -1, and the connection
+   is closed. Connections are served one at a time, so a client that is slow to send
+   its request holds up every other client.
+*/
+
+#ifndef CREMA_SERVER_H_
+#define CREMA_SERVER_H_
+
+#include <string>
+
+#define SERVER_MAX_SOURCE (64 * 1024 * 1024)
+
+/**
+ *  A program to compile, as sent to the server */
+struct ServerRequest {
+    std::string output; /**< What to produce: "object", "bitcode", "program" or "check" */
+    std::string path; /**< Where to write the output */
+    int optLevel; /**< Optimization level */
+    bool useRegions; /**< Allocate lists from per-function regions */
+    bool useCounters; /**< Link the counting runtime */
+    std::string source; /**< Crema source of the program */
+};
+
+/**
+ *  Compiles a request, printing its diagnostics to std::cout, and returns the exit code
+ *  cremacc would have returned */
+typedef int (*ServerHandler)(const ServerRequest & request);
+
+int runServer(const std::string & socketPath, ServerHandler handler);
+
+#endif // CREMA_SERVER_H_
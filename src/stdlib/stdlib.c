@@ -12,7 +12,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 //#define KLEE
 
@@ -20,46 +29,556 @@
 #include "klee/klee.h"
 #endif
 
+// Define CREMA_COUNTERS (or build stdlib_counters.bc) to count list operations
+//#define CREMA_COUNTERS
+
+#ifdef CREMA_COUNTERS
+/*
+  Counts of the list operations performed by the program, reported at exit
+*/
+static struct {
+  uint64_t creates;
+  uint64_t resizes;
+  uint64_t bytes_realloced;
+  uint64_t appends;
+  uint64_t retrieves;
+  uint64_t concats;
+  uint64_t oob_aborts;
+} crema_counters;
+
+// Parallel loops may update the counters from several threads
+#define CREMA_COUNT(field, n) __sync_fetch_and_add(&crema_counters.field, (n))
+
+/*
+  Writes the counters to the file named by CREMA_COUNTERS_FILE, or stderr
+*/
+static void crema_counters_dump()
+{
+  char * fname = getenv(CREMA_COUNTERS_ENV);
+  FILE * out = (fname != NULL) ? fopen(fname, "a") : NULL;
+  if (out == NULL)
+    {
+      out = stderr;
+    }
+  fprintf(out, "crema counters: list_create=%llu list_resize=%llu bytes_realloced=%llu appends=%llu retrieves=%llu concats=%llu oob_aborts=%llu\n",
+	  (unsigned long long) crema_counters.creates, (unsigned long long) crema_counters.resizes,
+	  (unsigned long long) crema_counters.bytes_realloced, (unsigned long long) crema_counters.appends,
+	  (unsigned long long) crema_counters.retrieves, (unsigned long long) crema_counters.concats,
+	  (unsigned long long) crema_counters.oob_aborts);
+  if (out != stderr)
+    {
+      fclose(out);
+    }
+}
+#else
+#define CREMA_COUNT(field, n)
+#endif
+
+/*
+  Registers the exit hook that reports the list operation counters. Called at the
+  start of main() by programs compiled with -counters; does nothing unless the
+  runtime was built with CREMA_COUNTERS.
+*/
+void crema_counters_init()
+{
+#ifdef CREMA_COUNTERS
+  atexit(crema_counters_dump);
+#endif
+}
+
+/*
+  A chunk of memory that region allocations are bumped from. The usable memory
+  starts CREMA_CHUNK_HDR_SZ bytes after the start of the chunk.
+*/
+typedef struct crema_chunk_s {
+  struct crema_chunk_s * next;
+  size_t size;
+  size_t used;
+} crema_chunk_t;
+
+#define CREMA_CHUNK_HDR_SZ ((sizeof(crema_chunk_t) + CREMA_REGION_ALIGN - 1) & ~((size_t) CREMA_REGION_ALIGN - 1))
+
+/*
+  A region owns every list header and backing array allocated while it is the
+  innermost active region, and releases them all at once when it is left.
+*/
+struct crema_region_s {
+  crema_region_t * parent;
+  crema_chunk_t * chunks;
+};
+
+// Each thread running a parallel loop has its own regions
+static __thread crema_region_t * crema_curr_region = NULL;
+static __thread crema_region_t * crema_free_regions = NULL;
+static __thread crema_chunk_t * crema_free_chunks = NULL;
+static __thread int crema_num_free_chunks = 0;
+
+/*
+  Allocates memory from a region, starting a new chunk when the current one is full.
+  Standard-sized chunks are recycled from previously released regions.
+
+  @param region The region to allocate from
+  @param sz The number of bytes to allocate
+  @return Pointer to the allocated memory
+*/
+static void * crema_region_alloc(crema_region_t * region, size_t sz)
+{
+  crema_chunk_t * c = region->chunks;
+  void * p;
+  sz = (sz + CREMA_REGION_ALIGN - 1) & ~((size_t) CREMA_REGION_ALIGN - 1);
+  if (c == NULL || c->used + sz > c->size)
+    {
+      if (sz <= CREMA_REGION_CHUNK_SZ && crema_free_chunks != NULL)
+	{
+	  c = crema_free_chunks;
+	  crema_free_chunks = c->next;
+	  crema_num_free_chunks--;
+	}
+      else
+	{
+	  size_t csz = (sz > CREMA_REGION_CHUNK_SZ) ? sz : CREMA_REGION_CHUNK_SZ;
+	  c = malloc(CREMA_CHUNK_HDR_SZ + csz);
+	  if (c == NULL)
+	    {
+	      fprintf(stderr, "ERROR: Out of memory!\n");
+	      exit(-1);
+	    }
+	  c->size = csz;
+	}
+      c->used = 0;
+      c->next = region->chunks;
+      region->chunks = c;
+    }
+  p = (char *) c + CREMA_CHUNK_HDR_SZ + c->used;
+  c->used += sz;
+  return p;
+}
+
+/*
+  Enters a new region. Until the matching crema_region_leave(), new lists are
+  allocated from this region instead of with malloc.
+*/
+void crema_region_enter()
+{
+  crema_region_t * r = crema_free_regions;
+  if (r != NULL)
+    {
+      crema_free_regions = r->parent;
+    }
+  else
+    {
+      r = malloc(sizeof(crema_region_t));
+    }
+  r->parent = crema_curr_region;
+  r->chunks = NULL;
+  crema_curr_region = r;
+}
+
+static void list_unshare(list_t * list);
+
+/*
+  Leaves the innermost region, releasing every list allocated from it. A single
+  list may be kept alive (e.g. a function's return value): if it belongs to the
+  region being left it is moved into the enclosing region, or onto the heap.
+
+  @param keep A list to keep alive, or NULL
+  @return The kept list, which may have moved
+*/
+list_t * crema_region_leave(list_t * keep)
+{
+  crema_region_t * r = crema_curr_region;
+  crema_chunk_t * c;
+  if (r == NULL)
+    {
+      return keep;
+    }
+  crema_curr_region = r->parent;
+  if (keep != NULL && keep->region == r)
+    {
+      list_t * nkeep = list_create(keep->elem_sz);
+      // Also copy the terminating entry (e.g. '\0') if there is one
+      int64_t n = (keep->cap > keep->len) ? keep->len + 1 : keep->len;
+      list_reserve(nkeep, keep->len);
+      if (n > 0)
+	{
+	  memcpy(nkeep->arr, keep->arr, n * keep->elem_sz);
+	}
+      nkeep->len = keep->len;
+      // A substring's reference to the array it was taken from is not released with the region
+      list_unshare(keep);
+      keep = nkeep;
+    }
+  while (r->chunks != NULL)
+    {
+      c = r->chunks;
+      r->chunks = c->next;
+      if (c->size == CREMA_REGION_CHUNK_SZ && crema_num_free_chunks < CREMA_REGION_MAX_FREE_CHUNKS)
+	{
+	  c->next = crema_free_chunks;
+	  crema_free_chunks = c;
+	  crema_num_free_chunks++;
+	}
+      else
+	{
+	  free(c);
+	}
+    }
+  r->parent = crema_free_regions;
+  crema_free_regions = r;
+  return keep;
+}
+
+/*
+  The loop being run by the thread pool. Iterations are counted from start, so that
+  a loop ending at INT64_MAX never overflows, and are claimed in chunks of chunk
+  iterations by atomically advancing next.
+*/
+static struct {
+  void (*body)(int64_t, int64_t, void *);
+  void * env;
+  int64_t start;
+  uint64_t span;
+  uint64_t chunk;
+  uint64_t next;
+} crema_pool_job;
+
+static pthread_mutex_t crema_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t crema_pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t crema_pool_done = PTHREAD_COND_INITIALIZER;
+static int crema_pool_size = -1;
+static int crema_pool_active = 0;
+static uint64_t crema_pool_generation = 0;
+static __thread int crema_in_parallel = 0;
+
+/*
+  Runs chunks of the current loop until none are left
+*/
+static void crema_pool_run()
+{
+  uint64_t lo, hi;
+  while ((lo = __sync_fetch_and_add(&crema_pool_job.next, crema_pool_job.chunk)) <= crema_pool_job.span)
+    {
+      hi = (crema_pool_job.span - lo >= crema_pool_job.chunk) ? lo + crema_pool_job.chunk - 1 : crema_pool_job.span;
+      crema_pool_job.body((int64_t) ((uint64_t) crema_pool_job.start + lo), (int64_t) ((uint64_t) crema_pool_job.start + hi), crema_pool_job.env);
+    }
+}
+
+/*
+  Waits for each new loop and helps run it. Every worker checks in once per loop, so
+  a new loop is never started before all workers are done with the previous one.
+*/
+static void * crema_pool_worker(void * arg)
+{
+  uint64_t seen = 0;
+  (void) arg;
+  crema_in_parallel = 1;
+  pthread_mutex_lock(&crema_pool_lock);
+  for (;;)
+    {
+      while (crema_pool_generation == seen)
+	{
+	  pthread_cond_wait(&crema_pool_work, &crema_pool_lock);
+	}
+      seen = crema_pool_generation;
+      pthread_mutex_unlock(&crema_pool_lock);
+      crema_pool_run();
+      pthread_mutex_lock(&crema_pool_lock);
+      if (--crema_pool_active == 0)
+	{
+	  pthread_cond_signal(&crema_pool_done);
+	}
+    }
+  return NULL;
+}
+
+/*
+  Starts the worker threads. The calling thread also runs iterations, so one thread
+  fewer than CREMA_THREADS (or the number of online CPUs) is started.
+*/
+static void crema_pool_start()
+{
+  char * env = getenv(CREMA_THREADS_ENV);
+  long n = (env != NULL) ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_t thread;
+  n = (n < 1) ? 1 : (n > CREMA_MAX_THREADS) ? CREMA_MAX_THREADS : n;
+  crema_pool_size = 0;
+  while (crema_pool_size < n - 1 && pthread_create(&thread, NULL, crema_pool_worker, NULL) == 0)
+    {
+      pthread_detach(thread);
+      crema_pool_size++;
+    }
+}
+
+/**
+   Runs the iterations start to last, inclusive, of a parallel foreach loop on the
+   thread pool. Like crema_seq(), there are none if last <= start. The body is called
+   with disjoint sub-ranges [lo, hi] of the iterations and returns once all of them
+   have run. Small loops, and loops nested in a parallel loop, run serially on the
+   calling thread.
+
+   @param start The first iteration
+   @param last The last iteration
+   @param body The outlined loop body, which runs the iterations lo to hi, inclusive
+   @param env The loop's captured variables, passed to body
+*/
+void crema_parallel_for(int64_t start, int64_t last, void (*body)(int64_t, int64_t, void *), void * env)
+{
+  uint64_t span;
+  if (last <= start)
+    {
+      return;
+    }
+  // The number of iterations after the first, which fits even if start is INT64_MIN
+  span = (uint64_t) last - (uint64_t) start;
+  if (crema_pool_size < 0)
+    {
+      crema_pool_start();
+    }
+  if (crema_in_parallel || crema_pool_size == 0 || span < CREMA_PARALLEL_MIN_ITERS - 1)
+    {
+      body(start, last, env);
+      return;
+    }
+  pthread_mutex_lock(&crema_pool_lock);
+  crema_pool_job.body = body;
+  crema_pool_job.env = env;
+  crema_pool_job.start = start;
+  crema_pool_job.span = span;
+  crema_pool_job.next = 0;
+  crema_pool_job.chunk = span / ((crema_pool_size + 1) * CREMA_PARALLEL_CHUNKS_PER_THREAD);
+  if (crema_pool_job.chunk < 1)
+    {
+      crema_pool_job.chunk = 1;
+    }
+  crema_pool_active = crema_pool_size;
+  crema_pool_generation++;
+  pthread_cond_broadcast(&crema_pool_work);
+  pthread_mutex_unlock(&crema_pool_lock);
+
+  crema_in_parallel = 1;
+  crema_pool_run();
+  crema_in_parallel = 0;
+
+  pthread_mutex_lock(&crema_pool_lock);
+  while (crema_pool_active > 0)
+    {
+      pthread_cond_wait(&crema_pool_done, &crema_pool_lock);
+    }
+  pthread_mutex_unlock(&crema_pool_lock);
+}
+
+static void list_resize(list_t * list, int64_t new_sz);
+
+/*
+  Drops a list's reference to the shared array it uses, freeing the array if no
+  other list uses it any more
+
+  @param list The list letting go of its array
+*/
+static void list_unshare(list_t * list)
+{
+  crema_shared_t * shared = list->shared;
+  if (shared == NULL)
+    {
+      return;
+    }
+  list->shared = NULL;
+  if (__sync_sub_and_fetch(&shared->refs, 1) == 0)
+    {
+      free(shared->arr);
+      free(shared);
+    }
+}
+
+/*
+  Gives a list an array of its own before it is changed, if its array is borrowed
+  from another list or borrowed by slices (copy-on-write). The old array is left to
+  the lists still using it, and freed if it was shared and none are.
+
+  @param list The list about to be changed
+*/
+static void list_own(list_t * list)
+{
+  void * old = list->arr;
+  int64_t n = list->len;
+  crema_shared_t * shared = list->shared;
+  if (list->flags == 0)
+    {
+      return;
+    }
+  list->flags = 0;
+  list->arr = NULL;
+  list->cap = 0;
+  list->shared = NULL;
+  // Leave room for, and clear, a terminating entry (e.g. '\0')
+  list_resize(list, n + 1);
+  if (n > 0)
+    {
+      memcpy(list->arr, old, n * list->elem_sz);
+    }
+  memset(list->arr + (n * list->elem_sz), 0, list->elem_sz);
+  list->shared = shared;
+  list_unshare(list);
+}
+
 /*
-  Re-allocates memory for a list.
+  Re-allocates memory for a list. The list is never shrunk.
 
   @param list The list to re-allocate memory for
-  @param new_sz The number of bytes to be re-allocated for the list
+  @param new_sz The number of elements to be re-allocated for the list
 */
-static void list_resize(list_t * list, size_t new_sz)
+static void list_resize(list_t * list, int64_t new_sz)
 {
   if (list == NULL)
     {
       return;
     }
-  if (new_sz > list->len)
+  if (new_sz > list->cap)
     {
-      list->arr = realloc(list->arr, new_sz * list->elem_sz);
+      list_own(list);
+      CREMA_COUNT(resizes, 1);
+      CREMA_COUNT(bytes_realloced, new_sz * list->elem_sz);
+      if (list->region != NULL)
+	{
+	  // Region memory can't be realloc'd, the old array is released with the region
+	  void * arr = crema_region_alloc(list->region, new_sz * list->elem_sz);
+	  if (list->arr != NULL)
+	    {
+	      memcpy(arr, list->arr, list->cap * list->elem_sz);
+	    }
+	  list->arr = arr;
+	}
+      else
+	{
+	  list->arr = realloc(list->arr, new_sz * list->elem_sz);
+	}
       list->cap = new_sz;
     }
 }
 
+/*
+  Grows a list geometrically so it can hold at least min_sz elements. Growing by
+  LIST_GROWTH_FACTOR instead of a fixed amount keeps the cost of appending N elements
+  at O(N) copies and O(log N) reallocations.
+
+  @param list The list to grow
+  @param min_sz The number of elements the list must be able to hold
+*/
+static void list_grow(list_t * list, int64_t min_sz)
+{
+  int64_t new_sz;
+  if (list == NULL || min_sz <= list->cap)
+    {
+      return;
+    }
+  new_sz = (list->cap < DEFAULT_RESIZE_AMT) ? DEFAULT_RESIZE_AMT : list->cap;
+  while (new_sz < min_sz)
+    {
+      new_sz *= LIST_GROWTH_FACTOR;
+    }
+  list_resize(list, new_sz);
+}
+
+/*
+  Pre-allocates room for at least n elements in a list, so that appending up to n
+  elements will not re-allocate the list.
+
+  @param list The list to reserve memory for
+  @param n The number of elements to reserve room for
+*/
+void list_reserve(list_t * list, int64_t n)
+{
+  // use n+1 to save space for a terminating entry (e.g. '\0')
+  list_resize(list, n + 1);
+}
+
 /*
   Allocates a new list_t structure, which represents either an array or a string
-  in a Crema program.
+  in a Crema program. The list is allocated from the current region, if any, and
+  will keep allocating from that region as it grows.
 
   @param es The number of byes each element fo the list takes (i.e. 1 for char, 8 for double, etc)
 */
 list_t * list_create(int64_t es)
 {
-  list_t * l = malloc(sizeof(list_t));
+  list_t * l;
+  CREMA_COUNT(creates, 1);
+  if (crema_curr_region != NULL)
+    {
+      l = crema_region_alloc(crema_curr_region, sizeof(list_t));
+    }
+  else
+    {
+      l = malloc(sizeof(list_t));
+    }
   if (l)
     {
       l->elem_sz = es;
       l->cap = 0;
       l->len = 0;
       l->arr = NULL;
+      l->region = crema_curr_region;
+      l->flags = 0;
+      l->shared = NULL;
+    }
+  return l;
+}
+
+/*
+  Creates a list that borrows its elements from memory it doesn't own, such as a
+  range of another list. The elements are only copied if the list is changed.
+
+  @param es The number of bytes each element of the list takes
+  @param arr Pointer to the first element
+  @param len The number of elements
+  @return The new list
+*/
+static list_t * list_view(int64_t es, void * arr, int64_t len)
+{
+  list_t * l = list_create(es);
+  if (l)
+    {
+      l->arr = arr;
+      l->len = len;
+      l->cap = len;
+      l->flags = LIST_BORROWED;
     }
   return l;
 }
 
 /*
-  Frees memory for the given list_t structure
+  Gives a list an array of its own if its array is borrowed, before a parallel loop
+  stores into it. Done once by the thread starting the loop, as list_own() is not
+  safe to run concurrently on the same list.
+
+  @param list The list the parallel loop stores into
+*/
+void list_own_array(list_t * list)
+{
+  if (list != NULL)
+    {
+      list_own(list);
+    }
+}
+
+/*
+  Creates a list from a constant array, which the compiler emits for list literals
+  whose elements are all constants. The list borrows the array, and copies it only
+  if it is changed.
+
+  @param arr Pointer to the first element
+  @param len The number of elements
+  @param es The number of bytes each element takes
+  @return The new list
+*/
+list_t * list_from_array(void * arr, int64_t len, int64_t es)
+{
+  return list_view(es, arr, len);
+}
+
+/*
+  Frees memory for the given list_t structure. An array shared with substrings is
+  only freed by the last list using it.
 
   @param list The list_t structure to be freed
 */
@@ -69,7 +588,13 @@ void list_free(list_t * list)
     {
       return;
     }
-  if (list->arr != NULL)
+  list_unshare(list);
+  if (list->region != NULL)
+    {
+      // Region lists are released with their region
+      return;
+    }
+  if (list->arr != NULL && list->flags == 0)
     {
       free(list->arr);
     }
@@ -88,6 +613,7 @@ void list_delete(list_t * list, unsigned int idx)
     {
       return;
     }
+  list_own(list);
   if (idx < list->len)
     {
 	memmove(list->arr + (idx * list->elem_sz), list->arr + ((idx + 1) * list->elem_sz), (list->len - idx - 1) * list->elem_sz);
@@ -122,13 +648,14 @@ void str_delete(string_t * str, unsigned int idx)
 
   @param list Pointer to a list_t structure
 */
-void list_insert(list_t * list, unsigned int idx, void * elem)
+void list_insert(list_t * list, int64_t idx, void * elem)
 {
   if (list == NULL)
     {
       return;
     }
-  if (idx < list->len)
+  list_own(list);
+  if (idx >= 0 && idx < list->len)
     {
       memcpy(list->arr + (idx * list->elem_sz), elem, list->elem_sz);
     }
@@ -141,19 +668,46 @@ void list_insert(list_t * list, unsigned int idx, void * elem)
   @param idx The index to retrieve from list
   @return Pointer to the element at the given index
 */
-void * list_retrieve(list_t * list, unsigned int idx)
+void * list_retrieve(list_t * list, int64_t idx)
 {
+  CREMA_COUNT(retrieves, 1);
   if (list == NULL)
     {
       return NULL;
     }
-  if (idx >= list->len)
+  if (idx < 0 || idx >= list->len)
     {
       return NULL;
     }
   return list->arr + (idx * list->elem_sz);
 }
 
+/*
+  Returns a pointer to the element of a list_t structure found at the given index,
+  through which the element may be changed. Used for the elements of lists of
+  structures, whose members are accessed in place.
+
+  @param list Pointer to a list_t structure
+  @param idx The index of the element
+  @return Pointer to the element at the given index
+*/
+void * list_element(list_t * list, int64_t idx)
+{
+  void * p;
+  if (list != NULL)
+    {
+      list_own(list);
+    }
+  p = list_retrieve(list, idx);
+  if (p == NULL)
+    {
+      CREMA_COUNT(oob_aborts, 1);
+      fprintf(stderr, "ERROR: Retrieving out of bounds list element!\n");
+      exit(-1);
+    }
+  return p;
+}
+
 /*
   Appends a new element onto the given list, increasing the size of the list by one
 
@@ -166,33 +720,144 @@ void list_append(list_t * list, void * elem)
     {
       return;
     }
+  CREMA_COUNT(appends, 1);
+  list_own(list);
   // use len+1 to save space for a terminating entry (e.g. '\0')
   if (list->len+1 >= list->cap)
     {
-      list_resize(list, list->cap + DEFAULT_RESIZE_AMT);
+      list_grow(list, list->len + 2);
     }
   list->len++;
   list_insert(list, list->len - 1, elem);
 }
 
 /*
-  Concatenates two lists together (string or array)
+  Concatenates two lists together (string or array). The first list is grown once
+  and the elements of the second list are copied over in a single memcpy.
 
   @param list1 The first list
   @param list2 The second list to be concatenated onto the first list
 */
 void list_concat(list_t * list1, list_t * list2)
 {
-  int i;
-  if (list1->elem_sz != list2->elem_sz)
+  int64_t len2;
+  if (list1 == NULL || list2 == NULL || list1->elem_sz != list2->elem_sz)
+    {
+      return;
+    }
+  CREMA_COUNT(concats, 1);
+  list_own(list1);
+  // list1 and list2 may be the same list, so save the length before growing
+  len2 = list2->len;
+  if (len2 == 0)
+    {
+      return;
+    }
+  // use +1 to save space for a terminating entry (e.g. '\0')
+  list_grow(list1, list1->len + len2 + 1);
+  memcpy(list1->arr + (list1->len * list1->elem_sz), list2->arr, len2 * list1->elem_sz);
+  list1->len += len2;
+}
+
+/*
+  Creates a copy of a list (string or array) with a single allocation and memcpy
+
+  @param list The list to copy
+  @return A new list holding the same elements as list
+*/
+list_t * list_copy(list_t * list)
+{
+  list_t * nlist;
+  if (list == NULL)
+    {
+      return NULL;
+    }
+  nlist = list_create(list->elem_sz);
+  list_reserve(nlist, list->len);
+  if (list->len > 0)
+    {
+      memcpy(nlist->arr, list->arr, list->len * list->elem_sz);
+    }
+  nlist->len = list->len;
+  return nlist;
+}
+
+/*
+  Creates a new list from a range of elements of a list (string or array). The range
+  is clamped to the end of the list.
+
+  @param list The list to copy the elements from
+  @param start Index of the first element of the range
+  @param len The number of elements in the range
+  @return A new list holding the elements of the range
+*/
+list_t * list_slice(list_t * list, int64_t start, int64_t len)
+{
+  list_t * nlist;
+  if (list == NULL)
+    {
+      return NULL;
+    }
+  if (start < 0 || start > list->len || len < 0)
+    {
+      CREMA_COUNT(oob_aborts, 1);
+      fprintf(stderr, "ERROR: Slicing out of bounds list range!\n");
+      exit(-1);
+    }
+  if (len > list->len - start)
+    {
+      len = list->len - start;
+    }
+  nlist = list_create(list->elem_sz);
+  list_reserve(nlist, len);
+  if (len > 0)
+    {
+      memcpy(nlist->arr, list->arr + (start * list->elem_sz), len * list->elem_sz);
+    }
+  nlist->len = len;
+  return nlist;
+}
+
+/*
+  Inserts all the elements of one list into another at the given index, shifting the
+  following elements back. The destination is grown once and the tail is moved with a
+  single memmove.
+
+  @param list The list to insert into
+  @param idx The index in list to insert the elements at (0 to list_length(list))
+  @param src The list of elements to insert
+*/
+void list_insert_range(list_t * list, int64_t idx, list_t * src)
+{
+  int64_t n;
+  if (list == NULL || src == NULL || list->elem_sz != src->elem_sz)
+    {
+      return;
+    }
+  if (idx < 0 || idx > list->len)
     {
+      CREMA_COUNT(oob_aborts, 1);
+      fprintf(stderr, "ERROR: Inserting at out of bounds list index!\n");
+      exit(-1);
+    }
+  list_own(list);
+  if (list == src)
+    {
+      // Inserting a list into itself, copy it first so the source isn't shifted
+      src = list_copy(list);
+      list_insert_range(list, idx, src);
+      list_free(src);
       return;
     }
-  list_resize(list1, list1->cap + list2->len);
-  for (i = 0; i < list2->len; i++)
+  n = src->len;
+  if (n == 0)
     {
-      list_append(list1, list_retrieve(list2, i));
+      return;
     }
+  list_grow(list, list->len + n + 1);
+  memmove(list->arr + ((idx + n) * list->elem_sz), list->arr + (idx * list->elem_sz), (list->len - idx) * list->elem_sz);
+  memcpy(list->arr + (idx * list->elem_sz), src->arr, n * list->elem_sz);
+  list->len += n;
 }
 
 /*
@@ -223,228 +888,908 @@ string_t * str_from_cstring(char * s)
 }
 
 /*
-  Returns a sub-string of a given string, given by a start index within the
-  string, and a length of the substring.
+  Creates a string from the characters of a string literal, which the compiler
+  emits as read-only constants. The string borrows the characters, and copies
+  them only if it is changed.
+
+  @param s Pointer to the characters of the literal
+  @param len The number of characters
+  @return The new string
+*/
+string_t * str_from_literal(char * s, int64_t len)
+{
+  return list_view(sizeof(char), s, len);
+}
+
+/*
+  Returns a sub-string of a given string, given by a start index within the
+  string, and a length of the substring. The substring borrows the characters
+  of str instead of copying them; whichever of the two is changed first gets a
+  copy of its own.
+
+  @param str The string to be operated on
+  @param start The starting index of the substring
+  @param len The number of characters after 'start' to be included in the substring,
+  0 or a negative number for the rest of the string
+  @return The substring, or NULL if start is out of bounds
+*/
+string_t * str_substr(string_t * str, int64_t start, int64_t len)
+{
+  string_t * sub;
+  crema_shared_t * shared;
+  if (start < 0 || start >= str->len)
+    return NULL;
+
+  if (len <= 0 || len > str->len - start)
+    len = str->len - start;
+
+  // Substrings may be taken concurrently by parallel loops
+  if (str->flags == 0 && str->region == NULL && str->shared == NULL)
+    {
+      // A heap array the string owns is counted from now on; the string holds one reference
+      shared = malloc(sizeof(crema_shared_t));
+      shared->refs = 1;
+      shared->arr = str->arr;
+      if (!__sync_bool_compare_and_swap(&str->shared, NULL, shared))
+	{
+	  free(shared);
+	}
+    }
+  __sync_fetch_and_or(&str->flags, LIST_SHARED);
+  sub = list_view(sizeof(char), (char *) str->arr + start, len);
+  // Borrowed and region arrays outlive the substring without being counted
+  if (sub && str->shared)
+    {
+      __sync_fetch_and_add(&str->shared->refs, 1);
+      sub->shared = str->shared;
+    }
+  return sub;
+}
+
+/*
+  Finds the first occurrence of a string within another. Candidate positions are
+  found with memchr(), which the C library implements with SIMD instructions.
+
+  @param str The string to search
+  @param sub The string to search for
+  @return The index of the first occurrence of sub in str, 0 if sub is empty, or -1
+  if sub does not occur in str
+*/
+int64_t str_find(string_t * str, string_t * sub)
+{
+  const char * s;
+  const char * p;
+  const char * last;
+  if (str == NULL || sub == NULL || sub->len > str->len)
+    {
+      return -1;
+    }
+  if (sub->len == 0)
+    {
+      return 0;
+    }
+  s = str->arr;
+  // Last position sub can start at
+  last = s + (str->len - sub->len);
+  for (p = s; p <= last; p++)
+    {
+      p = memchr(p, *(const char *) sub->arr, last - p + 1);
+      if (p == NULL)
+	{
+	  break;
+	}
+      if (memcmp(p, sub->arr, sub->len) == 0)
+	{
+	  return p - s;
+	}
+    }
+  return -1;
+}
+
+/*
+  Alias for list_free()
+*/
+void str_free(string_t * str)
+{
+  list_free(str);
+}
+
+/*
+  Alias for list_insert()
+*/
+void str_insert(string_t * str, int64_t idx, char elem)
+{
+  list_insert(str, idx, (void *) &elem);
+}
+
+/*
+  Retrieves the character in the given string at the given index
+
+  @param str The string to be operated on
+  @param idx The index of the character to be returned
+  @return The character found in string str at index idx
+*/
+char str_retrieve(string_t * str, int64_t idx)
+{
+  char * p = list_retrieve(str, idx);
+  if (p == NULL)
+    {
+      CREMA_COUNT(oob_aborts, 1);
+      fprintf(stderr, "ERROR: Retrieving out of bounds list element!\n");
+      exit(-1);
+    }
+  return (char) *p;
+}
+
+/*
+  Appends a new character onto the given string, increasing the size of the,
+  list by one, and appends a null-terminating character ('\0') at the end of the string
+
+  @param list Pointer to a list
+  @param elem Pointer to and element to be appended onto the list
+*/
+void str_append(string_t * str, char elem)
+{
+  list_append(str, (void *) &elem);
+  ((char*)str->arr)[str->len] = '\0';
+}
+
+/*
+  Concatenates two strings together, and then appends a null-termiating 
+  character ('\0') to the result
+
+  @param str1 The first string
+  @param str2 The second string to be concatenated onto the first list
+*/
+void str_concat(string_t * str1, string_t * str2)
+{
+  list_concat(str1, str2);
+  if (str1->arr != NULL)
+    {
+      ((char*)str1->arr)[str1->len] = '\0';
+    }
+}
+
+/*
+  Alias for list_reserve() on strings. Room is also kept for the null-terminating
+  character ('\0').
+*/
+void str_reserve(string_t * str, int64_t n)
+{
+  list_reserve(str, n);
+}
+
+/*
+  Creates a copy of a string, including its null-terminating character ('\0')
+
+  @param str The string to copy
+  @return A new string with the same characters as str
+*/
+string_t * str_copy(string_t * str)
+{
+  string_t * nstr = list_copy(str);
+  ((char*)nstr->arr)[nstr->len] = '\0';
+  return nstr;
+}
+
+/*
+  Inserts a string into another string at the given index, and then re-appends the
+  null-terminating character ('\0')
+
+  @param str The string to insert into
+  @param idx The index in str to insert the characters at
+  @param src The string to insert
+*/
+void str_insert_range(string_t * str, int64_t idx, string_t * src)
+{
+  list_insert_range(str, idx, src);
+  if (str->arr != NULL)
+    {
+      ((char*)str->arr)[str->len] = '\0';
+    }
+}
+
+/*
+  Program output is collected in a buffer and written to stdout in CREMA_OUT_BUF_SZ
+  blocks, instead of one printf() (with its locking and format parsing) per value.
+  The buffer is flushed at exit, and before the program waits for input.
+*/
+static char crema_out_buf[CREMA_OUT_BUF_SZ];
+static size_t crema_out_len = 0;
+static int crema_out_registered = 0;
+
+/*
+  Writes the buffered program output to stdout
+*/
+void crema_flush()
+{
+  size_t done = 0;
+  while (done < crema_out_len)
+    {
+      ssize_t n = write(STDOUT_FILENO, crema_out_buf + done, crema_out_len - done);
+      if (n <= 0)
+	{
+	  break;
+	}
+      done += n;
+    }
+  crema_out_len = 0;
+}
+
+/*
+  Appends bytes to the output buffer, flushing it when it is full. Writes larger than
+  the buffer bypass it.
+
+  @param data The bytes to write
+  @param len The number of bytes to write
+*/
+static void crema_out_write(const char * data, size_t len)
+{
+  if (!crema_out_registered)
+    {
+      // exit() (including the aborts on runtime errors) flushes the output
+      crema_out_registered = 1;
+      atexit(crema_flush);
+    }
+  if (crema_out_len + len > CREMA_OUT_BUF_SZ)
+    {
+      crema_flush();
+      if (len > CREMA_OUT_BUF_SZ)
+	{
+	  while (len > 0)
+	    {
+	      ssize_t n = write(STDOUT_FILENO, data, len);
+	      if (n <= 0)
+		{
+		  return;
+		}
+	      data += n;
+	      len -= n;
+	    }
+	  return;
+	}
+    }
+  memcpy(crema_out_buf + crema_out_len, data, len);
+  crema_out_len += len;
+}
+
+/*
+  Formats an int in decimal into the output buffer
+
+  @param val The value to write
+  @param end Character written after the value, or '\0' for none
+*/
+static void crema_out_int(int64_t val, char end)
+{
+  char buf[24];
+  char * p = buf + sizeof(buf);
+  // Negate as unsigned so that INT64_MIN does not overflow
+  uint64_t u = (val < 0) ? -(uint64_t) val : (uint64_t) val;
+  if (end != '\0')
+    {
+      *--p = end;
+    }
+  do
+    {
+      *--p = '0' + (u % 10);
+      u /= 10;
+    }
+  while (u != 0);
+  if (val < 0)
+    {
+      *--p = '-';
+    }
+  crema_out_write(p, buf + sizeof(buf) - p);
+}
+
+/*
+  Formats a double as printf("%lf") does into the output buffer
+
+  @param val The value to write
+  @param end Character written after the value, or '\0' for none
+*/
+static void crema_out_double(double val, char end)
+{
+  char buf[512];
+  int n = snprintf(buf, sizeof(buf) - 1, "%lf", val);
+  if (n < 0 || n >= (int) sizeof(buf) - 1)
+    {
+      // Only values beyond 1e500 could get here, and doubles don't go that far
+      n = sizeof(buf) - 2;
+    }
+  if (end != '\0')
+    {
+      buf[n++] = end;
+    }
+  crema_out_write(buf, n);
+}
+
+/*
+  Prints a string without a new line character
+
+  @param str The string to be printed
+*/
+void str_print(string_t * str)
+{
+  if(str->arr == NULL)
+  {
+    return;
+  }
+  crema_out_write((char *) str->arr, strnlen((char *) str->arr, str->len));
+}
+
+/*
+  Prints a string with a new line character
+
+  @param str The string to be printed
+*/
+void str_println(string_t * str)
+{
+  str_print(str);
+  crema_out_write("\n", 1);
+}
+
+/*
+  Creates an empty list of type int
+
+  @return Pointer to the intialized list
+*/
+list_t * int_list_create()
+{
+  return list_create(sizeof(int64_t));
+}
+
+/*
+  Inserts a value into a list of type int at the given index
+
+  @param list The list to insert into
+  @param idx The index in the list to insert the value
+  @param val The int value to be inserted
+*/
+void int_list_insert(list_t * list, int64_t idx, int64_t val)
+{
+  list_insert(list, idx, (void *) &val);
+}
+
+/*
+  Retrieves the element from a list of type int at the given index
+
+  @param list The list to search
+  @param idx The index of the element to be retrieved
+  @return The element (int value) at the given index
+*/
+int64_t int_list_retrieve(list_t * list, int64_t idx)
+{
+  int64_t *p = list_retrieve(list, idx);
+  if (p == NULL)
+    {
+      CREMA_COUNT(oob_aborts, 1);
+      fprintf(stderr, "ERROR: Retrieving out of bounds list element!\n");
+      exit(-1);
+    }
+  return (int64_t) *p;
+}
+
+/*
+  Appends a new element of type int onto the given list, increasing the size of the list by one
+
+  @param list A list to append an int to
+  @param elem The int to be appended
+*/
+void int_list_append(list_t * list, int64_t elem)
+{
+  list_append(list, (void *) &elem);
+}
+
+/*
+  Alias for list_concat() on lists of type int
+*/
+void int_list_concat(list_t * list1, list_t * list2)
+{
+  list_concat(list1, list2);
+}
+
+/*
+  Alias for list_copy() on lists of type int
+*/
+list_t * int_list_copy(list_t * list)
+{
+  return list_copy(list);
+}
+
+/*
+  Alias for list_slice() on lists of type int
+*/
+list_t * int_list_slice(list_t * list, int64_t start, int64_t len)
+{
+  return list_slice(list, start, len);
+}
+
+/*
+  Alias for list_insert_range() on lists of type int
+*/
+void int_list_insert_range(list_t * list, int64_t idx, list_t * src)
+{
+  list_insert_range(list, idx, src);
+}
+
+/*
+  Creates an empty list of type int
+
+  @return Pointer to the intialized list
+*/
+list_t * double_list_create()
+{
+  return list_create(sizeof(double));
+}
+
+/*
+  Inserts a value into a list of type double at the given index
+
+  @param list The list to insert into
+  @param idx The index in the list to insert the value
+  @param val The double value to be inserted
+*/
+void double_list_insert(list_t * list, int64_t idx, double val)
+{
+  list_insert(list, idx, (void *) &val);
+}
+
+/*
+  Retrieves the element from a list of type double at the given index
+
+  @param list The list to search
+  @param idx The index of the element to be retrieved
+  @return The element (double value) at the given index
+*/
+double double_list_retrieve(list_t * list, int64_t idx)
+{
+  double *p = list_retrieve(list, idx);
+  if (p == NULL)
+    {
+      CREMA_COUNT(oob_aborts, 1);
+      fprintf(stderr, "ERROR: Retrieving out of bounds list element!\n");
+      exit(-1);
+    }
+  return (double) *p;
+}
+
+/*
+  Appends a new element of type double onto the given list, increasing the size of the list by one
+
+  @param list A list to append an double to
+  @param elem The double to be appended
+*/
+void double_list_append(list_t * list, double elem)
+{
+  list_append(list, (void *) &elem);
+}
+
+/*
+  Alias for list_concat() on lists of type double
+*/
+void double_list_concat(list_t * list1, list_t * list2)
+{
+  list_concat(list1, list2);
+}
+
+/*
+  Alias for list_reserve() on lists of type double
+*/
+void double_list_reserve(list_t * list, int64_t n)
+{
+  list_reserve(list, n);
+}
+
+/*
+  Alias for list_copy() on lists of type double
+*/
+list_t * double_list_copy(list_t * list)
+{
+  return list_copy(list);
+}
+
+/*
+  Alias for list_slice() on lists of type double
+*/
+list_t * double_list_slice(list_t * list, int64_t start, int64_t len)
+{
+  return list_slice(list, start, len);
+}
+
+/*
+  Alias for list_insert_range() on lists of type double
+*/
+void double_list_insert_range(list_t * list, int64_t idx, list_t * src)
+{
+  list_insert_range(list, idx, src);
+}
+
+// ************************ List Reductions **************************** //
+
+/*
+  The integer kernels are plain loops over the backing arrays, which the compiler
+  vectorizes for the target since integer addition and comparison can be reordered
+  freely; sums and products wrap around on overflow, as Crema arithmetic does. The
+  compiler may not reorder floating point additions, so the double kernels use SSE2
+  with two vectors of accumulators, and a scalar loop on other targets. Their sums may
+  therefore differ in the last bits from a foreach loop adding the elements in order.
+*/
+
+/*
+  Aborts the program if a list has no elements to take the minimum or maximum of
 
-  @param str The string to be operated on
-  @param start The starting index of the substring
-  @param len The number of characters after 'start' to be included in the substring
-  @return The substring
+  @param list The list to check
 */
-string_t * str_substr(string_t * str, unsigned int start, unsigned int len)
+static void crema_check_nonempty(list_t * list)
 {
-  string_t * nstr = list_create(sizeof(char));
-
-  if (start >= str->len)
-    return NULL;
-
-  if (len > str->len || len == 0)
-    len = str->len - start;
-
-  if (start == 0 && (len == 0 || len == str->len))
-    return str;
+  if (list == NULL || list->len == 0)
+    {
+      CREMA_COUNT(oob_aborts, 1);
+      fprintf(stderr, "ERROR: Reducing an empty list!\n");
+      exit(-1);
+    }
+}
 
-  if (start >= str->len)
-    return NULL;
+/*
+  Aborts the program if the lists of an elementwise operation differ in length
 
-  list_resize(nstr, len + 1);
-  strncpy(nstr->arr, (char*)str->arr + start, len);
-  nstr->len = len;
-  str_insert(nstr, len, '\0');
-  return nstr;
+  @param list1 The first list
+  @param list2 The second list
+  @return The length of both lists
+*/
+static int64_t crema_check_same_len(list_t * list1, list_t * list2)
+{
+  int64_t len1 = (list1 != NULL) ? list1->len : 0;
+  int64_t len2 = (list2 != NULL) ? list2->len : 0;
+  if (len1 != len2)
+    {
+      CREMA_COUNT(oob_aborts, 1);
+      fprintf(stderr, "ERROR: Combining lists of different lengths!\n");
+      exit(-1);
+    }
+  return len1;
 }
 
 /*
-  Alias for list_free()
+  Creates the list holding the result of an elementwise operation
+
+  @param es The number of bytes each element takes
+  @param len The number of elements of the result
+  @return A new list of len elements, whose values are to be filled in
 */
-void str_free(string_t * str)
+static list_t * crema_result_list(int64_t es, int64_t len)
 {
-  list_free(str);
+  list_t * nlist = list_create(es);
+  list_reserve(nlist, len);
+  nlist->len = len;
+  return nlist;
 }
 
 /*
-  Alias for list_insert()
+  Adds up the elements of a list of type int
+
+  @param list The list to sum
+  @return The sum of the elements, 0 for an empty list
 */
-void str_insert(string_t * str, unsigned int idx, char elem)
+int64_t int_list_sum(list_t * list)
 {
-  list_insert(str, idx, (void *) &elem);
+  const int64_t * a;
+  uint64_t sum = 0;
+  int64_t i;
+  if (list == NULL)
+    {
+      return 0;
+    }
+  a = list->arr;
+  for (i = 0; i < list->len; i++)
+    {
+      sum += (uint64_t) a[i];
+    }
+  return (int64_t) sum;
 }
 
 /*
-  Retrieves the character in the given string at the given index
+  Finds the smallest or largest element of a non-empty list of type int
 
-  @param str The string to be operated on
-  @param idx The index of the character to be returned
-  @return The character found in string str at index idx
+  @param list The list to search
+  @param max Whether to find the largest element instead of the smallest
+  @return The smallest or largest element
 */
-char str_retrieve(string_t * str, unsigned int idx)
+static int64_t crema_int_extreme(list_t * list, int max)
 {
-  char * p = list_retrieve(str, idx);
-  if (p == NULL)
+  const int64_t * a;
+  int64_t m;
+  int64_t i;
+  crema_check_nonempty(list);
+  a = list->arr;
+  m = a[0];
+  if (max)
     {
-      fprintf(stderr, "ERROR: Retrieving out of bounds list element!\n");
-      exit(-1);
+      for (i = 1; i < list->len; i++)
+	{
+	  m = (a[i] > m) ? a[i] : m;
+	}
     }
-  return (char) *p;
+  else
+    {
+      for (i = 1; i < list->len; i++)
+	{
+	  m = (a[i] < m) ? a[i] : m;
+	}
+    }
+  return m;
 }
 
 /*
-  Appends a new character onto the given string, increasing the size of the,
-  list by one, and appends a null-terminating character ('\0') at the end of the string
+  Finds the smallest element of a list of type int, aborting if the list is empty
 
-  @param list Pointer to a list
-  @param elem Pointer to and element to be appended onto the list
+  @param list The list to search
+  @return The smallest element
 */
-void str_append(string_t * str, char elem)
+int64_t int_list_min(list_t * list)
 {
-  list_append(str, (void *) &elem);
-  ((char*)str->arr)[str->len] = '\0';
+  return crema_int_extreme(list, 0);
 }
 
 /*
-  Concatenates two strings together, and then appends a null-termiating 
-  character ('\0') to the result
+  Finds the largest element of a list of type int, aborting if the list is empty
 
-  @param str1 The first string
-  @param str2 The second string to be concatenated onto the first list
+  @param list The list to search
+  @return The largest element
 */
-void str_concat(string_t * str1, string_t * str2)
+int64_t int_list_max(list_t * list)
 {
-  list_concat(str1, str2);
-  ((char*)str1->arr)[str1->len] = '\0';
+  return crema_int_extreme(list, 1);
 }
 
 /*
-  Prints a string without a new line character
+  Computes the dot product of two lists of type int of the same length
 
-  @param str The string to be printed
+  @param list1 The first list
+  @param list2 The second list
+  @return The sum of the products of the elements at the same index
 */
-void str_print(string_t * str)
+int64_t int_list_dot(list_t * list1, list_t * list2)
 {
-  if(str->arr == NULL)
-  {
-    return;
-  }
-  printf("%s", (char *) str->arr);
+  int64_t len = crema_check_same_len(list1, list2);
+  const int64_t * a;
+  const int64_t * b;
+  uint64_t sum = 0;
+  int64_t i;
+  if (len == 0)
+    {
+      return 0;
+    }
+  a = list1->arr;
+  b = list2->arr;
+  for (i = 0; i < len; i++)
+    {
+      sum += (uint64_t) a[i] * (uint64_t) b[i];
+    }
+  return (int64_t) sum;
 }
 
 /*
-  Prints a string with a new line character
+  Adds two lists of type int of the same length element by element
 
-  @param str The string to be printed
+  @param list1 The first list
+  @param list2 The second list
+  @return A new list holding the sums of the elements at the same index
 */
-void str_println(string_t * str)
+list_t * int_list_add(list_t * list1, list_t * list2)
 {
-  if(str->arr == NULL)
-  {
-    printf("\n");
-  }
-  else
-  {
-    printf("%s\n", (char *) str->arr);
-  }
+  int64_t len = crema_check_same_len(list1, list2);
+  list_t * nlist = crema_result_list(sizeof(int64_t), len);
+  int64_t * restrict out = nlist->arr;
+  int64_t i;
+  for (i = 0; i < len; i++)
+    {
+      out[i] = (int64_t) ((uint64_t) ((int64_t *) list1->arr)[i] + (uint64_t) ((int64_t *) list2->arr)[i]);
+    }
+  return nlist;
 }
 
 /*
-  Creates an empty list of type int
+  Multiplies the elements of a list of type int by a value
 
-  @return Pointer to the intialized list
+  @param list The list to scale
+  @param k The value to multiply the elements by
+  @return A new list holding the products
 */
-list_t * int_list_create()
+list_t * int_list_scale(list_t * list, int64_t k)
 {
-  return list_create(sizeof(int64_t));
+  int64_t len = (list != NULL) ? list->len : 0;
+  list_t * nlist = crema_result_list(sizeof(int64_t), len);
+  int64_t * restrict out = nlist->arr;
+  int64_t i;
+  for (i = 0; i < len; i++)
+    {
+      out[i] = (int64_t) ((uint64_t) ((int64_t *) list->arr)[i] * (uint64_t) k);
+    }
+  return nlist;
 }
 
 /*
-  Inserts a value into a list of type int at the given index
+  Adds up the elements of a list of type double, or the products of the elements of
+  two lists at the same index
 
-  @param list The list to insert into
-  @param idx The index in the list to insert the value
-  @param val The int value to be inserted
+  @param a The elements of the first list
+  @param b The elements of the second list, or NULL to sum the elements of a
+  @param len The number of elements of the lists
+  @return The sum
 */
-void int_list_insert(list_t * list, int64_t idx, int64_t val)
+static double crema_double_sum(const double * a, const double * b, int64_t len)
 {
-  list_insert(list, idx, (void *) &val);
+  double sum = 0.0;
+  int64_t i = 0;
+#ifdef __SSE2__
+  __m128d acc0 = _mm_setzero_pd();
+  __m128d acc1 = _mm_setzero_pd();
+  double lanes[2];
+  for (; i + 4 <= len; i += 4)
+    {
+      __m128d x0 = _mm_loadu_pd(a + i);
+      __m128d x1 = _mm_loadu_pd(a + i + 2);
+      if (b != NULL)
+	{
+	  x0 = _mm_mul_pd(x0, _mm_loadu_pd(b + i));
+	  x1 = _mm_mul_pd(x1, _mm_loadu_pd(b + i + 2));
+	}
+      acc0 = _mm_add_pd(acc0, x0);
+      acc1 = _mm_add_pd(acc1, x1);
+    }
+  _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+  sum = lanes[0] + lanes[1];
+#endif
+  for (; i < len; i++)
+    {
+      sum += (b != NULL) ? a[i] * b[i] : a[i];
+    }
+  return sum;
 }
 
 /*
-  Retrieves the element from a list of type int at the given index
+  Adds up the elements of a list of type double
 
-  @param list The list to search
-  @param idx The index of the element to be retrieved
-  @return The element (int value) at the given index
+  @param list The list to sum
+  @return The sum of the elements, 0 for an empty list
 */
-int64_t int_list_retrieve(list_t * list, int64_t idx)
+double double_list_sum(list_t * list)
 {
-  int64_t *p = list_retrieve(list, idx);
-  if (p == NULL)
+  if (list == NULL || list->len == 0)
     {
-      fprintf(stderr, "ERROR: Retrieving out of bounds list element!\n");
-      exit(-1);
+      return 0.0;
     }
-  return (int64_t) *p;
+  return crema_double_sum(list->arr, NULL, list->len);
 }
 
 /*
-  Appends a new element of type int onto the given list, increasing the size of the list by one
+  Computes the dot product of two lists of type double of the same length
 
-  @param list A list to append an int to
-  @param elem The int to be appended
+  @param list1 The first list
+  @param list2 The second list
+  @return The sum of the products of the elements at the same index
 */
-void int_list_append(list_t * list, int64_t elem)
+double double_list_dot(list_t * list1, list_t * list2)
 {
-  list_append(list, (void *) &elem);
+  int64_t len = crema_check_same_len(list1, list2);
+  if (len == 0)
+    {
+      return 0.0;
+    }
+  return crema_double_sum(list1->arr, list2->arr, len);
 }
 
 /*
-  Creates an empty list of type int
+  Finds the smallest or largest element of a non-empty list of type double. Like
+  a foreach loop keeping the element if (x < m) or (x > m), NaN elements are skipped
+  unless the first element is NaN.
 
-  @return Pointer to the intialized list
+  @param list The list to search
+  @param max Whether to find the largest element instead of the smallest
+  @return The smallest or largest element
 */
-list_t * double_list_create()
+static double crema_double_extreme(list_t * list, int max)
 {
-  return list_create(sizeof(double));
+  const double * a;
+  double m;
+  int64_t i = 1;
+  crema_check_nonempty(list);
+  a = list->arr;
+  m = a[0];
+  if (m != m)
+    {
+      return m;
+    }
+#ifdef __SSE2__
+  if (list->len >= 5)
+    {
+      // _mm_min_pd(x, m) is (x < m) ? x : m, so NaN elements are skipped
+      __m128d acc0 = _mm_set1_pd(m);
+      __m128d acc1 = acc0;
+      double lanes[2];
+      for (; i + 4 <= list->len; i += 4)
+	{
+	  __m128d x0 = _mm_loadu_pd(a + i);
+	  __m128d x1 = _mm_loadu_pd(a + i + 2);
+	  acc0 = max ? _mm_max_pd(x0, acc0) : _mm_min_pd(x0, acc0);
+	  acc1 = max ? _mm_max_pd(x1, acc1) : _mm_min_pd(x1, acc1);
+	}
+      _mm_storeu_pd(lanes, max ? _mm_max_pd(acc0, acc1) : _mm_min_pd(acc0, acc1));
+      m = max ? ((lanes[1] > lanes[0]) ? lanes[1] : lanes[0]) : ((lanes[1] < lanes[0]) ? lanes[1] : lanes[0]);
+    }
+#endif
+  for (; i < list->len; i++)
+    {
+      if (max ? (a[i] > m) : (a[i] < m))
+	{
+	  m = a[i];
+	}
+    }
+  return m;
 }
 
 /*
-  Inserts a value into a list of type double at the given index
+  Finds the smallest element of a list of type double, aborting if the list is empty
 
-  @param list The list to insert into
-  @param idx The index in the list to insert the value
-  @param val The double value to be inserted
+  @param list The list to search
+  @return The smallest element
 */
-void double_list_insert(list_t * list, unsigned int idx, double val)
+double double_list_min(list_t * list)
 {
-  list_insert(list, idx, (void *) &val);
+  return crema_double_extreme(list, 0);
 }
 
 /*
-  Retrieves the element from a list of type double at the given index
+  Finds the largest element of a list of type double, aborting if the list is empty
 
   @param list The list to search
-  @param idx The index of the element to be retrieved
-  @return The element (double value) at the given index
+  @return The largest element
 */
-double double_list_retrieve(list_t * list, unsigned int idx)
+double double_list_max(list_t * list)
 {
-  double *p = list_retrieve(list, idx);
-  if (p != NULL)
+  return crema_double_extreme(list, 1);
+}
+
+/*
+  Adds two lists of type double of the same length element by element
+
+  @param list1 The first list
+  @param list2 The second list
+  @return A new list holding the sums of the elements at the same index
+*/
+list_t * double_list_add(list_t * list1, list_t * list2)
+{
+  int64_t len = crema_check_same_len(list1, list2);
+  list_t * nlist = crema_result_list(sizeof(double), len);
+  double * restrict out = nlist->arr;
+  int64_t i;
+  for (i = 0; i < len; i++)
     {
-      fprintf(stderr, "ERROR: Retrieving out of bounds list element!\n");
-      exit(-1);
+      out[i] = ((double *) list1->arr)[i] + ((double *) list2->arr)[i];
     }
-  return (double) *p;
+  return nlist;
 }
 
 /*
-  Appends a new element of type double onto the given list, increasing the size of the list by one
+  Multiplies the elements of a list of type double by a value
 
-  @param list A list to append an double to
-  @param elem The double to be appended
+  @param list The list to scale
+  @param k The value to multiply the elements by
+  @return A new list holding the products
 */
-void double_list_append(list_t * list, double elem)
+list_t * double_list_scale(list_t * list, double k)
 {
-  list_append(list, (void *) &elem);
+  int64_t len = (list != NULL) ? list->len : 0;
+  list_t * nlist = crema_result_list(sizeof(double), len);
+  double * restrict out = nlist->arr;
+  int64_t i;
+  for (i = 0; i < len; i++)
+    {
+      out[i] = ((double *) list->arr)[i] * k;
+    }
+  return nlist;
 }
 
 /*
@@ -453,17 +1798,18 @@ void double_list_append(list_t * list, double elem)
 
   @param start An integer number to begin a sequence at
   @param end An integer number to end the sequence at
+  @return The sequence, an empty list (rather than NULL) if end <= start
 */
 list_t * crema_seq(int64_t start, int64_t end)
 {
   list_t * l;
   int64_t i;
+  l = int_list_create();
   if (end <= start)
     {
-      return NULL;
+      return l;
     }
-  l = int_list_create();
-  list_resize(l, end - start);
+  list_reserve(l, end - start + 1);
   for (i = start; i <= end; i++)
     {
       int_list_append(l, i);
@@ -478,7 +1824,7 @@ list_t * crema_seq(int64_t start, int64_t end)
 */
 void double_print(double val)
 {
-  printf("%lf", val);
+  crema_out_double(val, '\0');
 }
 
 /**
@@ -488,7 +1834,7 @@ void double_print(double val)
 */
 void double_println(double val)
 {
-  printf("%lf\n", val);
+  crema_out_double(val, '\n');
 }
 
 /**
@@ -498,7 +1844,7 @@ void double_println(double val)
 */
 void int_print(int64_t val)
 {
-    printf("%ld", val);
+    crema_out_int(val, '\0');
 }
 
 /**
@@ -508,7 +1854,35 @@ void int_print(int64_t val)
 */
 void int_println(int64_t val)
 {
-    printf("%ld\n", val);
+    crema_out_int(val, '\n');
+}
+
+/**
+   Prints each value of an int list to stdout on a line of its own
+
+   @params list The list of ints to be printed
+*/
+void int_list_print(list_t * list)
+{
+  int64_t i;
+  for (i = 0; i < list->len; i++)
+    {
+      crema_out_int(((int64_t *) list->arr)[i], '\n');
+    }
+}
+
+/**
+   Prints each value of a double list to stdout on a line of its own
+
+   @params list The list of doubles to be printed
+*/
+void double_list_print(list_t * list)
+{
+  int64_t i;
+  for (i = 0; i < list->len; i++)
+    {
+      crema_out_double(((double *) list->arr)[i], '\n');
+    }
 }
 
 /**
@@ -564,10 +1938,175 @@ int64_t prog_arg_count()
 */
 list_t * prog_argument(int64_t idx)
 {
-  if (idx >= main_argc)
+  if (idx < 0 || idx >= main_argc)
     return str_from_cstring("null cstring");
 
-  return str_from_cstring(main_args[idx]);
+  // The arguments live as long as the program, so they are borrowed rather than copied
+  return list_view(sizeof(char), main_args[idx], strlen(main_args[idx]));
+}
+
+// **************************** Input ********************************* //
+
+/*
+  Input from stdin is read CREMA_IN_BUF_SZ bytes at a time into a buffer that
+  read_line() and read_all() consume
+*/
+static char crema_in_buf[CREMA_IN_BUF_SZ];
+static size_t crema_in_pos = 0;
+static size_t crema_in_len = 0;
+
+/*
+  Appends bytes to a string and re-terminates it, growing it geometrically
+
+  @param str The string to append to
+  @param data The bytes to append
+  @param len The number of bytes to append
+*/
+static void str_append_bytes(string_t * str, const char * data, size_t len)
+{
+  list_grow(str, str->len + len + 1);
+  memcpy((char *) str->arr + str->len, data, len);
+  str->len += len;
+  ((char *) str->arr)[str->len] = '\0';
+}
+
+/*
+  Refills the input buffer once it has been consumed, flushing the program's output
+  first so that prompts appear before the program waits
+
+  @return 1 if there is buffered input, 0 at the end of the input
+*/
+static int crema_in_fill()
+{
+  ssize_t n;
+  if (crema_in_pos < crema_in_len)
+    {
+      return 1;
+    }
+  crema_flush();
+  do
+    {
+      n = read(STDIN_FILENO, crema_in_buf, CREMA_IN_BUF_SZ);
+    }
+  while (n < 0 && errno == EINTR);
+  crema_in_pos = 0;
+  crema_in_len = (n > 0) ? n : 0;
+  return n > 0;
+}
+
+/*
+  Reads the rest of a file descriptor into a string, in chunks of at least
+  CREMA_IN_BUF_SZ bytes
+
+  @param fd The file descriptor to read
+  @param str The string to append the bytes to
+*/
+static void crema_read_fd(int fd, string_t * str)
+{
+  for (;;)
+    {
+      ssize_t n;
+      list_grow(str, str->len + CREMA_IN_BUF_SZ + 1);
+      n = read(fd, (char *) str->arr + str->len, str->cap - str->len - 1);
+      if (n < 0 && errno == EINTR)
+	{
+	  continue;
+	}
+      if (n <= 0)
+	{
+	  break;
+	}
+      str->len += n;
+    }
+  ((char *) str->arr)[str->len] = '\0';
+}
+
+/**
+   Reads the next line of stdin
+
+   @return The line, without its new line character; an empty string at the end of the input
+*/
+string_t * read_line()
+{
+  string_t * line = str_create();
+  str_append_bytes(line, "", 0);
+  while (crema_in_fill())
+    {
+      char * start = crema_in_buf + crema_in_pos;
+      char * nl = memchr(start, '\n', crema_in_len - crema_in_pos);
+      size_t n = (nl != NULL) ? (size_t) (nl - start) : crema_in_len - crema_in_pos;
+      str_append_bytes(line, start, n);
+      crema_in_pos += n;
+      if (nl != NULL)
+	{
+	  crema_in_pos++;
+	  break;
+	}
+    }
+  return line;
+}
+
+/**
+   Checks whether all of stdin has been read
+
+   @return 1 if there is no more input, 0 otherwise
+*/
+int64_t read_eof()
+{
+  return !crema_in_fill();
+}
+
+/**
+   Reads the rest of stdin
+
+   @return A string with every byte of the remaining input
+*/
+string_t * read_all()
+{
+  string_t * str = str_create();
+  str_append_bytes(str, crema_in_buf + crema_in_pos, crema_in_len - crema_in_pos);
+  crema_in_pos = crema_in_len = 0;
+  crema_flush();
+  crema_read_fd(STDIN_FILENO, str);
+  return str;
+}
+
+/**
+   Reads a whole file. Regular files are mapped into memory and copied into the
+   string at once; other files (pipes, devices) are read in chunks. Aborts the
+   program if the file cannot be opened.
+
+   @param path The name of the file
+   @return A string with the contents of the file
+*/
+string_t * read_file(string_t * path)
+{
+  char * name = strndup((path->arr != NULL) ? (char *) path->arr : "", path->len);
+  string_t * str = str_create();
+  struct stat st;
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    {
+      crema_flush();
+      fprintf(stderr, "ERROR: Unable to open file %s!\n", name);
+      exit(-1);
+    }
+  free(name);
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+      void * map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED)
+	{
+	  list_resize(str, st.st_size + 1);
+	  str_append_bytes(str, map, st.st_size);
+	  munmap(map, st.st_size);
+	  close(fd);
+	  return str;
+	}
+    }
+  crema_read_fd(fd, str);
+  close(fd);
+  return str;
 }
 
 // *********************** Type Conversions ***************************** //
@@ -610,6 +2149,22 @@ string_t * int_to_string(int64_t val)
   return stp;
 }
 
+/*
+  Copies the start of a string into a terminated buffer for parsing as a number,
+  since substrings are not terminated
+
+  @param str The string to copy
+  @param buf Buffer of CREMA_NUM_STR_SZ characters
+  @return buf
+*/
+static char * crema_str_number(string_t * str, char * buf)
+{
+  size_t n = (str->len < CREMA_NUM_STR_SZ - 1) ? str->len : CREMA_NUM_STR_SZ - 1;
+  memcpy(buf, str->arr, n);
+  buf[n] = '\0';
+  return buf;
+}
+
 /**
    Converts a string to an int.
 
@@ -624,7 +2179,8 @@ int64_t string_to_int(string_t * str)
   }
   else
   {
-    return atoi(str->arr);
+    char buf[CREMA_NUM_STR_SZ];
+    return atoi(crema_str_number(str, buf));
   }
 }
 
@@ -634,7 +2190,7 @@ int64_t string_to_int(string_t * str)
    @params str A string to be converted to a double
    @return Double value, or 0.0 if the string could not be parsed as a double
 */
-int64_t string_to_double(string_t * str)
+double string_to_double(string_t * str)
 {
   if(str->arr == NULL)
   {
@@ -642,7 +2198,8 @@ int64_t string_to_double(string_t * str)
   }
   else
   {
-    return atof(str->arr);
+    char buf[CREMA_NUM_STR_SZ];
+    return atof(crema_str_number(str, buf));
   }
 }
 
@@ -13,66 +13,139 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+typedef struct crema_region_s crema_region_t;
+
+// An array shared by a string and its substrings, freed by the last of them to let go of it
+typedef struct crema_shared_s {
+  int64_t refs;
+  void * arr;
+} crema_shared_t;
+
 struct list_s {
-  unsigned int cap;
+  int64_t cap;
   int64_t len;
   size_t elem_sz;
   void * arr;
+  crema_region_t * region;
+  int64_t flags;
+  crema_shared_t * shared; // Reference count of the array arr points into, NULL if it is not shared
 };
 
 typedef struct list_s list_t;
 typedef list_t string_t;
 
+// list_t flags
+#define LIST_BORROWED 1 // arr belongs to another list (or to argv) and is copied before any change
+#define LIST_SHARED 2 // arr is borrowed by slices and is copied before any change, see shared
+
 #define DEFAULT_RESIZE_AMT 5
+#define LIST_GROWTH_FACTOR 2
+#define CREMA_REGION_CHUNK_SZ (64 * 1024)
+#define CREMA_REGION_ALIGN 16
+#define CREMA_REGION_MAX_FREE_CHUNKS 16
+#define CREMA_COUNTERS_ENV "CREMA_COUNTERS_FILE"
+#define CREMA_THREADS_ENV "CREMA_THREADS"
+#define CREMA_MAX_THREADS 64
+#define CREMA_PARALLEL_MIN_ITERS 64
+#define CREMA_PARALLEL_CHUNKS_PER_THREAD 4
+#define CREMA_OUT_BUF_SZ (64 * 1024)
+#define CREMA_IN_BUF_SZ (64 * 1024)
+#define CREMA_NUM_STR_SZ 512
+
+void crema_region_enter();
+list_t * crema_region_leave(list_t * keep);
+void crema_counters_init();
+void crema_flush();
+void crema_parallel_for(int64_t start, int64_t last, void (*body)(int64_t, int64_t, void *), void * env);
 
 list_t * list_create(int64_t es);
+list_t * list_from_array(void * arr, int64_t len, int64_t es);
 void list_free(list_t * list);
-void list_insert(list_t * list, unsigned int idx, void * elem);
-void * list_retrieve(list_t * list, unsigned int idx);
+void list_reserve(list_t * list, int64_t n);
+void list_own_array(list_t * list);
+void list_insert(list_t * list, int64_t idx, void * elem);
+void * list_retrieve(list_t * list, int64_t idx);
+void * list_element(list_t * list, int64_t idx);
 void list_append(list_t * list, void * elem);
 void list_concat(list_t * list1, list_t * list2);
+list_t * list_copy(list_t * list);
+list_t * list_slice(list_t * list, int64_t start, int64_t len);
+void list_insert_range(list_t * list, int64_t idx, list_t * src);
 void list_delete(list_t * list, unsigned int idx);
 int64_t list_length(list_t * list);
 
 string_t * str_create();
+string_t * str_from_literal(char * s, int64_t len);
 void str_free(string_t * str);
-void str_insert(string_t * str, unsigned int idx, char elem);
-char str_retrieve(string_t * str, unsigned int idx);
+void str_insert(string_t * str, int64_t idx, char elem);
+char str_retrieve(string_t * str, int64_t idx);
 void str_append(string_t * str, char elem);
 void str_concat(string_t * str1, string_t * str2);
+void str_reserve(string_t * str, int64_t n);
+string_t * str_copy(string_t * str);
+void str_insert_range(string_t * str, int64_t idx, string_t * src);
 void str_print(string_t * str);
 void str_println(string_t * str);
 void str_delete(string_t * str, unsigned int idx);
-string_t * str_substr(string_t * str, unsigned int start, unsigned int len);
+string_t * str_substr(string_t * str, int64_t start, int64_t len);
+int64_t str_find(string_t * str, string_t * sub);
 
 list_t * int_list_create();
 void int_list_insert(list_t * list, int64_t idx, int64_t val);
 int64_t int_list_retrieve(list_t * list, int64_t idx);
 void int_list_append(list_t * list, int64_t elem);
+void int_list_concat(list_t * list1, list_t * list2);
+list_t * int_list_copy(list_t * list);
+list_t * int_list_slice(list_t * list, int64_t start, int64_t len);
+void int_list_insert_range(list_t * list, int64_t idx, list_t * src);
+int64_t int_list_sum(list_t * list);
+int64_t int_list_min(list_t * list);
+int64_t int_list_max(list_t * list);
+int64_t int_list_dot(list_t * list1, list_t * list2);
+list_t * int_list_add(list_t * list1, list_t * list2);
+list_t * int_list_scale(list_t * list, int64_t k);
 
 list_t * double_list_create();
-void double_list_insert(list_t * list, unsigned int idx, double val);
-double double_list_retrieve(list_t * list, unsigned int idx);
+void double_list_insert(list_t * list, int64_t idx, double val);
+double double_list_retrieve(list_t * list, int64_t idx);
 void double_list_append(list_t * list, double elem);
+void double_list_concat(list_t * list1, list_t * list2);
+void double_list_reserve(list_t * list, int64_t n);
+list_t * double_list_copy(list_t * list);
+list_t * double_list_slice(list_t * list, int64_t start, int64_t len);
+void double_list_insert_range(list_t * list, int64_t idx, list_t * src);
+double double_list_sum(list_t * list);
+double double_list_min(list_t * list);
+double double_list_max(list_t * list);
+double double_list_dot(list_t * list1, list_t * list2);
+list_t * double_list_add(list_t * list1, list_t * list2);
+list_t * double_list_scale(list_t * list, double k);
 void double_print(double val);
 void double_println(double val);
+void double_list_print(list_t * list);
 
 list_t * crema_seq(int64_t start, int64_t end);
 
 void int_print(int64_t val);
 void int_println(int64_t val);
+void int_list_print(list_t * list);
 void make_symbolic(list_t * list);
 
 void save_args(int64_t argc, char ** argv);
 int64_t prog_arg_count();
 list_t * prog_argument(int64_t idx);
 
+string_t * read_line();
+int64_t read_eof();
+string_t * read_all();
+string_t * read_file(string_t * path);
+
 // *********************** Type Conversion ***************************** //
 int64_t double_to_int(double val);
 double int_to_double(int64_t val);
 string_t * int_to_string(int64_t val);
 int64_t string_to_int(string_t * str);
-int64_t string_to_double(string_t * str);
+double string_to_double(string_t * str);
 
 // ************************ Math Functions ***************************** //
 double double_floor(double val);
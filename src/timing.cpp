@@ -0,0 +1,142 @@
+/**
+   @file timing.cpp
+   @brief Implementation of the per-phase timing and memory statistics of cremacc
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   Contains the PhaseTimer implementation
+*/
+
+#include "timing.h"
+#include "arena.h"
+#include <chrono>
+#include <iomanip>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+/**
+   Reads the wall clock time
+
+   @return Seconds since an arbitrary fixed point
+*/
+static double wallTime()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+   Reads the process' resource usage
+
+   @param cpu Set to the user and system CPU time used so far, in seconds
+   @param peakRss Set to the peak resident set size so far, in KB
+*/
+static void resourceUsage(double & cpu, long & peakRss)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    cpu = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+    peakRss = ru.ru_maxrss;
+}
+
+/**
+   Starts timing a phase, ending the current phase if there is one
+
+   @param name Name of the phase
+*/
+void PhaseTimer::start(const char * name)
+{
+    if (!enabled)
+    {
+	return;
+    }
+    stop();
+    current.name = name;
+    current.wall = wallTime();
+    resourceUsage(current.cpu, current.peakRss);
+    current.arenaBytes = Arena::get().bytesAllocated();
+    active = true;
+}
+
+/**
+   Ends the current phase, if there is one, and records its measurements
+*/
+void PhaseTimer::stop()
+{
+    if (!active)
+    {
+	return;
+    }
+    PhaseRecord rec;
+    rec.name = current.name;
+    rec.wall = wallTime() - current.wall;
+    resourceUsage(rec.cpu, rec.peakRss);
+    rec.cpu -= current.cpu;
+    rec.arenaBytes = Arena::get().bytesAllocated() - current.arenaBytes;
+    phases.push_back(rec);
+    active = false;
+}
+
+/**
+   Records a size statistic of the compilation, such as the number of AST nodes
+
+   @param name Name of the statistic
+   @param value Value of the statistic
+*/
+void PhaseTimer::addStat(const char * name, uint64_t value)
+{
+    if (enabled)
+    {
+	stats.push_back(std::make_pair(std::string(name), value));
+    }
+}
+
+/**
+   Prints the recorded phases and statistics as a table
+
+   @param os Output stream to print to
+*/
+void PhaseTimer::report(std::ostream & os) const
+{
+    double wall = 0, cpu = 0;
+    os << "===== Phase timings =====" << std::endl;
+    os << std::left << std::setw(16) << "phase" << std::right << std::setw(12) << "wall (ms)" << std::setw(12) << "cpu (ms)"
+       << std::setw(14) << "peak RSS (KB)" << std::setw(14) << "AST bytes" << std::endl;
+    os << std::fixed << std::setprecision(3);
+    for (auto & p : phases)
+    {
+	os << std::left << std::setw(16) << p.name << std::right << std::setw(12) << p.wall * 1e3 << std::setw(12) << p.cpu * 1e3
+	   << std::setw(14) << p.peakRss << std::setw(14) << p.arenaBytes << std::endl;
+	wall += p.wall;
+	cpu += p.cpu;
+    }
+    os << std::left << std::setw(16) << "total" << std::right << std::setw(12) << wall * 1e3 << std::setw(12) << cpu * 1e3 << std::endl;
+    os.unsetf(std::ios::floatfield);
+    for (auto & s : stats)
+    {
+	os << std::left << std::setw(16) << s.first << std::right << std::setw(12) << s.second << std::endl;
+    }
+}
+
+/**
+   Prints the recorded phases and statistics as a JSON object of the form
+   {"phases": [{"name": ..., "wall": ..., "cpu": ..., "peak_rss_kb": ..., "ast_bytes": ...}], "stats": {...}}
+   with times in seconds
+
+   @param os Output stream to print to
+*/
+void PhaseTimer::reportJSON(std::ostream & os) const
+{
+    os << "{\"phases\": [";
+    for (size_t i = 0; i < phases.size(); i++)
+    {
+	const PhaseRecord & p = phases[i];
+	os << (i ? ", " : "") << "{\"name\": \"" << p.name << "\", \"wall\": " << p.wall << ", \"cpu\": " << p.cpu
+	   << ", \"peak_rss_kb\": " << p.peakRss << ", \"ast_bytes\": " << p.arenaBytes << "}";
+    }
+    os << "], \"stats\": {";
+    for (size_t i = 0; i < stats.size(); i++)
+    {
+	os << (i ? ", " : "") << "\"" << stats[i].first << "\": " << stats[i].second;
+    }
+    os << "}}" << std::endl;
+}
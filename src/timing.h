@@ -0,0 +1,50 @@
+/**
+   @file timing.h
+   @brief Header file for the per-phase timing and memory statistics of cremacc
+   @copyright 2015 Assured Information Security, Inc.
+   @author Jacob Torrey <torreyj@ainfosec.com>
+
+   The compiler pipeline (parsing, semantic analysis, code generation, optimization,
+   emission and linking) is split into phases. A PhaseTimer records the wall and CPU
+   time and the memory use of each phase, along with size statistics of the program,
+   and reports them as text or JSON.
+*/
+
+#ifndef CREMA_TIMING_H_
+#define CREMA_TIMING_H_
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ *  The measurements of one compiler phase */
+struct PhaseRecord {
+    std::string name; /**< Name of the phase */
+    double wall; /**< Elapsed wall clock time, in seconds */
+    double cpu; /**< User and system CPU time, in seconds */
+    long peakRss; /**< Peak resident set size of cremacc at the end of the phase, in KB */
+    size_t arenaBytes; /**< Bytes of AST memory allocated during the phase */
+};
+
+/**
+ *  Records the phases of a compilation. A disabled PhaseTimer records nothing. */
+class PhaseTimer {
+public:
+    PhaseTimer() : enabled(false), active(false) { }
+    bool enabled; /**< Whether phases and statistics are recorded */
+    void start(const char * name);
+    void stop();
+    void addStat(const char * name, uint64_t value);
+    void report(std::ostream & os) const;
+    void reportJSON(std::ostream & os) const;
+private:
+    bool active; /**< Whether a phase is being timed */
+    PhaseRecord current; /**< Phase being timed, with its starting measurements */
+    std::vector<PhaseRecord> phases; /**< Completed phases, in order */
+    std::vector<std::pair<std::string, uint64_t> > stats; /**< Size statistics, in order */
+};
+
+#endif // CREMA_TIMING_H_
@@ -215,41 +215,46 @@ std::ostream & Type::print(std::ostream & os) const
 std::ostream & StructType::print(std::ostream & os) const
 {
     os << "STRUCT " << ident;
+    if (isList)
+    {
+	os << "[]";
+    }
     return os;
 }
 
 /**
    Function to convert a Crema Type to an llvm::Type
 
+   @param ctx LLVMContext to create the type in
    @return LLVM type object corresponding with the Type
 */
-llvm::Type * Type::toLlvmType()
+llvm::Type * Type::toLlvmType(llvm::LLVMContext & ctx)
 {
     llvm::Type * t;
     if (isList)
     {
-	t = llvm::PointerType::get(llvm::Type::getInt8Ty(llvm::getGlobalContext()), 0);
+	t = llvm::PointerType::get(llvm::Type::getInt8Ty(ctx), 0);
 	return t;
     }
     switch(typecode)
     {
     case INT:
-    	t = llvm::Type::getInt64Ty(llvm::getGlobalContext());
+    	t = llvm::Type::getInt64Ty(ctx);
 	break;
     case DOUBLE:
-    	t = llvm::Type::getDoubleTy(llvm::getGlobalContext());
+    	t = llvm::Type::getDoubleTy(ctx);
     	break;
     case VOID:
-    	t = llvm::Type::getVoidTy(llvm::getGlobalContext());
+    	t = llvm::Type::getVoidTy(ctx);
     	break;
     case BOOL:
-    	t = llvm::Type::getInt1Ty(llvm::getGlobalContext());
+    	t = llvm::Type::getInt1Ty(ctx);
 	break;
     case CHAR:
-    	t = llvm::Type::getInt8Ty(llvm::getGlobalContext());
+    	t = llvm::Type::getInt8Ty(ctx);
     	break;
     case STRING:
-	t = llvm::PointerType::get(llvm::Type::getInt8Ty(llvm::getGlobalContext()), 0);
+	t = llvm::PointerType::get(llvm::Type::getInt8Ty(ctx), 0);
 	break;
     default:
     	return NULL;
@@ -13,6 +13,7 @@
 
 #include <iostream>
 #include <llvm/IR/Type.h>
+#include "arena.h"
 
 class NIdentifier;
 
@@ -40,13 +41,15 @@ public:
     bool isStruct; /**< Bool value if the type is a struct type */
     TypeCodes typecode; /**< typecode for the Type */
     virtual ~Type() { }
+    static void * operator new(size_t sz) { return Arena::get().allocate(sz); } /**< Types are allocated from the compilation's Arena */
+    static void operator delete(void * p) { } /**< Arena memory is released with the Arena */
 Type() : typecode(INVALID) { }
     Type(int type) { isList = false; setType(type); isStruct = false; }
     Type(int type, bool l) { setType(type); isList = l; isStruct = false; }
     Type(Type & t, bool l) { typecode = t.typecode; isList = l; isStruct = false; }
     bool getIsList() { return isList; }
     size_t getSize();
-    llvm::Type * toLlvmType();
+    llvm::Type * toLlvmType(llvm::LLVMContext & ctx);
     static Type & getLargerType(Type & t1, Type & t2);
     virtual std::ostream & print(std::ostream & os) const;
     friend std::ostream & operator<<(std::ostream & os, Type & type); 
@@ -62,8 +65,11 @@ class StructType : public Type
 {
 public:
     NIdentifier & ident;
-StructType(NIdentifier & ident) : ident(ident) { setType(STRUCT); isStruct = true; }
+    bool soa; /**< Whether a list of the structure stores each member in a list of its own (struct-of-arrays) */
+StructType(NIdentifier & ident) : ident(ident), soa(false) { typecode = STRUCT; isList = false; isStruct = true; }
+StructType(NIdentifier & ident, bool l, bool soa) : ident(ident), soa(soa) { typecode = STRUCT; isList = l; isStruct = true; } /**< Constructor for lists of structures, stored contiguously or as one list per member */
     std::ostream & print(std::ostream & os) const;
+    static bool isSoaList(Type & type) { return type.isStruct && type.isList && ((StructType &) type).soa; } /**< Whether a declared type is a struct-of-arrays list of structures */
 };
 
 #endif // CREMA_TYPE_H_
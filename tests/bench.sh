@@ -0,0 +1,180 @@
+#!/bin/bash
+
+# Crema Benchmark Framework
+# (C) Assured Information Security, Inc. 2015
+#
+# Compiles and runs every workload in bench/ several times and records the best compile
+# time of each compiler phase (from cremacc -time-json), the best run time of the generated
+# program and the peak RSS of both. The results are written to bench_results.txt and
+# compared against bench/baseline.txt; a metric that is more than THRESHOLD percent worse
+# than its baseline is reported as a regression. No baseline is committed, since timings
+# depend on the machine: record one with --save-baseline on the machine that compares.
+#
+# Usage: ./bench.sh [-n RUNS] [-t THRESHOLD] [-l N] [--save-baseline]
+#   -n RUNS          Number of compiles and runs per workload (default 5)
+#   -t THRESHOLD     Allowed slowdown in percent before reporting a regression (default 10)
+#   -l N             Also time compiling large generated sources (see bench/gen_large.sh) of size N
+#   --save-baseline  Store the results as the new bench/baseline.txt
+
+RUNS=5
+THRESHOLD=10
+LARGE=0
+SAVE=0
+RESULTS=bench_results.txt
+BASELINE=bench/baseline.txt
+# Times below this many seconds are too noisy to compare
+MIN_TIME=0.01
+
+while [[ $# -gt 0 ]]
+do
+    case $1 in
+	-n) RUNS=$2; shift ;;
+	-t) THRESHOLD=$2; shift ;;
+	-l) LARGE=$2; shift ;;
+	--save-baseline) SAVE=1 ;;
+	*) echo "Usage: $0 [-n RUNS] [-t THRESHOLD] [-l N] [--save-baseline]"; exit -1 ;;
+    esac
+    shift
+done
+
+if [ ! -f ../src/cremacc ]
+then
+    echo "cremacc not found! Please build and try again!"
+    exit -1
+fi
+
+# cremacc looks for the runtime relative to the working directory, so compile from src/
+SRCDIR=$(cd ../src && pwd)
+BENCHDIR=$(cd bench && pwd)
+WORKDIR=$(mktemp -d)
+trap "rm -rf $WORKDIR" EXIT
+unset CREMA_CACHE_DIR
+> $RESULTS
+
+# Runs a command with its output discarded, setting ELAPSED (seconds), MAXRSS (KB) and STATUS
+measure()
+{
+    if [ -x /usr/bin/time ]
+    then
+	/usr/bin/time -f "%e %M" -o $WORKDIR/time "$@" > /dev/null 2>&1
+	STATUS=$?
+	read ELAPSED MAXRSS < <(tail -n 1 $WORKDIR/time)
+    else
+	local START=$(date +%s.%N)
+	"$@" > /dev/null 2>&1
+	STATUS=$?
+	ELAPSED=$(echo "$START $(date +%s.%N)" | awk '{ printf "%.3f", $2 - $1 }')
+	MAXRSS=0
+    fi
+}
+
+min() { echo "$1 $2" | awk '{ print ($1 < $2) ? $1 : $2 }'; }
+max() { echo "$1 $2" | awk '{ print ($1 > $2) ? $1 : $2 }'; }
+
+# Prints "phase wall" for each phase recorded in a -time-json file
+phases()
+{
+    grep -o '"name": "[^"]*", "wall": [0-9.e+-]*' $1 | sed 's/"name": "\([^"]*\)", "wall": /\1 /'
+}
+
+# Compiles a source RUNS times with the given output options and records the compile metrics
+# Usage: bench_compile <name> <source> <cremacc output options...>
+bench_compile()
+{
+    local NAME=$1 SRC=$2
+    shift 2
+    local BEST= RSS=0
+    declare -A PHASE
+    for ((i = 0; i < RUNS; i++))
+    do
+	measure bash -c "cd $SRCDIR && ./cremacc -f $SRC -O 2 -time-json $WORKDIR/phases.json $*"
+	if [[ $STATUS -ne 0 ]]
+	then
+	    echo "$NAME compile FAILED"
+	    return 1
+	fi
+	BEST=$(min ${BEST:-$ELAPSED} $ELAPSED)
+	RSS=$(max $RSS $MAXRSS)
+	while read P WALL
+	do
+	    PHASE[$P]=$(min ${PHASE[$P]:-$WALL} $WALL)
+	done < <(phases $WORKDIR/phases.json)
+    done
+    echo "$NAME compile_s $BEST" >> $RESULTS
+    echo "$NAME compile_rss_kb $RSS" >> $RESULTS
+    for P in "${!PHASE[@]}"
+    do
+	echo "$NAME phase_${P}_s ${PHASE[$P]}" >> $RESULTS
+    done
+    echo "$NAME compiled in ${BEST}s (peak ${RSS} KB)"
+}
+
+echo "Running workloads ($RUNS runs each):"
+for FILE in $(ls $BENCHDIR/*.crema)
+do
+    NAME=$(basename $FILE .crema)
+    bench_compile $NAME $FILE -o $WORKDIR/$NAME || continue
+    BEST=
+    RSS=0
+    for ((i = 0; i < RUNS; i++))
+    do
+	measure $WORKDIR/$NAME
+	if [[ $STATUS -ne 0 ]]
+	then
+	    echo "$NAME run FAILED"
+	    continue 2
+	fi
+	BEST=$(min ${BEST:-$ELAPSED} $ELAPSED)
+	RSS=$(max $RSS $MAXRSS)
+    done
+    echo "$NAME run_s $BEST" >> $RESULTS
+    echo "$NAME run_rss_kb $RSS" >> $RESULTS
+    echo "$NAME ran in ${BEST}s (peak ${RSS} KB)"
+done
+
+if [[ $LARGE -gt 0 ]]
+then
+    echo ""
+    echo "Compiling generated sources of size $LARGE:"
+    for SHAPE in statements functions nesting lists
+    do
+	$BENCHDIR/gen_large.sh $SHAPE $LARGE > $WORKDIR/large_$SHAPE.crema
+	bench_compile large_${SHAPE}_$LARGE $WORKDIR/large_$SHAPE.crema -c $WORKDIR/large.o
+    done
+fi
+
+sort -o $RESULTS $RESULTS
+
+if [[ $SAVE -eq 1 ]]
+then
+    cp $RESULTS $BASELINE
+    echo ""
+    echo "Saved baseline to $BASELINE"
+    exit 0
+fi
+
+if [ ! -f $BASELINE ]
+then
+    echo ""
+    echo "No baseline found, run with --save-baseline to create one"
+    exit 0
+fi
+
+echo ""
+echo "Comparing against $BASELINE (threshold $THRESHOLD%):"
+REGRESSIONS=$(awk -v t=$THRESHOLD -v floor=$MIN_TIME '
+    NR == FNR { base[$1 "/" $2] = $3; next }
+    ($1 "/" $2) in base {
+	b = base[$1 "/" $2]
+	if ($2 ~ /_s$/ && b < floor && $3 < floor)
+	    next
+	if ($3 > b * (1 + t / 100))
+	    printf "REGRESSION: %s %s %s -> %s (%+.1f%%)\n", $1, $2, b, $3, (b > 0) ? ($3 - b) * 100 / b : 100
+    }' $BASELINE $RESULTS)
+
+if [[ -n "$REGRESSIONS" ]]
+then
+    echo "$REGRESSIONS"
+    exit 1
+fi
+echo "No regressions!"
@@ -0,0 +1,70 @@
+#!/bin/bash
+
+# Crema Benchmark Source Generator
+# (C) Assured Information Security, Inc. 2015
+#
+# Writes a very large Crema program to stdout, for stress-testing how the front end
+# (lexer, parser, semantic analysis) and code generation scale with the input size.
+#
+# Usage: gen_large.sh <shape> <N>
+#   statements  N straight-line declarations and assignments in the main block
+#   functions   N functions, each calling the previous one
+#   nesting     a foreach nest N deep
+#   lists       N list literals of 100 elements each
+
+SHAPE=$1
+N=$2
+
+if [[ -z "$SHAPE" || -z "$N" ]]
+then
+    echo "Usage: $0 <statements|functions|nesting|lists> <N>" >&2
+    exit -1
+fi
+
+case $SHAPE in
+    statements)
+	awk -v n=$N 'BEGIN {
+	    print "int acc = 0"
+	    for (i = 0; i < n; i++) {
+		printf "int v%d = %d * 3 + acc %% 7\n", i, i
+		printf "acc = acc + v%d\n", i
+	    }
+	    print "int_println(acc)"
+	}'
+	;;
+    functions)
+	awk -v n=$N 'BEGIN {
+	    print "def int f0(int a) {\n  return a + 1\n}\n"
+	    for (i = 1; i < n; i++)
+		printf "def int f%d(int a) {\n  return f%d(a) %% 1000003 + %d\n}\n\n", i, i - 1, i
+	    printf "int_println(f%d(1))\n", n - 1
+	}'
+	;;
+    nesting)
+	awk -v n=$N 'BEGIN {
+	    print "int xs[] = [1, 2]"
+	    print "int acc = 0"
+	    for (i = 0; i < n; i++)
+		printf "%*sforeach (xs as x%d) {\n", i * 2, "", i
+	    printf "%*sacc = acc + 1\n", n * 2, ""
+	    for (i = n - 1; i >= 0; i--)
+		printf "%*s}\n", i * 2, ""
+	    print "int_println(acc)"
+	}'
+	;;
+    lists)
+	awk -v n=$N 'BEGIN {
+	    for (i = 0; i < n; i++) {
+		printf "int l%d[] = [", i
+		for (j = 0; j < 100; j++)
+		    printf "%s%d", (j ? ", " : ""), i + j
+		print "]"
+	    }
+	    print "int_println(list_length(l0))"
+	}'
+	;;
+    *)
+	echo "Unknown shape: $SHAPE" >&2
+	exit -1
+	;;
+esac
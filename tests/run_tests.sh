@@ -5,8 +5,14 @@
 # 10/22/2014
 #
 # Runs all the tests in fail that are supposed to fail either parsing or semantic analysis
-# and all the tests in success which should succeed and collates that information into a single,
+# and all the tests in success which should succeed, compiles and runs the tests in run and
+# compares their output with the matching .expected file, compiles the tests in output and compares
+# everything cremacc prints with the matching .expected file, runs the scripts in scripts that check
+# cremacc modes spanning several invocations, and collates that information into a single,
 # easy-to-read display.
+#
+# A test may come with a .flags file of the same name. Each line of it is a set of extra cremacc
+# options, and the test is run once with each set; an empty line runs it without extra options.
 
 TOTALTESTS=0
 PASSEDTESTS=0
@@ -17,13 +23,43 @@ then
     exit -1
 fi
 
+# Sets FLAGSETS to the option sets to run a test with, from the lines of its .flags file
+flagsets()
+{
+    FLAGSETS=("")
+    if [ -f $1 ]
+    then
+	mapfile -t FLAGSETS < $1
+    fi
+}
+
 echo "Running failure tests:"
-for FILE in $(ls fail/)
+for FILE in $(cd fail && ls *.crema)
+do
+    flagsets fail/$(basename $FILE .crema).flags
+    for FLAGS in "${FLAGSETS[@]}"
+    do
+	echo -n "Running test" $FILE $FLAGS "... "
+	((TOTALTESTS++))
+	CREMA=$(../src/cremacc -s $FLAGS < "fail/"$FILE &> /dev/null)
+	if [[ $? -ne 0 ]]
+	then
+	    echo "passed!"
+	    ((PASSEDTESTS++))
+	else
+	    echo "failed!"
+	fi
+    done
+done
+
+echo ""
+echo "Running success tests:"
+for FILE in $(ls success/)
 do
     echo -n "Running test" $FILE "... "
     ((TOTALTESTS++))
-    CREMA=$(../src/cremacc -s < "fail/"$FILE &> /dev/null)
-    if [[ $? -ne 0 ]]
+    CREMA=$(../src/cremacc -s < "success/"$FILE &> /dev/null)
+    if [[ $? -eq 0 ]]
     then
 	echo "passed!"
 	((PASSEDTESTS++))
@@ -33,13 +69,65 @@ do
 done
 
 echo ""
-echo "Running success tests:"
-for FILE in $(ls success/)
+echo "Running output tests:"
+# cremacc looks for the runtime relative to the working directory, so compile from src/
+SRCDIR=$(cd ../src && pwd)
+RUNDIR=$(cd run && pwd)
+WORKDIR=$(mktemp -d)
+trap "rm -rf $WORKDIR" EXIT
+unset CREMA_CACHE_DIR
+for FILE in $(ls run/*.crema)
 do
-    echo -n "Running test" $FILE "... "
+    NAME=$(basename $FILE .crema)
+    flagsets run/$NAME.flags
+    for FLAGS in "${FLAGSETS[@]}"
+    do
+	echo -n "Running test" $NAME $FLAGS "... "
+	((TOTALTESTS++))
+	rm -f $WORKDIR/$NAME
+	# Several threads, so that parallel loops of at least CREMA_PARALLEL_MIN_ITERS iterations use the pool
+	if (cd $SRCDIR && ./cremacc $FLAGS -f $RUNDIR/$NAME.crema -o $WORKDIR/$NAME &> /dev/null) && CREMA_THREADS=4 $WORKDIR/$NAME 2>&1 | cmp -s - $RUNDIR/$NAME.expected
+	then
+	    echo "passed!"
+	    ((PASSEDTESTS++))
+	else
+	    echo "failed!"
+	fi
+    done
+done
+
+echo ""
+echo "Running compiler output tests:"
+OUTDIR=$(cd output && pwd)
+for FILE in $(ls output/*.crema)
+do
+    NAME=$(basename $FILE .crema)
+    flagsets output/$NAME.flags
+    for FLAGS in "${FLAGSETS[@]}"
+    do
+	echo -n "Running test" $NAME $FLAGS "... "
+	((TOTALTESTS++))
+	if (cd $SRCDIR && ./cremacc $FLAGS -f $OUTDIR/$NAME.crema 2>&1) | cmp -s - $OUTDIR/$NAME.expected
+	then
+	    echo "passed!"
+	    ((PASSEDTESTS++))
+	else
+	    echo "failed!"
+	fi
+    done
+done
+
+echo ""
+echo "Running script tests:"
+# Each script is run from src/ with a scratch directory of its own, and passes if it exits with 0
+SCRIPTDIR=$(cd scripts && pwd)
+for FILE in $(ls scripts/*.sh)
+do
+    NAME=$(basename $FILE .sh)
+    echo -n "Running test" $NAME "... "
     ((TOTALTESTS++))
-    CREMA=$(../src/cremacc -s < "success/"$FILE &> /dev/null)
-    if [[ $? -eq 0 ]]
+    mkdir -p $WORKDIR/$NAME
+    if (cd $SRCDIR && bash $SCRIPTDIR/$NAME.sh $WORKDIR/$NAME &> /dev/null)
     then
 	echo "passed!"
 	((PASSEDTESTS++))
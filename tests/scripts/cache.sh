@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# Compiles a program twice into a fresh cache: the second compile must reuse the cached
+# program, and compiling with another option must not. Compiles running at once must all
+# be counted in the cache statistics.
+#
+# Usage (from src/): cache.sh WORKDIR
+
+WORKDIR=$1
+CACHE=$WORKDIR/cache
+SOURCE=$WORKDIR/cached.crema
+echo 'int_println(42)' > $SOURCE
+
+./cremacc -cache $CACHE -f $SOURCE -o $WORKDIR/first | grep -q "Reusing cached output" && exit 1
+./cremacc -cache $CACHE -f $SOURCE -o $WORKDIR/second | grep -q "Reusing cached output" || exit 1
+cmp -s $WORKDIR/first $WORKDIR/second || exit 1
+[ "$($WORKDIR/second)" == "42" ] || exit 1
+./cremacc -cache $CACHE -f $SOURCE -o $WORKDIR/third -O2 | grep -q "Reusing cached output" && exit 1
+[ "$(./cremacc -cache $CACHE -cache-stats)" == "Cache: 1 hits, 2 misses" ] || exit 1
+
+for i in $(seq 1 8)
+do
+    ./cremacc -cache $CACHE -f $SOURCE -o $WORKDIR/concurrent$i -O2 > /dev/null &
+done
+wait
+[ "$(./cremacc -cache $CACHE -cache-stats)" == "Cache: 9 hits, 2 misses" ] || exit 1
+exit 0
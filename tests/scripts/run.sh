@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# Runs a program in-process with -r, at -O0 and -O2, passing it the arguments after --,
+# and checks that it prints what the same program compiled to an executable prints.
+#
+# Usage (from src/): run.sh WORKDIR
+
+WORKDIR=$1
+SOURCE=$WORKDIR/args.crema
+cat > $SOURCE <<'CREMA'
+int_println(prog_arg_count())
+str_println(prog_argument(1))
+str_println(prog_argument(2))
+int total = 0
+foreach (crema_seq(1, 100) as i)
+{
+  total = total + i
+}
+int_println(total)
+CREMA
+
+./cremacc -f $SOURCE -o $WORKDIR/args > /dev/null || exit 1
+$WORKDIR/args first second > $WORKDIR/expected || exit 1
+[ "$(cat $WORKDIR/expected)" == "3
+first
+second
+5050" ] || exit 1
+for LEVEL in 0 2
+do
+    ./cremacc -r -O$LEVEL -f $SOURCE -- first second > $WORKDIR/jit || exit 1
+    [ "$(head -n 2 $WORKDIR/jit)" == "Passed semantic analysis!
+Generating LLVM IR bytecode" ] || exit 1
+    tail -n +3 $WORKDIR/jit | cmp -s - $WORKDIR/expected || exit 1
+done
+exit 0
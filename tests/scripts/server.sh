@@ -0,0 +1,69 @@
+#!/bin/bash
+
+# Starts a compile server, sends it one program to build, one that fails semantic
+# analysis and one longer than the server accepts, and checks the replies. Nothing may
+# reach the server's own output besides its start-up line; every message belongs in the
+# reply.
+#
+# Usage (from src/): server.sh WORKDIR
+
+WORKDIR=$1
+SOCKET=$WORKDIR/server.sock
+rm -f $SOCKET
+
+./cremacc -server $SOCKET > $WORKDIR/server.log 2>&1 &
+SERVER=$!
+trap "kill $SERVER 2> /dev/null" EXIT
+for i in $(seq 1 50)
+do
+    [ -S $SOCKET ] && break
+    sleep 0.1
+done
+
+python3 - $SOCKET $WORKDIR > $WORKDIR/reply <<'EOF' || exit 1
+import socket, sys
+
+def connect():
+    sock = socket.socket(socket.AF_UNIX)
+    sock.connect(sys.argv[1])
+    return sock.makefile('rwb')
+
+def request(lines, source):
+    conn.write(lines + b'source %d\n' % len(source) + source)
+    conn.flush()
+    reply = conn.readline()
+    diagnostics = conn.readline()
+    if diagnostics.startswith(b'path '):
+        reply += diagnostics
+        diagnostics = conn.readline()
+    reply += diagnostics + conn.read(int(diagnostics.split()[1]))
+    sys.stdout.write(reply.decode())
+
+conn = connect()
+request(b'output program\npath ' + sys.argv[2].encode() + b'/served\n', b'int_println(42)\n')
+request(b'output check\n', b'int x = 1.5\n')
+conn.close()
+
+# The server answers without reading the source, and closes the connection
+conn = connect()
+conn.write(b'source 1000000000000\n')
+conn.flush()
+sys.stdout.write(conn.read().decode())
+conn.close()
+
+conn = connect()
+conn.write(b'shutdown\n')
+conn.flush()
+EOF
+wait $SERVER || exit 1
+trap - EXIT
+
+[ "$(head -n 2 $WORKDIR/reply)" == "status 0
+path $WORKDIR/served" ] || exit 1
+grep -q "Passed semantic analysis!" $WORKDIR/reply || exit 1
+[ "$(grep -c "^status -1" $WORKDIR/reply)" == "2" ] || exit 1
+grep -q "Failed semantic analysis!" $WORKDIR/reply || exit 1
+grep -q "^ERROR: Source of 1000000000000 bytes exceeds the limit" $WORKDIR/reply || exit 1
+[ "$($WORKDIR/served)" == "42" ] || exit 1
+[ "$(cat $WORKDIR/server.log)" == "Listening on $SOCKET" ] || exit 1
+exit 0
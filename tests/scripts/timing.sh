@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Compiles a program with -time-phases and -time-json, and checks that both reports cover
+# the phases of the compilation and the size statistics of the program.
+#
+# Usage (from src/): timing.sh WORKDIR
+
+WORKDIR=$1
+SOURCE=$WORKDIR/timed.crema
+echo 'int_println(42)' > $SOURCE
+
+./cremacc -time-phases -f $SOURCE -o $WORKDIR/timed > $WORKDIR/report || exit 1
+[ "$($WORKDIR/timed)" == "42" ] || exit 1
+grep -q "^===== Phase timings =====" $WORKDIR/report || exit 1
+for PHASE in parse semantic codegen optimize link total ast_nodes ir_instructions module_bytes
+do
+    grep -q "^$PHASE " $WORKDIR/report || exit 1
+done
+
+./cremacc -time-json $WORKDIR/phases.json -f $SOURCE -o $WORKDIR/timed > /dev/null || exit 1
+for PHASE in parse semantic codegen optimize link
+do
+    grep -q "{\"name\": \"$PHASE\", \"wall\": " $WORKDIR/phases.json || exit 1
+done
+grep -q "\"ast_nodes\": [1-9]" $WORKDIR/phases.json || exit 1
+grep -q "\"ir_instructions\": [1-9]" $WORKDIR/phases.json || exit 1
+python3 -m json.tool $WORKDIR/phases.json > /dev/null || exit 1
+
+# With '-' the JSON report is the last line printed
+[ "$(./cremacc -time-json - -s -f $SOURCE | tail -n 1 | cut -c 1-12)" == "{\"phases\": [" ] || exit 1
+exit 0